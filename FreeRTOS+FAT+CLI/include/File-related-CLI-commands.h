@@ -13,4 +13,30 @@ specific language governing permissions and limitations under the License.
 */
 #pragma once
 
+#include "FreeRTOS.h"
+//
+#include "FreeRTOS_CLI.h"
+#include "ff_stdio.h"
+#include "ff_xfer.h"
+
 void vRegisterFileSystemCLICommands(void);
+
+/* Register sz and rz, which send and receive files over pxLink (see
+ff_xfer.h). They run in the CLI's task, so the link is normally the console
+itself. */
+void vRegisterFileTransferCLICommands(const FF_XferLink_t *pxLink);
+
+// Make pxSink write to an open file
+void vFileSystemCLIFileSink(CLI_Output_Sink_t *pxSink, FF_FILE *pxFile);
+
+/* Run a command line, with its output going to pxConsole or, if the line ends
+with "> <filename>" (the '>' on its own), to that file.  Either way, that
+includes what the command prints to stdout. */
+BaseType_t xFileSystemCLIProcessCommand(const char *pcCommandInput,
+                                        CLI_Output_Sink_t *pxConsole);
+
+/* Does what xFileSystemCLIProcessCommand() does, and returns pdFAIL if the
+command failed by run's rules (a line of its output starts with "Error",
+"Usage" or "Failed", or the command isn't known) or writing to pxConsole did. */
+BaseType_t xFileSystemCLIRunCommand(const char *pcCommandInput,
+                                    CLI_Output_Sink_t *pxConsole);
@@ -168,16 +168,25 @@ following times:
 
 Normally this is quick enough and it is efficient.  If
 ffconfigCACHE_WRITE_THROUGH is set to 1 then buffers will also be flushed each
-time a buffer is released - which is less efficient but more secure. */
+time a buffer is released - which is less efficient but more secure.
+
+Set to 0 for write-back: ff_writeback_start() (see ff_writeback.h) then starts
+a task that flushes modified buffers in the background, and ff_fsync() makes a
+file durable on demand. */
+#ifndef ffconfigCACHE_WRITE_THROUGH
 #define	ffconfigCACHE_WRITE_THROUGH	1
+#endif
 
 /* In most cases, the FAT table has two identical copies on the disk,
 allowing the second copy to be used in the case of a read error.  If
 
 Set to 1 to use both FATs - this is less efficient but more	secure.
 
-Set to 0 to use only one FAT - the second FAT will never be written to. */
-#define	ffconfigWRITE_BOTH_FATS	1
+Set to 0 to use only one FAT - the second FAT will never be written to.
+
+Here only the first FAT is written by FreeRTOS+FAT, and the disk driver keeps
+the second up to date (see ffconfigFAT_MIRROR). */
+#define	ffconfigWRITE_BOTH_FATS	0
 
 /* Set to 1 to have the number of free clusters and the first free cluster
 to be written to the FS info sector each time one of those values changes.
@@ -225,8 +234,12 @@ Set to 0 not to 'trust' these fields.*/
 when the path is deep within a directory structure at the expense of
 additional RAM usage.
 
-Set to 0 to not use a path cache. */
-#define	ffconfigPATH_CACHE 0
+Set to 0 to not use a path cache.
+
+Each entry costs about ffconfigMAX_FILENAME bytes per mounted disk. The
+YYYY-MM-DD directories of the data logger are found through the cache rather
+than by scanning their parents. */
+#define	ffconfigPATH_CACHE 1
 
 /* Only used if ffconfigPATH_CACHE is 1.
 
@@ -238,16 +251,29 @@ one time. */
 Use of HASH values can improve performance when working with large
 directories, or with files that have a similar name.
 
-Set to 0 not to calculate a HASH value. */
-#define	ffconfigHASH_CACHE	0
+Set to 0 not to calculate a HASH value.
+
+With a directory's hashes cached, looking up a name that isn't there (as when
+creating a file) needs no scan of the directory, as long as its hash isn't
+taken. A name that is there is found through the directory index (see
+ffconfigDIR_INDEX_DIRS), or else by scanning. With CRC8 there are only 256
+hashes, so in a directory of more than a few hundred names most misses scan
+too; bench's lookup and miss rows show what it saves on a given card and
+directory. */
+#define	ffconfigHASH_CACHE	1
 
 /* Only used if ffconfigHASH_CACHE is set to 1
 
-Set to CRC8 or CRC16 to use 8-bit or 16-bit HASH values respectively. */
-#define	ffconfigHASH_FUNCTION CRC16
+Set to CRC8 or CRC16 to use 8-bit or 16-bit HASH values respectively.
 
-/*_RB_ Not in FreeRTOSFFConfigDefaults.h. */
-#define ffconfigHASH_CACHE_DEPTH 64
+Each cached directory takes a bit per possible hash: 32 bytes with CRC8, but
+8 KB with CRC16, which is more than can be spared here. */
+#define	ffconfigHASH_FUNCTION CRC8
+
+/*_RB_ Not in FreeRTOSFFConfigDefaults.h.
+
+Directories whose hashes are cached at once. */
+#define ffconfigHASH_CACHE_DEPTH 16
 
 /* Set to 1 to add a parameter to ff_mkdir() that allows an entire directory
 tree to be created in one go, rather than having to create one directory in
@@ -347,5 +373,91 @@ implementation, so I have to set it to 1 here, so it is not defined. */
 conform with the coding standard, so use this function with care! */
 #define ffconfigUSE_DELTREE					1
 
+/* Number of open files that can have an extent map (see ff_extent_map.h) at
+any one time.  Maps are recycled least recently used first. */
+#define ffconfigEXTENT_MAPS 4
+
+/* Runs of contiguous clusters recorded in each extent map, at 12 bytes a
+run.  Beyond the last recorded run, the FAT is walked from the end of that
+run. */
+#define ffconfigEXTENT_MAP_RUNS 32
+
+/* Name to directory entry indexes (see ff_dir_index.h): directories indexed
+at any one time, and names each can hold, at 4 bytes a name, so 16 KB as
+set.  A directory with more names isn't indexed.  Set ffconfigDIR_INDEX_DIRS
+to 0 to leave every lookup to FreeRTOS+FAT. */
+#define ffconfigDIR_INDEX_DIRS 2
+#define ffconfigDIR_INDEX_NAMES 2048
+
+/* Read-ahead in the SD card disk driver (ff_sddisk.c).  Reads that carry on
+where an earlier read left off are recognised as a stream, and the driver
+reads beyond the request into a staging buffer, doubling the window on each
+further sequential read up to ffconfigREAD_AHEAD_MAX_SECTORS.  Up to
+ffconfigREAD_AHEAD_STREAMS streams (for example, a file's data and its FAT
+sectors) are followed at once, each with its own staging buffer of
+ffconfigREAD_AHEAD_MAX_SECTORS * 512 bytes.
+
+Set ffconfigREAD_AHEAD_MAX_SECTORS to 0 to disable read-ahead. */
+#define ffconfigREAD_AHEAD_STREAMS 2
+#define ffconfigREAD_AHEAD_MAX_SECTORS 16
+
+/* Write-back flusher (ff_writeback.c), for use with ffconfigCACHE_WRITE_THROUGH
+set to 0.  Every ffconfigWRITEBACK_POLL_MS the flusher looks at the cache of
+each mounted disk, and flushes it once its oldest modification is
+ffconfigWRITEBACK_DIRTY_AGE_MS old, or once ffconfigWRITEBACK_DIRTY_BYTES bytes
+of it are modified.  The age bounds how much can be lost at power failure. */
+#define ffconfigWRITEBACK_POLL_MS 100
+#define ffconfigWRITEBACK_DIRTY_AGE_MS 1000
+#define ffconfigWRITEBACK_DIRTY_BYTES 1024
+
+/* Deferred FAT mirroring in the SD card disk driver (ff_sddisk.c), for use with
+ffconfigWRITE_BOTH_FATS set to 0.  The driver notes which sectors of the first
+FAT are written, and copies them to the other FATs later, in runs of up to
+ffconfigFAT_MIRROR_BATCH_SECTORS: from the flusher task once the oldest has
+waited ffconfigFAT_MIRROR_DELAY_MS, and at unmount.  A flag in the boot sector
+is set from the first FAT write after mount until unmount (or a USB export),
+so mounting a volume that was not cleanly unmounted copies the whole FAT.
+
+Set ffconfigFAT_MIRROR to 0 to leave the second FAT alone. */
+#define ffconfigFAT_MIRROR 1
+#define ffconfigFAT_MIRROR_DELAY_MS 5000
+#define ffconfigFAT_MIRROR_BATCH_SECTORS 16
+
+/* Append-only log files (see ff_logfile.h).  Up to ffconfigLOG_FILES can be
+open at once.  Each append is written to the card at once, but the directory
+entry (and so the size) only when ffconfigLOG_DIRENT_MS have passed or
+ffconfigLOG_DIRENT_BYTES have been appended since it was last written. */
+#define ffconfigLOG_FILES 2
+#define ffconfigLOG_DIRENT_MS 60000
+#define ffconfigLOG_DIRENT_BYTES 4096
+
+/* Size of each of the two buffers used by ff_fcopy() (see ff_copy.h), in
+sectors.  They are allocated for the duration of the copy. */
+#define ffconfigCOPY_BUFFER_SECTORS 16
+
+/* Binary file transfer (see ff_xfer.h).  A frame carries up to
+ffconfigXFER_BLOCK_SIZE bytes of the file (a whole number of sectors), and the
+sender can have ffconfigXFER_WINDOW frames unacknowledged, in a buffer of
+ffconfigXFER_BLOCK_SIZE * ffconfigXFER_WINDOW bytes.  The window should cover
+the link's round trip: on the USB console, a short write can wait
+CDC_OUT_FLUSH_MS (10 ms) in the output buffer, and 16 KiB is about 10 ms at
+full speed.  Either end goes back after ffconfigXFER_TIMEOUT_MS without
+hearing from the other, and gives up after ffconfigXFER_RETRIES of those in a
+row. */
+#define ffconfigXFER_BLOCK_SIZE 1024
+#define ffconfigXFER_WINDOW 16
+#define ffconfigXFER_TIMEOUT_MS 1000
+#define ffconfigXFER_RETRIES 10
+
+/* Directory walks (see ff_walk.h) go at most this many levels below where
+they start.  Each level costs an FF_FindData_t, about ffconfigMAX_FILENAME
+bytes, allocated for the length of the walk. */
+#define ffconfigWALK_MAX_DEPTH 8
+
+/* ff_purge() (see ff_purge.h) frees clusters with the FAT lock held, and lets
+it go after each ffconfigPURGE_FAT_BATCH of them, so that a task writing
+meanwhile waits for one batch at most, not the whole purge. */
+#define ffconfigPURGE_FAT_BATCH 512
+
 #endif /* _FF_CONFIG_H_ */
 
@@ -56,6 +56,8 @@ specific language governing permissions and limitations under the License.
 #ifndef COMMAND_INTERPRETER_H
 #define COMMAND_INTERPRETER_H
 
+#include "stream_buffer.h"
+
 /* The prototype to which callback functions used to process command line
 commands must comply.  pcWriteBuffer is a buffer into which the output from
 executing the command can be written, xWriteBufferLen is the length, in bytes of
@@ -63,6 +65,20 @@ the pcWriteBuffer buffer, and pcCommandString is the entire string as input by
 the user (from which parameters can be extracted).*/
 typedef BaseType_t (*pdCOMMAND_LINE_CALLBACK)( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 
+/* Where a streaming command's output goes: the console, a stream buffer, a
+file...  pxWrite must take all xLength bytes, blocking until it can, and
+returns pdFAIL if they can't be delivered. */
+typedef struct xCLI_OUTPUT_SINK CLI_Output_Sink_t;
+struct xCLI_OUTPUT_SINK
+{
+	BaseType_t (*pxWrite)( CLI_Output_Sink_t *pxSink, const char *pcData, size_t xLength );
+	void *pvContext;
+};
+
+/* The prototype of a streaming command.  It writes all of its output, of any
+length, to pxSink in one call, and returns pdFAIL if the sink failed. */
+typedef BaseType_t (*pdCOMMAND_LINE_STREAM_CALLBACK)( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+
 /* The structure that defines command line commands.  A command line command
 should be defined by declaring a const structure of this type. */
 typedef struct xCOMMAND_LINE_INPUT
@@ -73,6 +89,13 @@ typedef struct xCOMMAND_LINE_INPUT
 	int8_t cExpectedNumberOfParameters;			/* Commands expect a fixed number of parameters, which may be zero. */
 } CLI_Command_Definition_t;
 
+/* A streaming command.  xDefinition's pxCommandInterpreter must be NULL. */
+typedef struct xSTREAM_COMMAND_LINE_INPUT
+{
+	const CLI_Command_Definition_t xDefinition;
+	const pdCOMMAND_LINE_STREAM_CALLBACK pxStreamInterpreter;	/* A pointer to the callback function that will write the output generated by the command. */
+} CLI_Stream_Command_Definition_t;
+
 /* For backward compatibility. */
 #define xCommandLineInput CLI_Command_Definition_t
 
@@ -83,6 +106,7 @@ typedef struct xCOMMAND_LINE_INPUT
  * can be executed from the command line.
  */
 BaseType_t FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const pxCommandToRegister );
+BaseType_t FreeRTOS_CLIRegisterStreamCommand( const CLI_Stream_Command_Definition_t * const pxCommandToRegister );
 
 /*
  * Runs the command interpreter for the command string "pcCommandInput".  Any
@@ -97,6 +121,49 @@ BaseType_t FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const p
  */
 BaseType_t FreeRTOS_CLIProcessCommand( const char * const pcCommandInput, char * pcWriteBuffer, size_t xWriteBufferLen  );
 
+/*
+ * Runs the command interpreter for the command string "pcCommandInput", with
+ * all of its output going to pxSink, in one call.  Commands that aren't
+ * streaming commands are called repeatedly, as FreeRTOS_CLIProcessCommand()
+ * would, and each chunk they return is written to the sink.  (Called through
+ * FreeRTOS_CLIProcessCommand(), a streaming command's output is cut short at
+ * xWriteBufferLen.)
+ *
+ * While the command runs, what the task running it prints to stdout goes to
+ * pxSink too, if the platform's stdout passes it to FreeRTOS_CLICaptureWrite().
+ *
+ * Returns pdFAIL if the sink failed.  Not reentrant either.
+ */
+BaseType_t FreeRTOS_CLIProcessCommandToSink( const char * const pcCommandInput, CLI_Output_Sink_t *pxSink );
+
+/*
+ * For the platform's stdout: if the calling task is running a command through
+ * FreeRTOS_CLIProcessCommandToSink(), writes the data to the command's sink and
+ * returns pdTRUE.  Otherwise, and for what the sink itself prints, returns
+ * pdFALSE, and the data should go to the console as usual.
+ */
+BaseType_t FreeRTOS_CLICaptureWrite( const char *pcData, size_t xLength );
+
+/*
+ * Tab completion.  FreeRTOS_CLICompleteCommand() returns how many registered
+ * commands start with the xPrefixLength characters at pcPrefix, and writes to
+ * pcCompletion (NUL terminated) what follows the prefix in all of them.
+ * FreeRTOS_CLIGetCompletion() returns the uxIndex'th of them, or NULL.
+ */
+UBaseType_t FreeRTOS_CLICompleteCommand( const char *pcPrefix, size_t xPrefixLength, char *pcCompletion, size_t xCompletionLength );
+const char *FreeRTOS_CLIGetCompletion( const char *pcPrefix, size_t xPrefixLength, UBaseType_t uxIndex );
+
+/*
+ * Write to a sink.
+ */
+BaseType_t FreeRTOS_CLISinkWrite( CLI_Output_Sink_t *pxSink, const char *pcData, size_t xLength );
+BaseType_t FreeRTOS_CLISinkPrintf( CLI_Output_Sink_t *pxSink, const char *pcFormat, ... ) __attribute__( ( format( __printf__, 2, 3 ) ) );
+
+/*
+ * Make pxSink write to a stream buffer, waiting for space when it is full.
+ */
+void FreeRTOS_CLIStreamBufferSink( CLI_Output_Sink_t *pxSink, StreamBufferHandle_t xStreamBuffer );
+
 /*-----------------------------------------------------------*/
 
 /*
@@ -0,0 +1,42 @@
+/* ff_copy.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* File copy engine.
+
+The destination is preallocated (see ff_fallocate()), then the data is moved
+in chunks of ffconfigCOPY_BUFFER_SECTORS sectors with ff_fread_direct() and
+ff_fwrite_direct(), so each chunk takes one multi-block command per run of
+contiguous clusters. There are two buffers: a writer task writes one chunk
+while the caller reads the next, so a copy between cards on different SPI
+buses keeps both buses busy. */
+
+#ifndef _FF_COPY_H_
+#define _FF_COPY_H_
+
+#include "ff_headers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Copy pcSource to pcDestination, which is created, or truncated if it
+exists. Returns 0 on success, or -1 and sets errno. */
+int ff_fcopy(const char *pcSource, const char *pcDestination);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
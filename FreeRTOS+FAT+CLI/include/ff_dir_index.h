@@ -0,0 +1,69 @@
+/* ff_dir_index.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Name to directory entry indexes for large directories.
+
+FreeRTOS+FAT finds a name in a directory (FF_FindEntryInDir()) by reading
+the directory from the start until it comes to it, so opening a file in a
+directory of thousands takes as long as reading the directory up to it. An
+index records, for one directory, a 16-bit hash of each name and where its
+(short) directory entry is, sorted by hash. A lookup is then a binary search
+and one read of the entry found, which is checked against the name before it
+is believed.
+
+FF_FindEntryInDir() is wrapped at link time (--wrap, see CMakeLists.txt). The
+second lookup running in a directory that isn't indexed reads the whole
+directory to index it (not the first, so that lookups scattered over many
+directories don't each read a whole directory). A name that isn't in the
+index, or whose entry doesn't match, is left to FreeRTOS+FAT, as are lookups
+made by FreeRTOS+FAT within ff_dir.c (FF_FindDir() walking a path among them;
+ffconfigPATH_CACHE covers that), and lookups made while a directory is being
+changed. A file's long name is indexed; its short name only if it has no long
+name, so a lookup by a generated short name ("DATA~1.TXT") is left to
+FreeRTOS+FAT too. An entry found through the index comes back as
+FF_GetEntry() gives it, with pcFileName holding the short name.
+
+Indexes come from a fixed pool of ffconfigDIR_INDEX_DIRS, each holding up to
+ffconfigDIR_INDEX_NAMES names, at 4 bytes a name, and are recycled least
+recently used first. A directory with more names than that isn't indexed.
+
+Since every hit is checked on the card, an index that has fallen behind only
+costs lookups that go back to FreeRTOS+FAT; it never gives a wrong entry.
+To keep them useful, FF_Open() adds the files it creates to their directory's
+index, and FF_MkDir(), FF_RmFile(), FF_RmDir(), FF_Move() and FF_Unmount()
+are wrapped to forget the indexes of the directories they change. Anything
+else that adds, deletes or renames directory entries must call
+ff_dir_index_forget(). */
+
+#ifndef _FF_DIR_INDEX_H_
+#define _FF_DIR_INDEX_H_
+
+#include "ff_headers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Forget the index of the directory starting at ulDirCluster, if it has one
+void ff_dir_index_forget(FF_IOManager_t *pxIOManager, uint32_t ulDirCluster);
+
+// Lookups answered from an index, and lookups left to FreeRTOS+FAT, so far
+void ff_dir_index_counts(uint32_t *pulHits, uint32_t *pulScans);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
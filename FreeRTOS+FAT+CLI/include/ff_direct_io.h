@@ -0,0 +1,49 @@
+/* ff_direct_io.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Direct (cache-bypassing) file I/O, in the spirit of O_DIRECT.
+
+ff_fread_direct() and ff_fwrite_direct() take the same arguments as ff_fread()
+and ff_fwrite(). When the file pointer is on a sector boundary, the whole
+sectors of the request are transferred between the caller's buffer and the
+card with sd_read_blocks()/sd_write_blocks(), one multi-block command per run
+of contiguous clusters, without copying through the IOManager's cache. Any
+partial sector at the end goes through the normal, cached path, as does the
+whole request if the file pointer is not sector aligned.
+
+Writes extend the file's cluster chain up front (see ff_fallocate()), so a
+file written sequentially in large chunks ends up mostly contiguous. */
+
+#ifndef _FF_DIRECT_IO_H_
+#define _FF_DIRECT_IO_H_
+
+#include <stddef.h>
+
+#include "ff_headers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t ff_fread_direct(void *pvBuffer, size_t xSize, size_t xItems,
+                       FF_FILE *pxStream);
+size_t ff_fwrite_direct(const void *pvBuffer, size_t xSize, size_t xItems,
+                        FF_FILE *pxStream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
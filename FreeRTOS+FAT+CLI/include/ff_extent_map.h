@@ -0,0 +1,59 @@
+/* ff_extent_map.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Per-file extent maps.
+
+Finding the cluster at a given offset in a FAT file means following the
+cluster chain from the start, one FAT entry at a time. An extent map records
+the chain of an open file as a list of runs (first cluster, length), built
+lazily as far as it has been needed, so that later lookups take a binary
+search instead of a walk.
+
+Maps come from a fixed pool of ffconfigEXTENT_MAPS, each holding up to
+ffconfigEXTENT_MAP_RUNS runs, and are keyed by the file handle and its first
+cluster. A map lasts no longer than the open file it describes: FF_Close()
+and FF_SetEof() are wrapped at link time (--wrap, see ff_utils.c) to
+forget it, since a file opened later can get the same handle. While the file
+is open, nothing else can change its chain (FreeRTOS+FAT won't open a file
+for writing twice); anything that changes it through the handle other than
+at the end must call ff_extent_map_invalidate(). */
+
+#ifndef _FF_EXTENT_MAP_H_
+#define _FF_EXTENT_MAP_H_
+
+#include "ff_headers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Get the cluster number of the ulRel'th cluster of the file (counting from
+0), and, in *pulRun, how many clusters from there on are contiguous (at
+least 1). Call with the FAT locked. */
+uint32_t ff_extent_lookup(FF_FILE *pxFile, uint32_t ulRel, uint32_t *pulRun,
+                          FF_Error_t *pxError);
+
+/* Like ff_fseek(), but positions the file on its new cluster using the
+extent map, so the next read or write doesn't walk the chain. */
+int ff_fseek_mapped(FF_FILE *pxStream, long lOffset, int iWhence);
+
+// Forget what is known about the file's cluster chain
+void ff_extent_map_invalidate(FF_FILE *pxFile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,69 @@
+/* ff_format_plan.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Card-aware FAT layout planner.
+
+The layout follows the SD Association "Part 2 File System Specification":
+the partition offset, reserved area and FAT sizes are chosen so that the
+first data cluster starts on a Boundary Unit (BU), and clusters are a power
+of two that divides the BU. Every cluster then sits inside a single flash
+page/erase block, which avoids read-modify-write cycles inside the card.
+
+This module has no FreeRTOS or hardware dependencies, so it can be built and
+tested on a host. */
+
+#ifndef _FF_FORMAT_PLAN_H_
+#define _FF_FORMAT_PLAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* All sizes and addresses are in 512 byte sectors. LBAs are absolute (from
+the start of the card). */
+typedef struct {
+    uint32_t ulHiddenSectors;      // LBA of the volume boot record
+    uint32_t ulPartitionSectors;   // Sectors in the partition
+    uint32_t ulBoundarySectors;    // Alignment unit applied to the data area
+    uint32_t ulReservedSectors;    // Reserved area, including the boot sector
+    uint32_t ulSectorsPerFAT;
+    uint32_t ulRootDirSectors;     // Fixed root directory (FAT16 only)
+    uint32_t ulSectorsPerCluster;
+    uint32_t ulClusterCount;       // Number of data clusters
+    uint32_t ulFATBeginLBA;        // LBA of the first FAT
+    uint32_t ulDataBeginLBA;       // LBA of cluster 2
+    uint8_t ucNumFATs;
+    uint8_t ucFATBits;             // 16 or 32
+} FF_FormatPlan_t;
+
+/* Plan the layout of a single partition filling a card of ullTotalSectors.
+ulAUSectors is the card's Allocation Unit size (from the SD Status register),
+or 0 if unknown. Returns false if no FAT16/FAT32 layout fits. */
+bool ff_format_plan(uint64_t ullTotalSectors, uint32_t ulAUSectors,
+                    FF_FormatPlan_t *pxPlan);
+
+/* Sanity check a plan: alignment, cluster count limits and bounds.
+Returns NULL if the plan is consistent, or a description of the problem. */
+const char *ff_format_plan_check(uint64_t ullTotalSectors,
+                                 const FF_FormatPlan_t *pxPlan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
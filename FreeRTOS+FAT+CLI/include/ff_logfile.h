@@ -0,0 +1,67 @@
+/* ff_logfile.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Append-only log files.
+
+A file's size is kept in its directory entry, so keeping the size on the card
+up to date with every append means writing the directory sector as well as the
+data. A log file opened with ff_log_open() has each ff_log_write() written
+through to the card at once, but its directory entry is only rewritten every
+ffconfigLOG_DIRENT_MS or ffconfigLOG_DIRENT_BYTES, and by ff_log_close().
+
+To recover from a crash in between, each write is followed (just beyond the
+end of the file) by a trailer holding its own offset, and the file's name is
+recorded in a small registry file (LOG_REGISTRY, in the root of the volume)
+while it is open, with a nonce chosen at ff_log_open() that every trailer
+repeats. At mount, ff_log_recover() looks for the last trailer with the
+file's first cluster and nonce in each file left in the registry, and sets
+the file's size from it; trailers left beyond the end by earlier files, or
+earlier openings, are passed over. */
+
+#ifndef _FF_LOGFILE_H_
+#define _FF_LOGFILE_H_
+
+#include <stddef.h>
+
+#include "ff_headers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Open (creating if need be) a file for appending records to. pcPath must be
+absolute ("/<mount point>/..."). Returns NULL and sets errno on failure. */
+FF_FILE *ff_log_open(const char *pcPath);
+
+/* Append xSize bytes and write them to the card. Returns the number of bytes
+written; on error, fewer, and errno is set. */
+size_t ff_log_write(const void *pvBuffer, size_t xSize, FF_FILE *pxStream);
+
+// Like ff_fprintf(), through ff_log_write()
+int ff_log_printf(FF_FILE *pxStream, const char *pcFormat, ...);
+
+/* Update the directory entry and close (which releases the space allocated
+beyond the end, see ff_fallocate()). Returns 0 on success, or -1 and sets errno. */
+int ff_log_close(FF_FILE *pxStream);
+
+/* Set the size of any log file on the volume mounted at pcMountPoint that
+was not closed. Called by mount(). */
+void ff_log_recover(const char *pcMountPoint);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
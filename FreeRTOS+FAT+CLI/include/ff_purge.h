@@ -0,0 +1,72 @@
+/* ff_purge.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Retention: delete everything under a directory last modified before a
+given time, as one batch.
+
+ff_remove() on each file costs a directory search, a walk of the file's
+cluster chain with a FAT update per cluster, and a cache flush, per file.
+ff_purge() instead gathers all of the victims first (see ff_walk.h), then:
+  1. marks their directory entries deleted, a directory at a time, in entry
+     order, so that each directory sector is read and written once; a
+     directory whose contents all go is deleted whole, without touching the
+     entries in it;
+  2. optionally (FF_PURGE_TRIM) erases the freed clusters on the card;
+  3. frees all of their cluster chains in one pass over the FAT, in cluster
+     order, taking the FAT lock for ffconfigPURGE_FAT_BATCH clusters at a time
+     so that writers (a logger, say) are not held off for long.
+A crash part way through can lose clusters (to be recovered by a disk check),
+but can't leave a cluster both free and in use.
+
+Files that are open, read-only, or changed since they were gathered are kept,
+and so are the directories holding them. The directory named is never
+deleted itself. */
+
+#ifndef _FF_PURGE_H_
+#define _FF_PURGE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "ff_headers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ff_purge() flags
+#define FF_PURGE_TRIM 1     // Erase the freed clusters (CMD38)
+#define FF_PURGE_DRY_RUN 2  // Only count what would go
+
+typedef struct {
+    uint32_t ulFiles;        // Deleted
+    uint32_t ulDirectories;  // Deleted
+    uint64_t ullBytes;       // In the files deleted
+    uint32_t ulClusters;     // Freed
+    uint32_t ulRuns;         // Of contiguous clusters, freed (and trimmed)
+    uint32_t ulKept;         // Old enough, but open, read-only or changed
+} FF_PurgeStats_t;
+
+/* Delete the files and directories under pcPath last modified before
+xBefore (FreeRTOS_time() seconds). Returns 0 on success, or -1 and sets errno;
+*pxStats counts what was done either way. */
+int ff_purge(const char *pcPath, time_t xBefore, unsigned uFlags,
+             FF_PurgeStats_t *pxStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
@@ -21,6 +21,8 @@ specific language governing permissions and limitations under the License.
 #include "ff_headers.h"
 
 bool format(FF_Disk_t **ppxDisk, const char *const devName);
+// Like format(), but erases the FAT and root directory instead of zeroing them
+bool quick_format(FF_Disk_t **ppxDisk, const char *const devName);
 bool mount(FF_Disk_t **ppxDisk, const char *const devName, const char *const path);
 void unmount(FF_Disk_t *pxDisk, const char *pcPath);
 void eject(const char *const name, const char *pcPath);
@@ -28,5 +30,18 @@ void getFree(FF_Disk_t *pxDisk, uint64_t *pFreeMB, unsigned *pFreePct);
 FF_Error_t ff_set_fsize( FF_FILE *pxFile ); // Make Filesize equal to the FilePointer
 int mkdirhier(char *path);
 
+/* Reserve clusters so that the file's cluster chain covers ulSize bytes.
+The new clusters are taken as one contiguous run, starting on an AU boundary
+if possible, and linked in a single FAT update. The file size (the logical
+size) is not changed; later writes up to ulSize need no FAT updates. Closing
+the file gives back whatever is left beyond its size.
+Returns 0 on success, or -1 and sets errno. */
+int ff_fallocate(FF_FILE *pxStream, uint32_t ulSize);
+FF_Error_t FF_Allocate(FF_FILE *pxFile, uint32_t ulSize);  // As above
+/* Write the file's buffered data, size and directory entry, and everything
+else modified in the cache, to the card. Returns 0 on success, or -1 and sets
+errno. */
+int ff_fsync(FF_FILE *pxStream);
+
 #endif
 /* [] END OF FILE */
@@ -0,0 +1,98 @@
+/* ff_walk.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Depth-first traversal of a directory tree.
+
+There is no recursion: the walk keeps its own stack of ff_findfirst() /
+ff_findnext() states, one per directory level, allocated when the walk is
+opened. Its memory is fixed, at about ffconfigWALK_MAX_DEPTH times
+sizeof(FF_FindData_t), and its stack use is that of ff_findnext(). Directories
+deeper than that are returned, but not entered, and counted.
+
+    FF_Walk_t *pxWalk = ff_walk_open("/sd0/data", 0);
+    const FF_WalkEntry_t *pxEntry;
+    while ((pxEntry = ff_walk_next(pxWalk)))
+        ...
+    ff_walk_close(pxWalk); */
+
+#ifndef _FF_WALK_H_
+#define _FF_WALK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "ff_headers.h"
+#include "ff_stdio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ff_walk_open() flags
+#define FF_WALK_LEAVE 1  // Return each directory again after its contents
+
+typedef struct {
+    const char *pcPath;  // The full path: valid until the next ff_walk_next()
+    const char *pcName;  // The last component of pcPath
+    uint32_t ulSize;
+    uint8_t ucAttributes;  // FF_FAT_ATTR_*
+    time_t xModified;      // 0 if not recorded
+    unsigned uDepth;       // 0 for the top directory's entries
+    bool bLeaving;         // A directory, returned after its contents
+    /* The entry as ff_findnext() found it, with its directory entry and
+    IOManager: for work below the ff_stdio level (see ff_purge.c). */
+    const FF_FindData_t *pxFind;
+} FF_WalkEntry_t;
+
+typedef struct {
+    uint32_t ulEntries;      // Returned, "." and ".." not included
+    uint32_t ulDirectories;  // Entered, the top one included
+    uint32_t ulTooDeep;      // Directories not entered for ffconfigWALK_MAX_DEPTH
+    uint32_t ulErrors;       // Directories that couldn't be read, or not to the end
+} FF_WalkStats_t;
+
+typedef struct FF_Walk FF_Walk_t;
+
+/* Start a walk of the tree under pcPath (a directory; "" for the current
+one). Returns NULL, and sets errno, if it can't be read. */
+FF_Walk_t *ff_walk_open(const char *pcPath, unsigned uFlags);
+/* The next entry, or NULL at the end. A directory is returned before its
+contents (and, with FF_WALK_LEAVE, again after them). */
+const FF_WalkEntry_t *ff_walk_next(FF_Walk_t *pxWalk);
+// Don't enter the directory just returned by ff_walk_next()
+void ff_walk_prune(FF_Walk_t *pxWalk);
+const FF_WalkStats_t *ff_walk_stats(const FF_Walk_t *pxWalk);
+void ff_walk_close(FF_Walk_t *pxWalk);
+
+typedef struct {
+    const char *pcGlob;  // For the name, with * and ?, or NULL for any
+    char cType;          // 'f' for files, 'd' for directories, or 0 for both
+    uint32_t ulMinSize, ulMaxSize;  // Inclusive
+    time_t xModifiedAfter, xModifiedBefore;  // Exclusive; 0 for no limit
+} FF_WalkFilter_t;
+
+// A filter that passes everything
+void ff_walk_filter_init(FF_WalkFilter_t *pxFilter);
+bool ff_walk_match(const FF_WalkFilter_t *pxFilter,
+                   const FF_WalkEntry_t *pxEntry);
+// Case-insensitive, as FAT names are: * matches any run, ? any one character
+bool ff_glob_match(const char *pcPattern, const char *pcName);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,69 @@
+/* ff_writeback.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Write-back flusher.
+
+With ffconfigCACHE_WRITE_THROUGH set to 0, modified sectors stay in the
+IOManager cache until a buffer is needed or a file is closed. The flusher task
+bounds how long that can be: it flushes a disk's cache once the oldest
+modification in it reaches ffconfigWRITEBACK_DIRTY_AGE_MS, or once
+ffconfigWRITEBACK_DIRTY_BYTES of it are modified.
+
+The flusher only sees the cache. Data still in a file's own sector buffer, and
+the size in its directory entry, are written by ff_fsync() (see ff_utils.h)
+or ff_fclose(), called by the task that owns the file.
+
+On power failure, ff_writeback_power_fail_from_isr() has the flusher write
+out everything at once, and ff_power_failing() tells tasks to ff_fsync() and
+close their files. */
+
+#ifndef _FF_WRITEBACK_H_
+#define _FF_WRITEBACK_H_
+
+#include <stdbool.h>
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Start the flusher task. Call once, before or after starting the scheduler.
+It has nothing to do unless ffconfigCACHE_WRITE_THROUGH is 0 or
+ffconfigFAT_MIRROR is set. Its stack's high-water mark is in `task-stats`. */
+void ff_writeback_start(void);
+
+/* Called from an interrupt handler on warning of power failure: flush
+everything now, at the highest priority. */
+void ff_writeback_power_fail_from_isr(void);
+
+/* Treat an edge on a GPIO (for example, from a supply supervisor) as a
+warning of power failure. This installs the GPIO interrupt callback for the
+calling core. */
+void ff_writeback_watch_power_fail(uint gpio, bool bActiveHigh);
+
+// True once power failure has been signalled
+bool ff_power_failing(void);
+
+/* Hold off the flusher while disks are deleted (see eject()). Does nothing if
+the flusher hasn't been started. */
+void ff_writeback_lock(void);
+void ff_writeback_unlock(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,85 @@
+/* ff_xfer.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Binary file transfer over a byte link, such as the USB console.
+
+Everything goes in frames:
+
+    SOH (0x01), type, sequence (4 bytes), length (2 bytes), payload, CRC
+
+with the numbers little endian, and the CRC the CRC-16/XMODEM of everything
+after the SOH, most significant byte first. A receiver hunts for the SOH and
+drops anything that fails the CRC, so the frames can follow console output.
+
+The sender numbers its frames from 0: an 'F' frame (the file's size, 4 bytes,
+then its name), 'D' frames of up to ffconfigXFER_BLOCK_SIZE bytes of data, and
+an empty 'E' frame. The receiver answers each frame with an 'A' frame holding
+the next sequence number it expects, and, if a frame is missing, with one 'N'
+frame holding the same. The sender keeps up to ffconfigXFER_WINDOW frames
+unacknowledged, and goes back to the first of them on an 'N', or when nothing
+has come back for ffconfigXFER_TIMEOUT_MS. Once the 'E' frame is acknowledged,
+the sender acknowledges that with an 'A' of its own, so that the receiver need
+not wait to see whether the sender got it. Either end gives up with a 'C'
+frame.
+
+On the sending side, the data is read straight from the card (see
+ff_direct_io.h), as many blocks at a time as the window has room for. See
+example/tools/ffxfer.py for the other end. */
+
+#ifndef _FF_XFER_H_
+#define _FF_XFER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    // Send xLength bytes. Returns false if the link has failed.
+    bool (*pxSend)(void *pvContext, const void *pvData, size_t xLength);
+    /* Receive up to xLength bytes, waiting up to xTimeout ticks for the first.
+    Returns the number received: 0 if none came. */
+    size_t (*pxReceive)(void *pvContext, void *pvBuffer, size_t xLength,
+                        TickType_t xTimeout);
+    void *pvContext;
+} FF_XferLink_t;
+
+typedef struct {
+    uint32_t ulBytes;   // Of the file
+    uint32_t ulFrames;  // Sent, or received intact
+    uint32_t ulResent;  // Sent again, or received out of turn
+} FF_XferStats_t;
+
+/* Send the file at pcPath over the link. Returns 0 once the far end has
+acknowledged all of it, or -1 and sets errno. pxStats may be NULL. */
+int ff_xfer_send(const char *pcPath, const FF_XferLink_t *pxLink,
+                 FF_XferStats_t *pxStats);
+
+/* Receive a file over the link into pcPath, which is created, or truncated if
+it exists. (The name the sender gives is not used.) Returns 0 on success, or
+-1 and sets errno; then pcPath is removed. pxStats may be NULL. */
+int ff_xfer_receive(const char *pcPath, const FF_XferLink_t *pxLink,
+                    FF_XferStats_t *pxStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
@@ -0,0 +1,60 @@
+/* lat_hist.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Latency histograms, in microseconds.
+
+Buckets are logarithmic: each power of two is split into four, so a bucket is
+never wider than a quarter of its lower bound, and percentiles taken from the
+histogram are within 25% (they are rounded up to the top of their bucket, but
+never past the largest sample). Adding a sample is a few instructions, with no
+division. */
+
+#ifndef _LAT_HIST_H_
+#define _LAT_HIST_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAT_HIST_BUCKETS 124  // Enough for any uint32_t
+
+typedef struct {
+    uint32_t ulCount;
+    uint32_t ulMaxUs;
+    uint64_t ullSumUs;
+    uint32_t ulBuckets[LAT_HIST_BUCKETS];
+} lat_hist_t;
+
+void lat_hist_reset(lat_hist_t *pxHist);
+void lat_hist_add(lat_hist_t *pxHist, uint32_t ulUs);
+// Add the samples in pxOther
+void lat_hist_merge(lat_hist_t *pxHist, const lat_hist_t *pxOther);
+/* Keep only the samples added since pxOld was copied from pxHist. Their
+maximum is taken as the top of the highest bucket left. */
+void lat_hist_sub(lat_hist_t *pxHist, const lat_hist_t *pxOld);
+// The latency that uPermille thousandths of the samples are within
+uint32_t lat_hist_percentile(const lat_hist_t *pxHist, unsigned uPermille);
+uint32_t lat_hist_mean(const lat_hist_t *pxHist);
+// The range of latencies counted in a bucket
+uint32_t lat_hist_bucket_low(unsigned uBucket);
+uint32_t lat_hist_bucket_high(unsigned uBucket);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* [] END OF FILE */
@@ -19,6 +19,7 @@ specific language governing permissions and limitations under the License.
 #include <time.h>
 
 //#include "pico/stdio.h"
+#include "hardware/timer.h"  // time_us_64(), for time_fn()
 
 void mark_start_time();
 time_t GLOBAL_uptime_seconds();
@@ -39,11 +40,12 @@ void task_printf(const char *pcFormat, ...) __attribute__((format(__printf__, 1,
 
 #define time_fn(arg)                                              \
     {                                                             \
-        TickType_t xStart = xTaskGetTickCount();                  \
+        uint64_t ullStart = time_us_64();                         \
         arg;                                                      \
-        FF_PRINTF("%s: Elapsed time: %lu s\n", #arg,              \
-                  (unsigned long)(xTaskGetTickCount() - xStart) / \
-                      configTICK_RATE_HZ);                        \
+        uint64_t ullUs = time_us_64() - ullStart;                 \
+        FF_PRINTF("%s: Elapsed time: %lu.%06lu s\n", #arg,        \
+                  (unsigned long)(ullUs / 1000000),               \
+                  (unsigned long)(ullUs % 1000000));              \
     }
 
 // See FreeRTOSConfig.h
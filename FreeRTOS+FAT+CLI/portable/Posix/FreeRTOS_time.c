@@ -0,0 +1,52 @@
+/* FreeRTOS_time.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* On the host, the "RTC" is the system clock, plus whatever setrtc() moved it
+by. */
+
+#include <time.h>
+//
+#include "FreeRTOS.h"
+#include "ff_time.h"
+//
+#include "FreeRTOS_time.h"
+
+time_t epochtime;
+
+static time_t offset;
+
+time_t FreeRTOS_time(time_t *pxTime) {
+    epochtime = time(NULL) + offset;
+    if (pxTime) {
+        *pxTime = epochtime;
+    }
+    return epochtime;
+}
+
+void FreeRTOS_time_init() {}
+
+void setrtc(datetime_t *t) {
+    struct tm timeinfo = {
+        .tm_sec = t->sec,
+        .tm_min = t->min,
+        .tm_hour = t->hour,
+        .tm_mday = t->day,
+        .tm_mon = t->month - 1,
+        .tm_year = t->year - 1900,
+        .tm_isdst = -1
+    };
+    offset = mktime(&timeinfo) - time(NULL);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,75 @@
+/* hardware.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* The GPIOs and timer of the host build */
+
+#include <errno.h>
+#include <time.h>
+//
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
+//
+#include "sd_emulator.h"
+
+static bool gpio_level[NUM_BANK0_GPIOS];
+
+void gpio_init(uint gpio) { gpio_level[gpio] = 0; }
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+    (void)gpio, (void)fn;
+}
+void gpio_set_dir(uint gpio, bool out) { (void)gpio, (void)out; }
+void gpio_pull_up(uint gpio) { gpio_level[gpio] = 1; }
+void gpio_pull_down(uint gpio) { gpio_level[gpio] = 0; }
+void gpio_put(uint gpio, bool value) {
+    gpio_level[gpio] = value;
+    sd_emu_chip_select(gpio, value);
+}
+bool gpio_get(uint gpio) { return gpio_level[gpio]; }
+
+// Nothing raises GPIO interrupts on the host
+void gpio_set_irq_enabled_with_callback(uint gpio, uint32_t events,
+                                        bool enabled,
+                                        gpio_irq_callback_t callback) {
+    (void)gpio, (void)events, (void)enabled, (void)callback;
+}
+
+static uint64_t prvMonotonicUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t time_us_64(void) {
+    static uint64_t start;
+    if (!start) start = prvMonotonicUs();
+    return prvMonotonicUs() - start;
+}
+
+/* The simulated scheduler's tick signal interrupts sleeps, so sleep to an
+absolute time. */
+void sleep_us(uint64_t us) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += us / 1000000;
+    ts.tv_nsec += (us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_nsec -= 1000000000;
+        ++ts.tv_sec;
+    }
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL))
+        ;
+}
+
+/* [] END OF FILE */
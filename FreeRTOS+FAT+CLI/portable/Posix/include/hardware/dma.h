@@ -0,0 +1,24 @@
+/* hardware/dma.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Only carried around in spi_t: the host SPI has no DMA
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+/* [] END OF FILE */
@@ -0,0 +1,48 @@
+/* hardware/spi.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Host SPI "hardware": a byte-at-a-time bus to the emulated SD cards on it,
+which charges each transfer the time it would take at the bus's baud rate.
+See spi.c. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/types.h"
+
+typedef struct spi_inst {
+    uint baudrate;
+    uint64_t ulDebtNs;  // Modelled bus time not yet slept off
+} spi_inst_t;
+
+extern spi_inst_t host_spi_inst[2];
+#define spi0 (&host_spi_inst[0])
+#define spi1 (&host_spi_inst[1])
+
+typedef enum { SPI_CPHA_0 = 0, SPI_CPHA_1 = 1 } spi_cpha_t;
+typedef enum { SPI_CPOL_0 = 0, SPI_CPOL_1 = 1 } spi_cpol_t;
+typedef enum { SPI_LSB_FIRST = 0, SPI_MSB_FIRST = 1 } spi_order_t;
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+static inline void spi_set_format(spi_inst_t *spi, uint data_bits,
+                                  spi_cpol_t cpol, spi_cpha_t cpha,
+                                  spi_order_t order) {
+    (void)spi, (void)data_bits, (void)cpol, (void)cpha, (void)order;
+}
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+
+/* [] END OF FILE */
@@ -0,0 +1,47 @@
+/* pico/mutex.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* pico_sync mutexes, for the few places that guard one-time initialization.
+A pthread mutex would deadlock if its owner were switched out by the simulated
+scheduler, so these spin on a flag and yield instead. */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef struct {
+    volatile bool locked;
+} mutex_t;
+
+#define auto_init_mutex(name) static mutex_t name
+
+static inline void mutex_init(mutex_t *mtx) { mtx->locked = false; }
+static inline void mutex_enter_blocking(mutex_t *mtx) {
+    for (;;) {
+        taskENTER_CRITICAL();
+        if (!mtx->locked) {
+            mtx->locked = true;
+            taskEXIT_CRITICAL();
+            return;
+        }
+        taskEXIT_CRITICAL();
+        if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) taskYIELD();
+    }
+}
+static inline void mutex_exit(mutex_t *mtx) { mtx->locked = false; }
+
+/* [] END OF FILE */
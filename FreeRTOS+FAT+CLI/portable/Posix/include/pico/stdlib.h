@@ -0,0 +1,26 @@
+/* pico/stdlib.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#pragma once
+
+#include <stdlib.h>
+
+#include "hardware/gpio.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+#include "pico/types.h"
+
+#define panic_unsupported() abort()
+
+/* [] END OF FILE */
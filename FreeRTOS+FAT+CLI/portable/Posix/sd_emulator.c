@@ -0,0 +1,627 @@
+/* sd_emulator.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* The SPI-mode protocol, as seen from the card. See the SD Physical Layer
+Simplified Specification, chapter 7, and the overview at the top of
+portable/RP2040/sd_card.c. */
+
+#define _GNU_SOURCE  // fallocate()
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+//
+#include "FreeRTOS.h"
+//
+#include "crc.h"
+#include "hardware/timer.h"
+#include "sd_emulator.h"
+
+#define SD_EMU_CARDS 4
+#define SD_EMU_MAX_OPEN_AUS 8
+#define BLOCK_SIZE 512
+
+/* R1 Response Format */
+#define R1_IDLE_STATE (1 << 0)
+#define R1_ILLEGAL_COMMAND (1 << 2)
+#define R1_COM_CRC_ERROR (1 << 3)
+#define R1_ERASE_SEQUENCE_ERROR (1 << 4)
+#define R1_PARAMETER_ERROR (1 << 6)
+
+/* Second byte of R2 */
+#define R2_ERROR (1 << 2)
+
+/* Control Tokens */
+#define SPI_DATA_ACCEPTED (0x05)
+#define SPI_DATA_CRC_ERROR (0x0B)
+#define SPI_DATA_WRITE_ERROR (0x0D)
+#define SPI_START_BLOCK (0xFE)
+#define SPI_START_BLK_MUL_WRITE (0xFC)
+#define SPI_STOP_TRAN (0xFD)
+#define SPI_READ_ERROR_OFR (0x1 << 3)
+
+typedef enum {
+    EMU_COMMAND,      // Waiting for a command
+    EMU_READING,      // Sending blocks until CMD12 (CMD18)
+    EMU_WRITE_TOKEN,  // Waiting for a start block token (CMD24, CMD25)
+    EMU_WRITE_DATA    // Receiving a block
+} emu_state_t;
+
+typedef struct {
+    spi_inst_t *spi;
+    uint ss_gpio;
+    bool selected;
+    int fd;
+    const char *pcImage;
+    uint64_t sectors;
+    sd_emu_timing_t timing;
+
+    // Protocol state
+    emu_state_t state;
+    bool idle, app_cmd, crc_on, multi;
+    unsigned op_cond_calls;
+    uint8_t cmd[6];
+    size_t cmd_len;
+    uint64_t block;  // Next block to read or write
+    uint32_t erase_start, erase_end;
+    uint8_t in[BLOCK_SIZE + 2];  // A block being written, and its CRC
+    size_t in_len;
+    uint8_t r2;  // Errors for the next CMD13 to report
+
+    // Bytes to clock out. Those from hold_pos on wait until hold_until_us.
+    uint8_t out[8 + 5 + 1 + BLOCK_SIZE + 2];
+    size_t out_len, out_pos, hold_pos;
+    uint64_t hold_until_us;
+    uint32_t busy_after_us;  // Busy for this long once out[] has gone
+    uint64_t busy_until_us;
+
+    // Least recently used AUs being written
+    uint64_t open_au[SD_EMU_MAX_OPEN_AUS];
+    uint64_t au_last_use[SD_EMU_MAX_OPEN_AUS];
+    size_t open_aus;
+    uint64_t au_clock;
+
+    struct {
+        uint64_t commands, blocks_read, blocks_written, au_opens, crc_errors,
+            busy_us, faults;
+    } stats;
+} sd_emu_t;
+
+static sd_emu_t cards[SD_EMU_CARDS];
+static size_t card_count;
+
+static sd_emu_faults_t faults;
+static uint32_t fault_lfsr = 1;
+
+/* Allocation Unit sizes in KB, indexed by the AU_SIZE field of the SD Status
+ * register (as in sd_card.c) */
+static const uint32_t au_size_kb[16] = {0,     16,    32,    64,   128,  256,
+                                        512,   1024,  2048,  4096, 8192, 12288,
+                                        16384, 24576, 32768, 65536};
+
+static uint32_t prvEnv(const char *pcName, uint32_t ulDefault) {
+    const char *pcValue = getenv(pcName);
+    return pcValue ? strtoul(pcValue, NULL, 0) : ulDefault;
+}
+
+void sd_emu_default_timing(sd_emu_timing_t *pxTiming) {
+    pxTiming->ucNcr = prvEnv("SD_EMU_NCR", 1);
+    pxTiming->ulCommandUs = prvEnv("SD_EMU_CMD_US", 20);
+    pxTiming->ulReadAccessUs = prvEnv("SD_EMU_READ_US", 200);
+    pxTiming->ulWriteBusyUs = prvEnv("SD_EMU_WRITE_US", 250);
+    pxTiming->ulAUSectors = prvEnv("SD_EMU_AU_KB", 4096) * 2;
+    pxTiming->ucOpenAUs = prvEnv("SD_EMU_OPEN_AUS", 2);
+    pxTiming->ulAUPenaltyUs = prvEnv("SD_EMU_AU_PENALTY_US", 20000);
+    pxTiming->ulEraseUsPerAU = prvEnv("SD_EMU_ERASE_US", 2000);
+}
+
+void sd_emu_default_faults(sd_emu_faults_t *pxFaults) {
+    pxFaults->ulCmdCrcPpm = prvEnv("SD_EMU_FAULT_CMD_CRC", 0);
+    pxFaults->ulNoResponsePpm = prvEnv("SD_EMU_FAULT_NO_RESPONSE", 0);
+    pxFaults->ulMissedTokenPpm = prvEnv("SD_EMU_FAULT_MISSED_TOKEN", 0);
+    pxFaults->ulReadCrcPpm = prvEnv("SD_EMU_FAULT_READ_CRC", 0);
+    pxFaults->ulLongBusyPpm = prvEnv("SD_EMU_FAULT_LONG_BUSY", 0);
+    pxFaults->ulLongBusyUs = prvEnv("SD_EMU_LONG_BUSY_US", 200000);
+    pxFaults->ulPartialWritePpm = prvEnv("SD_EMU_FAULT_PARTIAL_WRITE", 0);
+    pxFaults->ulSeed = prvEnv("SD_EMU_SEED", 1);
+}
+
+void sd_emu_set_faults(const sd_emu_faults_t *pxFaults) {
+    faults = *pxFaults;
+    fault_lfsr = faults.ulSeed ? faults.ulSeed : 1;
+}
+
+void sd_emu_get_faults(sd_emu_faults_t *pxFaults) { *pxFaults = faults; }
+
+// Whether a fault at this rate strikes now. Reproducible for a given seed.
+static bool prvFault(sd_emu_t *p, uint32_t ulPpm) {
+    if (!ulPpm) return false;
+    // xorshift32
+    fault_lfsr ^= fault_lfsr << 13;
+    fault_lfsr ^= fault_lfsr >> 17;
+    fault_lfsr ^= fault_lfsr << 5;
+    if (fault_lfsr % 1000000 >= ulPpm) return false;
+    ++p->stats.faults;
+    return true;
+}
+
+bool sd_emu_attach(spi_inst_t *pxSPI, uint ss_gpio, const char *pcImage,
+                   uint32_t ulMB, const sd_emu_timing_t *pxTiming) {
+    configASSERT(card_count < SD_EMU_CARDS);
+    sd_emu_t *p = &cards[card_count];
+
+    p->fd = open(pcImage, O_RDWR | O_CREAT, 0644);
+    if (-1 == p->fd) {
+        perror(pcImage);
+        return false;
+    }
+    struct stat st;
+    if (-1 == fstat(p->fd, &st)) {
+        perror(pcImage);
+        close(p->fd);
+        return false;
+    }
+    if ((uint64_t)st.st_size < (uint64_t)ulMB << 20) {
+        st.st_size = (off_t)ulMB << 20;
+        if (-1 == ftruncate(p->fd, st.st_size)) {
+            perror(pcImage);
+            close(p->fd);
+            return false;
+        }
+    }
+    // The CSD gives the capacity in units of 512 KB
+    p->sectors = (uint64_t)st.st_size / BLOCK_SIZE & ~(uint64_t)1023;
+    if (!p->sectors) {
+        fprintf(stderr, "%s: too small for an SD card\n", pcImage);
+        close(p->fd);
+        return false;
+    }
+    p->spi = pxSPI;
+    p->ss_gpio = ss_gpio;
+    p->pcImage = pcImage;
+    p->timing = *pxTiming;
+    if (!p->timing.ucNcr) p->timing.ucNcr = 1;
+    if (p->timing.ucNcr > 8) p->timing.ucNcr = 8;
+    if (!p->timing.ucOpenAUs) p->timing.ucOpenAUs = 1;
+    if (p->timing.ucOpenAUs > SD_EMU_MAX_OPEN_AUS)
+        p->timing.ucOpenAUs = SD_EMU_MAX_OPEN_AUS;
+    p->idle = true;
+    p->hold_pos = SIZE_MAX;
+    ++card_count;
+    return true;
+}
+
+void sd_emu_print_stats(void) {
+    for (size_t i = 0; i < card_count; ++i) {
+        sd_emu_t *p = &cards[i];
+        printf("%s: %" PRIu64 " commands, %" PRIu64 " blocks read, %" PRIu64
+               " blocks written, %" PRIu64 " AUs opened, %" PRIu64
+               " CRC errors, busy %" PRIu64 " ms, %" PRIu64
+               " faults injected\n",
+               p->pcImage, p->stats.commands, p->stats.blocks_read,
+               p->stats.blocks_written, p->stats.au_opens,
+               p->stats.crc_errors, p->stats.busy_us / 1000, p->stats.faults);
+    }
+}
+
+uint64_t sd_emu_faults_injected(void) {
+    uint64_t ullFaults = 0;
+    for (size_t i = 0; i < card_count; ++i) ullFaults += cards[i].stats.faults;
+    return ullFaults;
+}
+
+/* Responses */
+
+static void prvResponse(sd_emu_t *p, uint8_t r1, size_t lead) {
+    p->out_len = p->out_pos = 0;
+    p->hold_pos = SIZE_MAX;
+    for (size_t i = 0; i < lead + p->timing.ucNcr; ++i)
+        p->out[p->out_len++] = 0xFF;
+    p->out[p->out_len++] = r1 | (p->idle ? R1_IDLE_STATE : 0);
+}
+static void prvAppend(sd_emu_t *p, const uint8_t *data, size_t len) {
+    configASSERT(p->out_len + len <= sizeof p->out);
+    memcpy(p->out + p->out_len, data, len);
+    p->out_len += len;
+}
+// A data block: start token, data and CRC, after the read access time
+static void prvAppendBlock(sd_emu_t *p, const uint8_t *data, size_t len,
+                           uint64_t now) {
+    p->hold_pos = p->out_len;
+    p->hold_until_us = now + p->timing.ulReadAccessUs;
+    uint8_t token = SPI_START_BLOCK;
+    prvAppend(p, &token, 1);
+    prvAppend(p, data, len);
+    uint16_t crc = crc16((const char *)data, len);
+    uint8_t crc_bytes[2] = {crc >> 8, crc};
+    prvAppend(p, crc_bytes, 2);
+}
+
+/* The medium */
+
+static bool prvReadBlock(sd_emu_t *p, uint64_t block, uint8_t *buf) {
+    ssize_t n = pread(p->fd, buf, BLOCK_SIZE, (off_t)block * BLOCK_SIZE);
+    if (n < 0) {
+        perror(p->pcImage);
+        return false;
+    }
+    memset(buf + n, 0, BLOCK_SIZE - n);  // Past the end of a short image
+    ++p->stats.blocks_read;
+    return true;
+}
+
+// Writing to an AU that isn't open costs the card a garbage collection
+static uint32_t prvAUPenalty(sd_emu_t *p, uint64_t block) {
+    if (!p->timing.ulAUSectors) return 0;
+    uint64_t au = block / p->timing.ulAUSectors;
+    size_t lru = 0;
+    ++p->au_clock;
+    for (size_t i = 0; i < p->open_aus; ++i) {
+        if (p->open_au[i] == au) {
+            p->au_last_use[i] = p->au_clock;
+            return 0;
+        }
+        if (p->au_last_use[i] < p->au_last_use[lru]) lru = i;
+    }
+    if (p->open_aus < p->timing.ucOpenAUs) lru = p->open_aus++;
+    p->open_au[lru] = au;
+    p->au_last_use[lru] = p->au_clock;
+    ++p->stats.au_opens;
+    return p->timing.ulAUPenaltyUs;
+}
+
+static void prvWriteBlock(sd_emu_t *p) {
+    uint8_t token = SPI_DATA_ACCEPTED;
+    uint16_t crc = p->in[BLOCK_SIZE] << 8 | p->in[BLOCK_SIZE + 1];
+
+    p->state = p->multi ? EMU_WRITE_TOKEN : EMU_COMMAND;
+    if (p->crc_on && crc16((const char *)p->in, BLOCK_SIZE) != crc) {
+        ++p->stats.crc_errors;
+        token = SPI_DATA_CRC_ERROR;
+    } else if (p->block < p->sectors &&
+               prvFault(p, faults.ulPartialWritePpm)) {
+        // Power glitch: half the block made it
+        pwrite(p->fd, p->in, BLOCK_SIZE / 2, (off_t)p->block * BLOCK_SIZE);
+        p->r2 |= R2_ERROR;
+        p->busy_after_us = p->timing.ulWriteBusyUs;
+        token = SPI_DATA_WRITE_ERROR;
+    } else if (p->block >= p->sectors ||
+               BLOCK_SIZE != pwrite(p->fd, p->in, BLOCK_SIZE,
+                                    (off_t)p->block * BLOCK_SIZE)) {
+        p->r2 |= R2_ERROR;
+        token = SPI_DATA_WRITE_ERROR;
+    } else {
+        ++p->stats.blocks_written;
+        p->busy_after_us =
+            p->timing.ulWriteBusyUs + prvAUPenalty(p, p->block);
+        if (prvFault(p, faults.ulLongBusyPpm))
+            p->busy_after_us += faults.ulLongBusyUs;
+        ++p->block;
+    }
+    p->out_len = p->out_pos = 0;
+    p->hold_pos = SIZE_MAX;
+    prvAppend(p, &token, 1);
+}
+
+static bool prvErase(sd_emu_t *p) {
+    off_t off = (off_t)p->erase_start * BLOCK_SIZE;
+    off_t len = (off_t)(p->erase_end - p->erase_start + 1) * BLOCK_SIZE;
+    // Erased blocks read as zeros (see the SCR)
+    if (!fallocate(p->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off, len))
+        return true;
+    static const uint8_t zeros[BLOCK_SIZE * 16];
+    while (len > 0) {
+        size_t n = len < (off_t)sizeof zeros ? (size_t)len : sizeof zeros;
+        if ((ssize_t)n != pwrite(p->fd, zeros, n, off)) return false;
+        off += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Registers */
+
+static void prvAppendCSD(sd_emu_t *p, uint64_t now) {
+    uint32_t c_size = p->sectors / 1024 - 1;
+    // CSD Version 2.0: 25 MHz, 512 byte blocks
+    uint8_t csd[16] = {0x40, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00,
+                       (c_size >> 16) & 0x3F, c_size >> 8, c_size,
+                       0x7F, 0x80, 0x0A, 0x40, 0x00, 0x00};
+    csd[15] = crc7((const char *)csd, 15) << 1 | 0x01;
+    prvAppendBlock(p, csd, sizeof csd, now);
+}
+static void prvAppendCID(sd_emu_t *p, uint64_t now) {
+    uint8_t cid[16] = {0x7F, 'P', 'X', 'S', 'D', 'E', 'M', 'U', 0x10,
+                       0x00, 0x00, 0x00, (uint8_t)(p - cards), 0x01, 0x6A};
+    cid[15] = crc7((const char *)cid, 15) << 1 | 0x01;
+    prvAppendBlock(p, cid, sizeof cid, now);
+}
+static void prvAppendSDStatus(sd_emu_t *p, uint64_t now) {
+    uint8_t status[64] = {0};
+    uint8_t au_size = 0;
+    for (uint8_t i = 1; i < 16; ++i)
+        if (au_size_kb[i] * 2 <= p->timing.ulAUSectors) au_size = i;
+    status[8] = 0x04;  // SPEED_CLASS: Class 10
+    // AU_SIZE: [431:428]
+    status[(511 - 431) / 8] = au_size << 4;
+    prvAppendBlock(p, status, sizeof status, now);
+}
+static void prvAppendSCR(sd_emu_t *p, uint64_t now) {
+    /* SD_SPEC 2 and 3, DATA_STAT_AFTER_ERASE 0, SD_BUS_WIDTHS 1 and 4
+    bits */
+    uint8_t scr[8] = {0x02, 0x05, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00};
+    prvAppendBlock(p, scr, sizeof scr, now);
+}
+
+/* Commands */
+
+static void prvReadNext(sd_emu_t *p, uint64_t now) {
+    uint8_t buf[BLOCK_SIZE];
+    if (p->block >= p->sectors || !prvReadBlock(p, p->block, buf)) {
+        // Data Error Token
+        uint8_t token = SPI_READ_ERROR_OFR;
+        p->state = EMU_COMMAND;
+        p->hold_pos = 0;
+        p->hold_until_us = now + p->timing.ulReadAccessUs;
+        prvAppend(p, &token, 1);
+        return;
+    }
+    ++p->block;
+    if (prvFault(p, faults.ulMissedTokenPpm)) return;  // Silence
+    prvAppendBlock(p, buf, sizeof buf, now);
+    // Flip a bit in the last data byte, after the CRC was taken
+    if (prvFault(p, faults.ulReadCrcPpm)) p->out[p->out_len - 3] ^= 0x01;
+}
+
+static void prvCommand(sd_emu_t *p, uint64_t now) {
+    uint8_t cmd = p->cmd[0] & 0x3F;
+    uint32_t arg = (uint32_t)p->cmd[1] << 24 | p->cmd[2] << 16 |
+                   p->cmd[3] << 8 | p->cmd[4];
+    bool acmd = p->app_cmd;
+
+    ++p->stats.commands;
+    p->app_cmd = false;
+    p->spi->ulDebtNs += (uint64_t)p->timing.ulCommandUs * 1000;
+
+    // CMD0 is sent in SD mode, and CMD8 always has its CRC checked
+    if (p->crc_on || 0 == cmd || 8 == cmd) {
+        uint8_t crc = crc7((const char *)p->cmd, 5) << 1 | 0x01;
+        if (crc != p->cmd[5]) {
+            ++p->stats.crc_errors;
+            prvResponse(p, R1_COM_CRC_ERROR, 0);
+            return;
+        }
+    }
+    if (!acmd && (13 == cmd || 17 == cmd || 18 == cmd || 24 == cmd ||
+                  25 == cmd || 12 == cmd)) {
+        if (prvFault(p, faults.ulNoResponsePpm)) {
+            p->out_len = p->out_pos = 0;
+            p->hold_pos = SIZE_MAX;
+            if (12 == cmd) p->state = EMU_COMMAND;
+            return;
+        }
+        if (12 != cmd && prvFault(p, faults.ulCmdCrcPpm)) {
+            prvResponse(p, R1_COM_CRC_ERROR, 0);
+            return;
+        }
+    }
+    if (acmd) {
+        switch (cmd) {
+            case 13:  // ACMD13_SD_STATUS: R2 and a data block
+                prvResponse(p, 0, 0);
+                prvAppend(p, (const uint8_t[]){0x00}, 1);
+                prvAppendSDStatus(p, now);
+                return;
+            case 23:  // ACMD23_SET_WR_BLK_ERASE_COUNT
+            case 42:  // ACMD42_SET_CLR_CARD_DETECT
+                prvResponse(p, 0, 0);
+                return;
+            case 41:  // ACMD41_SD_SEND_OP_COND
+                // Takes a couple of goes, as real cards do
+                if (++p->op_cond_calls > 1) p->idle = false;
+                prvResponse(p, 0, 0);
+                return;
+            case 51:  // ACMD51_SEND_SCR
+                prvResponse(p, 0, 0);
+                prvAppendSCR(p, now);
+                return;
+            default:
+                break;  // Not an ACMD: take it as a plain command
+        }
+    }
+    switch (cmd) {
+        case 0:  // CMD0_GO_IDLE_STATE
+            p->state = EMU_COMMAND;
+            p->idle = true;
+            p->crc_on = false;
+            p->op_cond_calls = 0;
+            prvResponse(p, 0, 0);
+            break;
+        case 1:  // CMD1_SEND_OP_COND
+            if (++p->op_cond_calls > 1) p->idle = false;
+            prvResponse(p, 0, 0);
+            break;
+        case 8: {  // CMD8_SEND_IF_COND: R7 echoes the voltage and pattern
+            prvResponse(p, 0, 0);
+            uint8_t r7[4] = {0x00, 0x00, (arg >> 8) & 0x0F, arg};
+            prvAppend(p, r7, sizeof r7);
+            break;
+        }
+        case 9:  // CMD9_SEND_CSD
+            prvResponse(p, 0, 0);
+            prvAppendCSD(p, now);
+            break;
+        case 10:  // CMD10_SEND_CID
+            prvResponse(p, 0, 0);
+            prvAppendCID(p, now);
+            break;
+        case 12:  // CMD12_STOP_TRANSMISSION: a stuff byte, then R1b
+            p->state = EMU_COMMAND;
+            prvResponse(p, 0, 1);
+            break;
+        case 13: {  // CMD13_SEND_STATUS: R2
+            prvResponse(p, 0, 0);
+            prvAppend(p, &p->r2, 1);
+            p->r2 = 0;
+            break;
+        }
+        case 16:  // CMD16_SET_BLOCKLEN
+            prvResponse(p, BLOCK_SIZE == arg ? 0 : R1_PARAMETER_ERROR, 0);
+            break;
+        case 17:  // CMD17_READ_SINGLE_BLOCK
+        case 18:  // CMD18_READ_MULTIPLE_BLOCK
+            if (arg >= p->sectors) {
+                prvResponse(p, R1_PARAMETER_ERROR, 0);
+                break;
+            }
+            prvResponse(p, 0, 0);
+            p->block = arg;
+            p->state = 18 == cmd ? EMU_READING : EMU_COMMAND;
+            prvReadNext(p, now);
+            break;
+        case 24:  // CMD24_WRITE_BLOCK
+        case 25:  // CMD25_WRITE_MULTIPLE_BLOCK
+            if (arg >= p->sectors) {
+                prvResponse(p, R1_PARAMETER_ERROR, 0);
+                break;
+            }
+            prvResponse(p, 0, 0);
+            p->block = arg;
+            p->multi = 25 == cmd;
+            p->state = EMU_WRITE_TOKEN;
+            break;
+        case 32:  // CMD32_ERASE_WR_BLK_START_ADDR
+            p->erase_start = arg;
+            prvResponse(p, 0, 0);
+            break;
+        case 33:  // CMD33_ERASE_WR_BLK_END_ADDR
+            p->erase_end = arg;
+            prvResponse(p, 0, 0);
+            break;
+        case 38: {  // CMD38_ERASE: R1b
+            if (p->erase_start > p->erase_end || p->erase_end >= p->sectors) {
+                prvResponse(p, R1_ERASE_SEQUENCE_ERROR, 0);
+                break;
+            }
+            prvResponse(p, prvErase(p) ? 0 : R1_PARAMETER_ERROR, 0);
+            uint32_t aus = 1;
+            if (p->timing.ulAUSectors)
+                aus += (p->erase_end - p->erase_start) / p->timing.ulAUSectors;
+            p->busy_after_us = aus * p->timing.ulEraseUsPerAU;
+            break;
+        }
+        case 55:  // CMD55_APP_CMD
+            p->app_cmd = true;
+            prvResponse(p, 0, 0);
+            break;
+        case 58: {  // CMD58_READ_OCR: R3. Power up done and CCS once ready.
+            prvResponse(p, 0, 0);
+            uint8_t ocr[4] = {p->idle ? 0x00 : 0xC0, 0xFF, 0x80, 0x00};
+            prvAppend(p, ocr, sizeof ocr);
+            break;
+        }
+        case 59:  // CMD59_CRC_ON_OFF
+            p->crc_on = arg & 1;
+            prvResponse(p, 0, 0);
+            break;
+        default:
+            prvResponse(p, R1_ILLEGAL_COMMAND, 0);
+            break;
+    }
+}
+
+/* The bus */
+
+static uint8_t prvShiftOut(sd_emu_t *p, uint64_t now) {
+    if (p->out_pos >= p->out_len) return 0xFF;
+    if (p->out_pos >= p->hold_pos && now < p->hold_until_us) return 0xFF;
+    uint8_t miso = p->out[p->out_pos++];
+    if (p->out_pos == p->out_len) {
+        p->out_len = p->out_pos = 0;
+        p->hold_pos = SIZE_MAX;
+        if (p->busy_after_us) {
+            p->busy_until_us = now + p->busy_after_us;
+            p->stats.busy_us += p->busy_after_us;
+            p->busy_after_us = 0;
+        }
+        if (EMU_READING == p->state) prvReadNext(p, now);
+    }
+    return miso;
+}
+
+static sd_emu_t *prvSelected(spi_inst_t *pxSPI) {
+    for (size_t i = 0; i < card_count; ++i)
+        if (cards[i].spi == pxSPI && cards[i].selected) return &cards[i];
+    return NULL;
+}
+
+void sd_emu_chip_select(uint gpio, bool level) {
+    for (size_t i = 0; i < card_count; ++i) {
+        sd_emu_t *p = &cards[i];
+        if (p->ss_gpio != gpio) continue;
+        p->selected = !level;
+        if (!p->selected) {
+            // Anything half sent is lost, but programming carries on
+            p->cmd_len = 0;
+            if (EMU_WRITE_DATA == p->state) p->state = EMU_WRITE_TOKEN;
+        }
+    }
+}
+
+uint8_t sd_emu_exchange(spi_inst_t *pxSPI, uint8_t mosi) {
+    sd_emu_t *p = prvSelected(pxSPI);
+    if (!p) return 0xFF;  // MISO is pulled up
+
+    // As the card sees it, the bus is up to date
+    uint64_t now = time_us_64() + pxSPI->ulDebtNs / 1000;
+    if (now < p->busy_until_us) return 0x00;
+
+    switch (p->state) {
+        case EMU_WRITE_DATA:
+            p->in[p->in_len++] = mosi;
+            if (sizeof p->in == p->in_len) prvWriteBlock(p);
+            return 0xFF;
+        case EMU_WRITE_TOKEN:
+            if (p->out_pos < p->out_len) return prvShiftOut(p, now);
+            if (SPI_START_BLOCK == mosi && !p->multi) {
+                p->in_len = 0;
+                p->state = EMU_WRITE_DATA;
+            } else if (SPI_START_BLK_MUL_WRITE == mosi && p->multi) {
+                p->in_len = 0;
+                p->state = EMU_WRITE_DATA;
+            } else if (SPI_STOP_TRAN == mosi && p->multi) {
+                p->state = EMU_COMMAND;
+                p->busy_until_us = now + p->timing.ulWriteBusyUs;
+                p->stats.busy_us += p->timing.ulWriteBusyUs;
+            }
+            return 0xFF;
+        default: {
+            // A read carries on while the command that stops it comes in
+            uint8_t miso = prvShiftOut(p, now);
+            if (p->cmd_len || 0x40 == (mosi & 0xC0)) {
+                p->cmd[p->cmd_len++] = mosi;
+                if (sizeof p->cmd == p->cmd_len) {
+                    p->cmd_len = 0;
+                    prvCommand(p, now);
+                }
+            }
+            return miso;
+        }
+    }
+}
+
+/* [] END OF FILE */
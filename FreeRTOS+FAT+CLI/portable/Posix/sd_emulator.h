@@ -0,0 +1,94 @@
+/* sd_emulator.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* An SD card in SPI mode, backed by a disk image file, for the host build.
+
+The card sits on a host SPI bus (hardware/spi.h) behind a slave select GPIO,
+and talks the SPI-mode protocol byte by byte, so sd_card.c and sd_spi.c drive
+it exactly as they drive a real card. It reports itself as a v2 high capacity
+card.
+
+Time is real: the bus charges each byte at its baud rate, and the card holds
+back responses and data tokens, and signals busy, according to its timing
+model. */
+
+#ifndef _SD_EMULATOR_H_
+#define _SD_EMULATOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/spi.h"
+
+typedef struct {
+    uint8_t ucNcr;            // Bytes from the end of a command to its response
+    uint32_t ulCommandUs;     // Added to the bus time of every command
+    uint32_t ulReadAccessUs;  // From a read command (or block) to its data token
+    uint32_t ulWriteBusyUs;   // Programming one block
+    uint32_t ulAUSectors;     // Allocation Unit, as reported by ACMD13
+    uint8_t ucOpenAUs;        // AUs that can be written without a penalty
+    uint32_t ulAUPenaltyUs;   // Extra busy when a write has to open another AU
+    uint32_t ulEraseUsPerAU;  // Busy after CMD38
+} sd_emu_timing_t;
+
+/* Fill in a model of a typical class 10 card, then override any field given
+in the environment: SD_EMU_NCR, SD_EMU_CMD_US, SD_EMU_READ_US, SD_EMU_WRITE_US,
+SD_EMU_AU_KB, SD_EMU_OPEN_AUS, SD_EMU_AU_PENALTY_US, SD_EMU_ERASE_US. */
+void sd_emu_default_timing(sd_emu_timing_t *pxTiming);
+
+/* Faults, each at a rate in parts per million of the operations it can hit.
+Commands are the data path ones: CMD13, CMD17, CMD18, CMD24 and CMD25, and
+CMD12 (which can go unanswered, but still stops the read), so that cards still
+come up. */
+typedef struct {
+    uint32_t ulCmdCrcPpm;        // Command answered with a CRC error
+    uint32_t ulNoResponsePpm;    // Command ignored
+    uint32_t ulMissedTokenPpm;   // Read block whose start token never comes
+    uint32_t ulReadCrcPpm;       // Read block corrupted after its CRC16
+    uint32_t ulLongBusyPpm;      // Block write that stays busy ulLongBusyUs
+    uint32_t ulLongBusyUs;
+    uint32_t ulPartialWritePpm;  // Block write torn halfway, with a write error
+    uint32_t ulSeed;
+} sd_emu_faults_t;
+
+/* No faults, but for any rate given in the environment: SD_EMU_FAULT_CMD_CRC,
+SD_EMU_FAULT_NO_RESPONSE, SD_EMU_FAULT_MISSED_TOKEN, SD_EMU_FAULT_READ_CRC,
+SD_EMU_FAULT_LONG_BUSY (and SD_EMU_LONG_BUSY_US), SD_EMU_FAULT_PARTIAL_WRITE,
+and SD_EMU_SEED. */
+void sd_emu_default_faults(sd_emu_faults_t *pxFaults);
+// The faults all cards inject from now on
+void sd_emu_set_faults(const sd_emu_faults_t *pxFaults);
+void sd_emu_get_faults(sd_emu_faults_t *pxFaults);
+
+/* Put a card in the socket selected by ss_gpio on pxSPI. The image is created
+(sparse) or extended to ulMB megabytes if it is smaller; 0 takes the image as
+it is. Returns false if the image can't be opened. */
+bool sd_emu_attach(spi_inst_t *pxSPI, uint ss_gpio, const char *pcImage,
+                   uint32_t ulMB, const sd_emu_timing_t *pxTiming);
+
+/* Print what each card has been asked to do, how long it was busy, and the
+faults it injected */
+void sd_emu_print_stats(void);
+// The faults all cards have injected so far
+uint64_t sd_emu_faults_injected(void);
+
+/* For the host "hardware" */
+
+// A slave select has changed level
+void sd_emu_chip_select(uint gpio, bool level);
+// Clock one byte out to the selected card on pxSPI, returning what it sent back
+uint8_t sd_emu_exchange(spi_inst_t *pxSPI, uint8_t mosi);
+
+#endif
+/* [] END OF FILE */
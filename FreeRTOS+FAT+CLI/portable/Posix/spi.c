@@ -0,0 +1,93 @@
+/* spi.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* The host SPI: transfers go byte by byte to the emulated SD card selected on
+the bus, and take as long as they would at the bus's baud rate. */
+
+#include <stdbool.h>
+//
+#include "pico/mutex.h"
+#include "pico/stdlib.h"
+//
+#include "FreeRTOS.h"
+//
+#include "sd_emulator.h"
+#include "spi.h"
+
+/* Bus time is slept off once this much has built up, rather than after every
+byte */
+#define SPI_SLEEP_THRESHOLD_NS (100 * 1000)
+
+spi_inst_t host_spi_inst[2];
+
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate) {
+    spi->baudrate = baudrate;
+    return baudrate;
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate) {
+    spi->ulDebtNs = 0;
+    return spi_set_baudrate(spi, baudrate);
+}
+
+static void prvSpend(spi_inst_t *spi, size_t length) {
+    spi->ulDebtNs += (uint64_t)length * 8 * 1000000000 / spi->baudrate;
+    if (spi->ulDebtNs >= SPI_SLEEP_THRESHOLD_NS) {
+        sleep_us(spi->ulDebtNs / 1000);
+        spi->ulDebtNs %= 1000;
+    }
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; ++i) sd_emu_exchange(spi, src[i]);
+    prvSpend(spi, len);
+    return (int)len;
+}
+
+void spi_irq_handler(spi_t *pSPI) { (void)pSPI; }
+
+// SPI Transfer: Read & Write (simultaneously) on SPI bus
+//   If the data that will be received is not important, pass NULL as rx.
+//   If the data that will be transmitted is not important,
+//     pass NULL as tx and then the SPI_FILL_CHAR is sent out as each data
+//     element.
+bool spi_transfer(spi_t *pSPI, const uint8_t *tx, uint8_t *rx, size_t length) {
+    configASSERT(xTaskGetCurrentTaskHandle() == pSPI->owner);
+    configASSERT(tx || rx);
+
+    for (size_t i = 0; i < length; ++i) {
+        uint8_t miso = sd_emu_exchange(pSPI->hw_inst, tx ? tx[i] : SPI_FILL_CHAR);
+        if (rx) rx[i] = miso;
+    }
+    prvSpend(pSPI->hw_inst, length);
+    return true;
+}
+
+bool my_spi_init(spi_t *pSPI) {
+    auto_init_mutex(my_spi_init_mutex);
+    mutex_enter_blocking(&my_spi_init_mutex);
+    if (!pSPI->initialized) {
+        // The SPI may be shared (using multiple SSs); protect it
+        pSPI->mutex = xSemaphoreCreateMutex();
+
+        // Start at 100 kHz, like the hardware
+        spi_init(pSPI->hw_inst, 100 * 1000);
+
+        pSPI->initialized = true;
+    }
+    mutex_exit(&my_spi_init_mutex);
+    return true;
+}
+
+/* [] END OF FILE */
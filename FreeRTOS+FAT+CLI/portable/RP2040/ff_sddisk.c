@@ -54,13 +54,371 @@ specific language governing permissions and limitations under the License.
 #define BYTES_PER_KB			( 1024ull )
 #define SECTORS_PER_KB			( BYTES_PER_KB / 512ull )
 
+#if ffconfigREAD_AHEAD_MAX_SECTORS > 0
+
+// Initial read-ahead window, once a stream has been recognised
+#define READ_AHEAD_MIN_SECTORS	4
+
+typedef struct {
+	uint32_t ulReads;		/* Requests from the IOManager */
+	uint32_t ulCommands;	/* Reads sent to the card */
+	uint32_t ulHitSectors;	/* Sectors served from staging buffers */
+	uint32_t ulMissSectors;	/* Sectors read on demand */
+	uint32_t ulPrefetched;	/* Sectors read ahead */
+	uint32_t ulDropped;		/* Staged sectors dropped because they were written */
+	uint32_t ulMaxWindow;
+} read_ahead_stats_t;
+
+/* A sequential stream of reads, and what has been read ahead for it */
+typedef struct {
+	uint32_t ulNext;		/* Sector that a sequential read would start at */
+	uint32_t ulWindow;		/* Sectors to read ahead next time; 0 until recognised */
+	uint32_t ulStart;		/* First sector in the staging buffer */
+	uint32_t ulCount;		/* Sectors in the staging buffer */
+	uint32_t ulLastUsed;
+	uint8_t *pucBuffer;		/* Staging buffer */
+} read_ahead_stream_t;
+
+struct sd_read_ahead {
+	SemaphoreHandle_t xMutex;
+	uint32_t ulUseCount;
+	read_ahead_stream_t xStreams[ffconfigREAD_AHEAD_STREAMS];
+	read_ahead_stats_t xStats;
+	uint8_t ucBuffers[ffconfigREAD_AHEAD_STREAMS][ffconfigREAD_AHEAD_MAX_SECTORS * SECTOR_SIZE];
+};
+
+static bool prvReadAheadInit(sd_card_t *pSD) {
+	if (pSD->read_ahead) return true;
+	struct sd_read_ahead *pxRA = pvPortMalloc(sizeof(struct sd_read_ahead));
+	if (!pxRA) {
+		FF_PRINTF("FF_SDDiskInit: Malloc failed\n");
+		return false;
+	}
+	memset(pxRA, 0, sizeof(struct sd_read_ahead));
+	pxRA->xMutex = xSemaphoreCreateMutex();
+	if (!pxRA->xMutex) {
+		vPortFree(pxRA);
+		return false;
+	}
+	for (size_t i = 0; i < ffconfigREAD_AHEAD_STREAMS; ++i)
+		pxRA->xStreams[i].pucBuffer = pxRA->ucBuffers[i];
+	pSD->read_ahead = pxRA;
+	return true;
+}
+
+static void prvReadAheadDelete(sd_card_t *pSD) {
+	if (!pSD->read_ahead) return;
+	vSemaphoreDelete(pSD->read_ahead->xMutex);
+	vPortFree(pSD->read_ahead);
+	pSD->read_ahead = NULL;
+}
+
+/* Drop any staged copies of sectors in the given range. Call with the
+mutex held. */
+static void prvReadAheadDrop(struct sd_read_ahead *pxRA, uint32_t ulSector, uint32_t ulCount) {
+	for (size_t i = 0; i < ffconfigREAD_AHEAD_STREAMS; ++i) {
+		read_ahead_stream_t *pxStream = &pxRA->xStreams[i];
+		if (pxStream->ulCount && ulSector < pxStream->ulStart + pxStream->ulCount
+				&& pxStream->ulStart < ulSector + ulCount) {
+			pxRA->xStats.ulDropped += pxStream->ulCount;
+			pxStream->ulCount = 0;
+		}
+	}
+}
+
+/* Read through the staging buffers. A read that starts where a stream
+left off is a hit: the stream's window grows and the sectors beyond the
+request are read into its staging buffer in the same command. Anything
+else starts a new stream, replacing the least recently used one. */
+static int prvReadAhead(sd_card_t *pSD, uint8_t *pucDestination, uint32_t ulSector, uint32_t ulCount) {
+	struct sd_read_ahead *pxRA = pSD->read_ahead;
+	int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+	xSemaphoreTake(pxRA->xMutex, portMAX_DELAY);
+	++pxRA->xStats.ulReads;
+
+	// Serve what we can from the staging buffers
+	for (size_t i = 0; i < ffconfigREAD_AHEAD_STREAMS && ulCount; ++i) {
+		read_ahead_stream_t *pxStream = &pxRA->xStreams[i];
+		if (pxStream->ulCount && ulSector >= pxStream->ulStart
+				&& ulSector < pxStream->ulStart + pxStream->ulCount) {
+			uint32_t ulAvail = pxStream->ulStart + pxStream->ulCount - ulSector;
+			uint32_t n = ulCount < ulAvail ? ulCount : ulAvail;
+			memcpy(pucDestination, pxStream->pucBuffer + (ulSector - pxStream->ulStart) * SECTOR_SIZE,
+					n * SECTOR_SIZE);
+			pxRA->xStats.ulHitSectors += n;
+			pucDestination += n * SECTOR_SIZE;
+			ulSector += n;
+			ulCount -= n;
+			pxStream->ulNext = ulSector;
+			pxStream->ulLastUsed = ++pxRA->ulUseCount;
+		}
+	}
+	if (!ulCount) {
+		xSemaphoreGive(pxRA->xMutex);
+		return status;
+	}
+	pxRA->xStats.ulMissSectors += ulCount;
+
+	// Find the stream this read continues, or the one to replace
+	read_ahead_stream_t *pxStream = NULL;
+	for (size_t i = 0; i < ffconfigREAD_AHEAD_STREAMS; ++i) {
+		read_ahead_stream_t *px = &pxRA->xStreams[i];
+		if (px->ulNext == ulSector) {
+			pxStream = px;
+			break;
+		}
+		if (!pxStream || px->ulLastUsed < pxStream->ulLastUsed)
+			pxStream = px;
+	}
+	if (pxStream->ulNext == ulSector) {
+		// Sequential: open up the window
+		pxStream->ulWindow = pxStream->ulWindow ? 2 * pxStream->ulWindow : READ_AHEAD_MIN_SECTORS;
+		if (pxStream->ulWindow > ffconfigREAD_AHEAD_MAX_SECTORS)
+			pxStream->ulWindow = ffconfigREAD_AHEAD_MAX_SECTORS;
+	} else {
+		pxStream->ulWindow = 0;
+	}
+	pxStream->ulLastUsed = ++pxRA->ulUseCount;
+	pxStream->ulNext = ulSector + ulCount;
+	pxStream->ulCount = 0;
+	// The request and what follows it go through the staging buffer
+	uint32_t ulTotal = ulCount + pxStream->ulWindow;
+	if (ulTotal > ffconfigREAD_AHEAD_MAX_SECTORS)
+		ulTotal = ffconfigREAD_AHEAD_MAX_SECTORS;
+	if (ulTotal > pSD->sectors - ulSector)
+		ulTotal = pSD->sectors - ulSector;
+	if (!pxStream->ulWindow || ulTotal <= ulCount) {
+		// Nothing to read ahead, or the request fills the buffer on its own
+		status = sd_read_blocks(pSD, pucDestination, ulSector, ulCount);
+	} else {
+		status = sd_read_blocks(pSD, pxStream->pucBuffer, ulSector, ulTotal);
+		if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+			memcpy(pucDestination, pxStream->pucBuffer, ulCount * SECTOR_SIZE);
+			pxStream->ulStart = ulSector;
+			pxStream->ulCount = ulTotal;
+			pxRA->xStats.ulPrefetched += ulTotal - ulCount;
+		}
+	}
+	++pxRA->xStats.ulCommands;
+	if (pxStream->ulWindow > pxRA->xStats.ulMaxWindow)
+		pxRA->xStats.ulMaxWindow = pxStream->ulWindow;
+	xSemaphoreGive(pxRA->xMutex);
+	return status;
+}
+
+#endif /* ffconfigREAD_AHEAD_MAX_SECTORS */
+
+/* Write sectors to the card, dropping any staged copies of them. The
+read-ahead mutex is held across the write, so that a read meanwhile can't
+stage what is being overwritten. Refused while the card is write protected. */
+static int prvWriteBlocks(sd_card_t *pSD, const uint8_t *pucSource, uint32_t ulSector, uint32_t ulCount) {
+	if (pSD->write_protect) return SD_BLOCK_DEVICE_ERROR_WRITE_PROTECTED;
+#if ffconfigREAD_AHEAD_MAX_SECTORS > 0
+	struct sd_read_ahead *pxRA = pSD->read_ahead;
+	if (pxRA) {
+		xSemaphoreTake(pxRA->xMutex, portMAX_DELAY);
+		prvReadAheadDrop(pxRA, ulSector, ulCount);
+		int status = sd_write_blocks(pSD, pucSource, ulSector, ulCount);
+		xSemaphoreGive(pxRA->xMutex);
+		return status;
+	}
+#endif
+	return sd_write_blocks(pSD, pucSource, ulSector, ulCount);
+}
+
+#if ffconfigFAT_MIRROR
+
+#if ffconfigWRITE_BOTH_FATS
+#error "ffconfigFAT_MIRROR is for use with ffconfigWRITE_BOTH_FATS 0"
+#endif
+
+/* The BPB byte that Windows uses for its "volume dirty" flag. It is set while
+the copies of the FAT differ. */
+#define FAT16_FLAGS_OFFSET		0x25
+#define FAT32_FLAGS_OFFSET		0x41
+#define FLAG_FATS_DIFFER		0x01
+
+struct sd_fat_mirror {
+	SemaphoreHandle_t xMutex;
+	uint32_t ulFATBegin;		/* First sector of the first FAT */
+	uint32_t ulSectorsPerFAT;
+	uint32_t ulCopies;			/* FATs other than the first */
+	uint32_t ulBootSector;
+	uint16_t usFlagsOffset;
+	bool bFlagSet;				/* The boot sector says the FATs differ */
+	uint32_t ulDirty;			/* Sectors marked in ulBitmap */
+	TickType_t xDirtySince;
+	uint8_t ucBootSector[SECTOR_SIZE];	/* Not on the stack of the task writing */
+	uint32_t ulBitmap[];		/* One bit per sector of the first FAT */
+};
+
+/* Set or clear the flag in the boot sector. Call with the mutex held. */
+static int prvFATMirrorSetFlag(sd_card_t *pSD, bool bSet) {
+	struct sd_fat_mirror *pxFM = pSD->fat_mirror;
+	uint8_t *pucSector = pxFM->ucBootSector;
+
+	int status = sd_read_blocks(pSD, pucSector, pxFM->ulBootSector, 1);
+	if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+	if (bSet)
+		pucSector[pxFM->usFlagsOffset] |= FLAG_FATS_DIFFER;
+	else
+		pucSector[pxFM->usFlagsOffset] &= ~FLAG_FATS_DIFFER;
+	status = prvWriteBlocks(pSD, pucSector, pxFM->ulBootSector, 1);
+	if (SD_BLOCK_DEVICE_ERROR_NONE == status) pxFM->bFlagSet = bSet;
+	return status;
+}
+
+/* Write sectors, noting any that are in the first FAT. The boot sector flag
+is set before the first such write goes to the card, unless it is set
+already: it is only cleared when the copies are brought up to date for good
+(see prvFATMirrorCopy()), so it is written once per session rather than twice
+per copy. The mutex is held across
+the write, so that the sectors can't be copied to the other FATs, and the
+flag cleared, before the write is done. */
+static int prvFATMirrorWrite(sd_card_t *pSD, const uint8_t *pucSource, uint32_t ulSector, uint32_t ulCount) {
+	struct sd_fat_mirror *pxFM = pSD->fat_mirror;
+	int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+	if (!pxFM) return prvWriteBlocks(pSD, pucSource, ulSector, ulCount);
+	uint32_t ulBegin = ulSector;
+	uint32_t ulEnd = ulSector + ulCount;
+	uint32_t ulFATEnd = pxFM->ulFATBegin + pxFM->ulSectorsPerFAT;
+	if (ulEnd <= pxFM->ulFATBegin || ulSector >= ulFATEnd)
+		return prvWriteBlocks(pSD, pucSource, ulSector, ulCount);
+	if (ulBegin < pxFM->ulFATBegin) ulBegin = pxFM->ulFATBegin;
+	if (ulEnd > ulFATEnd) ulEnd = ulFATEnd;
+
+	xSemaphoreTake(pxFM->xMutex, portMAX_DELAY);
+	if (!pxFM->bFlagSet) status = prvFATMirrorSetFlag(pSD, true);
+	if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
+		if (!pxFM->ulDirty) pxFM->xDirtySince = xTaskGetTickCount();
+		for (uint32_t i = ulBegin - pxFM->ulFATBegin; i < ulEnd - pxFM->ulFATBegin; ++i) {
+			if (!(pxFM->ulBitmap[i / 32] & (1UL << (i % 32)))) {
+				pxFM->ulBitmap[i / 32] |= 1UL << (i % 32);
+				++pxFM->ulDirty;
+			}
+		}
+		status = prvWriteBlocks(pSD, pucSource, ulSector, ulCount);
+	}
+	xSemaphoreGive(pxFM->xMutex);
+	return status;
+}
+
+/* Copy the marked sectors of the first FAT to the others, in runs of up to
+ffconfigFAT_MIRROR_BATCH_SECTORS. With bClearFlag (at mount, unmount and
+export), then clear the boot sector flag; otherwise it stays set, as more FAT
+writes are likely to follow. Call with the mutex held. */
+static int prvFATMirrorCopy(sd_card_t *pSD, bool bClearFlag) {
+	struct sd_fat_mirror *pxFM = pSD->fat_mirror;
+	int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+	uint8_t *pucBuffer = pvPortMalloc(ffconfigFAT_MIRROR_BATCH_SECTORS * SECTOR_SIZE);
+	if (!pucBuffer) return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;
+	uint32_t i = 0;
+	while (pxFM->ulDirty && i < pxFM->ulSectorsPerFAT) {
+		if (!pxFM->ulBitmap[i / 32]) {
+			i = (i / 32 + 1) * 32;
+			continue;
+		}
+		if (!(pxFM->ulBitmap[i / 32] & (1UL << (i % 32)))) {
+			++i;
+			continue;
+		}
+		/* A run of marked sectors. Unmarked sectors between marked ones
+		are copied too, rather than start another command. */
+		uint32_t ulCount = 1, ulMarked = 1;
+		for (uint32_t j = i + 1; j < pxFM->ulSectorsPerFAT
+				&& j < i + ffconfigFAT_MIRROR_BATCH_SECTORS && ulMarked < pxFM->ulDirty; ++j) {
+			if (pxFM->ulBitmap[j / 32] & (1UL << (j % 32))) {
+				ulCount = j - i + 1;
+				++ulMarked;
+			}
+		}
+		status = sd_read_blocks(pSD, pucBuffer, pxFM->ulFATBegin + i, ulCount);
+		for (uint32_t k = 1; k <= pxFM->ulCopies && SD_BLOCK_DEVICE_ERROR_NONE == status; ++k)
+			status = prvWriteBlocks(pSD, pucBuffer,
+					pxFM->ulFATBegin + k * pxFM->ulSectorsPerFAT + i, ulCount);
+		if (SD_BLOCK_DEVICE_ERROR_NONE != status) break;
+		for (uint32_t j = i; j < i + ulCount; ++j)
+			pxFM->ulBitmap[j / 32] &= ~(1UL << (j % 32));
+		pxFM->ulDirty -= ulMarked;
+		i += ulCount;
+	}
+	vPortFree(pucBuffer);
+	if (SD_BLOCK_DEVICE_ERROR_NONE == status && bClearFlag && !pxFM->ulDirty && pxFM->bFlagSet)
+		status = prvFATMirrorSetFlag(pSD, false);
+	return status;
+}
+
+/* Start tracking the first FAT of a newly mounted volume. If the boot sector
+says the FATs differ, the last session ended without copying them, so copy
+the whole FAT now. */
+static void prvFATMirrorBegin(FF_Disk_t *pxDisk) {
+	sd_card_t *pSD = pxDisk->pvTag;
+	FF_Partition_t *pxPartition = &pxDisk->pxIOManager->xPartition;
+
+	if (pSD->fat_mirror || pxPartition->ucNumFATS < 2) return;
+	size_t xWords = (pxPartition->ulSectorsPerFAT + 31) / 32;
+	struct sd_fat_mirror *pxFM = pvPortMalloc(sizeof(struct sd_fat_mirror) + xWords * sizeof(uint32_t));
+	if (!pxFM) {
+		FF_PRINTF("FF_SDDiskMount: Malloc failed; FAT copies will not be kept\n");
+		return;
+	}
+	memset(pxFM, 0, sizeof(struct sd_fat_mirror) + xWords * sizeof(uint32_t));
+	pxFM->xMutex = xSemaphoreCreateMutex();
+	if (!pxFM->xMutex) {
+		vPortFree(pxFM);
+		return;
+	}
+	pxFM->ulFATBegin = pxPartition->ulFATBeginLBA;
+	pxFM->ulSectorsPerFAT = pxPartition->ulSectorsPerFAT;
+	pxFM->ulCopies = pxPartition->ucNumFATS - 1;
+	pxFM->ulBootSector = pxPartition->ulBeginLBA;
+	pxFM->usFlagsOffset = FF_T_FAT32 == pxPartition->ucType ? FAT32_FLAGS_OFFSET : FAT16_FLAGS_OFFSET;
+	pSD->fat_mirror = pxFM;
+
+	if (SD_BLOCK_DEVICE_ERROR_NONE != sd_read_blocks(pSD, pxFM->ucBootSector, pxFM->ulBootSector, 1))
+		return;
+	if (pxFM->ucBootSector[pxFM->usFlagsOffset] & FLAG_FATS_DIFFER) {
+		FF_PRINTF("%s: FAT copies differ; copying the FAT\n", pSD->pcName);
+		pxFM->bFlagSet = true;
+		for (uint32_t i = 0; i < pxFM->ulSectorsPerFAT; ++i)
+			pxFM->ulBitmap[i / 32] |= 1UL << (i % 32);
+		pxFM->ulDirty = pxFM->ulSectorsPerFAT;
+		xSemaphoreTake(pxFM->xMutex, portMAX_DELAY);
+		if (SD_BLOCK_DEVICE_ERROR_NONE != prvFATMirrorCopy(pSD, true))
+			FF_PRINTF("%s: FAT copy failed\n", pSD->pcName);
+		xSemaphoreGive(pxFM->xMutex);
+	}
+}
+
+// Bring the copies up to date and stop tracking
+static void prvFATMirrorEnd(sd_card_t *pSD) {
+	struct sd_fat_mirror *pxFM = pSD->fat_mirror;
+	if (!pxFM) return;
+	xSemaphoreTake(pxFM->xMutex, portMAX_DELAY);
+	if (SD_BLOCK_DEVICE_ERROR_NONE != prvFATMirrorCopy(pSD, true))
+		FF_PRINTF("%s: FAT copy failed\n", pSD->pcName);
+	pSD->fat_mirror = NULL;
+	xSemaphoreGive(pxFM->xMutex);
+	vSemaphoreDelete(pxFM->xMutex);
+	vPortFree(pxFM);
+}
+
+#endif /* ffconfigFAT_MIRROR */
+
 /* A function to write sectors to the device. */
 static int32_t prvWrite(uint8_t *pucSource, /* Source of data to be written. */
 		uint32_t ulSectorNumber, /* The first sector being written to. */
 		uint32_t ulSectorCount, /* The number of sectors to write. */
 		FF_Disk_t *pxDisk) /* Describes the disk being written to. */
 {
-	int status = sd_write_blocks(pxDisk->pvTag, pucSource, ulSectorNumber, ulSectorCount);
+#if ffconfigFAT_MIRROR
+	int status = prvFATMirrorWrite(pxDisk->pvTag, pucSource, ulSectorNumber, ulSectorCount);
+#else
+	int status = prvWriteBlocks(pxDisk->pvTag, pucSource, ulSectorNumber, ulSectorCount);
+#endif
 	if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
 		return FF_ERR_NONE;
 	} else {
@@ -74,7 +432,11 @@ static int32_t prvRead(uint8_t *pucDestination, /* Destination for data being re
 		uint32_t ulSectorCount, /* Number of sectors to read. */
 		FF_Disk_t *pxDisk) /* Describes the disk being read from. */
 {
+#if ffconfigREAD_AHEAD_MAX_SECTORS > 0
+	int status = prvReadAhead(pxDisk->pvTag, pucDestination, ulSectorNumber, ulSectorCount);
+#else
 	int status = sd_read_blocks(pxDisk->pvTag, pucDestination, ulSectorNumber, ulSectorCount);
+#endif
 	if (SD_BLOCK_DEVICE_ERROR_NONE == status) {
 		return FF_ERR_NONE;
 	} else {
@@ -82,6 +444,41 @@ static int32_t prvRead(uint8_t *pucDestination, /* Destination for data being re
 	}
 }
 
+FF_Error_t FF_SDDiskMirrorFATs(FF_Disk_t *pxDisk, TickType_t xMinAge) {
+#if ffconfigFAT_MIRROR
+	sd_card_t *pSD = pxDisk->pvTag;
+	struct sd_fat_mirror *pxFM = pSD->fat_mirror;
+	int status = SD_BLOCK_DEVICE_ERROR_NONE;
+
+	if (!pxFM) return FF_ERR_NONE;
+	xSemaphoreTake(pxFM->xMutex, portMAX_DELAY);
+	if (!xMinAge ? pxFM->ulDirty || pxFM->bFlagSet
+			: pxFM->ulDirty && xTaskGetTickCount() - pxFM->xDirtySince >= xMinAge)
+		status = prvFATMirrorCopy(pSD, !xMinAge);
+	xSemaphoreGive(pxFM->xMutex);
+	if (SD_BLOCK_DEVICE_ERROR_NONE != status)
+		return FF_ERR_IOMAN_DRIVER_FATAL_ERROR | FF_ERRFLAG;
+#else
+	(void)pxDisk;
+	(void)xMinAge;
+#endif
+	return FF_ERR_NONE;
+}
+
+void FF_SDDiskReadAheadInvalidate(FF_Disk_t *pxDisk, uint32_t ulSector, uint32_t ulCount) {
+#if ffconfigREAD_AHEAD_MAX_SECTORS > 0
+	sd_card_t *pSD = pxDisk->pvTag;
+	if (!pSD->read_ahead) return;
+	xSemaphoreTake(pSD->read_ahead->xMutex, portMAX_DELAY);
+	prvReadAheadDrop(pSD->read_ahead, ulSector, ulCount);
+	xSemaphoreGive(pSD->read_ahead->xMutex);
+#else
+	(void)pxDisk;
+	(void)ulSector;
+	(void)ulCount;
+#endif
+}
+
 BaseType_t FF_SDDiskDetect(FF_Disk_t *pxDisk) {
 	if (!pxDisk)
 		return false;
@@ -102,6 +499,16 @@ static bool disk_init(sd_card_t *pSD) {
 		// Couldn't init
 		return false;
 	}    
+#if ffconfigREAD_AHEAD_MAX_SECTORS > 0
+	// Anything staged may be from a different card
+	if (pSD->read_ahead) {
+		xSemaphoreTake(pSD->read_ahead->xMutex, portMAX_DELAY);
+		prvReadAheadDrop(pSD->read_ahead, 0, UINT32_MAX);
+		xSemaphoreGive(pSD->read_ahead->xMutex);
+	} else if (!prvReadAheadInit(pSD)) {
+		return false;
+	}
+#endif
 	// This logic needs to change in order to support multiple partitions per card:
 	if ((pSD->ff_disk_count)
 		&& (pSD->ff_disks)
@@ -189,6 +596,9 @@ BaseType_t FF_SDDiskUnmount(FF_Disk_t *pDisk) {
         FF_PRINTF("FF_Unmount error: %s\n", FF_GetErrMessage(e));
     } else {
         pDisk->xStatus.bIsMounted = pdFALSE;
+#if ffconfigFAT_MIRROR
+        prvFATMirrorEnd(pDisk->pvTag);
+#endif
     }
     return e;
 }
@@ -203,6 +613,9 @@ BaseType_t FF_SDDiskMount(FF_Disk_t *pDisk) {
         FF_PRINTF("FF_Mount error: %s\n", FF_GetErrMessage(e));
     } else {
         pDisk->xStatus.bIsMounted = pdTRUE;
+#if ffconfigFAT_MIRROR
+        prvFATMirrorBegin(pDisk);
+#endif
     }
     return e;
 }
@@ -210,6 +623,9 @@ BaseType_t FF_SDDiskMount(FF_Disk_t *pDisk) {
 BaseType_t FF_SDDiskDelete(FF_Disk_t *pxDisk) {
 	if (pxDisk) {
 		if (pxDisk->pvTag) {
+#if ffconfigFAT_MIRROR
+			prvFATMirrorEnd(pxDisk->pvTag);
+#endif
 			sd_card_deinit(pxDisk->pvTag);                    
 		}
 		if (pxDisk->xStatus.bIsInitialised) {
@@ -225,6 +641,9 @@ BaseType_t FF_SDDiskDelete(FF_Disk_t *pxDisk) {
 		if (pSD->ff_disk_count == 1) {
 			configASSERT(pSD->ff_disks);
 			vPortFree( pSD->ff_disks);
+#if ffconfigREAD_AHEAD_MAX_SECTORS > 0
+			prvReadAheadDelete(pSD);
+#endif
 		}
 		pSD->ff_disk_count--;
 	}
@@ -288,11 +707,51 @@ BaseType_t FF_SDDiskShowPartition(FF_Disk_t *pxDisk) {
 		FF_PRINTF("SecsPerCluster %8lu\n", (unsigned long)pxIOManager->xPartition.ulSectorsPerCluster);
 		FF_PRINTF("Size           %8lu KB\n", (unsigned long)ulTotalSizeKB);
 		FF_PRINTF("FreeSize       %8lu KB ( %d perc free )\n", (unsigned long)ulFreeSizeKB, iPercentageFree);
+#if ffconfigFAT_MIRROR
+		sd_card_t *pSD = pxDisk->pvTag;
+		if (pSD->fat_mirror)
+			FF_PRINTF("FAT to copy    %8lu sectors\n", (unsigned long)pSD->fat_mirror->ulDirty);
+#endif
 	}
 
 	return xReturn;
 }
 
+/* Show read-ahead statistics since they were last shown */
+BaseType_t FF_SDDiskShowReadAheadStats(FF_Disk_t *pxDisk) {
+#if ffconfigREAD_AHEAD_MAX_SECTORS > 0
+	sd_card_t *pSD = pxDisk ? pxDisk->pvTag : NULL;
+	if (!pSD || !pSD->read_ahead) return pdFAIL;
+	struct sd_read_ahead *pxRA = pSD->read_ahead;
+
+	xSemaphoreTake(pxRA->xMutex, portMAX_DELAY);
+	read_ahead_stats_t xStats = pxRA->xStats;
+	uint32_t ulWindows[ffconfigREAD_AHEAD_STREAMS];
+	for (size_t i = 0; i < ffconfigREAD_AHEAD_STREAMS; ++i)
+		ulWindows[i] = pxRA->xStreams[i].ulWindow;
+	memset(&pxRA->xStats, 0, sizeof pxRA->xStats);
+	xSemaphoreGive(pxRA->xMutex);
+
+	uint32_t ulSectors = xStats.ulHitSectors + xStats.ulMissSectors;
+	FF_PRINTF("Reads          %8lu\n", (unsigned long)xStats.ulReads);
+	FF_PRINTF("Card commands  %8lu\n", (unsigned long)xStats.ulCommands);
+	FF_PRINTF("Hit sectors    %8lu (%lu%%)\n", (unsigned long)xStats.ulHitSectors,
+			ulSectors ? (unsigned long)(HUNDRED_64_BIT * xStats.ulHitSectors / ulSectors) : 0UL);
+	FF_PRINTF("Miss sectors   %8lu\n", (unsigned long)xStats.ulMissSectors);
+	FF_PRINTF("Prefetched     %8lu\n", (unsigned long)xStats.ulPrefetched);
+	FF_PRINTF("Dropped        %8lu\n", (unsigned long)xStats.ulDropped);
+	FF_PRINTF("Max window     %8lu of %u\n", (unsigned long)xStats.ulMaxWindow,
+			ffconfigREAD_AHEAD_MAX_SECTORS);
+	for (size_t i = 0; i < ffconfigREAD_AHEAD_STREAMS; ++i)
+		FF_PRINTF("Stream %u window %6lu\n", (unsigned)i, (unsigned long)ulWindows[i]);
+	return pdPASS;
+#else
+	(void)pxDisk;
+	FF_PRINTF("Read-ahead is disabled (ffconfigREAD_AHEAD_MAX_SECTORS)\n");
+	return pdFAIL;
+#endif
+}
+
 /* Flush changes from the driver's buf to disk */
 void FF_SDDiskFlush( FF_Disk_t *pDisk ) {
 	FF_FlushCache(pDisk->pxIOManager);
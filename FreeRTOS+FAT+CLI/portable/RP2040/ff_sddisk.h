@@ -69,6 +69,19 @@ BaseType_t FF_SDDiskDelete( FF_Disk_t *pDisk );
 /* Show some partition information */
 BaseType_t FF_SDDiskShowPartition( FF_Disk_t *pDisk );
 
+/* Show read-ahead statistics since they were last shown */
+BaseType_t FF_SDDiskShowReadAheadStats( FF_Disk_t *pxDisk );
+
+/* Drop anything read ahead from the given sectors. Needed by anything that
+writes to the card other than through the IOManager. */
+void FF_SDDiskReadAheadInvalidate( FF_Disk_t *pxDisk, uint32_t ulSector, uint32_t ulCount );
+
+/* Copy the sectors of the first FAT written since they were last copied to
+the other FATs, if the oldest of them was written at least xMinAge ticks ago
+(see ffconfigFAT_MIRROR). With xMinAge 0, copy whatever there is and clear
+the boot sector flag too, as before handing the volume to a host. */
+FF_Error_t FF_SDDiskMirrorFATs( FF_Disk_t *pxDisk, TickType_t xMinAge );
+
 /* Flush changes from the driver's buf to disk */
 void FF_SDDiskFlush( FF_Disk_t *pDisk );
 
@@ -163,6 +163,7 @@ specific language governing permissions and limitations under the License.
 #include <inttypes.h>
 #include <string.h>
 //
+#include "hardware/timer.h"
 #include "pico/mutex.h"
 //
 #include "hw_config.h"  // Hardware Configuration of the SPI and SD Card "objects"
@@ -330,6 +331,12 @@ static uint8_t sd_cmd_spi(sd_card_t *pSD, cmdSupported cmd, uint32_t arg) {
     return response;
 }
 
+#if SD_IO_STATS
+#define SD_STAT_INC(pSD, field) (++(pSD)->io_stats.field)
+#else
+#define SD_STAT_INC(pSD, field)
+#endif
+
 static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
     char resp;
 
@@ -338,10 +345,19 @@ static bool sd_wait_ready(sd_card_t *pSD, int timeout) {
 
     TickType_t xStart = xTaskGetTickCount();
 
-    do {
-        resp = sd_spi_write(pSD, 0xFF);
-    } while (resp == 0x00 &&
-             (xTaskGetTickCount() - xStart) < pdMS_TO_TICKS(timeout));
+    resp = sd_spi_write(pSD, 0xFF);
+    if (resp == 0x00) {
+#if SD_IO_STATS
+        uint64_t ullBusyStart = time_us_64();
+#endif
+        do {
+            resp = sd_spi_write(pSD, 0xFF);
+        } while (resp == 0x00 &&
+                 (xTaskGetTickCount() - xStart) < pdMS_TO_TICKS(timeout));
+#if SD_IO_STATS
+        pSD->io_stats.ullBusyUs += time_us_64() - ullBusyStart;
+#endif
+    }
 
     if (resp == 0x00) DBG_PRINTF("%s failed\r\n", __FUNCTION__);
 
@@ -438,6 +454,14 @@ static const char *cmd2str(const cmdSupported cmd) {
 
 
 #define SD_COMMAND_TIMEOUT 2000 /*!< Timeout in ms for response */
+/* Upper limits of read access time and write busy time for SDHC and SDXC
+cards, in ms (Physical Layer Simplified Specification, 4.6.2). Waiting longer
+only turns a lost token into a stall. */
+#define SD_READ_TIMEOUT 100
+#define SD_WRITE_TIMEOUT 500
+/* Transient errors (a CRC error, a lost response or token, a rejected block)
+are retried this many times, from the start of the transfer */
+#define SD_IO_RETRIES 3
 
 static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
                   bool isAcmd, uint32_t *resp) {
@@ -466,6 +490,7 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
         }
         // Send command over SPI interface
         response = sd_cmd_spi(pSD, cmd, arg);
+        SD_STAT_INC(pSD, ulCommands);
         if (R1_NO_RESPONSE == response) {
             DBG_PRINTF("No response CMD:%d\r\n", cmd);
             continue;
@@ -480,10 +505,12 @@ static int sd_cmd(sd_card_t *pSD, const cmdSupported cmd, uint32_t arg,
     if (R1_NO_RESPONSE == response) {
         DBG_PRINTF("No response CMD:%d response: 0x%" PRIx32 "\r\n", cmd,
                    response);
+        SD_STAT_INC(pSD, ulNoResponse);
         return SD_BLOCK_DEVICE_ERROR_NO_DEVICE;  // No device
     }
     if (response & R1_COM_CRC_ERROR && ACMD23_SET_WR_BLK_ERASE_COUNT != cmd) {
         DBG_PRINTF("CRC error CMD:%d response 0x%" PRIx32 "\r\n", cmd, response);
+        SD_STAT_INC(pSD, ulCRCErrors);
         return SD_BLOCK_DEVICE_ERROR_CRC;  // CRC error
     }
     if (response & R1_ILLEGAL_COMMAND) {
@@ -753,12 +780,18 @@ uint64_t sd_sectors(sd_card_t *pSD) {
 static bool sd_wait_token(sd_card_t *pSD, uint8_t token) {
     TRACE_PRINTF("%s(0x%02hhx)\r\n", __FUNCTION__, token);
 
-    const uint32_t timeout = SD_COMMAND_TIMEOUT;  // Wait for start token
+    const uint32_t timeout = SD_READ_TIMEOUT;  // Wait for start token
     TickType_t xStart = xTaskGetTickCount();
     do {
-        if (token == sd_spi_write(pSD, SPI_FILL_CHAR)) {
+        uint8_t resp = sd_spi_write(pSD, SPI_FILL_CHAR);
+        if (token == resp) {
             return true;
         }
+        // A Data Error Token instead: no point waiting on
+        if (resp && !(resp & ~SPI_DATA_READ_ERROR_MASK)) {
+            DBG_PRINTF("sd_wait_token: data error token 0x%02hhx\r\n", resp);
+            return false;
+        }
     } while ((xTaskGetTickCount() - xStart) < pdMS_TO_TICKS(timeout));
     DBG_PRINTF("sd_wait_token: timeout\r\n");
     return false;
@@ -805,6 +838,7 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
     // read until start byte (0xFE)
     if (false == sd_wait_token(pSD, SPI_START_BLOCK)) {
         DBG_PRINTF("%s:%d Read timeout\r\n", __FILE__, __LINE__);
+        SD_STAT_INC(pSD, ulNoResponse);
         return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
     }
     // read data
@@ -825,6 +859,7 @@ static int sd_read_block(sd_card_t *pSD, uint8_t *buffer, uint32_t length) {
             DBG_PRINTF("%s: Invalid CRC received 0x%" PRIx16
                        " result of computation 0x%" PRIx16 "\r\n",
                        __FUNCTION__, crc, (uint16_t)crc_result);
+            SD_STAT_INC(pSD, ulCRCErrors);
             return SD_BLOCK_DEVICE_ERROR_CRC;
         }
     }
@@ -878,12 +913,61 @@ static int in_sd_read_blocks(sd_card_t *pSD, uint8_t *buffer,
     return rd_status ? rd_status : status;
 }
 
+static bool sd_retryable(int status) {
+    switch (status) {
+        case SD_BLOCK_DEVICE_ERROR_CRC:
+        case SD_BLOCK_DEVICE_ERROR_NO_RESPONSE:
+        case SD_BLOCK_DEVICE_ERROR_NO_DEVICE:
+        case SD_BLOCK_DEVICE_ERROR_WRITE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+#if SD_IO_STATS
+// Called with the card locked
+static void sd_io_account(sd_card_t *pSD, sd_io_op_t op, uint64_t ulSectorNumber,
+                          uint32_t ulSectorCount, uint64_t ullStart,
+                          int status) {
+    sd_io_op_stats_t *pxOp = &pSD->io_stats.xOps[op];
+    uint64_t ullUs = time_us_64() - ullStart;
+    uint32_t ulUs = ullUs > UINT32_MAX ? UINT32_MAX : (uint32_t)ullUs;
+    ++pxOp->ulOps;
+    if (status) ++pxOp->ulErrors;
+    pxOp->ullBlocks += ulSectorCount;
+    if (!pxOp->xLatency.ulCount || ulUs > pxOp->xLatency.ulMaxUs)
+        pxOp->ullMaxLBA = ulSectorNumber;
+    lat_hist_add(&pxOp->xLatency, ulUs);
+}
+void sd_get_io_stats(sd_card_t *pSD, sd_io_stats_t *pxStats) {
+    // Until the card is first initialized, nothing else touches the stats
+    if (pSD->mutex) sd_lock(pSD);
+    *pxStats = pSD->io_stats;
+    if (pSD->mutex) sd_unlock(pSD);
+}
+#define SD_IO_START() uint64_t ullIoStart = time_us_64()
+#define SD_IO_END(pSD, op, ulSectorNumber, ulSectorCount, status) \
+    sd_io_account(pSD, op, ulSectorNumber, ulSectorCount, ullIoStart, status)
+#else
+#define SD_IO_START()
+#define SD_IO_END(pSD, op, ulSectorNumber, ulSectorCount, status)
+#endif
+
 int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount) {
     sd_acquire(pSD);
+    SD_IO_START();
     TRACE_PRINTF("sd_read_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, ulSectorCount);
     int status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    for (int i = 0; i < SD_IO_RETRIES && sd_retryable(status); ++i) {
+        DBG_PRINTF("%s: retrying after %d\r\n", __FUNCTION__, status);
+        SD_STAT_INC(pSD, ulRetries);
+        sd_spi_deselect_pulse(pSD);
+        status = in_sd_read_blocks(pSD, buffer, ulSectorNumber, ulSectorCount);
+    }
+    SD_IO_END(pSD, SD_IO_READ, ulSectorNumber, ulSectorCount, status);
     sd_release(pSD);
     return status;
 }
@@ -915,7 +999,7 @@ static uint8_t sd_write_block(sd_card_t *pSD, const uint8_t *buffer,
     response = sd_spi_write(pSD, SPI_FILL_CHAR);
 
     // Wait for last block to be written
-    if (false == sd_wait_ready(pSD, SD_COMMAND_TIMEOUT)) {
+    if (false == sd_wait_ready(pSD, SD_WRITE_TIMEOUT)) {
         DBG_PRINTF("%s:%d: Card not ready yet\r\n", __FILE__, __LINE__);
     }
     return (response & SPI_DATA_RESPONSE_MASK);
@@ -1000,20 +1084,131 @@ static int in_sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
     uint32_t stat = 0;
     // Some SD cards want to be deselected between every bus transaction:
     sd_spi_deselect_pulse(pSD);
-    status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
-    return status;
+    // Don't let the status hide a block that was rejected
+    int st_status = sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+    return status ? status : st_status;
 }
 
 int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
                     uint64_t ulSectorNumber, uint32_t blockCnt) {
     sd_acquire(pSD);
+    SD_IO_START();
     TRACE_PRINTF("sd_write_blocks(0x%p, 0x%llx, 0x%lx)\r\n", buffer,
                  ulSectorNumber, blockCnt);
     int status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    for (int i = 0; i < SD_IO_RETRIES && sd_retryable(status); ++i) {
+        DBG_PRINTF("%s: retrying after %d\r\n", __FUNCTION__, status);
+        SD_STAT_INC(pSD, ulRetries);
+        sd_spi_deselect_pulse(pSD);
+        status = in_sd_write_blocks(pSD, buffer, ulSectorNumber, blockCnt);
+    }
+    SD_IO_END(pSD, SD_IO_WRITE, ulSectorNumber, blockCnt, status);
+    sd_release(pSD);
+    return status;
+}
+
+/* Allocation Unit sizes in KB, indexed by the AU_SIZE field of the SD Status
+ * register (Physical Layer Simplified Specification, Table 4-47) */
+static const uint32_t au_size_kb[16] = {0,     16,    32,    64,   128,  256,
+                                        512,   1024,  2048,  4096, 8192, 12288,
+                                        16384, 24576, 32768, 65536};
+
+// Returns the AU size in sectors, or 0 if the card doesn't report one.
+static uint32_t sd_au_sectors_nolock(sd_card_t *pSD) {
+    uint32_t response;
+    // ACMD13, Response R2 (R1 byte + status byte) + 64-byte block read
+    if (sd_cmd(pSD, ACMD13_SD_STATUS, 0x0, true, &response) !=
+        SD_BLOCK_DEVICE_ERROR_NONE) {
+        DBG_PRINTF("Didn't get a response to ACMD13\r\n");
+        return 0;
+    }
+    uint8_t sd_status[64];
+    if (sd_read_bytes(pSD, sd_status, sizeof sd_status) != 0) {
+        DBG_PRINTF("Couldn't read SD Status\r\n");
+        return 0;
+    }
+    // AU_SIZE: sd_status[431:428]
+    uint8_t au_size = sd_status[(511 - 431) / 8] >> 4;
+    uint32_t au_kb = au_size_kb[au_size];
+    DBG_PRINTF("AU size: %" PRIu32 " KB\r\n", au_kb);
+    return au_kb * 2;
+}
+
+// Worst case erase time per AU, if the card doesn't say otherwise
+#define SD_ERASE_TIMEOUT_PER_AU 250 /*!< ms */
+
+/** Erase a range of blocks
+ *
+ *  After erasing, the blocks read back as all pSD->erased_byte.
+ *
+ *  @param ulSectorNumber     Logical Address of first block to erase (LBA)
+ *  @param ulSectorCount      Number of blocks to erase
+ *  @return         SD_BLOCK_DEVICE_ERROR_NONE(0) - success
+ *                  SD_BLOCK_DEVICE_ERROR_PARAMETER - invalid parameter
+ *                  SD_BLOCK_DEVICE_ERROR_ERASE - erase error
+ *                  SD_BLOCK_DEVICE_ERROR_NO_RESPONSE - erase timed out
+ */
+static int in_sd_erase_blocks(sd_card_t *pSD, uint64_t ulSectorNumber,
+                              uint32_t ulSectorCount) {
+    if (!ulSectorCount || ulSectorNumber + ulSectorCount > pSD->sectors)
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+    if (pSD->m_Status & (STA_NOINIT | STA_NODISK))
+        return SD_BLOCK_DEVICE_ERROR_PARAMETER;
+
+    int status;
+    uint64_t start = ulSectorNumber, end = ulSectorNumber + ulSectorCount - 1;
+    // SDSC Card (CCS=0) uses byte unit address
+    // SDHC and SDXC Cards (CCS=1) use block unit address (512 Bytes unit)
+    if (SDCARD_V2HC != pSD->card_type) {
+        start *= _block_size;
+        end *= _block_size;
+    }
+    status = sd_cmd(pSD, CMD32_ERASE_WR_BLK_START_ADDR, start, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    status = sd_cmd(pSD, CMD33_ERASE_WR_BLK_END_ADDR, end, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+    status = sd_cmd(pSD, CMD38_ERASE, 0, false, 0);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) return status;
+
+    // CMD38 is R1b, but a large erase can stay busy for much longer than
+    // SD_COMMAND_TIMEOUT
+    uint32_t au = pSD->au_sectors ? pSD->au_sectors : 8192;
+    uint32_t timeout = SD_COMMAND_TIMEOUT +
+                       (ulSectorCount / au + 1) * SD_ERASE_TIMEOUT_PER_AU;
+    if (!sd_wait_ready(pSD, timeout)) return SD_BLOCK_DEVICE_ERROR_NO_RESPONSE;
+
+    uint32_t stat = 0;
+    sd_spi_deselect_pulse(pSD);
+    return sd_cmd(pSD, CMD13_SEND_STATUS, 0, false, &stat);
+}
+
+int sd_erase_blocks(sd_card_t *pSD, uint64_t ulSectorNumber,
+                    uint32_t ulSectorCount) {
+    sd_acquire(pSD);
+    SD_IO_START();
+    TRACE_PRINTF("sd_erase_blocks(0x%llx, 0x%lx)\r\n", ulSectorNumber,
+                 ulSectorCount);
+    int status = in_sd_erase_blocks(pSD, ulSectorNumber, ulSectorCount);
+    SD_IO_END(pSD, SD_IO_ERASE, ulSectorNumber, ulSectorCount, status);
     sd_release(pSD);
     return status;
 }
 
+// Returns the contents of erased blocks: 0x00 or 0xFF.
+static uint8_t sd_erased_byte_nolock(sd_card_t *pSD) {
+    // ACMD51, Response R1 + 8-byte block read
+    uint8_t scr[8];
+    if (sd_cmd(pSD, ACMD51_SEND_SCR, 0x0, true, 0) !=
+            SD_BLOCK_DEVICE_ERROR_NONE ||
+        sd_read_bytes(pSD, scr, sizeof scr) != 0) {
+        DBG_PRINTF("Couldn't read SCR\r\n");
+        // Assume the worst: erased blocks can't stand in for zeroed ones
+        return 0xFF;
+    }
+    // DATA_STAT_AFTER_ERASE: scr[55]
+    return (scr[(63 - 55) / 8] & 0x80) ? 0xFF : 0x00;
+}
+
 static int sd_init_card2(sd_card_t *pSD) {
     int32_t status = SD_BLOCK_DEVICE_ERROR_NONE;
     uint32_t response, arg;
@@ -1173,6 +1368,10 @@ int sd_init_card(sd_card_t *pSD) {
     // Set SCK for data transfer
     sd_spi_go_high_frequency(pSD);
 
+    // Used for aligning the file system layout. Not supported by v1.x cards.
+    pSD->au_sectors = SDCARD_V1 == pSD->card_type ? 0 : sd_au_sectors_nolock(pSD);
+    pSD->erased_byte = sd_erased_byte_nolock(pSD);
+
     // The card is now initialized
     pSD->m_Status &= ~STA_NOINIT;
 
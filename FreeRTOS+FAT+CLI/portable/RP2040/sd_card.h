@@ -27,12 +27,38 @@ specific language governing permissions and limitations under the License.
 #include "hardware/gpio.h"
 //
 #include "ff_headers.h"
+#include "lat_hist.h"
 #include "spi.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Count the driver's I/O: operations, commands, errors and latencies. Define
+as 0 to compile it out. */
+#ifndef SD_IO_STATS
+#define SD_IO_STATS 1
+#endif
+
+typedef enum { SD_IO_READ, SD_IO_WRITE, SD_IO_ERASE, SD_IO_OP_TYPES } sd_io_op_t;
+
+typedef struct {
+    uint32_t ulOps;
+    uint32_t ulErrors;     // Operations that failed, after any retries
+    uint64_t ullBlocks;
+    uint64_t ullMaxLBA;    // Where the slowest operation started
+    lat_hist_t xLatency;   // Of whole operations, retries included
+} sd_io_op_stats_t;
+
+typedef struct {
+    uint32_t ulCommands;
+    uint32_t ulRetries;    // Of whole operations
+    uint32_t ulCRCErrors;  // In command responses and read blocks
+    uint32_t ulNoResponse; // Commands unanswered, and data tokens never seen
+    uint64_t ullBusyUs;    // Waiting for the card to be ready
+    sd_io_op_stats_t xOps[SD_IO_OP_TYPES];
+} sd_io_stats_t;
+
 // "Class" representing SD Cards
 typedef struct {
     const char *pcName;
@@ -47,10 +73,18 @@ typedef struct {
     int m_Status;                                    // Card status
     uint64_t sectors;                                // Assigned dynamically
     int card_type;                                   // Assigned dynamically
+    uint32_t au_sectors;  // Allocation Unit size, 0 if unknown; assigned dynamically
+    uint8_t erased_byte;  // Contents of erased sectors (0x00 or 0xFF); assigned dynamically
     SemaphoreHandle_t mutex;  // Guard semaphore, assigned dynamically
     TaskHandle_t owner;       // Assigned dynamically
     size_t ff_disk_count;
     FF_Disk_t **ff_disks;  // FreeRTOS+FAT "disks" using this device
+    struct sd_read_ahead *read_ahead;  // ff_sddisk.c's state, assigned dynamically
+    struct sd_fat_mirror *fat_mirror;  // Likewise, while mounted
+    bool write_protect;  // Refuse FreeRTOS+FAT's writes, e.g. while a USB host reads the card
+#if SD_IO_STATS
+    sd_io_stats_t io_stats;  // Since boot
+#endif
 } sd_card_t;
 
 #define SD_BLOCK_DEVICE_ERROR_NONE 0
@@ -84,8 +118,14 @@ int sd_write_blocks(sd_card_t *pSD, const uint8_t *buffer,
                     uint64_t ulSectorNumber, uint32_t blockCnt);
 int sd_read_blocks(sd_card_t *pSD, uint8_t *buffer, uint64_t ulSectorNumber,
                    uint32_t ulSectorCount);
+int sd_erase_blocks(sd_card_t *pSD, uint64_t ulSectorNumber,
+                    uint32_t ulSectorCount);
 bool sd_card_detect(sd_card_t *pSD);
 uint64_t sd_sectors(sd_card_t *pSD);
+#if SD_IO_STATS
+// A consistent copy of the card's I/O statistics
+void sd_get_io_stats(sd_card_t *pSD, sd_io_stats_t *pxStats);
+#endif
 
 #ifdef __cplusplus
 }
@@ -81,6 +81,7 @@ specific language governing permissions and limitations under the License.
 */
 
 /* Standard includes. */
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -92,6 +93,7 @@ specific language governing permissions and limitations under the License.
 #include <malloc.h> // mallinfo2
 //
 #include "hardware/rtc.h"
+#include "hardware/timer.h"
 #include "pico/util/datetime.h"
 
 /* FreeRTOS includes. */
@@ -731,6 +733,149 @@ static const CLI_Command_Definition_t xDiskInfo = {
     1         /* One parameter is expected. */
 };
 /*-----------------------------------------------------------*/
+static BaseType_t raStats(char *pcWriteBuffer, size_t xWriteBufferLen,
+                          const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    const char *pcParameter;
+    BaseType_t xParameterStringLength;
+
+    /* Obtain the parameter string. */
+    pcParameter = FreeRTOS_CLIGetParameter(
+        pcCommandString,        /* The command string itself. */
+        1,                      /* Return the first parameter. */
+        &xParameterStringLength /* Store the parameter string length. */
+    );
+
+    /* Sanity check something was returned. */
+    configASSERT(pcParameter);
+
+    sd_card_t *sd = sd_get_by_name(pcParameter);
+    if (!sd) return pdFALSE;
+    if (sd->ff_disk_count && sd->ff_disks[0])
+        FF_SDDiskShowReadAheadStats(sd->ff_disks[0]);
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xRAStats = {
+    "rastats", /* The command string to type. */
+    "\nrastats <device name>:\n Print read-ahead statistics since last "
+    "shown\n"
+    "\te.g.: \"rastats sd0\"\n",
+    raStats, /* The function to run. */
+    1        /* One parameter is expected. */
+};
+/*-----------------------------------------------------------*/
+#if SD_IO_STATS
+static const char *const pcIOOps[SD_IO_OP_TYPES] = {"read", "write", "erase"};
+
+// The maximum's LBA is only known for an interval that set a new maximum
+#define IOSTAT_LBA_UNKNOWN UINT64_MAX
+
+static void subIOStats(sd_io_stats_t *pxStats, const sd_io_stats_t *pxOld) {
+    pxStats->ulCommands -= pxOld->ulCommands;
+    pxStats->ulRetries -= pxOld->ulRetries;
+    pxStats->ulCRCErrors -= pxOld->ulCRCErrors;
+    pxStats->ulNoResponse -= pxOld->ulNoResponse;
+    pxStats->ullBusyUs -= pxOld->ullBusyUs;
+    for (size_t i = 0; i < SD_IO_OP_TYPES; ++i) {
+        sd_io_op_stats_t *pxOp = &pxStats->xOps[i];
+        const sd_io_op_stats_t *pxOldOp = &pxOld->xOps[i];
+        if (pxOp->xLatency.ulMaxUs <= pxOldOp->xLatency.ulMaxUs)
+            pxOp->ullMaxLBA = IOSTAT_LBA_UNKNOWN;
+        pxOp->ulOps -= pxOldOp->ulOps;
+        pxOp->ulErrors -= pxOldOp->ulErrors;
+        pxOp->ullBlocks -= pxOldOp->ullBlocks;
+        lat_hist_sub(&pxOp->xLatency, &pxOldOp->xLatency);
+    }
+}
+static void printIOStats(const sd_io_stats_t *pxStats, uint64_t ullUs) {
+    printf("%" PRIu32 " commands, %" PRIu32 " retries, %" PRIu32
+           " CRC errors, %" PRIu32 " no response, %" PRIu64
+           " ms busy in %" PRIu64 " ms\n",
+           pxStats->ulCommands, pxStats->ulRetries, pxStats->ulCRCErrors,
+           pxStats->ulNoResponse, pxStats->ullBusyUs / 1000, ullUs / 1000);
+    printf("op         ops  errors        KiB    KiB/s  mean us   p50 us   "
+           "p99 us   max us  max LBA\n");
+    for (size_t i = 0; i < SD_IO_OP_TYPES; ++i) {
+        const sd_io_op_stats_t *pxOp = &pxStats->xOps[i];
+        const lat_hist_t *pxLat = &pxOp->xLatency;
+        uint64_t ullKiB = pxOp->ullBlocks / 2;
+        char lba[24] = "-";
+        if (pxOp->ulOps && IOSTAT_LBA_UNKNOWN != pxOp->ullMaxLBA)
+            snprintf(lba, sizeof lba, "%" PRIu64, pxOp->ullMaxLBA);
+        printf("%-5s %9" PRIu32 " %7" PRIu32 " %10" PRIu64 " %8" PRIu64
+               " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "  %s\n",
+               pcIOOps[i], pxOp->ulOps, pxOp->ulErrors, ullKiB,
+               ullUs ? ullKiB * 1000000 / ullUs : 0, lat_hist_mean(pxLat),
+               lat_hist_percentile(pxLat, 500), lat_hist_percentile(pxLat, 990),
+               pxLat->ulMaxUs, lba);
+    }
+}
+static BaseType_t ioStats(char *pcWriteBuffer, size_t xWriteBufferLen,
+                          const char *pcCommandString) {
+    const char *pcParameter;
+    BaseType_t xParameterStringLength;
+
+    /* Obtain the parameter string. */
+    pcParameter = FreeRTOS_CLIGetParameter(
+        pcCommandString,        /* The command string itself. */
+        1,                      /* Return the first parameter. */
+        &xParameterStringLength /* Store the parameter string length. */
+    );
+    if (!pcParameter) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                 "Usage: iostat <device name> [interval [count]]\n");
+        return pdFALSE;
+    }
+    char name[16];
+    snprintf(name, sizeof name, "%.*s", (int)xParameterStringLength,
+             pcParameter);
+    sd_card_t *sd = sd_get_by_name(name);
+    if (!sd) {
+        snprintf(pcWriteBuffer, xWriteBufferLen, "Unknown device: %s\n", name);
+        return pdFALSE;
+    }
+    int interval = 0, count = 10;
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2,
+                                           &xParameterStringLength);
+    if (pcParameter) interval = atoi(pcParameter);
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 3,
+                                           &xParameterStringLength);
+    if (pcParameter) count = atoi(pcParameter);
+
+    // Too big for the CLI task's stack
+    static sd_io_stats_t xLast, xNow, xDelta;
+
+    sd_get_io_stats(sd, &xNow);
+    uint64_t ullNow = time_us_64();
+    printf("%s since boot:\n", sd->pcName);
+    printIOStats(&xNow, ullNow);
+
+    for (int i = 0; interval > 0 && i < count; ++i) {
+        xLast = xNow;
+        uint64_t ullLast = ullNow;
+        vTaskDelay(pdMS_TO_TICKS(interval * 1000));
+        sd_get_io_stats(sd, &xNow);
+        ullNow = time_us_64();
+        xDelta = xNow;
+        subIOStats(&xDelta, &xLast);
+        printf("\n%s in the last %d s:\n", sd->pcName, interval);
+        printIOStats(&xDelta, ullNow - ullLast);
+    }
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xIOStats = {
+    "iostat", /* The command string to type. */
+    "\niostat <device name> [interval [count]]:\n"
+    " Print the SD card's I/O statistics since boot; then, if an interval\n"
+    " is given, what changed in each of count (default 10) intervals of\n"
+    " that many seconds\n"
+    "\te.g.: \"iostat sd0 1 5\"\n",
+    ioStats, /* The function to run. */
+    -1       /* The number of parameters is variable. */
+};
+#endif
+/*-----------------------------------------------------------*/
 bool die_now;
 static BaseType_t die_fn(char *pcWriteBuffer, size_t xWriteBufferLen,
                          const char *pcCommandString) {
@@ -1021,6 +1166,10 @@ void vRegisterMyCLICommands(void) {
     /* Register all the command line commands defined immediately above.
      */
     FreeRTOS_CLIRegisterCommand(&xDiskInfo);
+    FreeRTOS_CLIRegisterCommand(&xRAStats);
+#if SD_IO_STATS
+    FreeRTOS_CLIRegisterCommand(&xIOStats);
+#endif
     FreeRTOS_CLIRegisterCommand(&xSetRTC);
     FreeRTOS_CLIRegisterCommand(&xDate);
     FreeRTOS_CLIRegisterCommand(&xDie);
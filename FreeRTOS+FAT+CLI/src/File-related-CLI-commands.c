@@ -88,16 +88,67 @@ specific language governing permissions and limitations under the License.
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* FreeRTOS+CLI includes. */
 #include "FreeRTOS_CLI.h"
+#include "File-related-CLI-commands.h"
+#include "stdio_cli.h"
 
 /* FreeRTOS+FAT includes. */
 #include "ff_headers.h"
 #include "ff_stdio.h"
+#include "ff_copy.h"
+#include "ff_extent_map.h"
+#include "ff_purge.h"
+#include "ff_walk.h"
+#include "ff_xfer.h"
+
+#include "my_debug.h"
 
 #define cliNEW_LINE		"\r"
 
+/* The size of the buffer type reads the file into.  A multiple of the sector
+size, so that, once the reads are sector aligned, whole sectors go straight
+from the card into the buffer. */
+#ifndef cliTYPE_BUFFER_SIZE
+	#define cliTYPE_BUFFER_SIZE		4096
+#endif
+
+/* The bytes on each line of a hex dump, as dump8buf() lays them out. */
+#define cliHEX_DUMP_ROW			32
+
+/* The size of the buffer run reads its script into, so that the card is read
+a buffer (and, with the driver's read-ahead, more) at a time, not a line. */
+#ifndef cliRUN_BUFFER_SIZE
+	#define cliRUN_BUFFER_SIZE		1024
+#endif
+
+/* The lines of a script whose timings run keeps for its summary. */
+#ifndef cliRUN_SUMMARY_LINES
+	#define cliRUN_SUMMARY_LINES	32
+#endif
+
+/* What run passes the output of a script's commands through, to see whether
+they failed: by convention, their failures start a line with one of
+pcRunErrorPrefixes. */
+typedef struct xRUN_OUTPUT
+{
+	CLI_Output_Sink_t *pxOut;
+	char cLine[ 48 ];		/* The start of the line being written. */
+	size_t xLineLength;
+	BaseType_t xFailed;
+	BaseType_t xOutFailed;
+} CLI_Run_Output_t;
+
+/* How long a line of a script took. */
+typedef struct xRUN_TIMING
+{
+	uint32_t ulLine;
+	uint32_t ulMs;
+	char cCommand[ 28 ];
+} CLI_Run_Timing_t;
+
 /*******************************************************************************
  * See the URL in the comments within main.c for the location of the online
  * documentation.
@@ -108,16 +159,10 @@ specific language governing permissions and limitations under the License.
  */
 static void prvCreateFileInfoString( char *pcBuffer, FF_FindData_t *pxFindStruct );
 
-/*
- * Copies an existing file into a newly created file.
- */
-static BaseType_t prvPerformCopy(const char *pcSourceFile, size_t lSourceFileLength, const char *pcDestinationFile,
-		char *pxWriteBuffer, size_t xWriteBufferLen);
-
 /*
  * Implements the DIR command.
  */
-static BaseType_t prvDIRCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prvDIRCommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
 
 /*
  * Implements the CD command.
@@ -137,7 +182,12 @@ static BaseType_t prvRMDIRCommand( char *pcWriteBuffer, size_t xWriteBufferLen,
 /*
  * Implements the TYPE command.
  */
-static BaseType_t prvTYPECommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
+static BaseType_t prvTYPECommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+
+/*
+ * Writes xLength bytes, read from ulOffset in the file, as hex dump lines.
+ */
+static BaseType_t prvHexDump( CLI_Output_Sink_t *pxSink, uint32_t ulOffset, const uint8_t *pucData, size_t xLength );
 
 /*
  * Implements the COPY command.
@@ -154,17 +204,64 @@ static BaseType_t prvRENCommand( char *pcWriteBuffer, size_t xWriteBufferLen, co
  */
 static BaseType_t prvPWDCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 
+/*
+ * Implement the SZ and RZ (send and receive a file) commands.
+ */
+static BaseType_t prvSZCommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+static BaseType_t prvRZCommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+
+/*
+ * Print how a transfer went.
+ */
+static BaseType_t prvPrintXferStats( CLI_Output_Sink_t *pxSink, const char *pcVerb, const FF_XferStats_t *pxStats, TickType_t xTicks );
+
+/*
+ * Implement the DU, FIND and TREE (recursive directory walk) commands.
+ */
+static BaseType_t prvDUCommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+static BaseType_t prvFINDCommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+static BaseType_t prvTREECommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+
+/*
+ * Implements the purge command.
+ */
+static BaseType_t prvPURGECommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+
+/*
+ * Implements the ECHO command.
+ */
+static BaseType_t prvECHOCommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+
+/*
+ * Implements the RUN command, and runs one line of a script for it.
+ */
+static BaseType_t prvRUNCommand( CLI_Output_Sink_t *pxSink, const char *pcCommandString );
+static BaseType_t prvRunLine( CLI_Output_Sink_t *pxSink, const char *pcLine, uint32_t ulLine, CLI_Run_Timing_t *pxTiming );
+
+/*
+ * Reads the path and options the walk commands share.  Returns NULL, or what
+ * is wrong with them.
+ */
+static const char *prvParseWalkOptions( const char *pcCommandString, char *pcPath, char *pcGlob, FF_WalkFilter_t *pxFilter, BaseType_t *pxSummary );
+
+/*
+ * Print how long a walk took, and what it found.
+ */
+static BaseType_t prvPrintWalkStats( CLI_Output_Sink_t *pxSink, const FF_Walk_t *pxWalk, TickType_t xTicks );
+
 /* Structure that defines the DIR command line command, which lists all the
 files in the current directory. */
-static const CLI_Command_Definition_t xDIR =
-{ "dir", /* The command string to type. */
-"\rdir:\r Lists the files in the current directory\r", prvDIRCommand, /* The function to run. */
-	0 /* No parameters are expected. */
+static const CLI_Stream_Command_Definition_t xDIR =
+{ { "dir", /* The command string to type. */
+"\rdir:\r Lists the files in the current directory\r", NULL, /* Streams its output. */
+	0 }, /* No parameters are expected. */
+	prvDIRCommand /* The function to run. */
 };
-static const CLI_Command_Definition_t xLS =
-{ "ls", /* The command string to type. */
-"ls: Alias for \"dir\"\r", prvDIRCommand, /* The function to run. */
-	0 /* No parameters are expected. */
+static const CLI_Stream_Command_Definition_t xLS =
+{ { "ls", /* The command string to type. */
+"ls: Alias for \"dir\"\r", NULL, /* Streams its output. */
+	0 }, /* No parameters are expected. */
+	prvDIRCommand /* The function to run. */
 };
 
 /* Structure that defines the CD command line command, which changes the
@@ -177,10 +274,18 @@ static const CLI_Command_Definition_t xCD =
 
 /* Structure that defines the TYPE command line command, which prints the
 contents of a file to the console. */
-static const CLI_Command_Definition_t xTYPE =
-{ "type", /* The command string to type. */
-"\rtype <filename>:\r Prints file contents to the terminal\r", prvTYPECommand, /* The function to run. */
-	1 /* One parameter is expected. */
+static const CLI_Stream_Command_Definition_t xTYPE =
+{ { "type", /* The command string to type. */
+"\rtype [-x|-b] <filename> [<offset> [<length>]]:\r Prints file contents to the terminal\r"
+" -x: as a hex dump\r -b: as raw binary, with nothing added\r", NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvTYPECommand /* The function to run. */
+};
+static const CLI_Stream_Command_Definition_t xCAT =
+{ { "cat", /* The command string to type. */
+"cat: Alias for \"type\"\r", NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvTYPECommand /* The function to run. */
 };
 
 /* Structure that defines the DEL command line command, which deletes a file. */
@@ -218,80 +323,287 @@ static const CLI_Command_Definition_t xPWD =
 	0 /* No parameters are expected. */
 };
 
+/* Structures that define the SZ and RZ command line commands, which send and
+receive a file over the link given to vRegisterFileTransferCLICommands(). */
+static const CLI_Stream_Command_Definition_t xSZ =
+{ { "sz", /* The command string to type. */
+"\rsz <filename>:\r Sends a file over the console (see example/tools/ffxfer.py)\r", NULL, /* Streams its output. */
+	1 }, /* One parameter is expected. */
+	prvSZCommand /* The function to run. */
+};
+static const CLI_Stream_Command_Definition_t xRZ =
+{ { "rz", /* The command string to type. */
+"\rrz <filename>:\r Receives a file over the console into <filename>\r", NULL, /* Streams its output. */
+	1 }, /* One parameter is expected. */
+	prvRZCommand /* The function to run. */
+};
+
+/* Structures that define the DU, FIND and TREE command line commands, which
+walk the tree under a directory. */
+#define cliWALK_OPTIONS_HELP \
+" -name <glob>: names matching <glob> (with * and ?)\r" \
+" -type f|d: files, or directories\r" \
+" -size [+|-]<n>[k|M]: over, under or exactly <n> bytes\r" \
+" -mtime [+|-]<days>: modified over, under or exactly <days> days ago\r"
+static const CLI_Stream_Command_Definition_t xDU =
+{ { "du", /* The command string to type. */
+"\rdu [-s] [<dir>] [<options>]:\r Shows the space used by the files under each directory in <dir>, in KiB\r"
+" -s: only the total\r" cliWALK_OPTIONS_HELP, NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvDUCommand /* The function to run. */
+};
+static const CLI_Stream_Command_Definition_t xFIND =
+{ { "find", /* The command string to type. */
+"\rfind [<dir>] [<options>]:\r Lists what is under <dir>\r" cliWALK_OPTIONS_HELP
+"\te.g.: \"find /sd0/data -name *.csv -mtime +30\"\r", NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvFINDCommand /* The function to run. */
+};
+static const CLI_Stream_Command_Definition_t xTREE =
+{ { "tree", /* The command string to type. */
+"\rtree [<dir>] [<options>]:\r Shows the tree under <dir>: the directories, and the files the options pass\r"
+cliWALK_OPTIONS_HELP, NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvTREECommand /* The function to run. */
+};
+
+/* Structure that defines the PURGE command line command, which deletes what
+is under a directory and older than a given age. */
+static const CLI_Stream_Command_Definition_t xPURGE =
+{ { "purge", /* The command string to type. */
+"\rpurge <dir> --older-than <days> [--trim] [--dry-run]:\r Deletes the files and directories under <dir> last modified over <days> days ago\r"
+" --trim: erase the freed clusters on the card\r"
+" --dry-run: only count what would go\r", NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvPURGECommand /* The function to run. */
+};
+
+/* Structure that defines the ECHO command line command, which prints what
+follows it: "echo <command> > <file>" writes a line of a script. */
+static const CLI_Stream_Command_Definition_t xECHO =
+{ { "echo", /* The command string to type. */
+"\recho [<text>]:\r Prints <text>\r", NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvECHOCommand /* The function to run. */
+};
+
+/* Structure that defines the RUN command line command, which runs the
+commands in a file. */
+static const CLI_Stream_Command_Definition_t xRUN =
+{ { "run", /* The command string to type. */
+"\rrun [-e] <file>:\r Runs the commands in <file>, a line at a time (\"#\" starts a comment), then shows how long each took\r"
+" -e: stop at the first that fails\r"
+" A line can start with \"time \", and end with \"> <file>\", as at the console\r", NULL, /* Streams its output. */
+	-1 }, /* The number of parameters varies. */
+	prvRUNCommand /* The function to run. */
+};
+
+/* The starts of lines that tell run that a command failed. */
+static const char * const pcRunErrorPrefixes[] =
+{ "Error", "Usage", "Failed", "Command not recognised", "Incorrect command parameter" };
+
+/* The link sz and rz use. */
+static const FF_XferLink_t *pxXferLink = NULL;
+
 /*-----------------------------------------------------------*/
 
 void vRegisterFileSystemCLICommands(void) {
 	/* Register all the command line commands defined immediately above. */
-	FreeRTOS_CLIRegisterCommand( &xDIR );
-	FreeRTOS_CLIRegisterCommand( &xLS );
+	FreeRTOS_CLIRegisterStreamCommand( &xDIR );
+	FreeRTOS_CLIRegisterStreamCommand( &xLS );
 	FreeRTOS_CLIRegisterCommand( &xCD );
-	FreeRTOS_CLIRegisterCommand( &xTYPE );
+	FreeRTOS_CLIRegisterStreamCommand( &xTYPE );
+	FreeRTOS_CLIRegisterStreamCommand( &xCAT );
 	FreeRTOS_CLIRegisterCommand( &xDEL );
 	FreeRTOS_CLIRegisterCommand( &xRMDIR );
 	FreeRTOS_CLIRegisterCommand( &xCOPY );
 	FreeRTOS_CLIRegisterCommand( &xREN );
 	FreeRTOS_CLIRegisterCommand( &xPWD );
+	FreeRTOS_CLIRegisterStreamCommand( &xDU );
+	FreeRTOS_CLIRegisterStreamCommand( &xFIND );
+	FreeRTOS_CLIRegisterStreamCommand( &xTREE );
+	FreeRTOS_CLIRegisterStreamCommand( &xPURGE );
+	FreeRTOS_CLIRegisterStreamCommand( &xECHO );
+	FreeRTOS_CLIRegisterStreamCommand( &xRUN );
 }
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvTYPECommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
-const char *pcParameter;
-BaseType_t xParameterStringLength, xReturn = pdTRUE;
-static FF_FILE *pxFile = NULL;
-int iChar;
-size_t xByte;
-size_t xColumns = 80U;
+void vRegisterFileTransferCLICommands(const FF_XferLink_t *pxLink) {
+	pxXferLink = pxLink;
+	FreeRTOS_CLIRegisterStreamCommand( &xSZ );
+	FreeRTOS_CLIRegisterStreamCommand( &xRZ );
+}
+/*-----------------------------------------------------------*/
 
-	/* Ensure there is always a null terminator after each character written. */
-	memset( pcWriteBuffer, 0x00, xWriteBufferLen );
+static BaseType_t prvFileWrite(CLI_Output_Sink_t *pxSink, const char *pcData, size_t xLength) {
+FF_FILE *pxFile = ( FF_FILE * ) pxSink->pvContext;
 
-	/* Ensure the buffer leaves space for the \r. */
-	configASSERT( xWriteBufferLen > ( strlen( cliNEW_LINE ) * 2 ) );
-	xWriteBufferLen -= strlen( cliNEW_LINE );
+	return ff_fwrite( pcData, 1, xLength, pxFile ) == xLength ? pdPASS : pdFAIL;
+}
 
-	if (xWriteBufferLen < xColumns) {
-		/* Ensure the loop that uses xColumns as an end condition does not
-		write off the end of the buffer. */
-		xColumns = xWriteBufferLen;
+void vFileSystemCLIFileSink(CLI_Output_Sink_t *pxSink, FF_FILE *pxFile) {
+	pxSink->pxWrite = prvFileWrite;
+	pxSink->pvContext = pxFile;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xFileSystemCLIProcessCommand(const char *pcCommandInput, CLI_Output_Sink_t *pxConsole) {
+char cCommand[ cmdMAX_INPUT_SIZE ];
+const char *pcRedirect, *pcPath;
+size_t xLength;
+FF_FILE *pxFile;
+CLI_Output_Sink_t xFileSink;
+BaseType_t xReturn;
+
+	/* A redirection is a '>' on its own, after a space, with the file name
+	after it.  A '>' within a parameter is just a character. */
+	pcRedirect = NULL;
+	for (pcPath = pcCommandInput; *pcPath != 0x00; pcPath++) {
+		if ((pcPath[ 0 ] == '>') && (pcPath > pcCommandInput) && (pcPath[ -1 ] == ' ') &&
+				((pcPath[ 1 ] == ' ') || (pcPath[ 1 ] == 0x00))) {
+			pcRedirect = pcPath;
+		}
+	}
+	if (pcRedirect == NULL) {
+		return FreeRTOS_CLIProcessCommandToSink( pcCommandInput, pxConsole );
 	}
 
+	/* Split the line into the command, without the spaces before the '>',
+	and the file name. */
+	xLength = pcRedirect - pcCommandInput;
+	while ((xLength > 0) && (pcCommandInput[ xLength - 1 ] == ' ')) {
+		xLength--;
+	}
+	pcPath = pcRedirect + 1;
+	while (*pcPath == ' ') {
+		pcPath++;
+	}
+	if ((xLength == 0) || (xLength >= sizeof( cCommand )) || (*pcPath == 0x00)) {
+		return FreeRTOS_CLISinkPrintf( pxConsole, "Usage: <command> > <filename>" cliNEW_LINE );
+	}
+	memcpy( cCommand, pcCommandInput, xLength );
+	cCommand[ xLength ] = 0x00;
+
+	pxFile = ff_fopen( pcPath, "w" );
 	if (pxFile == NULL) {
-		/* The file has not been opened yet.  Find the file name. */
-		pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, /* The command string itself. */
-							1,						/* Return the first parameter. */
-							&xParameterStringLength	/* Store the parameter string length. */
-						);
+		return FreeRTOS_CLISinkPrintf( pxConsole, "Error: could not open %s: %s" cliNEW_LINE, pcPath, strerror( stdioGET_ERRNO() ) );
+	}
+	vFileSystemCLIFileSink( &xFileSink, pxFile );
+	xReturn = FreeRTOS_CLIProcessCommandToSink( cCommand, &xFileSink );
+	if (ff_fclose( pxFile ) != 0) {
+		xReturn = pdFAIL;
+	}
+	if (xReturn == pdFAIL) {
+		FreeRTOS_CLISinkPrintf( pxConsole, "Error writing %s: %s" cliNEW_LINE, pcPath, strerror( stdioGET_ERRNO() ) );
+	}
 
-		/* Sanity check something was returned. */
-		configASSERT( pcParameter );
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
 
-		/* Attempt to open the requested file. */
-		pxFile = ff_fopen( pcParameter, "r" );
+static BaseType_t prvTYPECommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+/* Kept from one type to the next, rather than allocated for each. */
+static uint8_t *pucBuffer = NULL;
+const char *pcParameter;
+BaseType_t xParameterStringLength, xReturn = pdPASS;
+UBaseType_t uxParameter = 1;
+char cMode = 0x00, cFileName[ cmdMAX_INPUT_SIZE ];
+uint32_t ulOffset = 0, ulRemaining = UINT32_MAX;
+FF_FILE *pxFile;
+size_t xToRead, xRead;
+
+	/* An option comes before the file name. */
+	pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, uxParameter, &xParameterStringLength );
+	if ((pcParameter != NULL) && (xParameterStringLength == 2) && (pcParameter[ 0 ] == '-')) {
+		cMode = pcParameter[ 1 ];
+		if ((cMode != 'x') && (cMode != 'b')) {
+			return FreeRTOS_CLISinkPrintf( pxSink, "Error: unknown option %.2s" cliNEW_LINE, pcParameter );
+		}
+		pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, ++uxParameter, &xParameterStringLength );
+	}
+	if ((pcParameter == NULL) || ((size_t)xParameterStringLength >= sizeof( cFileName ))) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Usage: type [-x|-b] <filename> [<offset> [<length>]]" cliNEW_LINE );
+	}
+	memcpy( cFileName, pcParameter, xParameterStringLength );
+	cFileName[ xParameterStringLength ] = 0x00;
+
+	/* Then, optionally, the window of the file to print. */
+	pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, ++uxParameter, &xParameterStringLength );
+	if (pcParameter != NULL) {
+		ulOffset = strtoul( pcParameter, NULL, 0 );
+		pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, ++uxParameter, &xParameterStringLength );
+		if (pcParameter != NULL) {
+			ulRemaining = strtoul( pcParameter, NULL, 0 );
+		}
 	}
 
-	if (pxFile != NULL) {
-		/* Read the next chunk of data from the file. */
-		for (xByte = 0; xByte < xColumns; xByte++) {
-			iChar = ff_fgetc( pxFile );
-
-			if (iChar == -1) {
-				/* No more characters to return. */
-				ff_fclose( pxFile );
-				pxFile = NULL;
-				break;
-			} else {
-				pcWriteBuffer[ xByte ] = ( char ) iChar;
-			}
+	if (pucBuffer == NULL) {
+		pucBuffer = ( uint8_t * ) pvPortMalloc( cliTYPE_BUFFER_SIZE );
+		if (pucBuffer == NULL) {
+			return FreeRTOS_CLISinkPrintf( pxSink, "Failed to allocate RAM" cliNEW_LINE );
 		}
 	}
 
+	/* Attempt to open the requested file. */
+	pxFile = ff_fopen( cFileName, "r" );
 	if (pxFile == NULL) {
-		/* Either the file was not opened, or all the data from the file has
-		been returned and the file is now closed. */
-		xReturn = pdFALSE;
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not open %s: %s" cliNEW_LINE, cFileName, strerror( stdioGET_ERRNO() ) );
+	}
+	/* Deep into a big file, the extent map saves walking the chain there. */
+	if ((ulOffset != 0) && (ff_fseek_mapped( pxFile, ulOffset, FF_SEEK_SET ) != 0)) {
+		ff_fclose( pxFile );
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not seek to %lu in %s: %s" cliNEW_LINE, ( unsigned long ) ulOffset, cFileName, strerror( stdioGET_ERRNO() ) );
 	}
 
-	strcat( pcWriteBuffer, cliNEW_LINE );
+	/* Pass the file on a buffer at a time.  The first read only goes as far
+	as the next sector boundary, so that the rest are whole sectors. */
+	while ((xReturn == pdPASS) && (ulRemaining > 0)) {
+		xToRead = cliTYPE_BUFFER_SIZE - ( ulOffset % 512 );
+		if (xToRead > ulRemaining) {
+			xToRead = ulRemaining;
+		}
+		xRead = ff_fread( pucBuffer, 1, xToRead, pxFile );
+		if (xRead == 0) {
+			break;
+		}
+		if (cMode == 'x') {
+			xReturn = prvHexDump( pxSink, ulOffset, pucBuffer, xRead );
+		} else {
+			xReturn = FreeRTOS_CLISinkWrite( pxSink, ( const char * ) pucBuffer, xRead );
+		}
+		ulOffset += xRead;
+		ulRemaining -= xRead;
+	}
+	ff_fclose( pxFile );
+
+	/* Raw output is just the file; text gets a line end after it. */
+	if ((xReturn == pdPASS) && (cMode == 0x00)) {
+		xReturn = FreeRTOS_CLISinkWrite( pxSink, cliNEW_LINE, strlen( cliNEW_LINE ) );
+	}
+
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvHexDump(CLI_Output_Sink_t *pxSink, uint32_t ulOffset, const uint8_t *pucData, size_t xLength) {
+char cLine[ 16 + ( cliHEX_DUMP_ROW * 3 ) ];
+size_t xRow;
+int iPrefix;
+BaseType_t xReturn = pdPASS;
+
+	while ((xReturn == pdPASS) && (xLength > 0)) {
+		/* The rows start at multiples of cliHEX_DUMP_ROW into the file. */
+		xRow = cliHEX_DUMP_ROW - ( ulOffset % cliHEX_DUMP_ROW );
+		if (xRow > xLength) {
+			xRow = xLength;
+		}
+		iPrefix = snprintf( cLine, sizeof( cLine ), "%08lx: ", ( unsigned long ) ulOffset );
+		dump8buf( cLine + iPrefix, sizeof( cLine ) - iPrefix, ( uint8_t * ) pucData, xRow );
+		xReturn = FreeRTOS_CLISinkWrite( pxSink, cLine, strlen( cLine ) );
+		ulOffset += xRow;
+		pucData += xRow;
+		xLength -= xRow;
+	}
 
 	return xReturn;
 }
@@ -329,55 +641,31 @@ size_t xStringLength;
 }
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvDIRCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
-static FF_FindData_t *pxFindStruct = NULL;
+static BaseType_t prvDIRCommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+FF_FindData_t *pxFindStruct;
+char cLine[ ffconfigMAX_FILENAME + 64 ];
 int iReturned;
-BaseType_t xReturn = pdFALSE;
+BaseType_t xReturn = pdPASS;
 
-	/* This assumes pcWriteBuffer is long enough. */
 	( void ) pcCommandString;
 
-	/* Ensure the buffer leaves space for the \r. */
-	configASSERT( xWriteBufferLen > ( strlen( cliNEW_LINE ) * 2 ) );
-	xWriteBufferLen -= strlen( cliNEW_LINE );
-
+	pxFindStruct = ( FF_FindData_t * ) pvPortMalloc( sizeof( FF_FindData_t ) );
 	if (pxFindStruct == NULL) {
-		/* This is the first time this function has been executed since the Dir
-		command was run.  Create the find structure. */
-		pxFindStruct = ( FF_FindData_t * ) pvPortMalloc( sizeof( FF_FindData_t ) );
-
-		if (pxFindStruct != NULL) {
-			memset( pxFindStruct, 0x00, sizeof( FF_FindData_t ) );
-			iReturned = ff_findfirst( "", pxFindStruct );
+		return FreeRTOS_CLISinkPrintf( pxSink, "Failed to allocate RAM (using heap_4.c will prevent fragmentation)." cliNEW_LINE );
+	}
+	memset( pxFindStruct, 0x00, sizeof( FF_FindData_t ) );
 
-			if (iReturned == FF_ERR_NONE) {
-				prvCreateFileInfoString( pcWriteBuffer, pxFindStruct );
-				xReturn = pdPASS;
-			} else {
-				snprintf( pcWriteBuffer, xWriteBufferLen, "Error: ff_findfirst() failed." );
-				pxFindStruct = NULL;
-			}
-		} else {
-			snprintf( pcWriteBuffer, xWriteBufferLen, "Failed to allocate RAM (using heap_4.c will prevent fragmentation)." );
-		}
-	} else {
-		/* The find struct has already been created.  Find the next file in
-		the directory. */
+	iReturned = ff_findfirst( "", pxFindStruct );
+	if (iReturned != FF_ERR_NONE) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "Error: ff_findfirst() failed." cliNEW_LINE );
+	}
+	while ((iReturned == FF_ERR_NONE) && (xReturn == pdPASS)) {
+		prvCreateFileInfoString( cLine, pxFindStruct );
+		strcat( cLine, cliNEW_LINE );
+		xReturn = FreeRTOS_CLISinkWrite( pxSink, cLine, strlen( cLine ) );
 		iReturned = ff_findnext( pxFindStruct );
-
-		if (iReturned == FF_ERR_NONE) {
-			prvCreateFileInfoString( pcWriteBuffer, pxFindStruct );
-			xReturn = pdPASS;
-		} else {
-			vPortFree( pxFindStruct );
-			pxFindStruct = NULL;
-
-			/* No string to return. */
-			pcWriteBuffer[ 0 ] = 0x00;
-		}
 	}
-
-	strcat( pcWriteBuffer, cliNEW_LINE );
+	vPortFree( pxFindStruct );
 
 	return xReturn;
 }
@@ -500,10 +788,10 @@ FF_Stat_t xStat;
 	/* Continue only if the source file exists and the destination file does
 	not exist. */
 	if ((lSourceLength != 0) && (lDestinationLength == 0)) {
-		if (prvPerformCopy(pcSourceFile, lSourceLength, pcDestinationFile, pcWriteBuffer, xWriteBufferLen) == pdPASS) {
+		if (ff_fcopy(pcSourceFile, pcDestinationFile) == 0) {
 			sprintf( pcWriteBuffer, "Copy made" );
 		} else {
-			sprintf( pcWriteBuffer, "Error during copy" );
+			sprintf( pcWriteBuffer, "Error during copy: %s", strerror( stdioGET_ERRNO() ) );
 		}
 	}
 
@@ -565,48 +853,415 @@ static BaseType_t prvPWDCommand(char *pcWriteBuffer, size_t xWriteBufferLen, con
 }
 /*-----------------------------------------------------------*/
 
-static BaseType_t prvPerformCopy(const char *pcSourceFile, size_t lSourceFileLength, const char *pcDestinationFile,
-		char *pxWriteBuffer, size_t xWriteBufferLen) {
-size_t lBytesRead = 0, lBytesToRead, lBytesRemaining;
-FF_FILE *pxSourceFile, *pxDestinationFile;
-BaseType_t xReturn = pdPASS;
+static BaseType_t prvSZCommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+const char *pcParameter;
+BaseType_t xParameterStringLength;
+FF_XferStats_t xStats;
+TickType_t xStart;
 
-	/* NOTE:  Error handling has been omitted for clarity. */
+	/* Obtain the name of the file to send. */
+	pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, 1, &xParameterStringLength );
 
-	pxSourceFile = ff_fopen( pcSourceFile, "r" );
-	pxDestinationFile = ff_fopen( pcDestinationFile, "a" );
+	/* Sanity check something was returned. */
+	configASSERT( pcParameter );
+
+	/* Nothing is printed until the transfer is over: the far end is waiting
+	for frames. */
+	xStart = xTaskGetTickCount();
+	if (ff_xfer_send( pcParameter, pxXferLink, &xStats ) != 0) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not send %s: %s" cliNEW_LINE, pcParameter, strerror( stdioGET_ERRNO() ) );
+	}
+
+	return prvPrintXferStats( pxSink, "Sent", &xStats, xTaskGetTickCount() - xStart );
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvRZCommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+const char *pcParameter;
+BaseType_t xParameterStringLength;
+FF_XferStats_t xStats;
+TickType_t xStart;
+
+	/* Obtain the name of the file to write. */
+	pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, 1, &xParameterStringLength );
+
+	/* Sanity check something was returned. */
+	configASSERT( pcParameter );
 
-	if ((pxSourceFile != NULL) && (pxDestinationFile != NULL)) {
-		while (lBytesRead < lSourceFileLength) {
-			/* How many bytes are left? */
-			lBytesRemaining = lSourceFileLength - lBytesRead;
+	xStart = xTaskGetTickCount();
+	if (ff_xfer_receive( pcParameter, pxXferLink, &xStats ) != 0) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not receive %s: %s" cliNEW_LINE, pcParameter, strerror( stdioGET_ERRNO() ) );
+	}
 
-			/* How many bytes should be read this time around the loop.  Can't
-			read more bytes than will fit into the buffer. */
-			if (lBytesRemaining > xWriteBufferLen) {
-				lBytesToRead = xWriteBufferLen;
+	return prvPrintXferStats( pxSink, "Received", &xStats, xTaskGetTickCount() - xStart );
+}
+/*-----------------------------------------------------------*/
+
+static const char *prvParseWalkOptions(const char *pcCommandString, char *pcPath, char *pcGlob, FF_WalkFilter_t *pxFilter, BaseType_t *pxSummary) {
+const char *pcParameter, *pcValue;
+BaseType_t xParameterStringLength, xValueLength;
+UBaseType_t uxParameter = 1;
+unsigned long ulValue;
+char *pcEnd, cSign;
+time_t xNow = FreeRTOS_time( NULL );
+
+	ff_walk_filter_init( pxFilter );
+	pcPath[ 0 ] = 0x00;
+	while ((pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, uxParameter++, &xParameterStringLength )) != NULL) {
+		if (pcParameter[ 0 ] != '-') {
+			/* The directory. */
+			if ((pcPath[ 0 ] != 0x00) || (xParameterStringLength >= ffconfigMAX_FILENAME)) {
+				return "one directory, please";
+			}
+			memcpy( pcPath, pcParameter, xParameterStringLength );
+			pcPath[ xParameterStringLength ] = 0x00;
+			continue;
+		}
+		if ((xParameterStringLength == 2) && (pcParameter[ 1 ] == 's') && (pxSummary != NULL)) {
+			*pxSummary = pdTRUE;
+			continue;
+		}
+
+		/* The rest take a value. */
+		pcValue = FreeRTOS_CLIGetParameter( pcCommandString, uxParameter++, &xValueLength );
+		if (pcValue == NULL) {
+			return "missing value";
+		}
+		cSign = 0x00;
+		if ((pcValue[ 0 ] == '+') || (pcValue[ 0 ] == '-')) {
+			cSign = *pcValue++;
+			xValueLength--;
+		}
+		if ((xParameterStringLength == 5) && (strncmp( pcParameter, "-name", 5 ) == 0)) {
+			if (xValueLength >= ffconfigMAX_FILENAME) {
+				return "pattern too long";
+			}
+			memcpy( pcGlob, pcValue - ( cSign != 0x00 ), xValueLength + ( cSign != 0x00 ) );
+			pcGlob[ xValueLength + ( cSign != 0x00 ) ] = 0x00;
+			pxFilter->pcGlob = pcGlob;
+		} else if ((xParameterStringLength == 5) && (strncmp( pcParameter, "-type", 5 ) == 0)) {
+			if ((xValueLength != 1) || (cSign != 0x00) || ((pcValue[ 0 ] != 'f') && (pcValue[ 0 ] != 'd'))) {
+				return "-type is f or d";
+			}
+			pxFilter->cType = pcValue[ 0 ];
+		} else if ((xParameterStringLength == 5) && (strncmp( pcParameter, "-size", 5 ) == 0)) {
+			ulValue = strtoul( pcValue, &pcEnd, 10 );
+			if (*pcEnd == 'k') {
+				ulValue *= 1024UL;
+			} else if (*pcEnd == 'M') {
+				ulValue *= 1024UL * 1024UL;
+			}
+			if (cSign == '+') {
+				pxFilter->ulMinSize = ulValue + 1;
+			} else if (cSign == '-') {
+				pxFilter->ulMaxSize = ulValue ? ulValue - 1 : 0;
+			} else {
+				pxFilter->ulMinSize = pxFilter->ulMaxSize = ulValue;
+			}
+		} else if ((xParameterStringLength == 6) && (strncmp( pcParameter, "-mtime", 6 ) == 0)) {
+			/* Whole days ago, as find counts them. */
+			ulValue = strtoul( pcValue, NULL, 10 );
+			if (cSign == '+') {
+				pxFilter->xModifiedBefore = xNow - ( time_t ) ( ulValue + 1 ) * 86400;
+			} else if (cSign == '-') {
+				pxFilter->xModifiedAfter = xNow - ( time_t ) ulValue * 86400;
 			} else {
-				lBytesToRead = lBytesRemaining;
+				pxFilter->xModifiedBefore = xNow - ( time_t ) ulValue * 86400;
+				pxFilter->xModifiedAfter = xNow - ( time_t ) ( ulValue + 1 ) * 86400;
 			}
+		} else {
+			return "unknown option";
+		}
+	}
+	return NULL;
+}
+/*-----------------------------------------------------------*/
 
-			ff_fread( pxWriteBuffer, lBytesToRead, 1, pxSourceFile );
-			ff_fwrite( pxWriteBuffer, lBytesToRead, 1, pxDestinationFile );
+static BaseType_t prvPrintWalkStats(CLI_Output_Sink_t *pxSink, const FF_Walk_t *pxWalk, TickType_t xTicks) {
+const FF_WalkStats_t *pxStats = ff_walk_stats( pxWalk );
+uint32_t ulMs = xTicks * portTICK_PERIOD_MS;
+BaseType_t xReturn;
+
+	xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%lu entries in %lu directories, %lu ms (%lu entries/s)" cliNEW_LINE,
+		( unsigned long ) pxStats->ulEntries, ( unsigned long ) pxStats->ulDirectories, ( unsigned long ) ulMs,
+		( unsigned long ) ( ( uint64_t ) pxStats->ulEntries * 1000 / ( ulMs ? ulMs : 1 ) ) );
+	if ((xReturn == pdPASS) && (pxStats->ulTooDeep != 0)) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%lu directories not entered: deeper than %d" cliNEW_LINE,
+			( unsigned long ) pxStats->ulTooDeep, ffconfigWALK_MAX_DEPTH );
+	}
+	if ((xReturn == pdPASS) && (pxStats->ulErrors != 0)) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%lu directories could not be read" cliNEW_LINE,
+			( unsigned long ) pxStats->ulErrors );
+	}
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
 
-			lBytesRead += lBytesToRead;
+static BaseType_t prvDUCommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+char cPath[ ffconfigMAX_FILENAME ], cGlob[ ffconfigMAX_FILENAME ];
+FF_WalkFilter_t xFilter;
+BaseType_t xSummary = pdFALSE, xReturn = pdPASS;
+const char *pcError;
+FF_Walk_t *pxWalk;
+const FF_WalkEntry_t *pxEntry;
+TickType_t xStart = xTaskGetTickCount();
+/* The bytes counted so far in each directory being walked, [ 0 ] being the
+top one. */
+uint64_t ullTotal[ ffconfigWALK_MAX_DEPTH + 1 ];
+
+	pcError = prvParseWalkOptions( pcCommandString, cPath, cGlob, &xFilter, &xSummary );
+	if (pcError != NULL) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: %s" cliNEW_LINE, pcError );
+	}
+	pxWalk = ff_walk_open( cPath, FF_WALK_LEAVE );
+	if (pxWalk == NULL) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not read %s: %s" cliNEW_LINE, cPath, strerror( stdioGET_ERRNO() ) );
+	}
+	ullTotal[ 0 ] = 0;
+	while ((xReturn == pdPASS) && ((pxEntry = ff_walk_next( pxWalk )) != NULL)) {
+		if ((pxEntry->ucAttributes & FF_FAT_ATTR_DIR) == 0) {
+			if (ff_walk_match( &xFilter, pxEntry )) {
+				ullTotal[ pxEntry->uDepth ] += pxEntry->ulSize;
+			}
+		} else if (pxEntry->bLeaving == pdFALSE) {
+			ullTotal[ pxEntry->uDepth + 1 ] = 0;
+		} else {
+			ullTotal[ pxEntry->uDepth ] += ullTotal[ pxEntry->uDepth + 1 ];
+			if (xSummary == pdFALSE) {
+				xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%8lu  %s" cliNEW_LINE,
+					( unsigned long ) ( ( ullTotal[ pxEntry->uDepth + 1 ] + 1023 ) / 1024 ), pxEntry->pcPath );
+			}
 		}
 	}
+	if (xReturn == pdPASS) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%8lu  %s" cliNEW_LINE,
+			( unsigned long ) ( ( ullTotal[ 0 ] + 1023 ) / 1024 ), cPath[ 0 ] ? cPath : "." );
+	}
+	if (xReturn == pdPASS) {
+		xReturn = prvPrintWalkStats( pxSink, pxWalk, xTaskGetTickCount() - xStart );
+	}
+	ff_walk_close( pxWalk );
+
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
 
-	if (pxSourceFile != NULL) {
-		ff_fclose( pxSourceFile );
+static BaseType_t prvFINDCommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+char cPath[ ffconfigMAX_FILENAME ], cGlob[ ffconfigMAX_FILENAME ];
+FF_WalkFilter_t xFilter;
+BaseType_t xReturn = pdPASS;
+const char *pcError;
+FF_Walk_t *pxWalk;
+const FF_WalkEntry_t *pxEntry;
+TickType_t xStart = xTaskGetTickCount();
+uint32_t ulFound = 0;
+
+	pcError = prvParseWalkOptions( pcCommandString, cPath, cGlob, &xFilter, NULL );
+	if (pcError != NULL) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: %s" cliNEW_LINE, pcError );
+	}
+	pxWalk = ff_walk_open( cPath, 0 );
+	if (pxWalk == NULL) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not read %s: %s" cliNEW_LINE, cPath, strerror( stdioGET_ERRNO() ) );
+	}
+	while ((xReturn == pdPASS) && ((pxEntry = ff_walk_next( pxWalk )) != NULL)) {
+		if (ff_walk_match( &xFilter, pxEntry )) {
+			ulFound++;
+			xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%s" cliNEW_LINE, pxEntry->pcPath );
+		}
+	}
+	if (xReturn == pdPASS) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "Found %lu" cliNEW_LINE, ( unsigned long ) ulFound );
 	}
+	if (xReturn == pdPASS) {
+		xReturn = prvPrintWalkStats( pxSink, pxWalk, xTaskGetTickCount() - xStart );
+	}
+	ff_walk_close( pxWalk );
 
-	if (pxSourceFile != NULL) {
-		ff_fclose( pxDestinationFile );
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvTREECommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+char cPath[ ffconfigMAX_FILENAME ], cGlob[ ffconfigMAX_FILENAME ];
+FF_WalkFilter_t xFilter;
+BaseType_t xReturn = pdPASS;
+const char *pcError;
+FF_Walk_t *pxWalk;
+const FF_WalkEntry_t *pxEntry;
+TickType_t xStart = xTaskGetTickCount();
+
+	pcError = prvParseWalkOptions( pcCommandString, cPath, cGlob, &xFilter, NULL );
+	if (pcError != NULL) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: %s" cliNEW_LINE, pcError );
+	}
+	pxWalk = ff_walk_open( cPath, 0 );
+	if (pxWalk == NULL) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not read %s: %s" cliNEW_LINE, cPath, strerror( stdioGET_ERRNO() ) );
+	}
+	xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%s" cliNEW_LINE, cPath[ 0 ] ? cPath : "." );
+	while ((xReturn == pdPASS) && ((pxEntry = ff_walk_next( pxWalk )) != NULL)) {
+		/* Every directory is shown, so that the files have somewhere to be. */
+		if ((pxEntry->ucAttributes & FF_FAT_ATTR_DIR) != 0) {
+			xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%*s%s/" cliNEW_LINE, ( int ) ( 2 * pxEntry->uDepth + 2 ), "", pxEntry->pcName );
+		} else if (ff_walk_match( &xFilter, pxEntry )) {
+			xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%*s%s  %lu" cliNEW_LINE, ( int ) ( 2 * pxEntry->uDepth + 2 ), "", pxEntry->pcName,
+				( unsigned long ) pxEntry->ulSize );
+		}
+	}
+	if (xReturn == pdPASS) {
+		xReturn = prvPrintWalkStats( pxSink, pxWalk, xTaskGetTickCount() - xStart );
 	}
+	ff_walk_close( pxWalk );
 
-	if (lBytesRead == lSourceFileLength) {
-		xReturn = pdPASS;
-	} else {
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvPURGECommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+char cPath[ ffconfigMAX_FILENAME ];
+const char *pcParameter;
+BaseType_t xParameterStringLength, xReturn;
+UBaseType_t uxParameter = 1;
+unsigned uFlags = 0;
+long lDays = -1;
+FF_PurgeStats_t xStats;
+TickType_t xStart;
+int iResult;
+
+	cPath[ 0 ] = 0x00;
+	while ((pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, uxParameter++, &xParameterStringLength )) != NULL) {
+		if ((xParameterStringLength == 12) && (strncmp( pcParameter, "--older-than", 12 ) == 0)) {
+			pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, uxParameter++, &xParameterStringLength );
+			if (pcParameter == NULL) {
+				break;
+			}
+			lDays = strtol( pcParameter, NULL, 10 );
+		} else if ((xParameterStringLength == 6) && (strncmp( pcParameter, "--trim", 6 ) == 0)) {
+			uFlags |= FF_PURGE_TRIM;
+		} else if ((xParameterStringLength == 9) && (strncmp( pcParameter, "--dry-run", 9 ) == 0)) {
+			uFlags |= FF_PURGE_DRY_RUN;
+		} else if ((pcParameter[ 0 ] != '-') && (cPath[ 0 ] == 0x00) && (xParameterStringLength < ffconfigMAX_FILENAME)) {
+			memcpy( cPath, pcParameter, xParameterStringLength );
+			cPath[ xParameterStringLength ] = 0x00;
+		} else {
+			return FreeRTOS_CLISinkPrintf( pxSink, "Error: unexpected %.*s" cliNEW_LINE, ( int ) xParameterStringLength, pcParameter );
+		}
+	}
+	/* Both are required: there is no default for deleting things. */
+	if ((cPath[ 0 ] == 0x00) || (lDays < 0)) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: purge <dir> --older-than <days>" cliNEW_LINE );
+	}
+
+	xStart = xTaskGetTickCount();
+	iResult = ff_purge( cPath, FreeRTOS_time( NULL ) - ( time_t ) lDays * 86400, uFlags, &xStats );
+	xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%s %lu files (%lu KiB) and %lu directories: %lu clusters in %lu runs, %lu ms" cliNEW_LINE,
+		( uFlags & FF_PURGE_DRY_RUN ) ? "Would purge" : "Purged", ( unsigned long ) xStats.ulFiles,
+		( unsigned long ) ( ( xStats.ullBytes + 1023 ) / 1024 ), ( unsigned long ) xStats.ulDirectories,
+		( unsigned long ) xStats.ulClusters, ( unsigned long ) xStats.ulRuns,
+		( unsigned long ) ( ( xTaskGetTickCount() - xStart ) * portTICK_PERIOD_MS ) );
+	if ((xReturn == pdPASS) && (xStats.ulKept != 0)) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "Kept %lu old enough, but open, read-only or changed" cliNEW_LINE,
+			( unsigned long ) xStats.ulKept );
+	}
+	if ((xReturn == pdPASS) && (iResult == -1)) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "Error: %s" cliNEW_LINE, strerror( stdioGET_ERRNO() ) );
+	}
+
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvECHOCommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+const char *pcParameter;
+BaseType_t xParameterStringLength;
+
+	/* Everything after the command name, as it was typed. */
+	pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, 1, &xParameterStringLength );
+
+	return FreeRTOS_CLISinkPrintf( pxSink, "%s" cliNEW_LINE, pcParameter != NULL ? pcParameter : "" );
+}
+/*-----------------------------------------------------------*/
+
+static void prvRunOutputEndLine(CLI_Run_Output_t *pxOutput) {
+const char *pcLine = pxOutput->cLine, *pcColon;
+size_t x;
+
+	pxOutput->cLine[ pxOutput->xLineLength ] = 0x00;
+
+	/* What a command prints with FF_PRINTF() (task_printf()) starts with
+	"core<n>: <task name>: ". */
+	if (strncmp( pcLine, "core", 4 ) == 0) {
+		pcColon = strstr( pcLine, ": " );
+		if ((pcColon != NULL) && ((pcColon = strstr( pcColon + 2, ": " )) != NULL)) {
+			pcLine = pcColon + 2;
+		}
+	}
+	for (x = 0; x < sizeof( pcRunErrorPrefixes ) / sizeof( pcRunErrorPrefixes[ 0 ] ); x++) {
+		if (strncmp( pcLine, pcRunErrorPrefixes[ x ], strlen( pcRunErrorPrefixes[ x ] ) ) == 0) {
+			pxOutput->xFailed = pdTRUE;
+		}
+	}
+	pxOutput->xLineLength = 0;
+}
+
+static BaseType_t prvRunOutputWrite(CLI_Output_Sink_t *pxSink, const char *pcData, size_t xLength) {
+CLI_Run_Output_t *pxOutput = ( CLI_Run_Output_t * ) pxSink->pvContext;
+size_t x;
+
+	for (x = 0; x < xLength; x++) {
+		if ((pcData[ x ] == '\r') || (pcData[ x ] == '\n')) {
+			prvRunOutputEndLine( pxOutput );
+		} else if (pxOutput->xLineLength < sizeof( pxOutput->cLine ) - 1) {
+			pxOutput->cLine[ pxOutput->xLineLength++ ] = pcData[ x ];
+		}
+	}
+	if (FreeRTOS_CLISinkWrite( pxOutput->pxOut, pcData, xLength ) != pdPASS) {
+		pxOutput->xOutFailed = pdTRUE;
+		return pdFAIL;
+	}
+	return pdPASS;
+}
+/*-----------------------------------------------------------*/
+
+BaseType_t xFileSystemCLIRunCommand(const char *pcCommandInput, CLI_Output_Sink_t *pxConsole) {
+CLI_Run_Output_t xOutput = { pxConsole, { 0 }, 0, pdFALSE, pdFALSE };
+CLI_Output_Sink_t xOutputSink = { prvRunOutputWrite, &xOutput };
+
+	xFileSystemCLIProcessCommand( pcCommandInput, &xOutputSink );
+	if (xOutput.xLineLength != 0) {
+		/* Output that didn't end its last line, as pwd's doesn't. */
+		prvRunOutputEndLine( &xOutput );
+		if ((xOutput.xOutFailed == pdFALSE) && (FreeRTOS_CLISinkWrite( pxConsole, cliNEW_LINE, strlen( cliNEW_LINE ) ) != pdPASS)) {
+			xOutput.xOutFailed = pdTRUE;
+		}
+	}
+
+	return ((xOutput.xFailed == pdFALSE) && (xOutput.xOutFailed == pdFALSE)) ? pdPASS : pdFAIL;
+}
+/*-----------------------------------------------------------*/
+
+/* Returns pdFAIL if the line failed, or the output did. */
+static BaseType_t prvRunLine(CLI_Output_Sink_t *pxSink, const char *pcLine, uint32_t ulLine, CLI_Run_Timing_t *pxTiming) {
+BaseType_t xTime = pdFALSE, xReturn;
+TickType_t xStart;
+
+	if (strncmp( pcLine, "time ", 5 ) == 0) {
+		xTime = pdTRUE;
+		pcLine += 5;
+	}
+	if (FreeRTOS_CLISinkPrintf( pxSink, "> %s" cliNEW_LINE, pcLine ) != pdPASS) {
+		return pdFAIL;
+	}
+
+	xStart = xTaskGetTickCount();
+	xReturn = xFileSystemCLIRunCommand( pcLine, pxSink );
+	pxTiming->ulMs = ( xTaskGetTickCount() - xStart ) * portTICK_PERIOD_MS;
+
+	pxTiming->ulLine = ulLine;
+	strncpy( pxTiming->cCommand, pcLine, sizeof( pxTiming->cCommand ) - 1 );
+	pxTiming->cCommand[ sizeof( pxTiming->cCommand ) - 1 ] = 0x00;
+	if ((xTime != pdFALSE) && (FreeRTOS_CLISinkPrintf( pxSink, "Time: %lu ms" cliNEW_LINE, ( unsigned long ) pxTiming->ulMs ) != pdPASS)) {
 		xReturn = pdFAIL;
 	}
 
@@ -614,6 +1269,132 @@ BaseType_t xReturn = pdPASS;
 }
 /*-----------------------------------------------------------*/
 
+static BaseType_t prvRUNCommand(CLI_Output_Sink_t *pxSink, const char *pcCommandString) {
+/* Scripts don't nest: a script that ran itself would never end. */
+static BaseType_t xRunning = pdFALSE;
+const char *pcParameter;
+BaseType_t xParameterStringLength, xReturn = pdPASS, xStopOnError = pdFALSE, xStop = pdFALSE, xTooLong = pdFALSE;
+char cFileName[ cmdMAX_INPUT_SIZE ], cLine[ cmdMAX_INPUT_SIZE ];
+char *pcBuffer, *pcLine;
+CLI_Run_Timing_t *pxTimings, xTiming;
+FF_FILE *pxFile;
+size_t xRead, x, xLineLength = 0;
+uint32_t ulLine = 0, ulRun = 0, ulFailed = 0, ulTimed = 0, ulNotShown = 0;
+TickType_t xStart = xTaskGetTickCount();
+
+	pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, 1, &xParameterStringLength );
+	if ((pcParameter != NULL) && (xParameterStringLength == 2) && (strncmp( pcParameter, "-e", 2 ) == 0)) {
+		xStopOnError = pdTRUE;
+		pcParameter = FreeRTOS_CLIGetParameter( pcCommandString, 2, &xParameterStringLength );
+	}
+	if ((pcParameter == NULL) || ((size_t) xParameterStringLength >= sizeof( cFileName ))) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Usage: run [-e] <file>" cliNEW_LINE );
+	}
+	memcpy( cFileName, pcParameter, xParameterStringLength );
+	cFileName[ xParameterStringLength ] = 0x00;
+	if (xRunning != pdFALSE) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: run can't be used in a script" cliNEW_LINE );
+	}
+
+	pxFile = ff_fopen( cFileName, "r" );
+	if (pxFile == NULL) {
+		return FreeRTOS_CLISinkPrintf( pxSink, "Error: could not open %s: %s" cliNEW_LINE, cFileName, strerror( stdioGET_ERRNO() ) );
+	}
+	pcBuffer = ( char * ) pvPortMalloc( cliRUN_BUFFER_SIZE );
+	pxTimings = ( CLI_Run_Timing_t * ) pvPortMalloc( cliRUN_SUMMARY_LINES * sizeof( CLI_Run_Timing_t ) );
+	if ((pcBuffer == NULL) || (pxTimings == NULL)) {
+		vPortFree( pcBuffer );
+		vPortFree( pxTimings );
+		ff_fclose( pxFile );
+		return FreeRTOS_CLISinkPrintf( pxSink, "Failed to allocate RAM" cliNEW_LINE );
+	}
+	xRunning = pdTRUE;
+
+	/* A buffer at a time, split into lines.  The last line needn't end with a
+	newline: reading nothing more (xRead == 0, once round the loop) ends it. */
+	do {
+		xRead = ff_fread( pcBuffer, 1, cliRUN_BUFFER_SIZE, pxFile );
+		for (x = 0; (x < xRead + ( xRead == 0 )) && (xStop == pdFALSE); x++) {
+			if (xRead != 0) {
+				if (pcBuffer[ x ] == '\r') {
+					continue;
+				}
+				if (pcBuffer[ x ] != '\n') {
+					if (xLineLength < sizeof( cLine ) - 1) {
+						cLine[ xLineLength++ ] = pcBuffer[ x ];
+					} else {
+						xTooLong = pdTRUE;
+					}
+					continue;
+				}
+			} else if ((xLineLength == 0) && (xTooLong == pdFALSE)) {
+				break;
+			}
+
+			/* A line. */
+			cLine[ xLineLength ] = 0x00;
+			xLineLength = 0;
+			ulLine++;
+			pcLine = cLine;
+			while (*pcLine == ' ') {
+				pcLine++;
+			}
+			if (xTooLong != pdFALSE) {
+				xTooLong = pdFALSE;
+				ulRun++;
+				ulFailed++;
+				xReturn = FreeRTOS_CLISinkPrintf( pxSink, "Error: line %lu is longer than %d characters" cliNEW_LINE,
+					( unsigned long ) ulLine, cmdMAX_INPUT_SIZE - 1 );
+				xStop = ( xReturn != pdPASS ) || ( xStopOnError != pdFALSE );
+				continue;
+			}
+			if ((*pcLine == 0x00) || (*pcLine == '#')) {
+				continue;
+			}
+			ulRun++;
+			if (prvRunLine( pxSink, pcLine, ulLine, &xTiming ) != pdPASS) {
+				ulFailed++;
+				xStop = xStopOnError;
+			}
+			if (ulTimed < cliRUN_SUMMARY_LINES) {
+				pxTimings[ ulTimed++ ] = xTiming;
+			} else {
+				ulNotShown++;
+			}
+		}
+	} while ((xRead != 0) && (xStop == pdFALSE));
+	xRunning = pdFALSE;
+	ff_fclose( pxFile );
+	vPortFree( pcBuffer );
+
+	if ((xStop != pdFALSE) && (xReturn == pdPASS)) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "Stopped at line %lu" cliNEW_LINE, ( unsigned long ) ulLine );
+	}
+	if (xReturn == pdPASS) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "Ran %lu lines of %s in %lu ms, %lu failed" cliNEW_LINE "  line       ms  command" cliNEW_LINE,
+			( unsigned long ) ulRun, cFileName, ( unsigned long ) ( ( xTaskGetTickCount() - xStart ) * portTICK_PERIOD_MS ),
+			( unsigned long ) ulFailed );
+	}
+	for (x = 0; (x < ulTimed) && (xReturn == pdPASS); x++) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "%6lu %8lu  %s" cliNEW_LINE,
+			( unsigned long ) pxTimings[ x ].ulLine, ( unsigned long ) pxTimings[ x ].ulMs, pxTimings[ x ].cCommand );
+	}
+	if ((xReturn == pdPASS) && (ulNotShown != 0)) {
+		xReturn = FreeRTOS_CLISinkPrintf( pxSink, "(and %lu more)" cliNEW_LINE, ( unsigned long ) ulNotShown );
+	}
+	vPortFree( pxTimings );
+
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvPrintXferStats(CLI_Output_Sink_t *pxSink, const char *pcVerb, const FF_XferStats_t *pxStats, TickType_t xTicks) {
+	return FreeRTOS_CLISinkPrintf( pxSink, "%s %lu bytes in %lu ms: %lu frames, %lu resent" cliNEW_LINE,
+		pcVerb, ( unsigned long ) pxStats->ulBytes, ( unsigned long ) ( xTicks * portTICK_PERIOD_MS ),
+		( unsigned long ) pxStats->ulFrames, ( unsigned long ) pxStats->ulResent );
+}
+/*-----------------------------------------------------------*/
+
 static void prvCreateFileInfoString(char *pcBuffer, FF_FindData_t *pxFindStruct) {
 const char * pcWritableFile = "writable file", *pcReadOnlyFile = "read only file", *pcDirectory = "directory";
 const char * pcAttrib;
@@ -54,6 +54,8 @@ specific language governing permissions and limitations under the License.
  */
 
 /* Standard includes. */
+#include <stdarg.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
@@ -66,10 +68,10 @@ specific language governing permissions and limitations under the License.
 
 #include "stdio_cli.h"
 
-typedef struct xCOMMAND_INPUT_LIST {
-	const CLI_Command_Definition_t *pxCommandLineDefinition;
-	struct xCOMMAND_INPUT_LIST *pxNext;
-} CLI_Definition_List_Item_t;
+/* The most commands that can be registered. */
+#ifndef cliMAX_COMMANDS
+	#define cliMAX_COMMANDS		128
+#endif
 
 /*
  * The callback function that is executed when "help" is entered.  This is the
@@ -77,23 +79,40 @@ typedef struct xCOMMAND_INPUT_LIST {
  */
 static BaseType_t prvHelpCommand( char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString );
 
+/*
+ * Find the registered command that pcCommandInput runs, or return NULL.
+ * *pxParametersOK is set to pdFALSE if it has the wrong number of parameters.
+ */
+static const CLI_Command_Definition_t *prvFindCommand( const char *pcCommandInput, BaseType_t *pxParametersOK );
+
+/*
+ * Return the index of the first registered command that does not sort before
+ * the xLength characters at pcName.
+ */
+static UBaseType_t prvLowerBound( const char *pcName, size_t xLength );
+
 /*
  * Return the number of parameters that follow the command name.
  */
 static int8_t prvGetNumberOfParameters( const char *pcCommandString );
 
-/* The definition of the "help" command.  This command is always at the front
-of the list of registered commands. */
+/*
+ * Does what FreeRTOS_CLIProcessCommandToSink() does, apart from capturing stdout.
+ */
+static BaseType_t prvProcessCommandToSink( const char * const pcCommandInput, CLI_Output_Sink_t *pxSink );
+
+/* The definition of the "help" command.  This command is always
+registered. */
 static const CLI_Command_Definition_t xHelpCommand =
 { "help", "\nhelp:\n Lists all the registered commands.\n\n"
 		"Prefix command with \"time \" to time execution.\n\n", prvHelpCommand, 0 };
 
-/* The definition of the list of commands.  Commands that are registered are
-added to pSD list. */
-static CLI_Definition_List_Item_t xRegisteredCommands =
-{ &xHelpCommand, /* The first command in the list is always the help command, defined in pSD file. */
-	NULL			/* The next pointer is initialised to NULL, as there are no other registered commands yet. */
+/* The registered commands, sorted by name, so that a command can be found by
+binary search, and the commands that start with some prefix are together. */
+static const CLI_Command_Definition_t *pxRegisteredCommands[ cliMAX_COMMANDS ] =
+{ &xHelpCommand /* The help command is always registered. */
 };
+static UBaseType_t uxRegisteredCommands = 1;
 
 /* A buffer into which command outputs can be written is declared here, rather
 than in the command console implementation, to allow multiple command consoles
@@ -105,94 +124,212 @@ reason, no attempt at providing mutual exclusion to the cOutputBuffer array is
 attempted. */
 static char cOutputBuffer[cmdMAX_OUTPUT_SIZE];
 
+/* The sink of the command FreeRTOS_CLIProcessCommandToSink() is running, and
+the task running it, for FreeRTOS_CLICaptureWrite().  xCaptureFailed is set if
+writing what it captured failed. */
+static CLI_Output_Sink_t *pxCaptureSink = NULL;
+static TaskHandle_t xCaptureTask = NULL;
+static BaseType_t xCaptureFailed = pdFALSE;
+
+static const char * const pcIncorrectParameters = "Incorrect command parameter(s).  Enter \"help\" to view a list of available commands.\n\n";
+static const char * const pcNotRecognised = "Command not recognised.  Enter 'help' to view a list of available commands.\n\n";
+
+/* A sink into a fixed buffer, for running streaming commands through
+FreeRTOS_CLIProcessCommand(). */
+typedef struct xCLI_BUFFER
+{
+	char *pcBuffer;
+	size_t xLength;
+	size_t xUsed;
+} CLI_Buffer_t;
+
 /*-----------------------------------------------------------*/
 
 BaseType_t FreeRTOS_CLIRegisterCommand(const CLI_Command_Definition_t * const pxCommandToRegister) {
-static CLI_Definition_List_Item_t *pxLastCommandInList = &xRegisteredCommands;
-CLI_Definition_List_Item_t *pxNewListItem;
+const char *pcName;
+UBaseType_t uxIndex;
 BaseType_t xReturn = pdFAIL;
 
 	/* Check the parameter is not NULL. */
 	configASSERT( pxCommandToRegister );
 
-	/* Create a new list item that will reference the command being registered. */
-	pxNewListItem = ( CLI_Definition_List_Item_t * ) pvPortMalloc( sizeof( CLI_Definition_List_Item_t ) );
-	configASSERT( pxNewListItem );
+	pcName = pxCommandToRegister->pcCommand;
+
+	taskENTER_CRITICAL();
+	{
+		/* Insert the command where it sorts.  A second command with the same
+		name would never be found, so isn't added. */
+		uxIndex = prvLowerBound( pcName, strlen( pcName ) );
+		if ((uxRegisteredCommands < cliMAX_COMMANDS) &&
+				((uxIndex == uxRegisteredCommands) || (strcmp( pxRegisteredCommands[ uxIndex ]->pcCommand, pcName ) != 0))) {
+			memmove( &pxRegisteredCommands[ uxIndex + 1 ], &pxRegisteredCommands[ uxIndex ],
+					( uxRegisteredCommands - uxIndex ) * sizeof( pxRegisteredCommands[ 0 ] ) );
+			pxRegisteredCommands[ uxIndex ] = pxCommandToRegister;
+			uxRegisteredCommands++;
+			xReturn = pdPASS;
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	/* Raise cliMAX_COMMANDS if this fails. */
+	configASSERT( xReturn == pdPASS );
 
-	if (pxNewListItem != NULL) {
-		taskENTER_CRITICAL();
-		{
-			/* Reference the command being registered from the newly created
-			list item. */
-			pxNewListItem->pxCommandLineDefinition = pxCommandToRegister;
+	return xReturn;
+}
+/*-----------------------------------------------------------*/
 
-			/* The new list item will get added to the end of the list, so
-			pxNext has nowhere to point. */
-			pxNewListItem->pxNext = NULL;
+static UBaseType_t prvLowerBound(const char *pcName, size_t xLength) {
+UBaseType_t uxLow = 0, uxHigh = uxRegisteredCommands, uxMiddle;
+const char *pcCommand;
+int iCompare;
 
-			/* Add the newly created list item to the end of the already existing
-			list. */
-			pxLastCommandInList->pxNext = pxNewListItem;
+	while (uxLow < uxHigh) {
+		uxMiddle = uxLow + ( uxHigh - uxLow ) / 2;
+		pcCommand = pxRegisteredCommands[ uxMiddle ]->pcCommand;
 
-			/* Set the end of list marker to the new list item. */
-			pxLastCommandInList = pxNewListItem;
+		/* A command that starts with the name doesn't sort before it. */
+		iCompare = strncmp( pcCommand, pcName, xLength );
+		if (iCompare < 0) {
+			uxLow = uxMiddle + 1;
+		} else {
+			uxHigh = uxMiddle;
 		}
-		taskEXIT_CRITICAL();
+	}
+
+	return uxLow;
+}
+/*-----------------------------------------------------------*/
 
-		xReturn = pdPASS;
+static const CLI_Command_Definition_t *prvFindCommand(const char *pcCommandInput, BaseType_t *pxParametersOK) {
+const CLI_Command_Definition_t *pxCommand = NULL;
+size_t xCommandStringLength;
+UBaseType_t uxIndex;
+
+	*pxParametersOK = pdTRUE;
+
+	/* The command is the first word of the input. */
+	xCommandStringLength = strcspn( pcCommandInput, " " );
+
+	/* Search for the command string in the registered commands.  To ensure
+	the string lengths match exactly, so as not to pick up a longer command
+	that starts with it, check the command ends there too. */
+	uxIndex = prvLowerBound( pcCommandInput, xCommandStringLength );
+	if ((uxIndex < uxRegisteredCommands) &&
+			(strncmp( pxRegisteredCommands[ uxIndex ]->pcCommand, pcCommandInput, xCommandStringLength ) == 0) &&
+			(pxRegisteredCommands[ uxIndex ]->pcCommand[ xCommandStringLength ] == 0x00)) {
+		pxCommand = pxRegisteredCommands[ uxIndex ];
+
+		/* The command has been found.  Check it has the expected number of
+		parameters.  If cExpectedNumberOfParameters is -1, then there could be
+		a variable number of parameters and no check is made. */
+		if (pxCommand->cExpectedNumberOfParameters >= 0) {
+			if (prvGetNumberOfParameters(pcCommandInput) != pxCommand->cExpectedNumberOfParameters) {
+				*pxParametersOK = pdFALSE;
+			}
+		}
 	}
 
-	return xReturn;
+	return pxCommand;
 }
 /*-----------------------------------------------------------*/
 
+UBaseType_t FreeRTOS_CLICompleteCommand(const char *pcPrefix, size_t xPrefixLength, char *pcCompletion, size_t xCompletionLength) {
+UBaseType_t uxFirst, uxLast, uxMatches;
+const char *pcFirst, *pcLast;
+size_t xCommon;
+
+	configASSERT( xCompletionLength > 0 );
+	pcCompletion[ 0 ] = 0x00;
+
+	uxFirst = prvLowerBound( pcPrefix, xPrefixLength );
+	for (uxLast = uxFirst; uxLast < uxRegisteredCommands; uxLast++) {
+		if (strncmp( pxRegisteredCommands[ uxLast ]->pcCommand, pcPrefix, xPrefixLength ) != 0) {
+			break;
+		}
+	}
+	uxMatches = uxLast - uxFirst;
+
+	if (uxMatches > 0) {
+		/* The commands are sorted, so what the first and last matches have in
+		common, they all have in common. */
+		pcFirst = pxRegisteredCommands[ uxFirst ]->pcCommand + xPrefixLength;
+		pcLast = pxRegisteredCommands[ uxLast - 1 ]->pcCommand + xPrefixLength;
+		for (xCommon = 0; (pcFirst[ xCommon ] != 0x00) && (pcFirst[ xCommon ] == pcLast[ xCommon ]); xCommon++) {
+		}
+		if (xCommon >= xCompletionLength) {
+			xCommon = xCompletionLength - 1;
+		}
+		memcpy( pcCompletion, pcFirst, xCommon );
+		pcCompletion[ xCommon ] = 0x00;
+	}
+
+	return uxMatches;
+}
+/*-----------------------------------------------------------*/
+
+const char *FreeRTOS_CLIGetCompletion(const char *pcPrefix, size_t xPrefixLength, UBaseType_t uxIndex) {
+	uxIndex += prvLowerBound( pcPrefix, xPrefixLength );
+
+	if ((uxIndex < uxRegisteredCommands) &&
+			(strncmp( pxRegisteredCommands[ uxIndex ]->pcCommand, pcPrefix, xPrefixLength ) == 0)) {
+		return pxRegisteredCommands[ uxIndex ]->pcCommand;
+	}
+
+	return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static BaseType_t prvBufferWrite(CLI_Output_Sink_t *pxSink, const char *pcData, size_t xLength) {
+CLI_Buffer_t *pxBuffer = ( CLI_Buffer_t * ) pxSink->pvContext;
+size_t xRoom = pxBuffer->xLength - pxBuffer->xUsed - 1;
+BaseType_t xReturn = pdPASS;
+
+	if (xLength > xRoom) {
+		/* Keep what fits, and stop the command. */
+		xLength = xRoom;
+		xReturn = pdFAIL;
+	}
+	memcpy( pxBuffer->pcBuffer + pxBuffer->xUsed, pcData, xLength );
+	pxBuffer->xUsed += xLength;
+	pxBuffer->pcBuffer[ pxBuffer->xUsed ] = 0x00;
+
+	return xReturn;
+}
+
+BaseType_t FreeRTOS_CLIRegisterStreamCommand(const CLI_Stream_Command_Definition_t * const pxCommandToRegister) {
+	configASSERT( pxCommandToRegister->xDefinition.pxCommandInterpreter == NULL );
+
+	return FreeRTOS_CLIRegisterCommand( &( pxCommandToRegister->xDefinition ) );
+}
+
 BaseType_t FreeRTOS_CLIProcessCommand(const char * const pcCommandInput, char * pcWriteBuffer, size_t xWriteBufferLen) {
-static const CLI_Definition_List_Item_t *pxCommand = NULL;
+static const CLI_Command_Definition_t *pxCommand = NULL;
 BaseType_t xReturn = pdTRUE;
-const char *pcRegisteredCommandString;
-size_t xCommandStringLength;
 
 	/* Note:  This function is not re-entrant.  It must not be called from more
 	thank one task. */
 
 	if (pxCommand == NULL) {
-		/* Search for the command string in the list of registered commands. */
-		for (pxCommand = &xRegisteredCommands; pxCommand != NULL; pxCommand = pxCommand->pxNext) {
-			pcRegisteredCommandString = pxCommand->pxCommandLineDefinition->pcCommand;
-			xCommandStringLength = strlen( pcRegisteredCommandString );
-
-			/* To ensure the string lengths match exactly, so as not to pick up
-			a sub-string of a longer command, check the byte after the expected
-			end of the string is either the end of the string or a space before
-			a parameter. */
-			if ((pcCommandInput[xCommandStringLength] == ' ') || (pcCommandInput[xCommandStringLength] == 0x00)) {
-				if (strncmp(pcCommandInput, pcRegisteredCommandString, xCommandStringLength) == 0) {
-					/* The command has been found.  Check it has the expected
-					number of parameters.  If cExpectedNumberOfParameters is -1,
-					then there could be a variable number of parameters and no
-					check is made. */
-					if (pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters >= 0) {
-						if (prvGetNumberOfParameters(pcCommandInput)
-								!= pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters) {
-							xReturn = pdFALSE;
-						}
-					}
-
-					break;
-				}
-			}
-		}
+		pxCommand = prvFindCommand( pcCommandInput, &xReturn );
 	}
 
 	if ((pxCommand != NULL) && (xReturn == pdFALSE)) {
 		/* The command was found, but the number of parameters with the command
 		was incorrect. */
-		strncpy(pcWriteBuffer, "Incorrect command parameter(s).  Enter \"help\" to view a list of available commands.\n\n",
-				xWriteBufferLen);
+		strncpy(pcWriteBuffer, pcIncorrectParameters, xWriteBufferLen);
+		pxCommand = NULL;
+	} else if ((pxCommand != NULL) && (pxCommand->pxCommandInterpreter == NULL)) {
+		/* A streaming command.  Return as much of its output as fits. */
+		CLI_Buffer_t xBuffer = { pcWriteBuffer, xWriteBufferLen, 0 };
+		CLI_Output_Sink_t xSink = { prvBufferWrite, &xBuffer };
+
+		pcWriteBuffer[ 0 ] = 0x00;
+		( ( const CLI_Stream_Command_Definition_t * ) pxCommand )->pxStreamInterpreter( &xSink, pcCommandInput );
 		pxCommand = NULL;
+		xReturn = pdFALSE;
 	} else if (pxCommand != NULL) {
 		/* Call the callback function that is registered to pSD command. */
-		xReturn = pxCommand->pxCommandLineDefinition->pxCommandInterpreter( pcWriteBuffer, xWriteBufferLen, pcCommandInput );
+		xReturn = pxCommand->pxCommandInterpreter( pcWriteBuffer, xWriteBufferLen, pcCommandInput );
 
 		/* If xReturn is pdFALSE, then no further strings will be returned
 		after pSD one, and	pxCommand can be reset to NULL ready to search
@@ -202,14 +339,144 @@ size_t xCommandStringLength;
 		}
 	} else {
 		/* pxCommand was NULL, the command was not found. */
-		strncpy(pcWriteBuffer, "Command not recognised.  Enter 'help' to view a list of available commands.\n\n",
-				xWriteBufferLen);
+		strncpy(pcWriteBuffer, pcNotRecognised, xWriteBufferLen);
 		xReturn = pdFALSE;
 	}
 
 	return xReturn;
 }
-/*-----------------------------------------------------------*/
+
+BaseType_t FreeRTOS_CLIProcessCommandToSink(const char * const pcCommandInput, CLI_Output_Sink_t *pxSink) {
+/* run calls this again for each line of its script, so put back what was
+being captured before. */
+CLI_Output_Sink_t *pxOuterSink = pxCaptureSink;
+TaskHandle_t xOuterTask = xCaptureTask;
+BaseType_t xOuterFailed = xCaptureFailed, xReturn;
+
+	pxCaptureSink = pxSink;
+	xCaptureTask = xTaskGetCurrentTaskHandle();
+	xCaptureFailed = pdFALSE;
+	xReturn = prvProcessCommandToSink( pcCommandInput, pxSink );
+	if (xCaptureFailed != pdFALSE) {
+		xReturn = pdFAIL;
+	}
+	pxCaptureSink = pxOuterSink;
+	xCaptureTask = xOuterTask;
+	xCaptureFailed = xOuterFailed;
+
+	return xReturn;
+}
+
+BaseType_t FreeRTOS_CLICaptureWrite(const char *pcData, size_t xLength) {
+CLI_Output_Sink_t *pxSink = pxCaptureSink;
+
+	if ((pxSink == NULL) || (xCaptureTask != xTaskGetCurrentTaskHandle())) {
+		return pdFALSE;
+	}
+
+	/* Anything the sink prints while writing goes to the console. */
+	pxCaptureSink = NULL;
+	if (FreeRTOS_CLISinkWrite( pxSink, pcData, xLength ) != pdPASS) {
+		xCaptureFailed = pdTRUE;
+	}
+	pxCaptureSink = pxSink;
+
+	return pdTRUE;
+}
+
+static BaseType_t prvProcessCommandToSink(const char * const pcCommandInput, CLI_Output_Sink_t *pxSink) {
+const CLI_Command_Definition_t *pxDefinition;
+BaseType_t xParametersOK, xMoreDataToFollow, xReturn = pdPASS;
+
+	/* Note:  This function is not re-entrant either. */
+
+	pxDefinition = prvFindCommand( pcCommandInput, &xParametersOK );
+
+	if (pxDefinition == NULL) {
+		return FreeRTOS_CLISinkWrite( pxSink, pcNotRecognised, strlen( pcNotRecognised ) );
+	}
+	if (xParametersOK == pdFALSE) {
+		return FreeRTOS_CLISinkWrite( pxSink, pcIncorrectParameters, strlen( pcIncorrectParameters ) );
+	}
+
+	if (pxDefinition->pxCommandInterpreter == NULL) {
+		/* A streaming command: xDefinition is the start of a
+		CLI_Stream_Command_Definition_t. */
+		return ( ( const CLI_Stream_Command_Definition_t * ) pxDefinition )->pxStreamInterpreter( pxSink, pcCommandInput );
+	}
+
+	/* A command that returns its output a buffer at a time.  Call it until it
+	has no more to say, even after the sink has failed, so that it can clean
+	up. */
+	do {
+		cOutputBuffer[ 0 ] = 0x00;
+		xMoreDataToFollow = pxDefinition->pxCommandInterpreter( cOutputBuffer, sizeof( cOutputBuffer ), pcCommandInput );
+
+		if (xReturn == pdPASS) {
+			xReturn = FreeRTOS_CLISinkWrite( pxSink, cOutputBuffer, strlen( cOutputBuffer ) );
+		}
+	} while (xMoreDataToFollow != pdFALSE);
+
+	return xReturn;
+}
+
+BaseType_t FreeRTOS_CLISinkWrite(CLI_Output_Sink_t *pxSink, const char *pcData, size_t xLength) {
+	if (xLength == 0) {
+		return pdPASS;
+	}
+	return pxSink->pxWrite( pxSink, pcData, xLength );
+}
+
+BaseType_t FreeRTOS_CLISinkPrintf(CLI_Output_Sink_t *pxSink, const char *pcFormat, ...) {
+char cBuffer[ 128 ];
+char *pcBuffer;
+va_list xArgs;
+int iLength;
+BaseType_t xReturn;
+
+	va_start( xArgs, pcFormat );
+	iLength = vsnprintf( cBuffer, sizeof( cBuffer ), pcFormat, xArgs );
+	va_end( xArgs );
+
+	if (iLength < 0) {
+		return pdFAIL;
+	}
+	if ((size_t) iLength < sizeof( cBuffer )) {
+		return FreeRTOS_CLISinkWrite( pxSink, cBuffer, iLength );
+	}
+
+	/* Too long for the stack. */
+	pcBuffer = ( char * ) pvPortMalloc( iLength + 1 );
+	if (pcBuffer == NULL) {
+		return pdFAIL;
+	}
+	va_start( xArgs, pcFormat );
+	vsnprintf( pcBuffer, iLength + 1, pcFormat, xArgs );
+	va_end( xArgs );
+	xReturn = FreeRTOS_CLISinkWrite( pxSink, pcBuffer, iLength );
+	vPortFree( pcBuffer );
+
+	return xReturn;
+}
+
+static BaseType_t prvStreamBufferWrite(CLI_Output_Sink_t *pxSink, const char *pcData, size_t xLength) {
+StreamBufferHandle_t xStreamBuffer = ( StreamBufferHandle_t ) pxSink->pvContext;
+size_t xSent;
+
+	/* Back-pressure: wait for the reader to make room. */
+	while (xLength > 0) {
+		xSent = xStreamBufferSend( xStreamBuffer, pcData, xLength, portMAX_DELAY );
+		pcData += xSent;
+		xLength -= xSent;
+	}
+
+	return pdPASS;
+}
+
+void FreeRTOS_CLIStreamBufferSink(CLI_Output_Sink_t *pxSink, StreamBufferHandle_t xStreamBuffer) {
+	pxSink->pxWrite = prvStreamBufferWrite;
+	pxSink->pvContext = ( void * ) xStreamBuffer;
+}
 
 char *FreeRTOS_CLIGetOutputBuffer(void) {
 	return cOutputBuffer;
@@ -264,23 +531,21 @@ const char *pcReturn = NULL;
 /*-----------------------------------------------------------*/
 
 static BaseType_t prvHelpCommand(char *pcWriteBuffer, size_t xWriteBufferLen, const char *pcCommandString) {
-static const CLI_Definition_List_Item_t * pxCommand = NULL;
+static UBaseType_t uxCommand = 0;
 BaseType_t xReturn;
 
 	( void ) pcCommandString;
 
-	if (pxCommand == NULL) {
-		/* Reset the pxCommand pointer back to the start of the list. */
-		pxCommand = &xRegisteredCommands;
-	}
+	/* Return the next command help string, before moving the index on to
+	the next command. */
+	strncpy( pcWriteBuffer, pxRegisteredCommands[ uxCommand ]->pcHelpString, xWriteBufferLen );
+	uxCommand++;
 
-	/* Return the next command help string, before moving the pointer on to
-	the next command in the list. */
-	strncpy( pcWriteBuffer, pxCommand->pxCommandLineDefinition->pcHelpString, xWriteBufferLen );
-	pxCommand = pxCommand->pxNext;
+	if (uxCommand >= uxRegisteredCommands) {
+		/* Reset the index back to the start, ready for the next time. */
+		uxCommand = 0;
 
-	if (pxCommand == NULL) {
-		/* There are no more commands in the list, so there will be no more
+		/* There are no more commands, so there will be no more
 		strings to return after pSD one and pdFALSE should be returned. */
 		xReturn = pdFALSE;
 	} else {
@@ -0,0 +1,143 @@
+/* ff_copy.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <stdbool.h>
+
+#include "ff_copy.h"
+#include "ff_direct_io.h"
+#include "ff_stdio.h"
+#include "ff_utils.h"
+#include "semphr.h"
+#include "task.h"
+
+#define COPY_BUFFER_BYTES (ffconfigCOPY_BUFFER_SECTORS * 512UL)
+
+// A chunk for the writer task
+typedef struct {
+    FF_FILE *pxFile;
+    const uint8_t *pucData;
+    size_t xSize;
+    size_t xDone;
+    int iErrno;
+    TaskHandle_t xClient;
+} copy_job_t;
+
+static TaskHandle_t xWriter;
+static copy_job_t xJob;
+
+static void prvWriterTask(void *arg) {
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xJob.xDone =
+            ff_fwrite_direct(xJob.pucData, 1, xJob.xSize, xJob.pxFile);
+        // errno is per task
+        xJob.iErrno = stdioGET_ERRNO();
+        xTaskNotifyGive(xJob.xClient);
+    }
+}
+
+/* There is one writer, shared by all copies: take the lock before using it.
+Returns NULL if it couldn't be started. */
+static SemaphoreHandle_t prvLock(void) {
+    static StaticSemaphore_t xMutexBuffer;
+    static SemaphoreHandle_t xMutex;
+
+    taskENTER_CRITICAL();
+    if (!xMutex) xMutex = xSemaphoreCreateMutexStatic(&xMutexBuffer);
+    taskEXIT_CRITICAL();
+    xSemaphoreTake(xMutex, portMAX_DELAY);
+    if (!xWriter) {
+        static StackType_t xStack[768];
+        static StaticTask_t xTaskBuffer;
+        xWriter = xTaskCreateStatic(prvWriterTask, "CopyWriter",
+                                    sizeof xStack / sizeof xStack[0], 0,
+                                    uxTaskPriorityGet(NULL), xStack,
+                                    &xTaskBuffer);
+    }
+    return xMutex;
+}
+
+static bool prvWaitWriter(void) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (xJob.xDone == xJob.xSize) return true;
+    stdioSET_ERRNO(xJob.iErrno ? xJob.iErrno : pdFREERTOS_ERRNO_EIO);
+    return false;
+}
+
+static bool prvCopy(FF_FILE *pxSource, FF_FILE *pxDestination, uint32_t ulSize,
+                    uint8_t *pucBuffers[2]) {
+    bool bPending = false, bOK = true;
+    size_t i = 0;
+
+    // Run at the caller's priority, whatever that is this time
+    vTaskPrioritySet(xWriter, uxTaskPriorityGet(NULL));
+    while (ulSize && bOK) {
+        size_t n = ulSize < COPY_BUFFER_BYTES ? ulSize : COPY_BUFFER_BYTES;
+        // Read the next chunk while the writer writes the last
+        if (ff_fread_direct(pucBuffers[i], 1, n, pxSource) != n) {
+            if (!stdioGET_ERRNO()) stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+            bOK = false;
+            break;
+        }
+        if (bPending) bOK = prvWaitWriter();
+        if (!bOK) {
+            bPending = false;
+            break;
+        }
+        xJob.pxFile = pxDestination;
+        xJob.pucData = pucBuffers[i];
+        xJob.xSize = n;
+        xJob.xClient = xTaskGetCurrentTaskHandle();
+        xTaskNotifyGive(xWriter);
+        bPending = true;
+        ulSize -= n;
+        i ^= 1;
+    }
+    if (bPending && !prvWaitWriter()) bOK = false;
+    return bOK;
+}
+
+int ff_fcopy(const char *pcSource, const char *pcDestination) {
+    int iResult = -1;
+
+    FF_FILE *pxSource = ff_fopen(pcSource, "r");
+    if (!pxSource) return -1;
+    FF_FILE *pxDestination = ff_fopen(pcDestination, "w");
+    if (!pxDestination) {
+        ff_fclose(pxSource);
+        return -1;
+    }
+    uint32_t ulSize = pxSource->ulFileSize;
+    uint8_t *pucBuffers[2] = {pvPortMalloc(COPY_BUFFER_BYTES),
+                              pvPortMalloc(COPY_BUFFER_BYTES)};
+    if (!pucBuffers[0] || !pucBuffers[1]) {
+        stdioSET_ERRNO(pdFREERTOS_ERRNO_ENOMEM);
+    } else if (-1 != ff_fallocate(pxDestination, ulSize)) {
+        SemaphoreHandle_t xMutex = prvLock();
+        if (!xWriter)
+            stdioSET_ERRNO(pdFREERTOS_ERRNO_ENOMEM);
+        else if (prvCopy(pxSource, pxDestination, ulSize, pucBuffers))
+            iResult = 0;
+        xSemaphoreGive(xMutex);
+    }
+    vPortFree(pucBuffers[0]);
+    vPortFree(pucBuffers[1]);
+    ff_fclose(pxSource);
+    // Trim in case the copy stopped short
+    if (-1 == ff_fclose(pxDestination)) iResult = -1;
+    return iResult;
+}
+
+/* [] END OF FILE */
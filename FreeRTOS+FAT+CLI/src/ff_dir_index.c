@@ -0,0 +1,620 @@
+/* ff_dir_index.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff_dir_index.h"
+#include "ff_stdio.h"
+#include "task.h"
+
+// FF_DirIndex_t.ucState
+#define DIR_INDEX_EMPTY 0
+#define DIR_INDEX_BUSY 1  // Being built or changed, by whoever claimed it
+#define DIR_INDEX_READY 2
+#define DIR_INDEX_TOO_BIG 3  // More names than it holds: left to FreeRTOS+FAT
+
+// Long name (LFN) entries
+#define LFN_ORDINAL_MASK 0x1F
+#define LFN_LAST 0x40   // In the ordinal: the part with the end of the name
+#define LFN_CHECKSUM 13  // Of the short entry the long name belongs to
+#define LFN_CHARS 13     // In each part
+
+typedef struct {
+    uint16_t usHash;
+    uint16_t usEntry;  // Of the short entry
+} FF_DirIndexName_t;
+
+typedef struct {
+    // Key:
+    FF_IOManager_t *pxIOManager;
+    uint32_t ulDirCluster;
+
+    uint32_t ulLastUsed;
+    uint16_t usNames;
+    uint8_t ucBusy;
+    uint8_t ucState;
+    bool bForget;  // Forgotten while busy: drop it when let go
+    FF_DirIndexName_t xNames[ffconfigDIR_INDEX_NAMES];  // Sorted by hash
+} FF_DirIndex_t;
+
+#if ffconfigDIR_INDEX_DIRS > 0
+static FF_DirIndex_t xIndexes[ffconfigDIR_INDEX_DIRS];
+#endif
+static uint32_t ulUseCount;
+// The last directory looked in that wasn't indexed (see ff_dir_index.h)
+static FF_IOManager_t *pxLastIOManager;
+static uint32_t ulLastDirCluster;
+/* Changes under way through the calls wrapped below. FreeRTOS+FAT looks up
+the names it is about to create or remove, and may go on to use what its own
+search leaves in FF_FindParams_t, so meanwhile no lookup is answered here. */
+static uint32_t ulChanging;
+/* Where FF_FindEntryInDir() leaves usCurrentItem, relative to the short
+entry it found, as learnt from a lookup left to it; -1 until then. */
+static int8_t cItemOffset = -1;
+static uint32_t ulHits, ulScans;
+
+// Where the characters of its part of the name are, in an LFN entry
+static const uint8_t ucLFNOffsets[LFN_CHARS] = {1,  3,  5,  7,  9,  14, 16,
+                                                18, 20, 22, 24, 28, 30};
+
+// FreeRTOS+FAT compares names ignoring ASCII case
+static char prvFold(char c) {
+    return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+static bool prvSameName(const char *pc1, const char *pc2) {
+    for (; *pc1 && prvFold(*pc1) == prvFold(*pc2); ++pc1, ++pc2)
+        ;
+    return prvFold(*pc1) == prvFold(*pc2);
+}
+
+// FNV-1a, folded to 16 bits
+static uint16_t prvHash(const char *pcName) {
+    uint32_t ulHash = 2166136261UL;
+    for (; *pcName; ++pcName) {
+        ulHash ^= (uint8_t)prvFold(*pcName);
+        ulHash *= 16777619UL;
+    }
+    return (uint16_t)(ulHash ^ ulHash >> 16);
+}
+
+static uint8_t prvChecksum(const uint8_t *pucEntry) {
+    uint8_t ucSum = 0;
+    for (size_t i = 0; i < 11; ++i)
+        ucSum = (uint8_t)(((ucSum & 1) << 7) + (ucSum >> 1) + pucEntry[i]);
+    return ucSum;
+}
+
+// A live short entry, other than a volume label, "." or ".."
+static bool prvIsShortEntry(const uint8_t *pucEntry) {
+    uint8_t ucAttrib = FF_getChar(pucEntry, FF_FAT_DIRENT_ATTRIB);
+    return 0x00 != pucEntry[0] && FF_FAT_DELETED != pucEntry[0] &&
+           '.' != pucEntry[0] &&
+           FF_FAT_ATTR_LFN != (ucAttrib & FF_FAT_ATTR_LFN) &&
+           !(ucAttrib & FF_FAT_ATTR_VOLID);
+}
+
+// Part xSeq (counting from 1) of the long name of a short entry
+static bool prvIsLongNamePart(const uint8_t *pucEntry, size_t xSeq,
+                              uint8_t ucSum) {
+    return FF_FAT_DELETED != pucEntry[0] &&
+           FF_FAT_ATTR_LFN == (FF_getChar(pucEntry, FF_FAT_DIRENT_ATTRIB) &
+                               FF_FAT_ATTR_LFN) &&
+           (pucEntry[0] & LFN_ORDINAL_MASK) == xSeq &&
+           pucEntry[LFN_CHECKSUM] == ucSum;
+}
+
+/* The short name, as "NAME.EXT", in pcName (of at least 13). Returns false
+if it isn't plain ASCII: only ASCII is compared the same way here as in
+FreeRTOS+FAT. */
+static bool prvShortName(const uint8_t *pucEntry, char *pcName) {
+    size_t xLength = 0;
+
+    for (size_t i = 0; i < 11; ++i) {
+        if (pucEntry[i] & 0x80 || 0x05 == pucEntry[i]) return false;
+        if (8 == i) {
+            while (xLength && ' ' == pcName[xLength - 1]) --xLength;
+            if (' ' != pucEntry[i]) pcName[xLength++] = '.';
+        }
+        pcName[xLength++] = (char)pucEntry[i];
+    }
+    while (xLength && ' ' == pcName[xLength - 1]) --xLength;
+    pcName[xLength] = '\0';
+    return true;
+}
+
+/* Copy the part of a long name in an LFN entry to its place in pcName (of
+ffconfigMAX_FILENAME). Returns false if it doesn't fit, or isn't plain
+ASCII. */
+static bool prvLongNamePart(const uint8_t *pucEntry, char *pcName) {
+    size_t xSeq = pucEntry[0] & LFN_ORDINAL_MASK;
+
+    if (!xSeq || xSeq * LFN_CHARS >= ffconfigMAX_FILENAME) return false;
+    char *pc = pcName + (xSeq - 1) * LFN_CHARS;
+    if (pucEntry[0] & LFN_LAST) pc[LFN_CHARS] = '\0';
+    for (size_t i = 0; i < LFN_CHARS; ++i) {
+        uint16_t usChar = FF_getShort(pucEntry, ucLFNOffsets[i]);
+        if (!usChar) {
+            pc[i] = '\0';
+            break;
+        }
+        if (usChar > 0x7F) return false;
+        pc[i] = (char)usChar;
+    }
+    return true;
+}
+
+/* The name entry usEntry is indexed by, in pcName (of ffconfigMAX_FILENAME):
+its long name or, if it has none, its short one. Returns false if it isn't a
+live short entry, or has no name that can be indexed. */
+static bool prvEntryName(FF_IOManager_t *pxIOManager,
+                         FF_FetchContext_t *pxContext, uint16_t usEntry,
+                         char *pcName, uint8_t *pucAttrib) {
+    uint8_t ucEntry[FF_SIZEOF_DIRECTORY_ENTRY];
+
+    if (FF_isERR(FF_FetchEntryWithContext(pxIOManager, usEntry, pxContext,
+                                          ucEntry)) != pdFALSE ||
+        !prvIsShortEntry(ucEntry))
+        return false;
+    *pucAttrib = FF_getChar(ucEntry, FF_FAT_DIRENT_ATTRIB);
+    uint8_t ucSum = prvChecksum(ucEntry);
+    bool bShort = prvShortName(ucEntry, pcName);
+    // The parts of the long name come before it, the first nearest
+    for (size_t xSeq = 1;; ++xSeq) {
+        bool bPart = xSeq <= usEntry &&
+                     FF_isERR(FF_FetchEntryWithContext(
+                         pxIOManager, usEntry - xSeq, pxContext, ucEntry)) ==
+                         pdFALSE &&
+                     prvIsLongNamePart(ucEntry, xSeq, ucSum);
+        if (!bPart) return 1 == xSeq && bShort;
+        if (!prvLongNamePart(ucEntry, pcName)) return false;
+        if (ucEntry[0] & LFN_LAST) return true;
+    }
+}
+
+static int prvCompareNames(const void *pv1, const void *pv2) {
+    const FF_DirIndexName_t *px1 = pv1, *px2 = pv2;
+    if (px1->usHash != px2->usHash) return px1->usHash < px2->usHash ? -1 : 1;
+    return (int)px1->usEntry - (int)px2->usEntry;
+}
+
+// The first name in the index with a hash of at least usHash
+static size_t prvLowerBound(const FF_DirIndex_t *pxIndex, uint16_t usHash) {
+    size_t lo = 0, hi = pxIndex->usNames;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (pxIndex->xNames[mid].usHash < usHash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void prvDrop(FF_DirIndex_t *pxIndex) {
+    pxIndex->pxIOManager = NULL;
+    pxIndex->ucState = DIR_INDEX_EMPTY;
+    pxIndex->bForget = false;
+    pxIndex->ulLastUsed = 0;
+}
+
+/* Find the directory's index, for a lookup if it is ready, or to change it
+(bChange) if nobody else is using it. Or, for a second lookup in a row in a
+directory that isn't indexed, recycle the least recently used idle index, in
+state DIR_INDEX_BUSY, for the caller to build. Returns NULL if none of that
+can be done. */
+static FF_DirIndex_t *prvClaim(FF_IOManager_t *pxIOManager,
+                               uint32_t ulDirCluster, bool bChange) {
+    FF_DirIndex_t *pxIndex = NULL;
+#if ffconfigDIR_INDEX_DIRS > 0
+    FF_DirIndex_t *pxFound = NULL;
+
+    taskENTER_CRITICAL();
+    for (size_t i = 0; i < ffconfigDIR_INDEX_DIRS; ++i) {
+        FF_DirIndex_t *px = &xIndexes[i];
+        if (DIR_INDEX_EMPTY != px->ucState && px->pxIOManager == pxIOManager &&
+            px->ulDirCluster == ulDirCluster) {
+            pxFound = px;
+            break;
+        }
+        if (!px->ucBusy && (!pxIndex || px->ulLastUsed < pxIndex->ulLastUsed))
+            pxIndex = px;
+    }
+    if (pxFound) {
+        pxIndex = NULL;
+        if (DIR_INDEX_READY == pxFound->ucState && !pxFound->bForget) {
+            if (!bChange) {
+                pxIndex = pxFound;
+            } else if (!pxFound->ucBusy) {
+                pxIndex = pxFound;
+                pxIndex->ucState = DIR_INDEX_BUSY;
+            } else {
+                // Can't be changed while it is read: do without it
+                pxFound->bForget = true;
+            }
+        }
+    } else if (bChange) {
+        pxIndex = NULL;  // Not indexed, so nothing to change
+    } else if (pxLastIOManager != pxIOManager ||
+               ulLastDirCluster != ulDirCluster) {
+        pxLastIOManager = pxIOManager;
+        ulLastDirCluster = ulDirCluster;
+        pxIndex = NULL;
+    } else if (pxIndex) {
+        pxIndex->pxIOManager = pxIOManager;
+        pxIndex->ulDirCluster = ulDirCluster;
+        pxIndex->usNames = 0;
+        pxIndex->ucState = DIR_INDEX_BUSY;
+        pxIndex->bForget = false;
+    }
+    if (pxIndex) {
+        ++pxIndex->ucBusy;
+        pxIndex->ulLastUsed = ++ulUseCount;
+    }
+    taskEXIT_CRITICAL();
+#else
+    (void)pxIOManager;
+    (void)ulDirCluster;
+    (void)bChange;
+#endif
+    return pxIndex;
+}
+
+// Let the index go, having set it to ucState if it was claimed busy
+static void prvRelease(FF_DirIndex_t *pxIndex, uint8_t ucState) {
+    taskENTER_CRITICAL();
+    if (DIR_INDEX_BUSY == pxIndex->ucState) pxIndex->ucState = ucState;
+    if (!--pxIndex->ucBusy &&
+        (pxIndex->bForget || DIR_INDEX_EMPTY == pxIndex->ucState))
+        prvDrop(pxIndex);
+    taskEXIT_CRITICAL();
+}
+
+static void prvForget(FF_IOManager_t *pxIOManager, uint32_t ulDirCluster,
+                      bool bAll) {
+#if ffconfigDIR_INDEX_DIRS > 0
+    taskENTER_CRITICAL();
+    for (size_t i = 0; i < ffconfigDIR_INDEX_DIRS; ++i) {
+        FF_DirIndex_t *px = &xIndexes[i];
+        if (DIR_INDEX_EMPTY == px->ucState || px->pxIOManager != pxIOManager ||
+            (!bAll && px->ulDirCluster != ulDirCluster))
+            continue;
+        if (px->ucBusy)
+            px->bForget = true;
+        else
+            prvDrop(px);
+    }
+    taskEXIT_CRITICAL();
+#else
+    (void)pxIOManager;
+    (void)ulDirCluster;
+    (void)bAll;
+#endif
+}
+
+/* Read the whole directory, and index its names. Sets *pucState to
+DIR_INDEX_READY, or DIR_INDEX_TOO_BIG if they don't all fit. pcName is
+scratch, of ffconfigMAX_FILENAME. */
+static FF_Error_t prvBuild(FF_IOManager_t *pxIOManager, FF_DirIndex_t *pxIndex,
+                           char *pcName, uint8_t *pucState) {
+    FF_FetchContext_t xContext;
+    uint8_t ucEntry[FF_SIZEOF_DIRECTORY_ENTRY];
+    char pcShort[13];
+    uint8_t ucSum = 0;
+    size_t xWant = 0;    // The part of a long name expected next, or 0
+    bool bLong = false;  // The entries just read make a whole long name
+
+    *pucState = DIR_INDEX_READY;
+    FF_Error_t xError, xTempError;
+    xError = FF_InitEntryFetch(pxIOManager, pxIndex->ulDirCluster, &xContext);
+    if (FF_isERR(xError) != pdFALSE) return xError;
+    for (uint32_t ulEntry = 0; ulEntry < FF_MAX_ENTRIES_PER_DIRECTORY;
+         ++ulEntry) {
+        xError = FF_FetchEntryWithContext(pxIOManager, ulEntry, &xContext,
+                                          ucEntry);
+        if (FF_isERR(xError) != pdFALSE) {
+            // The directory's clusters are full, with no end marker
+            if (FF_GETERROR(xError) == FF_ERR_DIR_END_OF_DIR)
+                xError = FF_ERR_NONE;
+            break;
+        }
+        if (0x00 == ucEntry[0]) break;  // Nothing is used beyond here
+        uint8_t ucAttrib = FF_getChar(ucEntry, FF_FAT_DIRENT_ATTRIB);
+        if (FF_FAT_DELETED != ucEntry[0] &&
+            FF_FAT_ATTR_LFN == (ucAttrib & FF_FAT_ATTR_LFN)) {
+            // The parts of a long name come last first
+            if (ucEntry[0] & LFN_LAST) {
+                xWant = ucEntry[0] & LFN_ORDINAL_MASK;
+                ucSum = ucEntry[LFN_CHECKSUM];
+            }
+            if (xWant && prvIsLongNamePart(ucEntry, xWant, ucSum) &&
+                prvLongNamePart(ucEntry, pcName)) {
+                bLong = 0 == --xWant;
+            } else {
+                xWant = 0;
+                bLong = false;
+            }
+            continue;
+        }
+        bool bHasLong = bLong && prvChecksum(ucEntry) == ucSum;
+        xWant = 0;
+        bLong = false;
+        if (!prvIsShortEntry(ucEntry)) continue;
+        const char *pcIndexed = bHasLong                          ? pcName
+                                : prvShortName(ucEntry, pcShort) ? pcShort
+                                                                  : NULL;
+        if (!pcIndexed) continue;
+        if (ffconfigDIR_INDEX_NAMES == pxIndex->usNames) {
+            *pucState = DIR_INDEX_TOO_BIG;
+            break;
+        }
+        FF_DirIndexName_t *pxName = &pxIndex->xNames[pxIndex->usNames++];
+        pxName->usHash = prvHash(pcIndexed);
+        pxName->usEntry = (uint16_t)ulEntry;
+    }
+    xTempError = FF_CleanupEntryFetch(pxIOManager, &xContext);
+    if (FF_isERR(xError) == pdFALSE) xError = xTempError;
+    if (FF_isERR(xError) == pdFALSE && DIR_INDEX_READY == *pucState)
+        qsort(pxIndex->xNames, pxIndex->usNames, sizeof pxIndex->xNames[0],
+              prvCompareNames);
+    return xError;
+}
+
+/* Look pcName up in the directory's index, building the index first if there
+isn't one. Returns the index of its short entry, or -1 to leave the lookup to
+FreeRTOS+FAT. pcScratch: of ffconfigMAX_FILENAME. */
+static int32_t prvFind(FF_IOManager_t *pxIOManager, uint32_t ulDirCluster,
+                       const char *pcName, uint8_t ucAttrib, char *pcScratch) {
+    int32_t lEntry = -1;
+    uint8_t ucState = DIR_INDEX_READY;
+
+    if (ulChanging) return -1;
+    FF_DirIndex_t *pxIndex = prvClaim(pxIOManager, ulDirCluster, false);
+    if (!pxIndex) return -1;
+    if (DIR_INDEX_BUSY == pxIndex->ucState &&
+        FF_isERR(prvBuild(pxIOManager, pxIndex, pcScratch, &ucState)) !=
+            pdFALSE)
+        ucState = DIR_INDEX_EMPTY;
+
+    FF_FetchContext_t xContext;
+    if (DIR_INDEX_READY == ucState && cItemOffset >= 0 &&
+        FF_isERR(FF_InitEntryFetch(pxIOManager, ulDirCluster, &xContext)) ==
+            pdFALSE) {
+        uint16_t usHash = prvHash(pcName);
+        for (size_t i = prvLowerBound(pxIndex, usHash);
+             i < pxIndex->usNames && pxIndex->xNames[i].usHash == usHash; ++i) {
+            uint16_t usEntry = pxIndex->xNames[i].usEntry;
+            uint8_t ucFound;
+            // The hash is only 16 bits: the entry has the last word
+            if (prvEntryName(pxIOManager, &xContext, usEntry, pcScratch,
+                             &ucFound) &&
+                prvSameName(pcScratch, pcName)) {
+                if ((ucFound & ucAttrib) == ucAttrib) lEntry = usEntry;
+                break;
+            }
+        }
+        FF_CleanupEntryFetch(pxIOManager, &xContext);
+    }
+    prvRelease(pxIndex, ucState);
+    return lEntry;
+}
+
+/* Learn where FF_FindEntryInDir() leaves usCurrentItem, from a lookup that
+was left to it and found pcName: on the short entry, or just past it. */
+static void prvLearnItemOffset(FF_IOManager_t *pxIOManager,
+                               uint32_t ulDirCluster, const char *pcName,
+                               uint16_t usItem) {
+    FF_FetchContext_t xContext;
+    uint8_t ucAttrib;
+
+    char *pcScratch = pvPortMalloc(ffconfigMAX_FILENAME);
+    if (!pcScratch) return;
+    if (FF_isERR(FF_InitEntryFetch(pxIOManager, ulDirCluster, &xContext)) ==
+        pdFALSE) {
+        for (int8_t c = 1; c >= 0 && cItemOffset < 0; --c)
+            if (usItem >= c &&
+                prvEntryName(pxIOManager, &xContext, usItem - c, pcScratch,
+                             &ucAttrib) &&
+                prvSameName(pcScratch, pcName))
+                cItemOffset = c;
+        FF_CleanupEntryFetch(pxIOManager, &xContext);
+    }
+    vPortFree(pcScratch);
+}
+
+/* FF_Open() may have created the file: if so, and its directory is indexed,
+add it. */
+static void prvAddCreated(FF_FILE *pxFile) {
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    FF_FetchContext_t xContext;
+    uint8_t ucAttrib, ucState = DIR_INDEX_READY;
+
+    FF_DirIndex_t *pxIndex =
+        prvClaim(pxIOManager, pxFile->ulDirCluster, true);
+    if (!pxIndex) return;
+    for (size_t i = 0; i < pxIndex->usNames; ++i)
+        if (pxIndex->xNames[i].usEntry == pxFile->usDirEntry) {
+            // It was there already
+            prvRelease(pxIndex, ucState);
+            return;
+        }
+    char *pcName = pvPortMalloc(ffconfigMAX_FILENAME);
+    bool bNamed = false;
+    if (pcName && FF_isERR(FF_InitEntryFetch(pxIOManager, pxFile->ulDirCluster,
+                                             &xContext)) == pdFALSE) {
+        bNamed = prvEntryName(pxIOManager, &xContext, pxFile->usDirEntry,
+                              pcName, &ucAttrib);
+        FF_CleanupEntryFetch(pxIOManager, &xContext);
+    }
+    if (!bNamed) {
+        // Read it all again when next needed
+        ucState = DIR_INDEX_EMPTY;
+    } else if (ffconfigDIR_INDEX_NAMES == pxIndex->usNames) {
+        ucState = DIR_INDEX_TOO_BIG;
+    } else {
+        uint16_t usHash = prvHash(pcName);
+        size_t i = prvLowerBound(pxIndex, usHash);
+        memmove(&pxIndex->xNames[i + 1], &pxIndex->xNames[i],
+                (pxIndex->usNames - i) * sizeof pxIndex->xNames[0]);
+        pxIndex->xNames[i].usHash = usHash;
+        pxIndex->xNames[i].usEntry = pxFile->usDirEntry;
+        ++pxIndex->usNames;
+    }
+    vPortFree(pcName);
+    prvRelease(pxIndex, ucState);
+}
+
+/* Forget the index of the directory holding pcPath, or, if that can't be
+found, every index of the disk. */
+static void prvForgetParent(FF_IOManager_t *pxIOManager, const char *pcPath) {
+    FF_Error_t xError = FF_ERR_NONE;
+    uint32_t ulDirCluster = 0;
+
+    const char *pcSlash = strrchr(pcPath, '/');
+    if (pcSlash) {
+        uint16_t usLength =
+            pcSlash == pcPath ? 1 : (uint16_t)(pcSlash - pcPath);
+        ulDirCluster = FF_FindDir(pxIOManager, pcPath, usLength, &xError);
+    }
+    if (ulDirCluster && FF_isERR(xError) == pdFALSE)
+        prvForget(pxIOManager, ulDirCluster, false);
+    else
+        prvForget(pxIOManager, 0, true);
+}
+
+static void prvChanging(bool bStart) {
+    taskENTER_CRITICAL();
+    if (bStart)
+        ++ulChanging;
+    else
+        --ulChanging;
+    taskEXIT_CRITICAL();
+}
+
+void ff_dir_index_forget(FF_IOManager_t *pxIOManager, uint32_t ulDirCluster) {
+    prvForget(pxIOManager, ulDirCluster, false);
+}
+
+void ff_dir_index_counts(uint32_t *pulHits, uint32_t *pulScans) {
+    *pulHits = ulHits;
+    *pulScans = ulScans;
+}
+
+/* FF_FindEntryInDir(), FF_Open(), FF_MkDir(), FF_RmFile(), FF_RmDir(),
+FF_Move() and FF_Unmount() are wrapped at link time (--wrap, see
+CMakeLists.txt). See ff_dir_index.h. */
+uint32_t __real_FF_FindEntryInDir(FF_IOManager_t *pxIOManager,
+                                  FF_FindParams_t *pxFindParams,
+                                  const char *pcName, uint8_t pa_Attrib,
+                                  FF_DirEnt_t *pxDirEntry,
+                                  FF_Error_t *pxError);
+FF_FILE *__real_FF_Open(FF_IOManager_t *pxIOManager, const char *pcPath,
+                        uint8_t ucMode, FF_Error_t *pxError);
+FF_Error_t __real_FF_MkDir(FF_IOManager_t *pxIOManager, const char *pcPath);
+FF_Error_t __real_FF_RmFile(FF_IOManager_t *pxIOManager, const char *pcPath);
+FF_Error_t __real_FF_RmDir(FF_IOManager_t *pxIOManager, const char *pcPath);
+FF_Error_t __real_FF_Move(FF_IOManager_t *pxIOManager,
+                          const char *szSourceFile,
+                          const char *szDestinationFile,
+                          BaseType_t xDeleteExisting);
+FF_Error_t __real_FF_Unmount(FF_Disk_t *pxDisk);
+
+uint32_t __wrap_FF_FindEntryInDir(FF_IOManager_t *pxIOManager,
+                                  FF_FindParams_t *pxFindParams,
+                                  const char *pcName, uint8_t pa_Attrib,
+                                  FF_DirEnt_t *pxDirEntry,
+                                  FF_Error_t *pxError) {
+    uint32_t ulDirCluster = pxFindParams->ulDirCluster;
+
+    // pxDirEntry->pcFileName is scratch until there is an entry to return
+    int32_t lEntry =
+        pcName == pxDirEntry->pcFileName
+            ? -1
+            : prvFind(pxIOManager, ulDirCluster, pcName, pa_Attrib,
+                      pxDirEntry->pcFileName);
+    if (lEntry >= 0 &&
+        FF_isERR(FF_GetEntry(pxIOManager, (uint16_t)lEntry, ulDirCluster,
+                             pxDirEntry)) == pdFALSE) {
+        pxDirEntry->usCurrentItem = (uint16_t)(lEntry + cItemOffset);
+        ++ulHits;
+        *pxError = FF_ERR_NONE;
+        return pxDirEntry->ulObjectCluster;
+    }
+    ++ulScans;
+    uint32_t ulCluster = __real_FF_FindEntryInDir(
+        pxIOManager, pxFindParams, pcName, pa_Attrib, pxDirEntry, pxError);
+    if (cItemOffset < 0 && FF_isERR(*pxError) == pdFALSE)
+        prvLearnItemOffset(pxIOManager, ulDirCluster, pcName,
+                           pxDirEntry->usCurrentItem);
+    return ulCluster;
+}
+
+FF_FILE *__wrap_FF_Open(FF_IOManager_t *pxIOManager, const char *pcPath,
+                        uint8_t ucMode, FF_Error_t *pxError) {
+    FF_FILE *pxFile = __real_FF_Open(pxIOManager, pcPath, ucMode, pxError);
+    if (pxFile && ucMode & FF_MODE_CREATE) prvAddCreated(pxFile);
+    return pxFile;
+}
+
+FF_Error_t __wrap_FF_MkDir(FF_IOManager_t *pxIOManager, const char *pcPath) {
+    prvChanging(true);
+    FF_Error_t xError = __real_FF_MkDir(pxIOManager, pcPath);
+    prvForgetParent(pxIOManager, pcPath);
+    prvChanging(false);
+    return xError;
+}
+
+FF_Error_t __wrap_FF_RmFile(FF_IOManager_t *pxIOManager, const char *pcPath) {
+    prvChanging(true);
+    FF_Error_t xError = __real_FF_RmFile(pxIOManager, pcPath);
+    prvForgetParent(pxIOManager, pcPath);
+    prvChanging(false);
+    return xError;
+}
+
+FF_Error_t __wrap_FF_RmDir(FF_IOManager_t *pxIOManager, const char *pcPath) {
+    FF_Error_t xError;
+
+    prvChanging(true);
+    // Its clusters may soon hold another directory
+    uint32_t ulDirCluster =
+        FF_FindDir(pxIOManager, pcPath, (uint16_t)strlen(pcPath), &xError);
+    xError = __real_FF_RmDir(pxIOManager, pcPath);
+    if (ulDirCluster) prvForget(pxIOManager, ulDirCluster, false);
+    prvForgetParent(pxIOManager, pcPath);
+    prvChanging(false);
+    return xError;
+}
+
+FF_Error_t __wrap_FF_Move(FF_IOManager_t *pxIOManager,
+                          const char *szSourceFile,
+                          const char *szDestinationFile,
+                          BaseType_t xDeleteExisting) {
+    prvChanging(true);
+    FF_Error_t xError = __real_FF_Move(pxIOManager, szSourceFile,
+                                       szDestinationFile, xDeleteExisting);
+    prvForgetParent(pxIOManager, szSourceFile);
+    prvForgetParent(pxIOManager, szDestinationFile);
+    prvChanging(false);
+    return xError;
+}
+
+FF_Error_t __wrap_FF_Unmount(FF_Disk_t *pxDisk) {
+    if (pxDisk && pxDisk->pxIOManager) prvForget(pxDisk->pxIOManager, 0, true);
+    return __real_FF_Unmount(pxDisk);
+}
+
+/* [] END OF FILE */
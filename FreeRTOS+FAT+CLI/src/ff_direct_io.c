@@ -0,0 +1,172 @@
+/* ff_direct_io.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <stdbool.h>
+
+#include "ff_direct_io.h"
+#include "ff_extent_map.h"
+#include "ff_sddisk.h"
+#include "ff_stdio.h"
+#include "ff_utils.h"
+//
+#include "sd_card.h"
+
+#define SECTOR_SIZE 512UL
+
+int prvFFErrorToErrno(FF_Error_t xError);  // In ff_stdio.c
+
+/* Can this request go direct? The cached path handles anything else. */
+static bool prvCanGoDirect(FF_FILE *pxFile, uint8_t ucMode) {
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+
+    if (!(pxFile->ucMode & ucMode)) return false;
+    // Appends are positioned by ff_fwrite
+    if (FF_MODE_WRITE == ucMode && (pxFile->ucMode & FF_MODE_APPEND))
+        return false;
+    if (pxIOManager->xPartition.usBlkSize != SECTOR_SIZE) return false;
+    if (pxFile->ulFilePointer % SECTOR_SIZE) return false;
+#if (ffconfigOPTIMISE_UNALIGNED_ACCESS != 0)
+    // The file's own sector buffer holds data not yet written
+    if (pxFile->ucState & FF_BUFSTATE_WRITTEN) return false;
+#endif
+    return true;
+}
+
+/* Mark cached copies of sectors that are about to be overwritten as
+invalid. The cache has been flushed, so there is nothing to lose. */
+static void prvInvalidateRange(FF_IOManager_t *pxIOManager, uint32_t ulLBA,
+                               uint32_t ulCount) {
+    FF_PendSemaphore(pxIOManager->pvSemaphore);
+    for (uint16_t i = 0; i < pxIOManager->usCacheSize; ++i) {
+        FF_Buffer_t *pxBuffer = &pxIOManager->pxBuffers[i];
+        if (pxBuffer->ulSector >= ulLBA &&
+            pxBuffer->ulSector < ulLBA + ulCount && !pxBuffer->usNumHandles)
+            pxBuffer->bValid = pdFALSE;
+    }
+    FF_ReleaseSemaphore(pxIOManager->pvSemaphore);
+}
+
+/* Transfer ulSectors whole sectors at the (sector aligned) file pointer,
+one multi-block command per run of contiguous clusters. The cluster chain
+must already cover the range. */
+static FF_Error_t prvDirectTransfer(FF_FILE *pxFile, uint8_t *pucBuffer,
+                                    uint32_t ulSectors, bool bWrite) {
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    sd_card_t *pSD = pxIOManager->xBlkDevice.pxDisk->pvTag;
+    uint32_t ulSPC = pxIOManager->xPartition.ulSectorsPerCluster;
+    uint32_t ulClusterBytes = ulSPC * SECTOR_SIZE;
+
+    // Anything dirty in the cache must reach the card first
+    FF_Error_t xError = FF_FlushCache(pxIOManager);
+
+    while (ulSectors && FF_isERR(xError) == pdFALSE) {
+        uint32_t ulRel = pxFile->ulFilePointer / ulClusterBytes;
+        uint32_t ulOffset = pxFile->ulFilePointer % ulClusterBytes / SECTOR_SIZE;
+        uint32_t ulRun;
+
+        FF_LockFAT(pxIOManager);
+        uint32_t ulCluster = ff_extent_lookup(pxFile, ulRel, &ulRun, &xError);
+        FF_UnlockFAT(pxIOManager);
+        if (FF_isERR(xError) != pdFALSE) break;
+
+        uint32_t ulCount = ulSectors;
+        if ((uint64_t)ulRun * ulSPC - ulOffset < ulCount) {
+            ulCount = ulRun * ulSPC - ulOffset;
+        } else {
+            ulRun = (ulOffset + ulCount + ulSPC - 1) / ulSPC;
+        }
+        uint32_t ulLBA = FF_Cluster2LBA(pxIOManager, ulCluster) + ulOffset;
+        int status;
+        if (bWrite) {
+            prvInvalidateRange(pxIOManager, ulLBA, ulCount);
+            FF_SDDiskReadAheadInvalidate(pxIOManager->xBlkDevice.pxDisk, ulLBA,
+                                         ulCount);
+            status = sd_write_blocks(pSD, pucBuffer, ulLBA, ulCount);
+        } else {
+            status = sd_read_blocks(pSD, pucBuffer, ulLBA, ulCount);
+        }
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            xError = FF_ERR_IOMAN_DRIVER_FATAL_ERROR | FF_ERRFLAG;
+            break;
+        }
+        pucBuffer += ulCount * SECTOR_SIZE;
+        ulSectors -= ulCount;
+        pxFile->ulFilePointer += ulCount * SECTOR_SIZE;
+        // Leave the file positioned on the last cluster of the run
+        pxFile->ulCurrentCluster = ulRel + ulRun - 1;
+        pxFile->ulAddrCurrentCluster = ulCluster + ulRun - 1;
+    }
+#if (ffconfigOPTIMISE_UNALIGNED_ACCESS != 0)
+    if (bWrite) pxFile->ucState = FF_BUFSTATE_INVALID;
+#endif
+    return xError;
+}
+
+size_t ff_fread_direct(void *pvBuffer, size_t xSize, size_t xItems,
+                       FF_FILE *pxStream) {
+    size_t xBytes = xSize * xItems, xDone = 0;
+
+    if (!xBytes) return 0;
+    if (prvCanGoDirect(pxStream, FF_MODE_READ) &&
+        pxStream->ulFilePointer < pxStream->ulFileSize) {
+        uint32_t ulAvail = pxStream->ulFileSize - pxStream->ulFilePointer;
+        uint32_t ulSectors =
+            (xBytes < ulAvail ? xBytes : ulAvail) / SECTOR_SIZE;
+        if (ulSectors) {
+            uint32_t ulStart = pxStream->ulFilePointer;
+            FF_Error_t xError =
+                prvDirectTransfer(pxStream, pvBuffer, ulSectors, false);
+            xDone = pxStream->ulFilePointer - ulStart;
+            if (FF_isERR(xError) != pdFALSE) {
+                stdioSET_ERRNO(prvFFErrorToErrno(xError));
+                return xDone / xSize;
+            }
+        }
+    }
+    if (xDone < xBytes)
+        xDone += ff_fread((uint8_t *)pvBuffer + xDone, 1, xBytes - xDone,
+                          pxStream);
+    return xDone / xSize;
+}
+
+size_t ff_fwrite_direct(const void *pvBuffer, size_t xSize, size_t xItems,
+                        FF_FILE *pxStream) {
+    size_t xBytes = xSize * xItems, xDone = 0;
+
+    if (!xBytes) return 0;
+    if (prvCanGoDirect(pxStream, FF_MODE_WRITE)) {
+        uint32_t ulSectors = xBytes / SECTOR_SIZE;
+        if (ulSectors) {
+            uint32_t ulStart = pxStream->ulFilePointer;
+            FF_Error_t xError =
+                FF_Allocate(pxStream, ulStart + ulSectors * SECTOR_SIZE);
+            if (FF_isERR(xError) == pdFALSE)
+                xError = prvDirectTransfer(pxStream, (uint8_t *)pvBuffer,
+                                           ulSectors, true);
+            xDone = pxStream->ulFilePointer - ulStart;
+            if (pxStream->ulFilePointer > pxStream->ulFileSize)
+                pxStream->ulFileSize = pxStream->ulFilePointer;
+            if (FF_isERR(xError) != pdFALSE) {
+                stdioSET_ERRNO(prvFFErrorToErrno(xError));
+                return xDone / xSize;
+            }
+        }
+    }
+    if (xDone < xBytes)
+        xDone += ff_fwrite((const uint8_t *)pvBuffer + xDone, 1,
+                           xBytes - xDone, pxStream);
+    return xDone / xSize;
+}
+
+/* [] END OF FILE */
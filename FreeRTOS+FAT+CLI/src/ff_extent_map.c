@@ -0,0 +1,240 @@
+/* ff_extent_map.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <stdbool.h>
+
+#include "ff_extent_map.h"
+#include "ff_stdio.h"
+#include "task.h"
+
+typedef struct {
+    uint32_t ulFileCluster;  // Index in the file of the first cluster
+    uint32_t ulFirstCluster;
+    uint32_t ulLength;
+} FF_Extent_t;
+
+typedef struct {
+    // Key:
+    FF_FILE *pxFile;
+    uint32_t ulObjectCluster;
+
+    uint32_t ulFileSize;  // As last seen, to notice truncation
+    uint32_t ulLastUsed;
+    uint16_t usRuns;
+    uint8_t ucBusy;
+    bool bComplete;  // The last run ends the chain
+    FF_Extent_t xRuns[ffconfigEXTENT_MAP_RUNS];
+} FF_ExtentMap_t;
+
+static FF_ExtentMap_t xMaps[ffconfigEXTENT_MAPS];
+static uint32_t ulUseCount;
+
+int prvFFErrorToErrno(FF_Error_t xError);  // In ff_stdio.c
+
+static uint32_t prvMappedClusters(const FF_ExtentMap_t *pxMap) {
+    if (!pxMap->usRuns) return 0;
+    const FF_Extent_t *pxRun = &pxMap->xRuns[pxMap->usRuns - 1];
+    return pxRun->ulFileCluster + pxRun->ulLength;
+}
+
+/* Find the file's map, or recycle the least recently used idle one. Returns
+NULL if every map is in use. */
+static FF_ExtentMap_t *prvClaimMap(FF_FILE *pxFile) {
+    FF_ExtentMap_t *pxMap = NULL;
+
+    taskENTER_CRITICAL();
+    for (size_t i = 0; i < ffconfigEXTENT_MAPS; ++i) {
+        FF_ExtentMap_t *px = &xMaps[i];
+        if (px->pxFile == pxFile &&
+            px->ulObjectCluster == pxFile->ulObjectCluster) {
+            pxMap = px;
+            break;
+        }
+        if (!px->ucBusy &&
+            (!pxMap || px->ulLastUsed < pxMap->ulLastUsed))
+            pxMap = px;
+    }
+    if (pxMap) {
+        if (pxMap->pxFile != pxFile ||
+            pxMap->ulObjectCluster != pxFile->ulObjectCluster) {
+            pxMap->pxFile = pxFile;
+            pxMap->ulObjectCluster = pxFile->ulObjectCluster;
+            pxMap->usRuns = 0;
+            pxMap->bComplete = false;
+        }
+        ++pxMap->ucBusy;
+        pxMap->ulLastUsed = ++ulUseCount;
+    }
+    taskEXIT_CRITICAL();
+    return pxMap;
+}
+
+static void prvReleaseMap(FF_ExtentMap_t *pxMap) {
+    taskENTER_CRITICAL();
+    --pxMap->ucBusy;
+    taskEXIT_CRITICAL();
+}
+
+/* Walk the chain from the end of the map until cluster ulRel is mapped and
+its run has ended, the chain ends, or the map is full. */
+static FF_Error_t prvExtendMap(FF_IOManager_t *pxIOManager,
+                               FF_ExtentMap_t *pxMap, uint32_t ulRel) {
+    FF_FATBuffers_t xFATBuffers;
+    FF_Error_t xError = FF_ERR_NONE, xTempError;
+    uint32_t ulLast = pxIOManager->xPartition.ulNumClusters + 1;
+
+    if (!pxMap->usRuns) {
+        pxMap->xRuns[0].ulFileCluster = 0;
+        pxMap->xRuns[0].ulFirstCluster = pxMap->ulObjectCluster;
+        pxMap->xRuns[0].ulLength = 1;
+        pxMap->usRuns = 1;
+    }
+    FF_Extent_t *pxRun = &pxMap->xRuns[pxMap->usRuns - 1];
+    uint32_t ulCluster = pxRun->ulFirstCluster + pxRun->ulLength - 1;
+
+    FF_InitFATBuffers(&xFATBuffers, FF_MODE_READ);
+    while (!pxMap->bComplete) {
+        uint32_t ulNext =
+            FF_getFATEntry(pxIOManager, ulCluster, &xError, &xFATBuffers);
+        if (FF_isERR(xError) != pdFALSE) break;
+        if (FF_isEndOfChain(pxIOManager, ulNext) != pdFALSE) {
+            pxMap->bComplete = true;
+            break;
+        }
+        if (ulNext < 2 || ulNext > ulLast) {
+            // A free or out of range entry in a chain: the FAT is damaged
+            xError = FF_ERR_IOMAN_OUT_OF_BOUNDS_READ | FF_ERRFLAG;
+            break;
+        }
+        if (ulNext == ulCluster + 1) {
+            ++pxRun->ulLength;
+        } else {
+            if (ulRel < prvMappedClusters(pxMap)) break;
+            if (pxMap->usRuns == ffconfigEXTENT_MAP_RUNS) break;
+            FF_Extent_t *pxPrev = pxRun;
+            pxRun = &pxMap->xRuns[pxMap->usRuns++];
+            pxRun->ulFileCluster = pxPrev->ulFileCluster + pxPrev->ulLength;
+            pxRun->ulFirstCluster = ulNext;
+            pxRun->ulLength = 1;
+        }
+        ulCluster = ulNext;
+    }
+    xTempError = FF_ReleaseFATBuffers(pxIOManager, &xFATBuffers);
+    if (FF_isERR(xError) == pdFALSE) xError = xTempError;
+    return xError;
+}
+
+uint32_t ff_extent_lookup(FF_FILE *pxFile, uint32_t ulRel, uint32_t *pulRun,
+                          FF_Error_t *pxError) {
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    uint32_t ulCluster = 0;
+
+    *pxError = FF_ERR_NONE;
+    *pulRun = 1;
+    if (!pxFile->ulObjectCluster) {
+        *pxError = FF_ERR_IOMAN_OUT_OF_BOUNDS_READ | FF_ERRFLAG;
+        return 0;
+    }
+    FF_ExtentMap_t *pxMap = prvClaimMap(pxFile);
+    if (!pxMap) {
+        // All maps busy: do it the slow way
+        return FF_TraverseFAT(pxIOManager, pxFile->ulObjectCluster, ulRel,
+                              pxError);
+    }
+    if (pxFile->ulFileSize < pxMap->ulFileSize) {
+        // Truncated: the end of the chain may have moved
+        pxMap->usRuns = 0;
+        pxMap->bComplete = false;
+    }
+    pxMap->ulFileSize = pxFile->ulFileSize;
+
+    uint32_t ulMapped = prvMappedClusters(pxMap);
+    if (ulRel >= ulMapped && pxMap->bComplete) {
+        // Perhaps the file has been extended since
+        pxMap->bComplete = false;
+    }
+    if (ulRel >= ulMapped) {
+        *pxError = prvExtendMap(pxIOManager, pxMap, ulRel);
+        ulMapped = prvMappedClusters(pxMap);
+    }
+    if (FF_isERR(*pxError) == pdFALSE) {
+        if (ulRel < ulMapped) {
+            // Binary search for the run holding ulRel
+            size_t lo = 0, hi = pxMap->usRuns - 1;
+            while (lo < hi) {
+                size_t mid = (lo + hi + 1) / 2;
+                if (pxMap->xRuns[mid].ulFileCluster <= ulRel)
+                    lo = mid;
+                else
+                    hi = mid - 1;
+            }
+            const FF_Extent_t *pxRun = &pxMap->xRuns[lo];
+            uint32_t ulIndex = ulRel - pxRun->ulFileCluster;
+            ulCluster = pxRun->ulFirstCluster + ulIndex;
+            *pulRun = pxRun->ulLength - ulIndex;
+        } else if (pxMap->bComplete) {
+            *pxError = FF_ERR_IOMAN_OUT_OF_BOUNDS_READ | FF_ERRFLAG;
+        } else {
+            // The map is full: walk on from its end
+            const FF_Extent_t *pxRun = &pxMap->xRuns[pxMap->usRuns - 1];
+            ulCluster = FF_TraverseFAT(
+                pxIOManager, pxRun->ulFirstCluster + pxRun->ulLength - 1,
+                ulRel - ulMapped + 1, pxError);
+        }
+    }
+    prvReleaseMap(pxMap);
+    return ulCluster;
+}
+
+int ff_fseek_mapped(FF_FILE *pxStream, long lOffset, int iWhence) {
+    int iResult = ff_fseek(pxStream, lOffset, iWhence);
+    if (iResult) return iResult;
+
+    FF_IOManager_t *pxIOManager = pxStream->pxIOManager;
+    uint32_t ulClusterBytes = pxIOManager->xPartition.usBlkSize *
+                              pxIOManager->xPartition.ulSectorsPerCluster;
+    uint32_t ulRel = pxStream->ulFilePointer / ulClusterBytes;
+
+    // Nothing to gain at the start of the file, or past the end of it
+    if (!ulRel || pxStream->ulFilePointer >= pxStream->ulFileSize) return 0;
+
+    FF_Error_t xError;
+    uint32_t ulRun;
+    FF_LockFAT(pxIOManager);
+    uint32_t ulCluster = ff_extent_lookup(pxStream, ulRel, &ulRun, &xError);
+    FF_UnlockFAT(pxIOManager);
+    if (FF_isERR(xError) != pdFALSE) {
+        stdioSET_ERRNO(prvFFErrorToErrno(xError));
+        return -1;
+    }
+    pxStream->ulCurrentCluster = ulRel;
+    pxStream->ulAddrCurrentCluster = ulCluster;
+    return 0;
+}
+
+void ff_extent_map_invalidate(FF_FILE *pxFile) {
+    taskENTER_CRITICAL();
+    for (size_t i = 0; i < ffconfigEXTENT_MAPS; ++i) {
+        FF_ExtentMap_t *pxMap = &xMaps[i];
+        if (pxMap->pxFile == pxFile) {
+            pxMap->pxFile = NULL;
+            pxMap->ulObjectCluster = 0;
+            pxMap->usRuns = 0;
+            pxMap->bComplete = false;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+/* [] END OF FILE */
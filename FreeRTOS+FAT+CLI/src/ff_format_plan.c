@@ -0,0 +1,194 @@
+/* ff_format_plan.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <string.h>
+
+#include "ff_format_plan.h"
+
+#define SECTOR_SIZE 512UL
+
+#define FAT16_MIN_CLUSTERS 4085UL
+#define FAT16_MAX_CLUSTERS 65524UL
+#define FAT32_MIN_CLUSTERS 65525UL
+#define FAT32_MAX_CLUSTERS 0x0FFFFFF5UL
+
+#define FAT16_ROOT_ENTRIES 512UL
+#define FAT16_RESERVED_SECTORS 1UL
+#define FAT32_MIN_RESERVED_SECTORS 32UL
+#define NUM_FATS 2UL
+
+// Largest cluster that every FAT implementation accepts (64 KiB)
+#define MAX_SECTORS_PER_CLUSTER 128UL
+
+/* Format parameters by capacity, from the SD Association "Part 2 File System
+Specification". Cards up to 64 MB are specified as FAT12, which is not
+configured here (ffconfigFAT12_SUPPORT), so they get FAT16 with smaller
+clusters. SDXC cards are specified as exFAT; FAT32 with 64 KiB clusters keeps
+the FAT (and the free cluster scan at mount) to a reasonable size. */
+static const struct {
+    uint32_t ulMaxSectors;
+    uint32_t ulSectorsPerCluster;
+    uint32_t ulBoundarySectors;
+} xLayouts[] = {
+    {16384UL, 16, 16},        // <= 8 MB
+    {131072UL, 32, 32},       // <= 64 MB
+    {524288UL, 32, 32},       // <= 256 MB
+    {2097152UL, 32, 64},      // <= 1 GB
+    {4194304UL, 64, 128},     // <= 2 GB (SDSC)
+    {67108864UL, 64, 8192},   // <= 32 GB (SDHC)
+    {268435456UL, 128, 32768},  // <= 128 GB (SDXC)
+    {UINT32_MAX, 128, 65536},   // <= 2 TB (SDXC)
+};
+
+static uint32_t div_up(uint64_t n, uint32_t d) { return (n + d - 1) / d; }
+
+/* Lay out the partition for a given FAT type and cluster size. The data
+area is aligned to ulBoundary. Fills in the plan even if the resulting
+cluster count is outside the limits for the FAT type, so the caller can
+adjust the cluster size and retry. */
+static void prvPlan(uint8_t ucBits, uint32_t ulTotal, uint32_t ulSPC,
+                    uint32_t ulBoundary, FF_FormatPlan_t *pxPlan) {
+    memset(pxPlan, 0, sizeof *pxPlan);
+    pxPlan->ucFATBits = ucBits;
+    pxPlan->ucNumFATs = NUM_FATS;
+    pxPlan->ulSectorsPerCluster = ulSPC;
+
+    // An upper bound: the data area is smaller than the card.
+    pxPlan->ulSectorsPerFAT =
+        div_up(((uint64_t)ulTotal / ulSPC + 2) * (ucBits / 8), SECTOR_SIZE);
+    uint32_t ulFATs = NUM_FATS * pxPlan->ulSectorsPerFAT;
+
+    if (32 == ucBits) {
+        /* FAT32: The partition starts on a BU boundary, and the reserved area
+        is padded so that the FATs end on a BU boundary. */
+        pxPlan->ulHiddenSectors = ulBoundary;
+        for (;;) {
+            uint32_t ulSys =
+                pxPlan->ulHiddenSectors + FAT32_MIN_RESERVED_SECTORS + ulFATs;
+            pxPlan->ulReservedSectors =
+                FAT32_MIN_RESERVED_SECTORS +
+                (ulBoundary - ulSys % ulBoundary) % ulBoundary;
+            // BPB_RsvdSecCnt is a 16 bit field
+            if (pxPlan->ulReservedSectors <= UINT16_MAX) break;
+            ulBoundary /= 2;
+        }
+    } else {
+        /* FAT16: The reserved area is a single sector, so the partition
+        start is moved instead, to put the end of the root directory on a BU
+        boundary. */
+        pxPlan->ulReservedSectors = FAT16_RESERVED_SECTORS;
+        pxPlan->ulRootDirSectors = FAT16_ROOT_ENTRIES * 32 / SECTOR_SIZE;
+        uint32_t ulSys = FAT16_RESERVED_SECTORS + ulFATs + pxPlan->ulRootDirSectors;
+        pxPlan->ulHiddenSectors = (ulBoundary - ulSys % ulBoundary) % ulBoundary;
+        // Sector 0 holds the MBR
+        if (!pxPlan->ulHiddenSectors) pxPlan->ulHiddenSectors = ulBoundary;
+    }
+    pxPlan->ulBoundarySectors = ulBoundary;
+    pxPlan->ulFATBeginLBA =
+        pxPlan->ulHiddenSectors + pxPlan->ulReservedSectors;
+    pxPlan->ulDataBeginLBA =
+        pxPlan->ulFATBeginLBA + ulFATs + pxPlan->ulRootDirSectors;
+    if (pxPlan->ulDataBeginLBA >= ulTotal) return;
+    pxPlan->ulPartitionSectors = ulTotal - pxPlan->ulHiddenSectors;
+    pxPlan->ulClusterCount = (ulTotal - pxPlan->ulDataBeginLBA) / ulSPC;
+}
+
+bool ff_format_plan(uint64_t ullTotalSectors, uint32_t ulAUSectors,
+                    FF_FormatPlan_t *pxPlan) {
+    // 32 bit LBAs in the MBR and BPB
+    if (!pxPlan || !ullTotalSectors || ullTotalSectors > UINT32_MAX)
+        return false;
+    uint32_t ulTotal = ullTotalSectors;
+
+    size_t i = 0;
+    while (ulTotal > xLayouts[i].ulMaxSectors) ++i;
+    uint32_t ulSPC = xLayouts[i].ulSectorsPerCluster;
+    uint32_t ulBoundary = xLayouts[i].ulBoundarySectors;
+
+    if (ulAUSectors) {
+        /* Align to a multiple of the card's own AU (which need not be a
+        power of two: 12 MB and 24 MB are legal), unless that would waste
+        more than 1/64 of a small card. */
+        uint32_t ulAUAligned =
+            div_up(ulBoundary, ulAUSectors) * ulAUSectors;
+        if (ulAUAligned <= ulTotal / 64) ulBoundary = ulAUAligned;
+        // A cluster must not straddle an AU
+        while (ulSPC > ulAUSectors && ulSPC > 1) ulSPC /= 2;
+    }
+    // Cluster boundaries must fall on BU boundaries
+    while (ulBoundary % ulSPC) ulSPC /= 2;
+
+    uint8_t ucBits = ulTotal > xLayouts[4].ulMaxSectors ? 32 : 16;
+    uint32_t ulMin = 32 == ucBits ? FAT32_MIN_CLUSTERS : FAT16_MIN_CLUSTERS;
+    uint32_t ulMax = 32 == ucBits ? FAT32_MAX_CLUSTERS : FAT16_MAX_CLUSTERS;
+
+    /* Adjust the cluster size until the cluster count suits the FAT type.
+    This only comes into play at the edges of the capacity ranges. */
+    for (;;) {
+        prvPlan(ucBits, ulTotal, ulSPC, ulBoundary, pxPlan);
+        if (pxPlan->ulClusterCount < ulMin && ulSPC > 1) {
+            ulSPC /= 2;
+        } else if (pxPlan->ulClusterCount > ulMax &&
+                   ulSPC < MAX_SECTORS_PER_CLUSTER) {
+            ulSPC *= 2;
+            if (ulBoundary < ulSPC) ulBoundary = ulSPC;
+        } else {
+            break;
+        }
+    }
+    return NULL == ff_format_plan_check(ullTotalSectors, pxPlan);
+}
+
+const char *ff_format_plan_check(uint64_t ullTotalSectors,
+                                 const FF_FormatPlan_t *pxPlan) {
+    const FF_FormatPlan_t *p = pxPlan;
+    uint64_t ullEnd = (uint64_t)p->ulHiddenSectors + p->ulPartitionSectors;
+
+    if (16 != p->ucFATBits && 32 != p->ucFATBits) return "FAT type";
+    if (!p->ucNumFATs) return "number of FATs";
+    if (!p->ulHiddenSectors) return "partition overlaps MBR";
+    if (!p->ulPartitionSectors || ullEnd > ullTotalSectors)
+        return "partition exceeds card";
+    if (!p->ulSectorsPerCluster || p->ulSectorsPerCluster > MAX_SECTORS_PER_CLUSTER ||
+        (p->ulSectorsPerCluster & (p->ulSectorsPerCluster - 1)))
+        return "cluster size";
+    if (!p->ulReservedSectors || p->ulReservedSectors > UINT16_MAX)
+        return "reserved sector count";
+    if (32 == p->ucFATBits && p->ulReservedSectors < FAT32_MIN_RESERVED_SECTORS)
+        return "reserved sector count";
+    if (p->ulFATBeginLBA != p->ulHiddenSectors + p->ulReservedSectors)
+        return "FAT placement";
+    if (p->ulDataBeginLBA != p->ulFATBeginLBA +
+                                 p->ucNumFATs * p->ulSectorsPerFAT +
+                                 p->ulRootDirSectors)
+        return "data area placement";
+    if (!p->ulBoundarySectors || p->ulBoundarySectors % p->ulSectorsPerCluster)
+        return "boundary unit";
+    if (p->ulDataBeginLBA % p->ulBoundarySectors) return "data area alignment";
+    if (16 == p->ucFATBits && (p->ulClusterCount < FAT16_MIN_CLUSTERS ||
+                               p->ulClusterCount > FAT16_MAX_CLUSTERS))
+        return "FAT16 cluster count";
+    if (32 == p->ucFATBits && (p->ulClusterCount < FAT32_MIN_CLUSTERS ||
+                               p->ulClusterCount > FAT32_MAX_CLUSTERS))
+        return "FAT32 cluster count";
+    if ((uint64_t)p->ulSectorsPerFAT * SECTOR_SIZE * 8 / p->ucFATBits <
+        (uint64_t)p->ulClusterCount + 2)
+        return "FAT too small";
+    if (p->ulDataBeginLBA +
+            (uint64_t)p->ulClusterCount * p->ulSectorsPerCluster > ullEnd)
+        return "clusters exceed partition";
+    return NULL;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,382 @@
+/* ff_logfile.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS_time.h"
+#include "ff_logfile.h"
+#include "ff_stdio.h"
+#include "ff_utils.h"
+#include "semphr.h"
+#include "task.h"
+
+// Open log files, one slot each
+#define LOG_REGISTRY "/.logopen"
+#define LOG_SLOT_SIZE 64
+#define LOG_PATH_MAX (LOG_SLOT_SIZE - sizeof(uint32_t))
+#define NO_SLOT 0xFF
+
+#define LOG_MAGIC 0x474F4CFEUL  // "\xFELOG"
+
+typedef struct {
+    char pcPath[LOG_PATH_MAX];  // Relative to the mount point; "" if free
+    uint32_t ulNonce;           // In the open file's trailers
+} FF_LogSlot_t;
+
+/* The first cluster and nonce tie a trailer to one opening of one file: the
+clusters beyond the end may hold trailers left by an earlier file that started
+in the same cluster, or by an earlier opening of this one. */
+typedef struct {
+    uint32_t ulMagic;
+    uint32_t ulObjectCluster;
+    uint32_t ulNonce;
+    uint32_t ulOffset;  // Of the trailer itself: the end of the data
+} FF_LogTrailer_t;
+
+typedef struct {
+    FF_FILE *pxFile;
+    uint32_t ulNonce;
+    uint32_t ulDirentSize;  // As last written to the directory entry
+    TickType_t xDirentTime;
+    bool bClusterRecorded;  // The directory entry has the first cluster
+    uint8_t ucSlot;         // In the registry
+    char pcRegistry[LOG_PATH_MAX];
+} FF_LogFile_t;
+
+static FF_LogFile_t xLogs[ffconfigLOG_FILES] = {
+    [0 ... ffconfigLOG_FILES - 1] = {.ucSlot = NO_SLOT}};
+
+int prvFFErrorToErrno(FF_Error_t xError);  // In ff_stdio.c
+FF_Error_t FF_UpdateDirEnt(FF_FILE *pxFile);  // In ff_utils.c
+
+static SemaphoreHandle_t prvRegistryMutex(void) {
+    static StaticSemaphore_t xMutexBuffer;
+    static SemaphoreHandle_t xMutex;
+
+    taskENTER_CRITICAL();
+    if (!xMutex) xMutex = xSemaphoreCreateMutexStatic(&xMutexBuffer);
+    taskEXIT_CRITICAL();
+    return xMutex;
+}
+
+static FF_LogFile_t *prvClaim(FF_FILE *pxFile) {
+    FF_LogFile_t *pxLog = NULL;
+
+    taskENTER_CRITICAL();
+    for (size_t i = 0; i < ffconfigLOG_FILES; ++i) {
+        if (xLogs[i].pxFile == pxFile) {
+            pxLog = &xLogs[i];
+            break;
+        }
+    }
+    if (pxLog && !pxFile) pxLog->pxFile = (FF_FILE *)pxLog;  // Reserved
+    taskEXIT_CRITICAL();
+    return pxLog;
+}
+
+static void prvRelease(FF_LogFile_t *pxLog) {
+    taskENTER_CRITICAL();
+    pxLog->pxFile = NULL;
+    pxLog->ucSlot = NO_SLOT;
+    taskEXIT_CRITICAL();
+}
+
+/* Split "/<mount point>/<rest>" into the registry path for the mount point
+and <rest>. Returns NULL if the path doesn't fit. */
+static const char *prvSplitPath(const char *pcPath, char *pcRegistry) {
+    if ('/' != pcPath[0]) return NULL;
+    const char *pcRest = strchr(pcPath + 1, '/');
+    if (!pcRest || strlen(pcRest) >= LOG_PATH_MAX) return NULL;
+    int n = snprintf(pcRegistry, LOG_PATH_MAX, "%.*s%s",
+                     (int)(pcRest - pcPath), pcPath, LOG_REGISTRY);
+    if (n < 0 || n >= LOG_PATH_MAX) return NULL;
+    return pcRest;
+}
+
+/* Record pcRest and the nonce in a free slot of the registry, creating it if
+need be. Returns the slot, or NO_SLOT. */
+static uint8_t prvRegister(const char *pcRegistry, const char *pcRest,
+                           uint32_t ulNonce) {
+    FF_LogSlot_t xSlot;
+    uint8_t ucSlot = NO_SLOT;
+
+    xSemaphoreTake(prvRegistryMutex(), portMAX_DELAY);
+    FF_FILE *pxReg = ff_fopen(pcRegistry, "r+");
+    if (!pxReg) {
+        // Made full size at once, so it never grows
+        pxReg = ff_fopen(pcRegistry, "w+");
+        memset(&xSlot, 0, sizeof xSlot);
+        for (size_t i = 0; pxReg && i < ffconfigLOG_FILES; ++i)
+            ff_fwrite(&xSlot, sizeof xSlot, 1, pxReg);
+    }
+    for (size_t i = 0; pxReg && i < ffconfigLOG_FILES; ++i) {
+        ff_fseek(pxReg, i * sizeof xSlot, FF_SEEK_SET);
+        if (1 != ff_fread(&xSlot, sizeof xSlot, 1, pxReg)) break;
+        if (xSlot.pcPath[0]) continue;
+        memset(&xSlot, 0, sizeof xSlot);
+        strcpy(xSlot.pcPath, pcRest);
+        xSlot.ulNonce = ulNonce;
+        ff_fseek(pxReg, i * sizeof xSlot, FF_SEEK_SET);
+        if (1 == ff_fwrite(&xSlot, sizeof xSlot, 1, pxReg)) ucSlot = i;
+        break;
+    }
+    if (pxReg) ff_fclose(pxReg);
+    xSemaphoreGive(prvRegistryMutex());
+    return ucSlot;
+}
+
+// Call with the registry mutex held
+static void prvClearSlot(FF_FILE *pxReg, uint8_t ucSlot) {
+    FF_LogSlot_t xSlot;
+
+    memset(&xSlot, 0, sizeof xSlot);
+    ff_fseek(pxReg, ucSlot * sizeof xSlot, FF_SEEK_SET);
+    ff_fwrite(&xSlot, sizeof xSlot, 1, pxReg);
+}
+
+static void prvUnregister(const char *pcRegistry, uint8_t ucSlot) {
+    xSemaphoreTake(prvRegistryMutex(), portMAX_DELAY);
+    FF_FILE *pxReg = ff_fopen(pcRegistry, "r+");
+    if (pxReg) {
+        prvClearSlot(pxReg, ucSlot);
+        ff_fclose(pxReg);
+    }
+    xSemaphoreGive(prvRegistryMutex());
+}
+
+// Write the size and first cluster to the directory entry
+static FF_Error_t prvUpdateDirEnt(FF_LogFile_t *pxLog) {
+    FF_FILE *pxFile = pxLog->pxFile;
+    FF_DirEnt_t xOriginalEntry;
+
+    FF_Error_t xError = FF_GetEntry(pxFile->pxIOManager, pxFile->usDirEntry,
+                                    pxFile->ulDirCluster, &xOriginalEntry);
+    if (FF_isERR(xError) == pdFALSE) {
+        xOriginalEntry.ulFileSize = pxFile->ulFileSize;
+        xOriginalEntry.ulObjectCluster = pxFile->ulObjectCluster;
+        xError = FF_PutEntry(pxFile->pxIOManager, pxFile->usDirEntry,
+                             pxFile->ulDirCluster, &xOriginalEntry, NULL);
+    }
+    if (FF_isERR(xError) == pdFALSE)
+        xError = FF_FlushCache(pxFile->pxIOManager);
+    if (FF_isERR(xError) == pdFALSE) {
+        pxLog->ulDirentSize = pxFile->ulFileSize;
+        pxLog->xDirentTime = xTaskGetTickCount();
+        pxLog->bClusterRecorded = pxFile->ulObjectCluster != 0;
+    }
+    return xError;
+}
+
+FF_FILE *ff_log_open(const char *pcPath) {
+    char pcRegistry[LOG_PATH_MAX];
+
+    const char *pcRest = prvSplitPath(pcPath, pcRegistry);
+    if (!pcRest) {
+        stdioSET_ERRNO(pdFREERTOS_ERRNO_ENAMETOOLONG);
+        return NULL;
+    }
+    FF_LogFile_t *pxLog = prvClaim(NULL);
+    if (!pxLog) {
+        stdioSET_ERRNO(pdFREERTOS_ERRNO_ENOBUFS);
+        return NULL;
+    }
+    FF_FILE *pxFile = ff_fopen(pcPath, "a");
+    if (!pxFile) {
+        prvRelease(pxLog);
+        return NULL;
+    }
+    strcpy(pxLog->pcRegistry, pcRegistry);
+    // Different for each opening, and never 0, which an empty slot holds
+    static uint32_t ulOpens;
+    pxLog->ulNonce = ((uint32_t)FreeRTOS_time(NULL) ^ xTaskGetTickCount()) +
+                     (++ulOpens << 20);
+    if (!pxLog->ulNonce) pxLog->ulNonce = 1;
+    pxLog->ucSlot = prvRegister(pcRegistry, pcRest, pxLog->ulNonce);
+    if (NO_SLOT == pxLog->ucSlot)
+        FF_PRINTF("%s: not registered; size kept up to date\n", pcPath);
+    pxLog->ulDirentSize = pxFile->ulFileSize;
+    pxLog->xDirentTime = xTaskGetTickCount();
+    pxLog->bClusterRecorded = pxFile->ulObjectCluster != 0;
+    pxLog->pxFile = pxFile;
+    return pxFile;
+}
+
+size_t ff_log_write(const void *pvBuffer, size_t xSize, FF_FILE *pxStream) {
+    FF_LogFile_t *pxLog = prvClaim(pxStream);
+    configASSERT(pxLog);
+    uint32_t ulEnd = pxStream->ulFileSize;
+
+    size_t xDone = ff_fwrite(pvBuffer, 1, xSize, pxStream);
+    if (xDone < xSize) return xDone;
+    ulEnd += xSize;
+    const FF_LogTrailer_t xTrailer = {LOG_MAGIC, pxStream->ulObjectCluster,
+                                      pxLog->ulNonce, ulEnd};
+    size_t xTrailed = ff_fwrite(&xTrailer, sizeof xTrailer, 1, pxStream);
+    // Back to the end of the data, which writes out the file's sector buffer
+    if (-1 == ff_fseek(pxStream, ulEnd, FF_SEEK_SET)) return 0;
+    // The trailer is beyond the end of the file
+    pxStream->ulFileSize = ulEnd;
+    if (1 != xTrailed) return 0;
+
+    FF_Error_t xError = FF_FlushCache(pxStream->pxIOManager);
+    if (FF_isERR(xError) == pdFALSE &&
+        (NO_SLOT == pxLog->ucSlot || !pxLog->bClusterRecorded ||
+         ulEnd - pxLog->ulDirentSize >= ffconfigLOG_DIRENT_BYTES ||
+         xTaskGetTickCount() - pxLog->xDirentTime >=
+             pdMS_TO_TICKS(ffconfigLOG_DIRENT_MS)))
+        xError = prvUpdateDirEnt(pxLog);
+    if (FF_isERR(xError) != pdFALSE) {
+        stdioSET_ERRNO(prvFFErrorToErrno(xError));
+        return 0;
+    }
+    return xSize;
+}
+
+int ff_log_printf(FF_FILE *pxStream, const char *pcFormat, ...) {
+    char pcBuffer[ffconfigFPRINTF_BUFFER_LENGTH];
+    va_list xArgs;
+
+    va_start(xArgs, pcFormat);
+    int n = vsnprintf(pcBuffer, sizeof pcBuffer, pcFormat, xArgs);
+    va_end(xArgs);
+    if (n < 0) return -1;
+    // Truncated, like ff_fprintf()
+    if (n >= (int)sizeof pcBuffer) n = sizeof pcBuffer - 1;
+    return ff_log_write(pcBuffer, n, pxStream) == (size_t)n ? n : -1;
+}
+
+int ff_log_close(FF_FILE *pxStream) {
+    FF_LogFile_t *pxLog = prvClaim(pxStream);
+    configASSERT(pxLog);
+
+    int iResult = ff_fclose(pxStream);
+    // If the close failed, leave it to ff_log_recover()
+    if (0 == iResult && NO_SLOT != pxLog->ucSlot)
+        prvUnregister(pxLog->pcRegistry, pxLog->ucSlot);
+    prvRelease(pxLog);
+    return iResult;
+}
+
+/* Find the last trailer at or beyond ulStart that belongs to this opening of
+the file and is where it says it is. Returns its offset, or ulStart if there
+is none. */
+static uint32_t prvFindTrailer(FF_FILE *pxFile, uint32_t ulStart,
+                               uint32_t ulNonce) {
+    uint8_t ucBuffer[512 + sizeof(FF_LogTrailer_t) - 1];
+    uint32_t ulFound = ulStart, ulBase = ulStart;
+    size_t xKeep = 0;
+
+    if (-1 == ff_fseek(pxFile, ulStart, FF_SEEK_SET)) return ulStart;
+    for (;;) {
+        size_t n = ff_fread(ucBuffer + xKeep, 1, 512, pxFile);
+        if (!n) break;
+        size_t xHave = xKeep + n;
+        for (size_t i = 0; i + sizeof(FF_LogTrailer_t) <= xHave; ++i) {
+            if ((LOG_MAGIC & 0xFF) != ucBuffer[i]) continue;
+            FF_LogTrailer_t xTrailer;
+            memcpy(&xTrailer, ucBuffer + i, sizeof xTrailer);
+            if (LOG_MAGIC == xTrailer.ulMagic &&
+                pxFile->ulObjectCluster == xTrailer.ulObjectCluster &&
+                ulNonce == xTrailer.ulNonce &&
+                ulBase + i == xTrailer.ulOffset)
+                ulFound = xTrailer.ulOffset;
+        }
+        // Keep the tail, in case a trailer straddles the next read
+        xKeep = xHave < sizeof(FF_LogTrailer_t) - 1
+                    ? xHave
+                    : sizeof(FF_LogTrailer_t) - 1;
+        memmove(ucBuffer, ucBuffer + xHave - xKeep, xKeep);
+        ulBase += xHave - xKeep;
+    }
+    return ulFound;
+}
+
+static void prvRecoverFile(const char *pcPath, uint32_t ulNonce) {
+    FF_FILE *pxFile = ff_fopen(pcPath, "r+");
+    if (!pxFile) return;  // Removed since
+
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    uint32_t ulClusterBytes = pxIOManager->xPartition.usBlkSize *
+                              pxIOManager->xPartition.ulSectorsPerCluster;
+    uint32_t ulRecorded = pxFile->ulFileSize, ulFound = ulRecorded;
+    FF_Error_t xError = FF_ERR_NONE;
+    uint32_t ulChain = 0, ulEnd;
+
+    if (pxFile->ulObjectCluster) {
+        FF_LockFAT(pxIOManager);
+        ulChain = FF_GetChainLength(pxIOManager, pxFile->ulObjectCluster,
+                                    &ulEnd, &xError);
+        FF_UnlockFAT(pxIOManager);
+        // So that closing it gives back the clusters beyond the size found
+        if (FF_isERR(xError) == pdFALSE) {
+            pxFile->ulChainLength = ulChain;
+            pxFile->ulEndOfChain = ulEnd;
+        }
+    }
+    uint64_t ullLimit = (uint64_t)ulChain * ulClusterBytes;
+    if (ullLimit > UINT32_MAX) ullLimit = UINT32_MAX;
+    if (FF_isERR(xError) == pdFALSE && ullLimit > ulRecorded) {
+        // Let reads go on to the end of the cluster chain
+        pxFile->ulFileSize = ullLimit;
+        ulFound = prvFindTrailer(pxFile, ulRecorded, ulNonce);
+        pxFile->ulFileSize = ulFound;
+    }
+    if (ulFound != ulRecorded) {
+        FF_PRINTF("%s: size recovered: %lu (was %lu)\n", pcPath,
+                  (unsigned long)ulFound, (unsigned long)ulRecorded);
+        FF_UpdateDirEnt(pxFile);
+    }
+    ff_fclose(pxFile);
+}
+
+static bool prvInUse(const char *pcRegistry, uint8_t ucSlot) {
+    bool bInUse = false;
+
+    taskENTER_CRITICAL();
+    for (size_t i = 0; i < ffconfigLOG_FILES; ++i) {
+        if (xLogs[i].pxFile && xLogs[i].ucSlot == ucSlot &&
+            !strcmp(xLogs[i].pcRegistry, pcRegistry))
+            bInUse = true;
+    }
+    taskEXIT_CRITICAL();
+    return bInUse;
+}
+
+void ff_log_recover(const char *pcMountPoint) {
+    char pcRegistry[LOG_PATH_MAX], pcPath[2 * LOG_PATH_MAX];
+    FF_LogSlot_t xSlot;
+
+    int n = snprintf(pcRegistry, sizeof pcRegistry, "%s%s", pcMountPoint,
+                     LOG_REGISTRY);
+    if (n < 0 || n >= (int)sizeof pcRegistry) return;
+
+    xSemaphoreTake(prvRegistryMutex(), portMAX_DELAY);
+    FF_FILE *pxReg = ff_fopen(pcRegistry, "r+");
+    for (size_t i = 0; pxReg && i < ffconfigLOG_FILES; ++i) {
+        ff_fseek(pxReg, i * sizeof xSlot, FF_SEEK_SET);
+        if (1 != ff_fread(&xSlot, sizeof xSlot, 1, pxReg)) break;
+        if (!xSlot.pcPath[0] || prvInUse(pcRegistry, i)) continue;
+        xSlot.pcPath[sizeof xSlot.pcPath - 1] = 0;
+        snprintf(pcPath, sizeof pcPath, "%s%s", pcMountPoint, xSlot.pcPath);
+        prvRecoverFile(pcPath, xSlot.ulNonce);
+        prvClearSlot(pxReg, i);
+    }
+    if (pxReg) ff_fclose(pxReg);
+    xSemaphoreGive(prvRegistryMutex());
+}
+
+/* [] END OF FILE */
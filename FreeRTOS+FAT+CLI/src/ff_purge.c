@@ -0,0 +1,488 @@
+/* ff_purge.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff_dir_index.h"
+#include "ff_purge.h"
+#include "ff_sddisk.h"
+#include "ff_stdio.h"
+#include "ff_walk.h"
+//
+#include "sd_card.h"
+
+int prvFFErrorToErrno(FF_Error_t xError);  // In ff_stdio.c
+
+// purge_victim_t.ucFlags
+#define PURGE_DIR 1
+#define PURGE_CHAIN_ONLY 2  // In a directory deleted whole: just free the chain
+#define PURGE_SKIP 4        // Keep it after all
+
+typedef struct {
+    /* Where the (short) directory entry is. For PURGE_CHAIN_ONLY, that of
+    the directory deleted whole, so that the two sort together. */
+    uint32_t ulDirCluster;
+    uint16_t usEntry;
+    uint8_t ucFlags;
+    uint32_t ulCluster;  // First of the chain, or 0 for none
+    uint32_t ulSize;
+    // Where its own entry is, to tell whether it is open
+    uint32_t ulOwnDirCluster;
+    uint16_t usOwnEntry;
+} purge_victim_t;
+
+typedef struct {
+    uint32_t ulStart, ulLength;
+} purge_run_t;
+
+// An array that grows as needed
+typedef struct {
+    void *pvItems;
+    size_t xCount, xMax, xSize;
+} purge_array_t;
+
+// A directory being gathered
+typedef struct {
+    size_t xFirst;      // The first victim found in it
+    uint32_t ulErrors;  // The walk's count when it was entered
+    bool bAll;          // Everything found in it so far is a victim
+} purge_level_t;
+
+// Add an item at the end. Returns NULL if out of memory.
+static void *prvAppend(purge_array_t *pxArray) {
+    if (pxArray->xCount == pxArray->xMax) {
+        size_t xMax = pxArray->xMax ? 2 * pxArray->xMax : 64;
+        void *pvItems = pvPortMalloc(xMax * pxArray->xSize);
+        if (!pvItems) return NULL;
+        if (pxArray->xCount)
+            memcpy(pvItems, pxArray->pvItems, pxArray->xCount * pxArray->xSize);
+        vPortFree(pxArray->pvItems);
+        pxArray->pvItems = pvItems;
+        pxArray->xMax = xMax;
+    }
+    return (char *)pxArray->pvItems + pxArray->xCount++ * pxArray->xSize;
+}
+
+static bool prvIsOpen(FF_IOManager_t *pxIOManager, uint32_t ulDirCluster,
+                      uint16_t usEntry) {
+    bool bOpen = false;
+    FF_PendSemaphore(pxIOManager->pvSemaphore);
+    for (FF_FILE *pxFile = pxIOManager->FirstFile; pxFile && !bOpen;
+         pxFile = pxFile->pxNext)
+        bOpen = pxFile->ulDirCluster == ulDirCluster &&
+                pxFile->usDirEntry == usEntry;
+    FF_ReleaseSemaphore(pxIOManager->pvSemaphore);
+    return bOpen;
+}
+
+/* Walk the tree, and list what is to go. A directory goes if it is old
+enough, and everything in it went too; then only the chains of what was in it
+need freeing. Returns 0, or -1 and sets errno. */
+static int prvGather(const char *pcPath, time_t xBefore,
+                     purge_array_t *pxVictims, FF_IOManager_t **ppxIOManager,
+                     FF_PurgeStats_t *pxStats) {
+    purge_level_t xLevels[ffconfigWALK_MAX_DEPTH + 1];
+    const FF_WalkEntry_t *pxEntry;
+
+    FF_Walk_t *pxWalk = ff_walk_open(pcPath, FF_WALK_LEAVE);
+    if (!pxWalk) return -1;
+    xLevels[0].bAll = true;
+    while ((pxEntry = ff_walk_next(pxWalk))) {
+        const FF_DirEnt_t *pxDirEnt = &pxEntry->pxFind->xDirectoryEntry;
+        purge_level_t *pxLevel = &xLevels[pxEntry->uDepth];  // Holding it
+        bool bDir = pxEntry->ucAttributes & FF_FAT_ATTR_DIR;
+        // FF_FindNext() leaves usCurrentItem just past the short entry
+        uint16_t usEntry = pxDirEnt->usCurrentItem - 1;
+
+        *ppxIOManager = pxEntry->pxFind->xDirectoryHandler.pxManager;
+        if (bDir && !pxEntry->bLeaving) {
+            if (ffconfigWALK_MAX_DEPTH == pxEntry->uDepth + 1) {
+                // It won't be entered, so can't be known to be empty
+                ff_walk_prune(pxWalk);
+                pxLevel->bAll = false;
+            } else {
+                purge_level_t *pxInner = &xLevels[pxEntry->uDepth + 1];
+                pxInner->xFirst = pxVictims->xCount;
+                pxInner->ulErrors = ff_walk_stats(pxWalk)->ulErrors;
+                pxInner->bAll = true;
+            }
+            continue;
+        }
+        bool bGoes = pxEntry->xModified && pxEntry->xModified < xBefore;
+        if (bGoes && (pxEntry->ucAttributes & FF_FAT_ATTR_READONLY ||
+                      (!bDir && prvIsOpen(*ppxIOManager,
+                                          pxDirEnt->ulDirCluster, usEntry)))) {
+            ++pxStats->ulKept;
+            bGoes = false;
+        }
+        if (pxEntry->bLeaving) {
+            const purge_level_t *pxInner = &xLevels[pxEntry->uDepth + 1];
+            bGoes = bGoes && pxInner->bAll &&
+                    pxInner->ulErrors == ff_walk_stats(pxWalk)->ulErrors;
+        }
+        if (!bGoes) {
+            pxLevel->bAll = false;
+            continue;
+        }
+        purge_victim_t *pxVictim = prvAppend(pxVictims);
+        if (!pxVictim) {
+            ff_walk_close(pxWalk);
+            stdioSET_ERRNO(pdFREERTOS_ERRNO_ENOMEM);
+            return -1;
+        }
+        pxVictim->ulDirCluster = pxVictim->ulOwnDirCluster =
+            pxDirEnt->ulDirCluster;
+        pxVictim->usEntry = pxVictim->usOwnEntry = usEntry;
+        pxVictim->ucFlags = bDir ? PURGE_DIR : 0;
+        pxVictim->ulCluster = pxDirEnt->ulObjectCluster;
+        pxVictim->ulSize = pxEntry->ulSize;
+        if (pxEntry->bLeaving) {
+            // What was in it goes with it
+            purge_victim_t *pxItems = pxVictims->pvItems;
+            for (size_t i = xLevels[pxEntry->uDepth + 1].xFirst;
+                 i < pxVictims->xCount - 1; ++i) {
+                pxItems[i].ulDirCluster = pxVictim->ulDirCluster;
+                pxItems[i].usEntry = pxVictim->usEntry;
+                pxItems[i].ucFlags |= PURGE_CHAIN_ONLY;
+            }
+        }
+    }
+    ff_walk_close(pxWalk);
+    return 0;
+}
+
+// By directory, then entry, with the chains that go with an entry after it
+static int prvCompareVictims(const void *pv1, const void *pv2) {
+    const purge_victim_t *px1 = pv1, *px2 = pv2;
+    if (px1->ulDirCluster != px2->ulDirCluster)
+        return px1->ulDirCluster < px2->ulDirCluster ? -1 : 1;
+    if (px1->usEntry != px2->usEntry) return (int)px1->usEntry - px2->usEntry;
+    return (px1->ucFlags & PURGE_CHAIN_ONLY) - (px2->ucFlags & PURGE_CHAIN_ONLY);
+}
+
+/* Check that the entry is still the one gathered (nothing has deleted,
+renamed or rewritten it since), then mark it and its long name entries
+deleted. */
+static FF_Error_t prvDeleteEntry(FF_IOManager_t *pxIOManager,
+                                 FF_FetchContext_t *pxContext,
+                                 purge_victim_t *pxVictim) {
+    uint8_t ucEntry[FF_SIZEOF_DIRECTORY_ENTRY];
+    FF_Error_t xError = FF_FetchEntryWithContext(pxIOManager, pxVictim->usEntry,
+                                                 pxContext, ucEntry);
+    if (FF_isERR(xError) != pdFALSE) return xError;
+
+    uint8_t ucAttrib = FF_getChar(ucEntry, FF_FAT_DIRENT_ATTRIB);
+    uint32_t ulCluster =
+        (uint32_t)FF_getShort(ucEntry, FF_FAT_DIRENT_CLUS_HIGH) << 16 |
+        FF_getShort(ucEntry, FF_FAT_DIRENT_CLUS_LOW);
+    if (0x00 == ucEntry[0] || FF_FAT_DELETED == ucEntry[0] ||
+        FF_FAT_ATTR_LFN == (ucAttrib & FF_FAT_ATTR_LFN) ||
+        !(ucAttrib & FF_FAT_ATTR_DIR) != !(pxVictim->ucFlags & PURGE_DIR) ||
+        ulCluster != pxVictim->ulCluster ||
+        FF_getLong(ucEntry, FF_FAT_DIRENT_FILESIZE) != pxVictim->ulSize) {
+        pxVictim->ucFlags |= PURGE_SKIP;
+        return FF_ERR_NONE;
+    }
+    xError = FF_RmLFNs(pxIOManager, pxVictim->usEntry, pxContext);
+    if (FF_isERR(xError) != pdFALSE) return xError;
+    ucEntry[0] = FF_FAT_DELETED;
+    return FF_PushEntryWithContext(pxIOManager, pxVictim->usEntry, pxContext,
+                                   ucEntry);
+}
+
+/* Keep the files among the victims from i to xEnd that have been opened since
+they were gathered, and any directory to be deleted whole that holds one.
+Call with the IOManager's semaphore held. */
+static void prvKeepOpen(FF_IOManager_t *pxIOManager, purge_victim_t *pxVictims,
+                        size_t i, size_t xEnd) {
+    size_t xHead = i;
+
+    for (size_t j = i; j < xEnd; ++j) {
+        purge_victim_t *pxVictim = &pxVictims[j];
+        // What was in a directory deleted whole sorts right after it
+        if (!(pxVictim->ucFlags & PURGE_CHAIN_ONLY)) xHead = j;
+        if (pxVictim->ucFlags & PURGE_DIR ||
+            !prvIsOpen(pxIOManager, pxVictim->ulOwnDirCluster,
+                       pxVictim->usOwnEntry))
+            continue;
+        pxVictim->ucFlags |= PURGE_SKIP;
+        if (pxVictim->ucFlags & PURGE_CHAIN_ONLY)
+            pxVictims[xHead].ucFlags |= PURGE_SKIP;
+    }
+}
+
+/* Delete the (sorted) victims' directory entries, a directory at a time, in
+entry order: each directory sector is fetched, changed and written back once.
+On error, the victims not yet done are marked to be kept. */
+static FF_Error_t prvDeleteEntries(FF_IOManager_t *pxIOManager,
+                                   purge_victim_t *pxVictims, size_t xCount) {
+    FF_Error_t xError = FF_ERR_NONE, xTempError;
+    size_t i = 0, j = 0;
+
+    while (i < xCount && FF_isERR(xError) == pdFALSE) {
+        uint32_t ulDirCluster = pxVictims[i].ulDirCluster;
+        size_t xEnd = i;
+        while (xEnd < xCount && pxVictims[xEnd].ulDirCluster == ulDirCluster)
+            ++xEnd;
+        /* Nothing can be opened from the check to the deletion: FF_Open()
+        adds a file to the IOManager's list under its semaphore. It takes the
+        semaphore, then the directory lock, and so does this. */
+        FF_PendSemaphore(pxIOManager->pvSemaphore);
+        prvKeepOpen(pxIOManager, pxVictims, i, xEnd);
+
+        FF_FetchContext_t xContext;
+        FF_LockDirectory(pxIOManager);
+        xError = FF_InitEntryFetch(pxIOManager, ulDirCluster, &xContext);
+        if (FF_isERR(xError) == pdFALSE) {
+            for (j = i; j < xEnd && FF_isERR(xError) == pdFALSE; ++j) {
+                purge_victim_t *pxVictim = &pxVictims[j];
+                if (pxVictim->ucFlags & PURGE_CHAIN_ONLY) {
+                    // Sorted after its directory (or a sibling), and kept if it is
+                    pxVictim->ucFlags |= pxVictims[j - 1].ucFlags & PURGE_SKIP;
+                } else if (!(pxVictim->ucFlags & PURGE_SKIP)) {
+                    xError = prvDeleteEntry(pxIOManager, &xContext, pxVictim);
+                }
+            }
+            xTempError = FF_CleanupEntryFetch(pxIOManager, &xContext);
+            if (FF_isERR(xError) == pdFALSE) xError = xTempError;
+        }
+        FF_UnlockDirectory(pxIOManager);
+        FF_ReleaseSemaphore(pxIOManager->pvSemaphore);
+        if (FF_isERR(xError) == pdFALSE) i = xEnd;
+    }
+    if (FF_isERR(xError) != pdFALSE)
+        // The one that failed may be half done: losing its chain is safer
+        for (j = i; j < xCount; ++j) pxVictims[j].ucFlags |= PURGE_SKIP;
+    return xError;
+}
+
+/* Forget the directories deleted: FreeRTOS+FAT would otherwise go on finding
+paths through them in its path cache, and names in them in its hash cache,
+after their clusters have been reused. FF_RmDir() does the same. The
+directories that entries were deleted from lose their indexes too (see
+ff_dir_index.h), even where a failure left the entry there. */
+static void prvForgetDirectories(FF_IOManager_t *pxIOManager,
+                                 const purge_victim_t *pxVictims,
+                                 size_t xCount) {
+    for (size_t i = 0; i < xCount; ++i) {
+        const purge_victim_t *pxVictim = &pxVictims[i];
+        if (!(pxVictim->ucFlags & PURGE_CHAIN_ONLY))
+            ff_dir_index_forget(pxIOManager, pxVictim->ulDirCluster);
+        if (!(pxVictim->ucFlags & PURGE_DIR) ||
+            pxVictim->ucFlags & PURGE_SKIP || !pxVictim->ulCluster)
+            continue;
+#if ffconfigPATH_CACHE != 0
+        FF_PendSemaphore(pxIOManager->pvSemaphore);
+        for (size_t j = 0; j < ffconfigPATH_CACHE_DEPTH; ++j) {
+            FF_PathCache_t *pxCache = &pxIOManager->xPartition.pxPathCache[j];
+            if (pxCache->ulDirCluster == pxVictim->ulCluster) {
+                pxCache->ulDirCluster = 0;
+                memset(pxCache->pcPath, '\0', sizeof pxCache->pcPath);
+            }
+        }
+        FF_ReleaseSemaphore(pxIOManager->pvSemaphore);
+#endif
+#if ffconfigHASH_CACHE != 0
+        FF_UnHashDir(pxIOManager, pxVictim->ulCluster);
+#endif
+        ff_dir_index_forget(pxIOManager, pxVictim->ulCluster);
+    }
+}
+
+static int prvCompareRuns(const void *pv1, const void *pv2) {
+    const purge_run_t *px1 = pv1, *px2 = pv2;
+    if (px1->ulStart == px2->ulStart) return 0;
+    return px1->ulStart < px2->ulStart ? -1 : 1;
+}
+
+/* Read the chains of the victims not kept, as runs of contiguous clusters,
+then sort the runs and merge the adjacent ones. */
+static FF_Error_t prvGatherRuns(FF_IOManager_t *pxIOManager,
+                                const purge_victim_t *pxVictims, size_t xCount,
+                                purge_array_t *pxRuns) {
+    FF_FATBuffers_t xFATBuffers;
+    FF_Error_t xError = FF_ERR_NONE, xTempError;
+    uint32_t ulLast = pxIOManager->xPartition.ulNumClusters + 1;
+
+    for (size_t i = 0; i < xCount && FF_isERR(xError) == pdFALSE; ++i) {
+        uint32_t ulCluster = pxVictims[i].ulCluster;
+        purge_run_t *pxRun = NULL;
+
+        if (pxVictims[i].ucFlags & PURGE_SKIP || !ulCluster) continue;
+        FF_LockFAT(pxIOManager);
+        FF_InitFATBuffers(&xFATBuffers, FF_MODE_READ);
+        // No chain is longer than the FAT: that stops a loop
+        for (uint32_t ulSeen = 0; ulSeen < ulLast; ++ulSeen) {
+            if (ulCluster < 2 || ulCluster > ulLast) {
+                xError = FF_ERR_IOMAN_OUT_OF_BOUNDS_READ | FF_ERRFLAG;
+                break;
+            }
+            if (pxRun && ulCluster == pxRun->ulStart + pxRun->ulLength) {
+                ++pxRun->ulLength;
+            } else {
+                pxRun = prvAppend(pxRuns);
+                if (!pxRun) {
+                    xError = FF_ERR_NOT_ENOUGH_MEMORY | FF_ERRFLAG;
+                    break;
+                }
+                pxRun->ulStart = ulCluster;
+                pxRun->ulLength = 1;
+            }
+            uint32_t ulNext =
+                FF_getFATEntry(pxIOManager, ulCluster, &xError, &xFATBuffers);
+            if (FF_isERR(xError) != pdFALSE ||
+                FF_isEndOfChain(pxIOManager, ulNext) != pdFALSE)
+                break;
+            ulCluster = ulNext;
+        }
+        xTempError = FF_ReleaseFATBuffers(pxIOManager, &xFATBuffers);
+        if (FF_isERR(xError) == pdFALSE) xError = xTempError;
+        FF_UnlockFAT(pxIOManager);
+    }
+    if (FF_isERR(xError) != pdFALSE || !pxRuns->xCount) return xError;
+
+    purge_run_t *pxItems = pxRuns->pvItems;
+    qsort(pxItems, pxRuns->xCount, sizeof(purge_run_t), prvCompareRuns);
+    size_t xMerged = 0;
+    for (size_t i = 1; i < pxRuns->xCount; ++i) {
+        purge_run_t *pxRun = &pxItems[xMerged];
+        uint32_t ulEnd = pxItems[i].ulStart + pxItems[i].ulLength;
+        // Overlapping runs would mean cross-linked chains: free each once
+        if (pxItems[i].ulStart <= pxRun->ulStart + pxRun->ulLength) {
+            if (ulEnd > pxRun->ulStart + pxRun->ulLength)
+                pxRun->ulLength = ulEnd - pxRun->ulStart;
+        } else {
+            pxItems[++xMerged] = pxItems[i];
+        }
+    }
+    pxRuns->xCount = xMerged + 1;
+    return xError;
+}
+
+/* Erase the runs on the card. They are unreachable, but not yet free, so
+nothing else can be writing to them. This is only an optimisation for the
+card's wear levelling, so a failure just stops it. */
+static void prvTrimRuns(FF_IOManager_t *pxIOManager, const purge_run_t *pxRuns,
+                        size_t xCount) {
+    FF_Disk_t *pxDisk = pxIOManager->xBlkDevice.pxDisk;
+    sd_card_t *pSD = pxDisk->pvTag;
+    uint32_t ulSPC = pxIOManager->xPartition.ulSectorsPerCluster;
+
+    for (size_t i = 0; i < xCount; ++i) {
+        uint32_t ulLBA = FF_Cluster2LBA(pxIOManager, pxRuns[i].ulStart);
+        uint32_t ulCount = pxRuns[i].ulLength * ulSPC;
+        int status = sd_erase_blocks(pSD, ulLBA, ulCount);
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            FF_PRINTF("sd_erase_blocks(%lu, %lu) failed: %d\n",
+                      (unsigned long)ulLBA, (unsigned long)ulCount, status);
+            return;
+        }
+        FF_SDDiskReadAheadInvalidate(pxDisk, ulLBA, ulCount);
+    }
+}
+
+/* Free the (sorted) runs in one pass over the FAT, so that each FAT sector is
+fetched and written once. The FAT lock is let go every ffconfigPURGE_FAT_BATCH
+clusters. */
+static FF_Error_t prvFreeRuns(FF_IOManager_t *pxIOManager,
+                              const purge_run_t *pxRuns, size_t xCount) {
+    FF_FATBuffers_t xFATBuffers;
+    FF_Error_t xError = FF_ERR_NONE, xTempError;
+    size_t i = 0;
+    uint32_t ulCluster = xCount ? pxRuns[0].ulStart : 0;
+
+    while (i < xCount && FF_isERR(xError) == pdFALSE) {
+        uint32_t ulFreed = 0;
+        FF_LockFAT(pxIOManager);
+        FF_InitFATBuffers(&xFATBuffers, FF_MODE_WRITE);
+        while (i < xCount && ulFreed < ffconfigPURGE_FAT_BATCH) {
+            xError = FF_putFATEntry(pxIOManager, ulCluster, 0, &xFATBuffers);
+            if (FF_isERR(xError) != pdFALSE) break;
+            ++ulFreed;
+            if (++ulCluster == pxRuns[i].ulStart + pxRuns[i].ulLength &&
+                ++i < xCount)
+                ulCluster = pxRuns[i].ulStart;
+        }
+        xTempError = FF_ReleaseFATBuffers(pxIOManager, &xFATBuffers);
+        if (FF_isERR(xError) == pdFALSE) xError = xTempError;
+        if (ulFreed) {
+            xTempError = FF_IncreaseFreeClusters(pxIOManager, ulFreed);
+            if (FF_isERR(xError) == pdFALSE) xError = xTempError;
+        }
+        FF_UnlockFAT(pxIOManager);
+    }
+    return xError;
+}
+
+int ff_purge(const char *pcPath, time_t xBefore, unsigned uFlags,
+             FF_PurgeStats_t *pxStats) {
+    purge_array_t xVictims = {.xSize = sizeof(purge_victim_t)};
+    purge_array_t xRuns = {.xSize = sizeof(purge_run_t)};
+    FF_IOManager_t *pxIOManager = NULL;
+    FF_Error_t xError = FF_ERR_NONE;
+
+    memset(pxStats, 0, sizeof *pxStats);
+    if (-1 == prvGather(pcPath, xBefore, &xVictims, &pxIOManager, pxStats)) {
+        vPortFree(xVictims.pvItems);
+        return -1;
+    }
+    purge_victim_t *pxVictims = xVictims.pvItems;
+    if (!xVictims.xCount) return 0;
+
+    if (!(uFlags & FF_PURGE_DRY_RUN)) {
+        qsort(pxVictims, xVictims.xCount, sizeof(purge_victim_t),
+              prvCompareVictims);
+        xError = prvDeleteEntries(pxIOManager, pxVictims, xVictims.xCount);
+        // Including those deleted before an error
+        prvForgetDirectories(pxIOManager, pxVictims, xVictims.xCount);
+        // The entries must be gone from the card before the clusters are free
+        if (FF_isERR(xError) == pdFALSE) xError = FF_FlushCache(pxIOManager);
+    }
+    for (size_t i = 0; i < xVictims.xCount; ++i) {
+        const purge_victim_t *pxVictim = &pxVictims[i];
+        if (pxVictim->ucFlags & PURGE_SKIP) {
+            if (!(pxVictim->ucFlags & PURGE_CHAIN_ONLY)) ++pxStats->ulKept;
+        } else if (pxVictim->ucFlags & PURGE_DIR) {
+            ++pxStats->ulDirectories;
+        } else {
+            ++pxStats->ulFiles;
+            pxStats->ullBytes += pxVictim->ulSize;
+        }
+    }
+    if (FF_isERR(xError) == pdFALSE)
+        xError = prvGatherRuns(pxIOManager, pxVictims, xVictims.xCount, &xRuns);
+    if (FF_isERR(xError) == pdFALSE && !(uFlags & FF_PURGE_DRY_RUN)) {
+        if (uFlags & FF_PURGE_TRIM)
+            prvTrimRuns(pxIOManager, xRuns.pvItems, xRuns.xCount);
+        xError = prvFreeRuns(pxIOManager, xRuns.pvItems, xRuns.xCount);
+        if (FF_isERR(xError) == pdFALSE) xError = FF_FlushCache(pxIOManager);
+    }
+    if (FF_isERR(xError) == pdFALSE) {
+        const purge_run_t *pxRuns = xRuns.pvItems;
+        pxStats->ulRuns = xRuns.xCount;
+        for (size_t i = 0; i < xRuns.xCount; ++i)
+            pxStats->ulClusters += pxRuns[i].ulLength;
+    }
+    vPortFree(xRuns.pvItems);
+    vPortFree(xVictims.pvItems);
+
+    int ff_errno = prvFFErrorToErrno(xError);
+    /* Store the errno to thread local storage. */
+    stdioSET_ERRNO(ff_errno);
+    return ff_errno == 0 ? 0 : -1;
+}
+
+/* [] END OF FILE */
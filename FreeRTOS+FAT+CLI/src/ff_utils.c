@@ -13,9 +13,13 @@ specific language governing permissions and limitations under the License.
 */
 #include "ff_utils.h"
 
+#include "ff_extent_map.h"
+#include "ff_format_plan.h"
 #include "ff_headers.h"
+#include "ff_logfile.h"
 #include "ff_sddisk.h"
 #include "ff_stdio.h"
+#include "ff_writeback.h"
 //
 #include "sd_card.h"
 #include "hw_config.h"
@@ -23,53 +27,235 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf
 
-static FF_Error_t prvPartitionAndFormatDisk(FF_Disk_t *pxDisk) {
-    FF_PartitionParameters_t xPartition;
-    FF_Error_t xError;
+#define SECTOR_SIZE 512
+// Sectors cleared per write while formatting
+#define FORMAT_CHUNK_SECTORS 16
+
+// Offsets in the MBR and boot sector (BPB)
+#define MBR_PARTITION_TABLE 0x1BE
+#define BS_SIGNATURE 0x1FE
+#define FSI_FREE_COUNT 488
+#define FSI_NEXT_FREE 492
+#define FAT32_FSINFO_SECTOR 1
+#define FAT32_BACKUP_BOOT_SECTOR 6
+#define FAT32_ROOT_CLUSTER 2
+
+static bool prvWriteSectors(sd_card_t *pSD, const uint8_t *pucBuffer,
+                            uint32_t ulSector, uint32_t ulCount) {
+    int status = sd_write_blocks(pSD, pucBuffer, ulSector, ulCount);
+    if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+        FF_PRINTF("sd_write_blocks(%lu, %lu) failed: %d\n",
+                  (unsigned long)ulSector, (unsigned long)ulCount, status);
+        return false;
+    }
+    return true;
+}
 
-    /* Media cannot be used until it has been partitioned.  In this
-    case a single partition is to be created that fills all available space – so
-    by clearing the xPartition structure to zero. */
-    memset(&xPartition, 0x00, sizeof(xPartition));
-    xPartition.ulSectorCount = pxDisk->ulNumberOfSectors;
-
-    switch (xPartition.ulSectorCount) {
-        // For alignment:
-        // See https://www.partitionwizard.com/help/align-partition.html
-        case 15519744:  // 8GB (7.4 GiB) SD card
-            xPartition.ulHiddenSectors = 2048;
-            break;
-        case 31205376:  // 16GB (14.9 GiB) SD card
-            xPartition.ulHiddenSectors = 67584;
-            break;
-        case 62325760:  // 32GB (29.72 GiB) SD card
-            xPartition.ulHiddenSectors = 8192;
-            break;
-        case 124702720:  // 64GB (59.46 GiB) SD card
-            xPartition.ulHiddenSectors = 32768;
-            break;
-        case 249733120:  // 128GB (119.08 GiB) SD card
-            xPartition.ulHiddenSectors = 2048;
-            break;
+/* Zero a range of sectors. pucBuffer holds FORMAT_CHUNK_SECTORS.
+If bErase, use a bulk erase (CMD32/33/38) when the card's erased state is
+zeros, which is much faster than writing and spares the flash. */
+static bool prvClearSectors(sd_card_t *pSD, uint8_t *pucBuffer,
+                            uint32_t ulSector, uint32_t ulCount, bool bErase) {
+    if (bErase && 0x00 == pSD->erased_byte) {
+        int status = sd_erase_blocks(pSD, ulSector, ulCount);
+        if (SD_BLOCK_DEVICE_ERROR_NONE == status) return true;
+        FF_PRINTF("sd_erase_blocks(%lu, %lu) failed: %d\n",
+                  (unsigned long)ulSector, (unsigned long)ulCount, status);
+        // Fall back to writing
+    } else if (bErase) {
+        FF_PRINTF("Card erases to 0x%02x; clearing with writes\n",
+                  pSD->erased_byte);
     }
-    //	xPartition.xPrimaryCount = PRIMARY_PARTITIONS;
-    //	xPartition.eSizeType = eSizeIsQuota;
+    memset(pucBuffer, 0, FORMAT_CHUNK_SECTORS * SECTOR_SIZE);
+    while (ulCount) {
+        uint32_t n = ulCount < FORMAT_CHUNK_SECTORS ? ulCount : FORMAT_CHUNK_SECTORS;
+        if (!prvWriteSectors(pSD, pucBuffer, ulSector, n)) return false;
+        ulSector += n;
+        ulCount -= n;
+    }
+    return true;
+}
 
-    /* Perform the partitioning. */
-    xError = FF_Partition(pxDisk, &xPartition);
+static void prvBuildMBR(uint8_t *pucSector, const FF_FormatPlan_t *pxPlan) {
+    memset(pucSector, 0, SECTOR_SIZE);
+    uint8_t *pucEntry = pucSector + MBR_PARTITION_TABLE;
+    uint8_t ucType;
+    if (32 == pxPlan->ucFATBits)
+        ucType = 0x0C;  // FAT32 LBA
+    else if (pxPlan->ulPartitionSectors < 65536)
+        ucType = 0x04;  // FAT16 < 32 MB
+    else
+        ucType = 0x06;  // FAT16
+    // CHS fields are maxed out; everything uses the LBA fields.
+    FF_putChar(pucEntry, 0, 0x00);  // Not bootable
+    FF_putChar(pucEntry, 1, 0xFE);
+    FF_putShort(pucEntry, 2, 0xFFFF);
+    FF_putChar(pucEntry, 4, ucType);
+    FF_putChar(pucEntry, 5, 0xFE);
+    FF_putShort(pucEntry, 6, 0xFFFF);
+    FF_putLong(pucEntry, 8, pxPlan->ulHiddenSectors);
+    FF_putLong(pucEntry, 12, pxPlan->ulPartitionSectors);
+    FF_putShort(pucSector, BS_SIGNATURE, 0xAA55);
+}
 
-    /* Print out the result of the partition operation. */
-    FF_PRINTF("FF_Partition: %s\n", FF_GetErrMessage(xError));
+static void prvBuildBootSector(uint8_t *pucSector,
+                               const FF_FormatPlan_t *pxPlan) {
+    const bool bFAT32 = 32 == pxPlan->ucFATBits;
+    uint32_t ulVolumeID = (uint32_t)FreeRTOS_time(NULL) ^ xTaskGetTickCount();
+
+    memset(pucSector, 0, SECTOR_SIZE);
+    FF_putChar(pucSector, 0, 0xEB);  // Jump
+    FF_putChar(pucSector, 1, bFAT32 ? 0x58 : 0x3C);
+    FF_putChar(pucSector, 2, 0x90);
+    memcpy(pucSector + 3, "MSWIN4.1", 8);  // OEM name
+    FF_putShort(pucSector, 11, SECTOR_SIZE);
+    FF_putChar(pucSector, 13, pxPlan->ulSectorsPerCluster);
+    FF_putShort(pucSector, 14, pxPlan->ulReservedSectors);
+    FF_putChar(pucSector, 16, pxPlan->ucNumFATs);
+    FF_putShort(pucSector, 17, pxPlan->ulRootDirSectors * SECTOR_SIZE / 32);
+    if (!bFAT32 && pxPlan->ulPartitionSectors < 65536)
+        FF_putShort(pucSector, 19, pxPlan->ulPartitionSectors);
+    else
+        FF_putLong(pucSector, 32, pxPlan->ulPartitionSectors);
+    FF_putChar(pucSector, 21, 0xF8);    // Media: fixed disk
+    FF_putShort(pucSector, 24, 63);     // Sectors per track
+    FF_putShort(pucSector, 26, 255);    // Heads
+    FF_putLong(pucSector, 28, pxPlan->ulHiddenSectors);
+    uint8_t *pucExt;  // Extended BPB
+    if (bFAT32) {
+        FF_putLong(pucSector, 36, pxPlan->ulSectorsPerFAT);
+        FF_putLong(pucSector, 44, FAT32_ROOT_CLUSTER);
+        FF_putShort(pucSector, 48, FAT32_FSINFO_SECTOR);
+        FF_putShort(pucSector, 50, FAT32_BACKUP_BOOT_SECTOR);
+        pucExt = pucSector + 64;
+    } else {
+        FF_putShort(pucSector, 22, pxPlan->ulSectorsPerFAT);
+        pucExt = pucSector + 36;
+    }
+    FF_putChar(pucExt, 0, 0x80);  // Drive number
+    FF_putChar(pucExt, 2, 0x29);  // Extended boot signature
+    FF_putLong(pucExt, 3, ulVolumeID);
+    memcpy(pucExt + 7, "NO NAME    ", 11);
+    memcpy(pucExt + 18, bFAT32 ? "FAT32   " : "FAT16   ", 8);
+    FF_putShort(pucSector, BS_SIGNATURE, 0xAA55);
+}
 
-    /* Was the disk partitioned successfully? */
-    if (FF_isERR(xError) == pdFALSE) {
-        /* The disk was partitioned successfully.  Format the first partition.
-         */
-        xError = FF_Format(pxDisk, 0, pdFALSE, pdFALSE);
+static void prvBuildFSInfo(uint8_t *pucSector, const FF_FormatPlan_t *pxPlan) {
+    memset(pucSector, 0, SECTOR_SIZE);
+    FF_putLong(pucSector, 0, 0x41615252);
+    FF_putLong(pucSector, 484, 0x61417272);
+    // The root directory occupies the first cluster
+    FF_putLong(pucSector, FSI_FREE_COUNT, pxPlan->ulClusterCount - 1);
+    FF_putLong(pucSector, FSI_NEXT_FREE, FAT32_ROOT_CLUSTER + 1);
+    FF_putLong(pucSector, 508, 0xAA550000);
+}
 
-        /* Print out the result of the format operation. */
-        FF_PRINTF("FF_Format: %s\n", FF_GetErrMessage(xError));
+static void prvBuildFirstFATSector(uint8_t *pucSector,
+                                   const FF_FormatPlan_t *pxPlan) {
+    memset(pucSector, 0, SECTOR_SIZE);
+    if (32 == pxPlan->ucFATBits) {
+        FF_putLong(pucSector, 0, 0x0FFFFFF8);
+        FF_putLong(pucSector, 4, 0x0FFFFFFF);
+        FF_putLong(pucSector, 8, 0x0FFFFFFF);  // Root directory: end of chain
+    } else {
+        FF_putShort(pucSector, 0, 0xFFF8);
+        FF_putShort(pucSector, 2, 0xFFFF);
     }
+}
+
+/* Write the MBR and an empty FAT volume as laid out by ff_format_plan().
+The MBR is written last, so an interrupted format doesn't leave a partition
+table pointing at a half-written volume. For a quick format, the FAT and
+root directory regions are erased rather than written, so the only sectors
+actually written are the MBR, boot sector(s), FSInfo and the first sector of
+each FAT. */
+static FF_Error_t prvWriteVolume(sd_card_t *pSD, const FF_FormatPlan_t *pxPlan,
+                                 bool bQuick) {
+    const bool bFAT32 = 32 == pxPlan->ucFATBits;
+    uint8_t *pucBuffer = pvPortMalloc(FORMAT_CHUNK_SECTORS * SECTOR_SIZE);
+    if (!pucBuffer) return FF_ERR_NOT_ENOUGH_MEMORY | FF_ERRFLAG;
+    bool ok;
+
+    // FATs, then the root directory (fixed region or first cluster)
+    uint32_t ulClear = pxPlan->ucNumFATs * pxPlan->ulSectorsPerFAT +
+                       pxPlan->ulRootDirSectors +
+                       (bFAT32 ? pxPlan->ulSectorsPerCluster : 0);
+    ok = prvClearSectors(pSD, pucBuffer, pxPlan->ulFATBeginLBA, ulClear, bQuick);
+
+    prvBuildFirstFATSector(pucBuffer, pxPlan);
+    for (size_t i = 0; ok && i < pxPlan->ucNumFATs; ++i)
+        ok = prvWriteSectors(pSD, pucBuffer,
+                             pxPlan->ulFATBeginLBA + i * pxPlan->ulSectorsPerFAT, 1);
+    if (ok && bFAT32) {
+        prvBuildFSInfo(pucBuffer, pxPlan);
+        ok = prvWriteSectors(pSD, pucBuffer,
+                             pxPlan->ulHiddenSectors + FAT32_FSINFO_SECTOR, 1) &&
+             prvWriteSectors(pSD, pucBuffer,
+                             pxPlan->ulHiddenSectors + FAT32_BACKUP_BOOT_SECTOR +
+                                 FAT32_FSINFO_SECTOR, 1);
+    }
+    if (ok) {
+        prvBuildBootSector(pucBuffer, pxPlan);
+        ok = prvWriteSectors(pSD, pucBuffer, pxPlan->ulHiddenSectors, 1);
+        if (ok && bFAT32)
+            ok = prvWriteSectors(pSD, pucBuffer,
+                                 pxPlan->ulHiddenSectors + FAT32_BACKUP_BOOT_SECTOR, 1);
+    }
+    if (ok) {
+        prvBuildMBR(pucBuffer, pxPlan);
+        ok = prvWriteSectors(pSD, pucBuffer, 0, 1);
+    }
+    vPortFree(pucBuffer);
+    return ok ? FF_ERR_NONE : FF_ERR_IOMAN_DRIVER_FATAL_ERROR | FF_ERRFLAG;
+}
+
+/* Drop everything the IO manager has cached for this disk, after the media has
+been written behind its back. */
+static void prvInvalidateCache(FF_IOManager_t *pxIOManager) {
+    for (size_t i = 0; i < pxIOManager->usCacheSize; ++i) {
+        FF_Buffer_t *pxBuffer = &pxIOManager->pxBuffers[i];
+        configASSERT(!pxBuffer->usNumHandles);
+        pxBuffer->bValid = pdFALSE;
+        pxBuffer->bModified = pdFALSE;
+    }
+}
+
+/* Partition and format the card with a layout that suits the card's flash:
+partition offset, cluster size and FAT placement are derived from the card's
+capacity and Allocation Unit size (see ff_format_plan.h). */
+static FF_Error_t prvPartitionAndFormatDisk(FF_Disk_t *pxDisk, bool bQuick) {
+    sd_card_t *pSD = pxDisk->pvTag;
+    FF_FormatPlan_t xPlan;
+    FF_Error_t xError;
+
+    if (pxDisk->xStatus.bIsMounted) {
+        FF_PRINTF("Can't format a mounted disk\n");
+        return FF_ERR_IOMAN_PARTITION_MOUNTED | FF_ERRFLAG;
+    }
+    if (!ff_format_plan(pxDisk->ulNumberOfSectors, pSD->au_sectors, &xPlan)) {
+        FF_PRINTF("No FAT layout fits %lu sectors\n",
+                  (unsigned long)pxDisk->ulNumberOfSectors);
+        return FF_ERR_IOMAN_INVALID_FORMAT | FF_ERRFLAG;
+    }
+    FF_PRINTF(
+        "FAT%u: partition at %lu, %lu sectors per cluster, "
+        "%lu reserved, FAT at %lu, data at %lu (%lu KB aligned)\n",
+        xPlan.ucFATBits, (unsigned long)xPlan.ulHiddenSectors,
+        (unsigned long)xPlan.ulSectorsPerCluster,
+        (unsigned long)xPlan.ulReservedSectors,
+        (unsigned long)xPlan.ulFATBeginLBA, (unsigned long)xPlan.ulDataBeginLBA,
+        (unsigned long)xPlan.ulBoundarySectors / 2);
+
+    TickType_t xStart = xTaskGetTickCount();
+    xError = prvWriteVolume(pSD, &xPlan, bQuick);
+    TickType_t xElapsed = xTaskGetTickCount() - xStart;
+    prvInvalidateCache(pxDisk->pxIOManager);
+    FF_SDDiskReadAheadInvalidate(pxDisk, 0, UINT32_MAX);
+
+    /* Print out the result of the format operation. */
+    FF_PRINTF("%s: %s (%lu ms)\n", bQuick ? "Quick format" : "Format",
+              FF_GetErrMessage(xError),
+              (unsigned long)xElapsed * portTICK_PERIOD_MS);
 
     return xError;
 }
@@ -79,7 +265,16 @@ bool format(FF_Disk_t **ppxDisk, const char *const devName) {
     if (!*ppxDisk) {
         return false;
     }
-    FF_Error_t e = prvPartitionAndFormatDisk(*ppxDisk);
+    FF_Error_t e = prvPartitionAndFormatDisk(*ppxDisk, false);
+    return FF_ERR_NONE == e ? true : false;
+}
+
+bool quick_format(FF_Disk_t **ppxDisk, const char *const devName) {
+    *ppxDisk = FF_SDDiskInit(devName);
+    if (!*ppxDisk) {
+        return false;
+    }
+    FF_Error_t e = prvPartitionAndFormatDisk(*ppxDisk, true);
     return FF_ERR_NONE == e ? true : false;
 }
 
@@ -102,7 +297,9 @@ bool mount(FF_Disk_t **ppxDisk, const char *const devName,
             return false;
         }
     }
-    return FF_FS_Add(path, *ppxDisk);
+    if (!FF_FS_Add(path, *ppxDisk)) return false;
+    ff_log_recover(path);
+    return true;
 }
 void unmount(FF_Disk_t *pxDisk, const char *pcPath) {
     FF_FS_Remove(pcPath);
@@ -122,6 +319,7 @@ void eject(const char *const name, const char *pcPath) {
         return;
     }
     FF_FS_Remove(pcPath);
+    ff_writeback_lock();
     for (size_t i = 0; i < pSD->ff_disk_count; ++i) {
         FF_Disk_t *pxDisk = pSD->ff_disks[i];
         if (pxDisk) {
@@ -136,6 +334,7 @@ void eject(const char *const name, const char *pcPath) {
             FF_SDDiskDelete(pxDisk);
         }
     }
+    ff_writeback_unlock();
     sd_card_deinit(pSD);
 }
 
@@ -213,6 +412,258 @@ FF_Error_t ff_set_fsize(FF_FILE *pxStream) {
     return iReturn;
 }
 
+// AU assumed when the card didn't report one (typical of SDHC)
+#define DEFAULT_AU_SECTORS 8192
+
+/* Find the first cluster of the data area that starts on an AU boundary, and
+the number of clusters per AU. If no cluster is AU aligned (e.g., a card
+formatted elsewhere), *pulAlign is set to 1. */
+static uint32_t prvFirstAlignedCluster(FF_IOManager_t *pxIOManager,
+                                       uint32_t *pulAlign) {
+    sd_card_t *pSD = pxIOManager->xBlkDevice.pxDisk->pvTag;
+    uint32_t ulAU = pSD->au_sectors ? pSD->au_sectors : DEFAULT_AU_SECTORS;
+    uint32_t ulSPC = pxIOManager->xPartition.ulSectorsPerCluster;
+
+    if (ulAU > ulSPC && 0 == ulAU % ulSPC) {
+        *pulAlign = ulAU / ulSPC;
+        for (uint32_t ulCluster = 2; ulCluster < 2 + *pulAlign; ++ulCluster)
+            if (0 == FF_Cluster2LBA(pxIOManager, ulCluster) % ulAU)
+                return ulCluster;
+    }
+    *pulAlign = 1;
+    return 2;
+}
+
+/* Scan the FAT for ulCount free clusters in a row, starting on a multiple of
+ulAlign clusters from ulFirst. Returns 0 if there is no such run.
+Call with the FAT locked. */
+static uint32_t prvFindFreeRun(FF_IOManager_t *pxIOManager, uint32_t ulCount,
+                               uint32_t ulFirst, uint32_t ulAlign,
+                               FF_Error_t *pxError) {
+    FF_FATBuffers_t xFATBuffers;
+    FF_Error_t xTempError;
+    uint32_t ulLast = pxIOManager->xPartition.ulNumClusters + 1;
+    uint32_t ulStart = ulFirst, ulCluster = ulFirst, ulFound = 0;
+
+    FF_InitFATBuffers(&xFATBuffers, FF_MODE_READ);
+    *pxError = FF_ERR_NONE;
+    while (ulStart + ulCount - 1 <= ulLast) {
+        uint32_t ulEntry =
+            FF_getFATEntry(pxIOManager, ulCluster, pxError, &xFATBuffers);
+        if (FF_isERR(*pxError)) break;
+        if (ulEntry) {
+            // In use: try again from the next boundary after this cluster
+            ulStart = ulFirst + ((ulCluster - ulFirst) / ulAlign + 1) * ulAlign;
+            ulCluster = ulStart;
+        } else if (++ulCluster == ulStart + ulCount) {
+            ulFound = ulStart;
+            break;
+        }
+    }
+    xTempError = FF_ReleaseFATBuffers(pxIOManager, &xFATBuffers);
+    if (FF_isERR(*pxError) == pdFALSE) *pxError = xTempError;
+    return ulFound;
+}
+
+/* Chain ulCount clusters from ulStart together, and onto ulPrevEnd (if not
+0). Call with the FAT locked. */
+static FF_Error_t prvLinkRun(FF_IOManager_t *pxIOManager, uint32_t ulPrevEnd,
+                             uint32_t ulStart, uint32_t ulCount) {
+    FF_FATBuffers_t xFATBuffers;
+    FF_Error_t xError = FF_ERR_NONE, xTempError;
+    uint32_t ulEnd = ulStart + ulCount - 1;
+
+    FF_InitFATBuffers(&xFATBuffers, FF_MODE_WRITE);
+    for (uint32_t ulCluster = ulStart;
+         ulCluster < ulEnd && FF_isERR(xError) == pdFALSE; ++ulCluster)
+        xError = FF_putFATEntry(pxIOManager, ulCluster, ulCluster + 1,
+                                &xFATBuffers);
+    if (FF_isERR(xError) == pdFALSE)
+        xError = FF_putFATEntry(pxIOManager, ulEnd, 0xFFFFFFFF, &xFATBuffers);
+    if (FF_isERR(xError) == pdFALSE && ulPrevEnd)
+        xError = FF_putFATEntry(pxIOManager, ulPrevEnd, ulStart, &xFATBuffers);
+    xTempError = FF_ReleaseFATBuffers(pxIOManager, &xFATBuffers);
+    if (FF_isERR(xError) == pdFALSE) xError = xTempError;
+    if (FF_isERR(xError) == pdFALSE)
+        xError = FF_DecreaseFreeClusters(pxIOManager, ulCount);
+    return xError;
+}
+
+FF_Error_t FF_Allocate(FF_FILE *pxFile, uint32_t ulSize) {
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    FF_Error_t xError = FF_ERR_NONE;
+    uint32_t ulClusterBytes = pxIOManager->xPartition.usBlkSize *
+                              pxIOManager->xPartition.ulSectorsPerCluster;
+    // Rounded up, without overflowing near 4 GiB
+    uint32_t ulWanted = ulSize / ulClusterBytes + (ulSize % ulClusterBytes != 0);
+    uint32_t ulHave = 0, ulEnd = 0, ulAlign, ulFirst, ulStart;
+
+    if (!(pxFile->ucMode & FF_MODE_WRITE))
+        return FF_ERR_FILE_NOT_OPENED_IN_WRITE_MODE | FF_ERRFLAG;
+
+    FF_LockFAT(pxIOManager);
+    if (pxFile->ulChainLength) {
+        // Already known (maintained by FF_Write as the file grows)
+        ulHave = pxFile->ulChainLength;
+        ulEnd = pxFile->ulEndOfChain;
+    } else if (pxFile->ulObjectCluster) {
+        ulHave = FF_GetChainLength(pxIOManager, pxFile->ulObjectCluster,
+                                   &ulEnd, &xError);
+        if (FF_isERR(xError) == pdFALSE) {
+            pxFile->ulChainLength = ulHave;
+            pxFile->ulEndOfChain = ulEnd;
+        }
+    }
+    if (FF_isERR(xError) == pdFALSE && ulHave >= ulWanted) {
+        FF_UnlockFAT(pxIOManager);
+        return FF_ERR_NONE;
+    }
+    if (FF_isERR(xError) == pdFALSE) {
+        uint32_t ulCount = ulWanted - ulHave;
+
+        ulFirst = prvFirstAlignedCluster(pxIOManager, &ulAlign);
+        ulStart = prvFindFreeRun(pxIOManager, ulCount, ulFirst, ulAlign, &xError);
+        if (FF_isERR(xError) == pdFALSE && !ulStart && ulAlign > 1)
+            // Fragmented: settle for contiguous
+            ulStart = prvFindFreeRun(pxIOManager, ulCount, 2, 1, &xError);
+        if (FF_isERR(xError) == pdFALSE && !ulStart)
+            xError = FF_ERR_FAT_NO_FREE_CLUSTERS | FF_ERRFLAG;
+        if (FF_isERR(xError) == pdFALSE)
+            xError = prvLinkRun(pxIOManager, ulEnd, ulStart, ulCount);
+        if (FF_isERR(xError) == pdFALSE) {
+            if (!pxFile->ulObjectCluster) {
+                pxFile->ulObjectCluster = ulStart;
+                pxFile->ulAddrCurrentCluster = ulStart;
+                pxFile->ulCurrentCluster = 0;
+            }
+            pxFile->ulChainLength = ulWanted;
+            pxFile->ulEndOfChain = ulStart + ulCount - 1;
+        }
+    }
+    FF_UnlockFAT(pxIOManager);
+
+    // A new file gets its first cluster in the directory entry
+    if (FF_isERR(xError) == pdFALSE && !ulHave && ulWanted) {
+        FF_DirEnt_t xOriginalEntry;
+        xError = FF_GetEntry(pxIOManager, pxFile->usDirEntry,
+                             pxFile->ulDirCluster, &xOriginalEntry);
+        if (FF_isERR(xError) == pdFALSE) {
+            xOriginalEntry.ulObjectCluster = pxFile->ulObjectCluster;
+            xError = FF_PutEntry(pxIOManager, pxFile->usDirEntry,
+                                 pxFile->ulDirCluster, &xOriginalEntry, NULL);
+        }
+    }
+    if (FF_isERR(xError) == pdFALSE) xError = FF_FlushCache(pxIOManager);
+    return xError;
+}
+
+/* Release the clusters in the chain beyond the file size. A handle that
+hasn't written, or preallocated, doesn't know the chain's length
+(ulChainLength 0), so it is found on the card: after a crash, a file reopened
+to recover it (see ff_logfile.c) has the preallocated clusters beyond the end,
+but nothing in memory says so. */
+static FF_Error_t FF_Trim(FF_FILE *pxFile) {
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    FF_Error_t xError = FF_ERR_NONE;
+    uint32_t ulClusterBytes = pxIOManager->xPartition.usBlkSize *
+                              pxIOManager->xPartition.ulSectorsPerCluster;
+    uint32_t ulKeep = pxFile->ulFileSize / ulClusterBytes +
+                      (pxFile->ulFileSize % ulClusterBytes != 0);
+
+    if (!pxFile->ulObjectCluster || !(pxFile->ucMode & FF_MODE_WRITE))
+        return FF_ERR_NONE;
+
+    FF_LockFAT(pxIOManager);
+    if (!pxFile->ulChainLength) {
+        uint32_t ulEnd = 0;
+        uint32_t ulLength = FF_GetChainLength(
+            pxIOManager, pxFile->ulObjectCluster, &ulEnd, &xError);
+        if (FF_isERR(xError) == pdFALSE) {
+            pxFile->ulChainLength = ulLength;
+            pxFile->ulEndOfChain = ulEnd;
+        }
+    }
+    if (FF_isERR(xError) != pdFALSE || pxFile->ulChainLength <= ulKeep) {
+        FF_UnlockFAT(pxIOManager);
+        return xError;
+    }
+    if (!ulKeep) {
+        xError = FF_UnlinkClusterChain(pxIOManager, pxFile->ulObjectCluster,
+                                       pdFALSE);
+        pxFile->ulObjectCluster = 0;
+        pxFile->ulEndOfChain = 0;
+    } else {
+        uint32_t ulLast = FF_TraverseFAT(pxIOManager, pxFile->ulObjectCluster,
+                                         ulKeep - 1, &xError);
+        if (FF_isERR(xError) == pdFALSE) {
+            uint32_t ulNext = FF_getFATEntry(pxIOManager, ulLast, &xError, NULL);
+            if (FF_isERR(xError) == pdFALSE &&
+                FF_isEndOfChain(pxIOManager, ulNext) == pdFALSE)
+                // Keeps ulLast, marked as the end of the chain
+                xError = FF_UnlinkClusterChain(pxIOManager, ulLast, pdTRUE);
+        }
+        pxFile->ulEndOfChain = ulLast;
+    }
+    pxFile->ulChainLength = ulKeep;
+    ff_extent_map_invalidate(pxFile);
+    pxFile->ulAddrCurrentCluster = pxFile->ulObjectCluster;
+    pxFile->ulCurrentCluster = 0;
+    FF_UnlockFAT(pxIOManager);
+
+    if (FF_isERR(xError) == pdFALSE) xError = FF_FlushCache(pxIOManager);
+    return xError;
+}
+
+static int prvSetErrno(FF_Error_t xError) {
+    int ff_errno = prvFFErrorToErrno(xError);
+
+    /* Store the errno to thread local storage. */
+    stdioSET_ERRNO(ff_errno);
+    return ff_errno == 0 ? 0 : -1;
+}
+
+int ff_fallocate(FF_FILE *pxStream, uint32_t ulSize) {
+    return prvSetErrno(FF_Allocate(pxStream, ulSize));
+}
+
+/* FF_Close() and FF_SetEof() are wrapped at link time (--wrap, see
+CMakeLists.txt), so that every close, ff_fclose() included, gives back what
+the file has allocated beyond its size, and so that a file's extent map goes
+with the open file (see ff_extent_map.h). At size 0, FreeRTOS+FAT would write
+the directory entry with no first cluster, and lose the whole chain, so it
+has to be given back here. */
+FF_Error_t __real_FF_Close(FF_FILE *pxFile);
+FF_Error_t __real_FF_SetEof(FF_FILE *pxFile);
+
+FF_Error_t __wrap_FF_Close(FF_FILE *pxFile) {
+    FF_Error_t xError = FF_ERR_NONE, xTempError;
+    if (pxFile) {
+        xError = FF_Trim(pxFile);
+        ff_extent_map_invalidate(pxFile);
+    }
+    xTempError = __real_FF_Close(pxFile);
+    return FF_isERR(xError) == pdFALSE ? xTempError : xError;
+}
+
+FF_Error_t __wrap_FF_SetEof(FF_FILE *pxFile) {
+    FF_Error_t xError = __real_FF_SetEof(pxFile);
+    if (pxFile) ff_extent_map_invalidate(pxFile);
+    return xError;
+}
+
+int ff_fsync(FF_FILE *pxStream) {
+    FF_Error_t xError = FF_ERR_NONE;
+
+    if (pxStream->ucMode & FF_MODE_WRITE) {
+        // A seek writes out the file's own sector buffer
+        if (-1 == ff_fseek(pxStream, 0, FF_SEEK_CUR)) return -1;
+        xError = FF_UpdateDirEnt(pxStream);
+    }
+    if (FF_isERR(xError) == pdFALSE)
+        xError = FF_FlushCache(pxStream->pxIOManager);
+    return prvSetErrno(xError);
+}
+
 /*
 ** mkdirhier() - create all directories in a given path
 ** returns:
@@ -225,6 +676,11 @@ int mkdirhier(char *path) {
     char *dirp, *nextp = src;
     int retval = 1;
 
+    /* Usually all but the last directory (or all of them) exist already, so
+    try that first: one lookup instead of one per level of the path. */
+    if (ff_mkdir(path) == 0) return 0;
+    if (stdioGET_ERRNO() == pdFREERTOS_ERRNO_EEXIST) return 1;
+
     if (strlcpy(src, path, sizeof(src)) > sizeof(src)) {
         stdioSET_ERRNO(pdFREERTOS_ERRNO_ENAMETOOLONG);
         return -1;
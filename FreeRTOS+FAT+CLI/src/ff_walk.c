@@ -0,0 +1,224 @@
+/* ff_walk.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ff_stdio.h"
+#include "ff_walk.h"
+
+// A directory being read
+typedef struct {
+    FF_FindData_t xFind;
+    size_t xLen;         // Of the directory's path, in acPath
+    time_t xModified;    // Of the directory, for FF_WALK_LEAVE
+    bool bPending;       // xFind holds an entry not yet returned
+    bool bDone;
+} walk_level_t;
+
+struct FF_Walk {
+    unsigned uFlags;
+    unsigned uDepth;  // Levels in use
+    bool bEnter;      // The last entry returned is a directory to enter
+    FF_WalkEntry_t xEntry;
+    FF_WalkStats_t xStats;
+    char acPath[ffconfigMAX_FILENAME];
+    walk_level_t xLevels[ffconfigWALK_MAX_DEPTH];
+};
+
+static time_t prvTime(const FF_SystemTime_t *pxTime) {
+    if (!pxTime->Year) return 0;
+    struct tm xTm = {.tm_sec = pxTime->Second,
+                     .tm_min = pxTime->Minute,
+                     .tm_hour = pxTime->Hour,
+                     .tm_mday = pxTime->Day,
+                     .tm_mon = pxTime->Month - 1,
+                     .tm_year = pxTime->Year - 1900,
+                     .tm_isdst = -1};
+    return mktime(&xTm);
+}
+
+// Whether a failed ff_findfirst() or ff_findnext() just ran out of entries
+static bool prvAtEnd(void) {
+    return pdFREERTOS_ERRNO_ENMFILE == stdioGET_ERRNO();
+}
+
+/* Read the directory whose path is in acPath as a new level. A directory
+that can't be read is still a level, with nothing in it, so that it is left
+like any other. */
+static void prvEnter(FF_Walk_t *pxWalk, time_t xModified) {
+    if (ffconfigWALK_MAX_DEPTH == pxWalk->uDepth) {
+        ++pxWalk->xStats.ulTooDeep;
+        return;
+    }
+    walk_level_t *pxLevel = &pxWalk->xLevels[pxWalk->uDepth++];
+    memset(&pxLevel->xFind, 0, sizeof pxLevel->xFind);
+    pxLevel->xLen = strlen(pxWalk->acPath);
+    pxLevel->xModified = xModified;
+    pxLevel->bPending = 0 == ff_findfirst(pxWalk->acPath, &pxLevel->xFind);
+    pxLevel->bDone = !pxLevel->bPending;
+    if (pxLevel->bDone && !prvAtEnd()) ++pxWalk->xStats.ulErrors;
+    ++pxWalk->xStats.ulDirectories;
+}
+
+// Put pcName in acPath after the directory's path (xLen long)
+static bool prvSetPath(FF_Walk_t *pxWalk, size_t xLen, const char *pcName) {
+    char *pcPath = pxWalk->acPath;
+    if (xLen && '/' != pcPath[xLen - 1]) {
+        if (xLen + 1 >= sizeof pxWalk->acPath) return false;
+        pcPath[xLen++] = '/';
+    }
+    size_t xName = strlen(pcName);
+    if (xLen + xName >= sizeof pxWalk->acPath) return false;
+    memcpy(pcPath + xLen, pcName, xName + 1);
+    pxWalk->xEntry.pcPath = pcPath;
+    pxWalk->xEntry.pcName = pcPath + xLen;
+    return true;
+}
+
+FF_Walk_t *ff_walk_open(const char *pcPath, unsigned uFlags) {
+    size_t xLen = strlen(pcPath);
+    while (xLen > 1 && '/' == pcPath[xLen - 1]) --xLen;
+    if (xLen >= ffconfigMAX_FILENAME) {
+        stdioSET_ERRNO(pdFREERTOS_ERRNO_ENAMETOOLONG);
+        return NULL;
+    }
+    FF_Walk_t *pxWalk = pvPortMalloc(sizeof(FF_Walk_t));
+    if (!pxWalk) {
+        stdioSET_ERRNO(pdFREERTOS_ERRNO_ENOMEM);
+        return NULL;
+    }
+    memset(pxWalk, 0, offsetof(FF_Walk_t, xLevels));
+    pxWalk->uFlags = uFlags;
+    memcpy(pxWalk->acPath, pcPath, xLen);
+    pxWalk->acPath[xLen] = '\0';
+    prvEnter(pxWalk, 0);
+    if (pxWalk->xStats.ulErrors) {
+        int iErrno = stdioGET_ERRNO();
+        vPortFree(pxWalk);
+        stdioSET_ERRNO(iErrno);
+        return NULL;
+    }
+    return pxWalk;
+}
+
+const FF_WalkEntry_t *ff_walk_next(FF_Walk_t *pxWalk) {
+    FF_WalkEntry_t *pxEntry = &pxWalk->xEntry;
+
+    if (pxWalk->bEnter) {
+        pxWalk->bEnter = false;
+        prvEnter(pxWalk, pxEntry->xModified);
+    }
+    while (pxWalk->uDepth) {
+        walk_level_t *pxLevel = &pxWalk->xLevels[pxWalk->uDepth - 1];
+        if (!pxLevel->bPending && !pxLevel->bDone) {
+            pxLevel->bPending = 0 == ff_findnext(&pxLevel->xFind);
+            pxLevel->bDone = !pxLevel->bPending;
+            if (pxLevel->bDone && !prvAtEnd()) ++pxWalk->xStats.ulErrors;
+        }
+        if (pxLevel->bDone) {
+            if (!--pxWalk->uDepth || !(pxWalk->uFlags & FF_WALK_LEAVE))
+                continue;
+            // Return the directory again: its path is still in acPath
+            pxWalk->acPath[pxLevel->xLen] = '\0';
+            const char *pcName = strrchr(pxWalk->acPath, '/');
+            pxEntry->pcPath = pxWalk->acPath;
+            pxEntry->pcName = pcName ? pcName + 1 : pxWalk->acPath;
+            pxEntry->ulSize = 0;
+            pxEntry->ucAttributes = FF_FAT_ATTR_DIR;
+            pxEntry->xModified = pxLevel->xModified;
+            pxEntry->uDepth = pxWalk->uDepth - 1;
+            pxEntry->bLeaving = true;
+            // Until the parent reads on, it still holds the directory's entry
+            pxEntry->pxFind = &pxWalk->xLevels[pxWalk->uDepth - 1].xFind;
+            return pxEntry;
+        }
+        pxLevel->bPending = false;
+        const FF_FindData_t *pxFind = &pxLevel->xFind;
+        if (0 == strcmp(pxFind->pcFileName, ".") ||
+            0 == strcmp(pxFind->pcFileName, ".."))
+            continue;
+        if (!prvSetPath(pxWalk, pxLevel->xLen, pxFind->pcFileName)) {
+            ++pxWalk->xStats.ulErrors;
+            continue;
+        }
+        pxEntry->ulSize = pxFind->ulFileSize;
+        pxEntry->ucAttributes = pxFind->ucAttributes;
+        pxEntry->xModified = prvTime(&pxFind->xDirectoryEntry.xModifiedTime);
+        pxEntry->uDepth = pxWalk->uDepth - 1;
+        pxEntry->bLeaving = false;
+        pxEntry->pxFind = pxFind;
+        pxWalk->bEnter = pxFind->ucAttributes & FF_FAT_ATTR_DIR;
+        ++pxWalk->xStats.ulEntries;
+        return pxEntry;
+    }
+    return NULL;
+}
+
+void ff_walk_prune(FF_Walk_t *pxWalk) { pxWalk->bEnter = false; }
+
+const FF_WalkStats_t *ff_walk_stats(const FF_Walk_t *pxWalk) {
+    return &pxWalk->xStats;
+}
+
+void ff_walk_close(FF_Walk_t *pxWalk) { vPortFree(pxWalk); }
+
+void ff_walk_filter_init(FF_WalkFilter_t *pxFilter) {
+    memset(pxFilter, 0, sizeof *pxFilter);
+    pxFilter->ulMaxSize = UINT32_MAX;
+}
+
+bool ff_walk_match(const FF_WalkFilter_t *pxFilter,
+                   const FF_WalkEntry_t *pxEntry) {
+    bool bDir = pxEntry->ucAttributes & FF_FAT_ATTR_DIR;
+    if (('f' == pxFilter->cType && bDir) || ('d' == pxFilter->cType && !bDir))
+        return false;
+    if (pxEntry->ulSize < pxFilter->ulMinSize ||
+        pxEntry->ulSize > pxFilter->ulMaxSize)
+        return false;
+    if (pxFilter->xModifiedAfter &&
+        pxEntry->xModified <= pxFilter->xModifiedAfter)
+        return false;
+    if (pxFilter->xModifiedBefore &&
+        pxEntry->xModified >= pxFilter->xModifiedBefore)
+        return false;
+    return !pxFilter->pcGlob || ff_glob_match(pxFilter->pcGlob, pxEntry->pcName);
+}
+
+/* Greedy, with backtracking to the last * only, which is enough: a later *
+can always absorb what an earlier one would have. */
+bool ff_glob_match(const char *pcPattern, const char *pcName) {
+    const char *pcStar = NULL, *pcResume = NULL;
+    while (*pcName) {
+        if ('*' == *pcPattern) {
+            pcStar = pcPattern++;
+            pcResume = pcName;
+        } else if ('?' == *pcPattern ||
+                   tolower((unsigned char)*pcPattern) ==
+                       tolower((unsigned char)*pcName)) {
+            ++pcPattern;
+            ++pcName;
+        } else if (pcStar) {
+            pcPattern = pcStar + 1;
+            pcName = ++pcResume;
+        } else {
+            return false;
+        }
+    }
+    while ('*' == *pcPattern) ++pcPattern;
+    return !*pcPattern;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,152 @@
+/* ff_writeback.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include "FreeRTOS.h" /* Must come first. */
+//
+#include "hardware/gpio.h"
+//
+#include "ff_headers.h"
+#include "ff_sddisk.h"
+#include "ff_writeback.h"
+#include "semphr.h"
+#include "task.h"
+//
+#include "hw_config.h"
+#include "sd_card.h"
+
+static TaskHandle_t xFlusher;
+static SemaphoreHandle_t xMutex;
+static volatile bool bPowerFailing;
+
+static size_t prvDirtyBytes(FF_IOManager_t *pxIOManager) {
+    size_t xBytes = 0;
+
+    FF_PendSemaphore(pxIOManager->pvSemaphore);
+    for (uint16_t i = 0; i < pxIOManager->usCacheSize; ++i) {
+        if (pxIOManager->pxBuffers[i].bModified)
+            xBytes += pxIOManager->usSectorSize;
+    }
+    FF_ReleaseSemaphore(pxIOManager->pvSemaphore);
+    return xBytes;
+}
+
+/* Flush the disk's cache if it is due. *pxDirtySince is the tick at which
+the disk was first seen dirty, or 0 if it was clean. */
+static void prvFlushIfDue(FF_Disk_t *pxDisk, TickType_t *pxDirtySince) {
+    size_t xBytes = prvDirtyBytes(pxDisk->pxIOManager);
+    if (!xBytes) {
+        *pxDirtySince = 0;
+        return;
+    }
+    TickType_t xNow = xTaskGetTickCount();
+    if (!*pxDirtySince) *pxDirtySince = xNow ? xNow : 1;
+    if (bPowerFailing || xBytes >= ffconfigWRITEBACK_DIRTY_BYTES ||
+        xNow - *pxDirtySince >=
+            pdMS_TO_TICKS(ffconfigWRITEBACK_DIRTY_AGE_MS)) {
+        FF_Error_t xError = FF_FlushCache(pxDisk->pxIOManager);
+        if (FF_isERR(xError) != pdFALSE)
+            FF_PRINTF("FF_FlushCache: %s\n",
+                      (const char *)FF_GetErrMessage(xError));
+        *pxDirtySince = 0;
+    }
+}
+
+static void prvFlusherTask(void *arg) {
+    (void)arg;
+    // One per card; the driver gives each card a single disk
+    TickType_t *pxDirtySince = pvPortMalloc(sd_get_num() * sizeof(TickType_t));
+    configASSERT(pxDirtySince);
+    for (size_t i = 0; i < sd_get_num(); ++i) pxDirtySince[i] = 0;
+
+    for (;;) {
+        uint32_t ulPowerFail = ulTaskNotifyTake(
+            pdTRUE, pdMS_TO_TICKS(ffconfigWRITEBACK_POLL_MS));
+        if (ulPowerFail) {
+            bPowerFailing = true;
+            vTaskPrioritySet(NULL, configMAX_PRIORITIES - 1);
+        }
+        xSemaphoreTake(xMutex, portMAX_DELAY);
+        for (size_t i = 0; i < sd_get_num(); ++i) {
+            sd_card_t *pSD = sd_get_by_num(i);
+            if (!pSD->ff_disk_count || !pSD->ff_disks) continue;
+            FF_Disk_t *pxDisk = pSD->ff_disks[0];
+            if (pxDisk && pxDisk->xStatus.bIsMounted) {
+                prvFlushIfDue(pxDisk, &pxDirtySince[i]);
+                /* The first FAT is what counts; leave the copies until
+                there is power to spare. */
+                if (!bPowerFailing)
+                    FF_SDDiskMirrorFATs(
+                        pxDisk, pdMS_TO_TICKS(ffconfigFAT_MIRROR_DELAY_MS));
+            } else {
+                pxDirtySince[i] = 0;
+            }
+        }
+        xSemaphoreGive(xMutex);
+    }
+}
+
+void ff_writeback_start(void) {
+    // FF_FlushCache() down through the SD driver, and FF_PRINTF() on error
+    static StackType_t xStack[1024];
+    static StaticTask_t xTaskBuffer;
+    static StaticSemaphore_t xMutexBuffer;
+
+    configASSERT(!xFlusher);
+    xMutex = xSemaphoreCreateMutexStatic(&xMutexBuffer);
+    // Above ordinary tasks, so a busy writer can't starve it
+    xFlusher = xTaskCreateStatic(prvFlusherTask, "Flusher",
+                                 sizeof xStack / sizeof xStack[0], 0,
+                                 configMAX_PRIORITIES - 2, xStack,
+                                 &xTaskBuffer);
+    configASSERT(xFlusher);
+}
+
+void ff_writeback_power_fail_from_isr(void) {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    bPowerFailing = true;
+    if (!xFlusher) return;
+    vTaskNotifyGiveFromISR(xFlusher, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void prvPowerFailCallback(uint gpio, uint32_t events) {
+    (void)gpio;
+    (void)events;
+    ff_writeback_power_fail_from_isr();
+}
+
+void ff_writeback_watch_power_fail(uint gpio, bool bActiveHigh) {
+    gpio_init(gpio);
+    gpio_set_dir(gpio, GPIO_IN);
+    if (bActiveHigh)
+        gpio_pull_down(gpio);
+    else
+        gpio_pull_up(gpio);
+    gpio_set_irq_enabled_with_callback(
+        gpio, bActiveHigh ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL, true,
+        &prvPowerFailCallback);
+}
+
+bool ff_power_failing(void) { return bPowerFailing; }
+
+void ff_writeback_lock(void) {
+    if (xMutex) xSemaphoreTake(xMutex, portMAX_DELAY);
+}
+
+void ff_writeback_unlock(void) {
+    if (xMutex) xSemaphoreGive(xMutex);
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,404 @@
+/* ff_xfer.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <string.h>
+
+#include "crc.h"
+#include "ff_direct_io.h"
+#include "ff_stdio.h"
+#include "ff_utils.h"
+#include "ff_xfer.h"
+#include "task.h"
+
+#if ffconfigXFER_BLOCK_SIZE % 512
+#error "ffconfigXFER_BLOCK_SIZE must be a whole number of sectors"
+#endif
+
+#define XFER_SOH 0x01
+#define XFER_HEADER 8  // SOH, type, sequence, length
+#define XFER_CRC 2
+#define XFER_FRAME_MAX (XFER_HEADER + ffconfigXFER_BLOCK_SIZE + XFER_CRC)
+#define XFER_TIMEOUT pdMS_TO_TICKS(ffconfigXFER_TIMEOUT_MS)
+
+// Frame types
+#define XFER_FILE 'F'
+#define XFER_DATA 'D'
+#define XFER_END 'E'
+#define XFER_ACK 'A'
+#define XFER_NAK 'N'
+#define XFER_CANCEL 'C'
+
+typedef struct {
+    const FF_XferLink_t *pxLink;
+    FF_XferStats_t xStats;
+    // The last frame received
+    uint8_t ucType;
+    uint32_t ulSequence;
+    uint16_t usLength;
+    const uint8_t *pucPayload;
+    // What has come in: the last frame (xUsed bytes), then the start of more
+    size_t xHave, xUsed;
+    uint8_t ucRx[2 * XFER_FRAME_MAX];
+} FF_Xfer_t;
+
+static void prvPut16(uint8_t *pucTo, uint16_t usValue) {
+    pucTo[0] = usValue;
+    pucTo[1] = usValue >> 8;
+}
+static void prvPut32(uint8_t *pucTo, uint32_t ulValue) {
+    prvPut16(pucTo, ulValue);
+    prvPut16(pucTo + 2, ulValue >> 16);
+}
+static uint16_t prvGet16(const uint8_t *pucFrom) {
+    return pucFrom[0] | pucFrom[1] << 8;
+}
+static uint32_t prvGet32(const uint8_t *pucFrom) {
+    return prvGet16(pucFrom) | (uint32_t)prvGet16(pucFrom + 2) << 16;
+}
+
+static FF_Xfer_t *prvNew(const FF_XferLink_t *pxLink) {
+    FF_Xfer_t *pxXfer = pvPortMalloc(sizeof(FF_Xfer_t));
+    if (!pxXfer) {
+        stdioSET_ERRNO(pdFREERTOS_ERRNO_ENOMEM);
+        return NULL;
+    }
+    memset(pxXfer, 0, sizeof(FF_Xfer_t));
+    pxXfer->pxLink = pxLink;
+    return pxXfer;
+}
+
+static bool prvSend(FF_Xfer_t *pxXfer, uint8_t ucType, uint32_t ulSequence,
+                    const void *pvPayload, uint16_t usLength) {
+    const FF_XferLink_t *pxLink = pxXfer->pxLink;
+    uint8_t ucHeader[XFER_HEADER], ucCRC[XFER_CRC];
+    unsigned short usCRC = 0;
+
+    ucHeader[0] = XFER_SOH;
+    ucHeader[1] = ucType;
+    prvPut32(&ucHeader[2], ulSequence);
+    prvPut16(&ucHeader[6], usLength);
+    update_crc16(&usCRC, (const char *)&ucHeader[1], XFER_HEADER - 1);
+    update_crc16(&usCRC, pvPayload, usLength);
+    ucCRC[0] = usCRC >> 8;
+    ucCRC[1] = usCRC;
+    if (pxLink->pxSend(pxLink->pvContext, ucHeader, sizeof ucHeader) &&
+        (!usLength ||
+         pxLink->pxSend(pxLink->pvContext, pvPayload, usLength)) &&
+        pxLink->pxSend(pxLink->pvContext, ucCRC, sizeof ucCRC))
+        return true;
+    stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+    return false;
+}
+
+// Tell the far end to give up, leaving errno as it is
+static void prvCancel(FF_Xfer_t *pxXfer) {
+    int iErrno = stdioGET_ERRNO();
+    prvSend(pxXfer, XFER_CANCEL, 0, NULL, 0);
+    stdioSET_ERRNO(iErrno);
+}
+
+/* Wait up to xTimeout for an intact frame. Anything else (console output, or
+a frame that fails the CRC) is skipped. */
+static bool prvReceive(FF_Xfer_t *pxXfer, TickType_t xTimeout) {
+    const FF_XferLink_t *pxLink = pxXfer->pxLink;
+    uint8_t *pucRx = pxXfer->ucRx;
+    TickType_t xStart = xTaskGetTickCount();
+
+    pxXfer->xHave -= pxXfer->xUsed;
+    memmove(pucRx, pucRx + pxXfer->xUsed, pxXfer->xHave);
+    pxXfer->xUsed = 0;
+    for (;;) {
+        const uint8_t *pucSOH = memchr(pucRx, XFER_SOH, pxXfer->xHave);
+        size_t xSkip = pucSOH ? (size_t)(pucSOH - pucRx) : pxXfer->xHave;
+        pxXfer->xHave -= xSkip;
+        memmove(pucRx, pucRx + xSkip, pxXfer->xHave);
+
+        if (pxXfer->xHave >= XFER_HEADER) {
+            uint16_t usLength = prvGet16(&pucRx[6]);
+            size_t xFrame = XFER_HEADER + usLength + XFER_CRC;
+            if (usLength > ffconfigXFER_BLOCK_SIZE) {
+                pucRx[0] = 0;  // Not a frame: look for the next SOH
+                continue;
+            }
+            if (pxXfer->xHave >= xFrame) {
+                unsigned short usCRC = 0;
+                update_crc16(&usCRC, (const char *)&pucRx[1],
+                             xFrame - 1 - XFER_CRC);
+                if (usCRC != (pucRx[xFrame - 2] << 8 | pucRx[xFrame - 1])) {
+                    pucRx[0] = 0;
+                    continue;
+                }
+                pxXfer->ucType = pucRx[1];
+                pxXfer->ulSequence = prvGet32(&pucRx[2]);
+                pxXfer->usLength = usLength;
+                pxXfer->pucPayload = &pucRx[XFER_HEADER];
+                pxXfer->xUsed = xFrame;
+                return true;
+            }
+        }
+        TickType_t xElapsed = xTaskGetTickCount() - xStart;
+        if (xElapsed >= xTimeout) return false;
+        size_t xReceived = pxLink->pxReceive(
+            pxLink->pvContext, pucRx + pxXfer->xHave,
+            sizeof pxXfer->ucRx - pxXfer->xHave, xTimeout - xElapsed);
+        if (!xReceived) return false;
+        pxXfer->xHave += xReceived;
+    }
+}
+
+/* Read the blocks after the *pulRead already in the window, up to the end of
+the window or of the buffer, whichever comes first, in one go. Block n (from
+1) is kept in slot (n - 1) % ffconfigXFER_WINDOW until it is acknowledged. */
+static bool prvReadAhead(FF_FILE *pxFile, uint8_t *pucWindow, uint32_t ulBase,
+                         uint32_t ulBlocks, uint32_t *pulRead) {
+    uint32_t ulLast = ulBase + ffconfigXFER_WINDOW - 1;
+    if (ulLast > ulBlocks) ulLast = ulBlocks;
+    uint32_t ulSlot = *pulRead % ffconfigXFER_WINDOW;
+    uint32_t ulCount = ulLast - *pulRead;
+    if (ulCount > ffconfigXFER_WINDOW - ulSlot)
+        ulCount = ffconfigXFER_WINDOW - ulSlot;
+
+    uint32_t ulOffset = *pulRead * ffconfigXFER_BLOCK_SIZE;
+    size_t xSize = ulCount * ffconfigXFER_BLOCK_SIZE;
+    if (xSize > pxFile->ulFileSize - ulOffset)
+        xSize = pxFile->ulFileSize - ulOffset;
+    if (ff_fread_direct(pucWindow + ulSlot * ffconfigXFER_BLOCK_SIZE, 1, xSize,
+                        pxFile) != xSize) {
+        if (!stdioGET_ERRNO()) stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+        return false;
+    }
+    *pulRead += ulCount;
+    return true;
+}
+
+static bool prvSendFrame(FF_Xfer_t *pxXfer, FF_FILE *pxFile,
+                         const char *pcName, uint8_t *pucWindow,
+                         uint32_t ulSequence) {
+    uint32_t ulSize = pxFile->ulFileSize;
+    uint32_t ulBlocks =
+        (ulSize + ffconfigXFER_BLOCK_SIZE - 1) / ffconfigXFER_BLOCK_SIZE;
+
+    if (0 == ulSequence) {
+        uint8_t ucInfo[4 + ffconfigMAX_FILENAME];
+        size_t xName = strnlen(pcName, ffconfigMAX_FILENAME);
+        prvPut32(ucInfo, ulSize);
+        memcpy(&ucInfo[4], pcName, xName);
+        return prvSend(pxXfer, XFER_FILE, 0, ucInfo, 4 + xName);
+    }
+    if (ulSequence > ulBlocks)
+        return prvSend(pxXfer, XFER_END, ulSequence, NULL, 0);
+    uint32_t ulOffset = (ulSequence - 1) * ffconfigXFER_BLOCK_SIZE;
+    uint16_t usLength = ulSize - ulOffset < ffconfigXFER_BLOCK_SIZE
+                            ? ulSize - ulOffset
+                            : ffconfigXFER_BLOCK_SIZE;
+    return prvSend(pxXfer, XFER_DATA, ulSequence,
+                   pucWindow + ((ulSequence - 1) % ffconfigXFER_WINDOW) *
+                                   ffconfigXFER_BLOCK_SIZE,
+                   usLength);
+}
+
+static bool prvSendFile(FF_Xfer_t *pxXfer, FF_FILE *pxFile, const char *pcName,
+                        uint8_t *pucWindow) {
+    uint32_t ulBlocks = (pxFile->ulFileSize + ffconfigXFER_BLOCK_SIZE - 1) /
+                        ffconfigXFER_BLOCK_SIZE;
+    // Frame 0 is the file, 1 to ulBlocks its data, and ulEnd the end
+    uint32_t ulEnd = ulBlocks + 1;
+    // Frames from ulBase are unacknowledged; ulNext is to be sent next
+    uint32_t ulBase = 0, ulNext = 0, ulSent = 0, ulRead = 0;
+    unsigned uTimeouts = 0;
+
+    pxXfer->xStats.ulBytes = pxFile->ulFileSize;
+    while (ulBase <= ulEnd) {
+        while (ulNext <= ulEnd && ulNext - ulBase < ffconfigXFER_WINDOW) {
+            if (ulNext && ulNext < ulEnd && ulNext > ulRead &&
+                !prvReadAhead(pxFile, pucWindow, ulBase, ulBlocks, &ulRead)) {
+                prvCancel(pxXfer);
+                return false;
+            }
+            if (!prvSendFrame(pxXfer, pxFile, pcName, pucWindow, ulNext))
+                return false;
+            ++pxXfer->xStats.ulFrames;
+            if (ulNext < ulSent)
+                ++pxXfer->xStats.ulResent;
+            else
+                ulSent = ulNext + 1;
+            ++ulNext;
+        }
+        if (!prvReceive(pxXfer, XFER_TIMEOUT)) {
+            if (++uTimeouts > ffconfigXFER_RETRIES) {
+                stdioSET_ERRNO(pdFREERTOS_ERRNO_ETIMEDOUT);
+                prvCancel(pxXfer);
+                return false;
+            }
+            ulNext = ulBase;  // Go back
+            continue;
+        }
+        switch (pxXfer->ucType) {
+            case XFER_ACK:
+            case XFER_NAK:
+                // Ignore stale acknowledgements
+                if (pxXfer->ulSequence < ulBase || pxXfer->ulSequence > ulNext)
+                    break;
+                if (pxXfer->ulSequence > ulBase) {
+                    ulBase = pxXfer->ulSequence;
+                    uTimeouts = 0;
+                }
+                if (XFER_NAK == pxXfer->ucType) ulNext = ulBase;
+                break;
+            case XFER_CANCEL:
+                stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+                return false;
+        }
+    }
+    // The receiver need not wait to see whether its last ACK arrived
+    prvSend(pxXfer, XFER_ACK, ulBase, NULL, 0);
+    return true;
+}
+
+int ff_xfer_send(const char *pcPath, const FF_XferLink_t *pxLink,
+                 FF_XferStats_t *pxStats) {
+    int iResult = -1;
+
+    FF_FILE *pxFile = ff_fopen(pcPath, "r");
+    if (!pxFile) return -1;
+    const char *pcName = strrchr(pcPath, '/');
+    pcName = pcName ? pcName + 1 : pcPath;
+    FF_Xfer_t *pxXfer = prvNew(pxLink);
+    uint8_t *pucWindow =
+        pvPortMalloc(ffconfigXFER_WINDOW * ffconfigXFER_BLOCK_SIZE);
+    if (pxXfer && !pucWindow) {
+        stdioSET_ERRNO(pdFREERTOS_ERRNO_ENOMEM);
+        prvCancel(pxXfer);
+    } else if (pxXfer && prvSendFile(pxXfer, pxFile, pcName, pucWindow)) {
+        iResult = 0;
+    }
+    if (pxXfer && pxStats) *pxStats = pxXfer->xStats;
+    vPortFree(pucWindow);
+    vPortFree(pxXfer);
+    ff_fclose(pxFile);
+    return iResult;
+}
+
+static bool prvReceiveFile(FF_Xfer_t *pxXfer, const char *pcPath,
+                           FF_FILE **ppxFile) {
+    uint32_t ulExpected = 0, ulSize = 0;
+    // The furthest frame seen beyond a gap since it was reported; 0 if none
+    uint32_t ulAhead = 0;
+    unsigned uTimeouts = 0;
+    bool bDone = false;
+
+    for (;;) {
+        /* Once done, stay long enough for a sender that missed our last ACK
+        to time out and send again. */
+        if (!prvReceive(pxXfer, bDone ? 2 * XFER_TIMEOUT : XFER_TIMEOUT)) {
+            if (bDone) return true;  // The sender's last ACK was lost
+            if (++uTimeouts > ffconfigXFER_RETRIES) {
+                stdioSET_ERRNO(pdFREERTOS_ERRNO_ETIMEDOUT);
+                prvCancel(pxXfer);
+                return false;
+            }
+            // Prod the sender into going back
+            if (!prvSend(pxXfer, XFER_NAK, ulExpected, NULL, 0)) return false;
+            continue;
+        }
+        if (XFER_CANCEL == pxXfer->ucType) {
+            stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+            return false;
+        }
+        if (XFER_ACK == pxXfer->ucType || XFER_NAK == pxXfer->ucType) {
+            if (bDone) return true;
+            continue;
+        }
+        if (pxXfer->ulSequence != ulExpected) {
+            ++pxXfer->xStats.ulResent;
+            bool bOK = true;
+            if (pxXfer->ulSequence < ulExpected) {
+                // Sent again: our ACK must have been lost
+                bOK = prvSend(pxXfer, XFER_ACK, ulExpected, NULL, 0);
+            } else {
+                /* One went missing. Ask once, and again only if the sender
+                has gone back and missed it again. */
+                if (!ulAhead || pxXfer->ulSequence <= ulAhead)
+                    bOK = prvSend(pxXfer, XFER_NAK, ulExpected, NULL, 0);
+                ulAhead = pxXfer->ulSequence;
+            }
+            if (!bOK) return false;
+            continue;
+        }
+        uTimeouts = 0;
+        ulAhead = 0;
+        ++pxXfer->xStats.ulFrames;
+
+        bool bOK = false;
+        if ((XFER_FILE == pxXfer->ucType) != (0 == ulExpected)) {
+            stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);  // Out of order
+        } else if (XFER_FILE == pxXfer->ucType) {
+            if (pxXfer->usLength < 4) {
+                stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+            } else {
+                ulSize = prvGet32(pxXfer->pucPayload);
+                *ppxFile = ff_fopen(pcPath, "w");
+                bOK = *ppxFile &&
+                      (!ulSize || -1 != ff_fallocate(*ppxFile, ulSize));
+            }
+        } else if (XFER_DATA == pxXfer->ucType) {
+            if (pxXfer->xStats.ulBytes + pxXfer->usLength > ulSize) {
+                stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+            } else if (ff_fwrite_direct(pxXfer->pucPayload, 1,
+                                        pxXfer->usLength, *ppxFile) ==
+                       pxXfer->usLength) {
+                pxXfer->xStats.ulBytes += pxXfer->usLength;
+                bOK = true;
+            } else if (!stdioGET_ERRNO()) {
+                stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+            }
+        } else if (XFER_END == pxXfer->ucType) {
+            if (pxXfer->xStats.ulBytes != ulSize)
+                stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+            else
+                bOK = bDone = true;
+        } else {
+            stdioSET_ERRNO(pdFREERTOS_ERRNO_EIO);
+        }
+        if (!bOK) {
+            prvCancel(pxXfer);
+            return false;
+        }
+        if (!prvSend(pxXfer, XFER_ACK, ++ulExpected, NULL, 0)) return false;
+    }
+}
+
+int ff_xfer_receive(const char *pcPath, const FF_XferLink_t *pxLink,
+                    FF_XferStats_t *pxStats) {
+    FF_FILE *pxFile = NULL;
+    int iResult = -1;
+
+    FF_Xfer_t *pxXfer = prvNew(pxLink);
+    if (!pxXfer) return -1;
+    if (prvReceiveFile(pxXfer, pcPath, &pxFile)) iResult = 0;
+    if (pxStats) *pxStats = pxXfer->xStats;
+    vPortFree(pxXfer);
+    if (pxFile) {
+        // Release what was allocated beyond the end
+        if (-1 == ff_fclose(pxFile)) iResult = -1;
+        if (-1 == iResult) {
+            int iErrno = stdioGET_ERRNO();
+            ff_remove(pcPath);
+            stdioSET_ERRNO(iErrno);
+        }
+    }
+    return iResult;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,92 @@
+/* lat_hist.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+#include <string.h>
+//
+#include "lat_hist.h"
+
+/* 0 to 3 us have a bucket each. Above that, bucket 4 * (msb - 1) + the two bits
+below the most significant one. */
+static unsigned prvBucket(uint32_t ulUs) {
+    if (ulUs < 4) return ulUs;
+    unsigned msb = 31 - __builtin_clz(ulUs);
+    return 4 * (msb - 1) + ((ulUs >> (msb - 2)) & 3);
+}
+
+uint32_t lat_hist_bucket_low(unsigned uBucket) {
+    if (uBucket < 4) return uBucket;
+    unsigned msb = uBucket / 4 + 1;
+    return (uint32_t)(4 + uBucket % 4) << (msb - 2);
+}
+
+uint32_t lat_hist_bucket_high(unsigned uBucket) {
+    if (uBucket < 4) return uBucket;
+    unsigned msb = uBucket / 4 + 1;
+    return lat_hist_bucket_low(uBucket) + ((uint32_t)1 << (msb - 2)) - 1;
+}
+
+void lat_hist_reset(lat_hist_t *pxHist) { memset(pxHist, 0, sizeof *pxHist); }
+
+void lat_hist_add(lat_hist_t *pxHist, uint32_t ulUs) {
+    ++pxHist->ulBuckets[prvBucket(ulUs)];
+    ++pxHist->ulCount;
+    pxHist->ullSumUs += ulUs;
+    if (ulUs > pxHist->ulMaxUs) pxHist->ulMaxUs = ulUs;
+}
+
+void lat_hist_merge(lat_hist_t *pxHist, const lat_hist_t *pxOther) {
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; ++i)
+        pxHist->ulBuckets[i] += pxOther->ulBuckets[i];
+    pxHist->ulCount += pxOther->ulCount;
+    pxHist->ullSumUs += pxOther->ullSumUs;
+    if (pxOther->ulMaxUs > pxHist->ulMaxUs) pxHist->ulMaxUs = pxOther->ulMaxUs;
+}
+
+void lat_hist_sub(lat_hist_t *pxHist, const lat_hist_t *pxOld) {
+    unsigned uTop = 0;
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; ++i) {
+        pxHist->ulBuckets[i] -= pxOld->ulBuckets[i];
+        if (pxHist->ulBuckets[i]) uTop = i + 1;
+    }
+    pxHist->ulCount -= pxOld->ulCount;
+    pxHist->ullSumUs -= pxOld->ullSumUs;
+    if (!uTop) {
+        pxHist->ulMaxUs = 0;
+    } else {
+        uint32_t ulHigh = lat_hist_bucket_high(uTop - 1);
+        if (ulHigh < pxHist->ulMaxUs) pxHist->ulMaxUs = ulHigh;
+    }
+}
+
+uint32_t lat_hist_percentile(const lat_hist_t *pxHist, unsigned uPermille) {
+    if (!pxHist->ulCount) return 0;
+    // The rank of the sample wanted, rounded up
+    uint64_t ullRank = ((uint64_t)pxHist->ulCount * uPermille + 999) / 1000;
+    if (!ullRank) ullRank = 1;
+    uint64_t ullSeen = 0;
+    for (unsigned i = 0; i < LAT_HIST_BUCKETS; ++i) {
+        ullSeen += pxHist->ulBuckets[i];
+        if (ullSeen >= ullRank) {
+            uint32_t ulHigh = lat_hist_bucket_high(i);
+            return ulHigh < pxHist->ulMaxUs ? ulHigh : pxHist->ulMaxUs;
+        }
+    }
+    return pxHist->ulMaxUs;
+}
+
+uint32_t lat_hist_mean(const lat_hist_t *pxHist) {
+    return pxHist->ulCount ? pxHist->ullSumUs / pxHist->ulCount : 0;
+}
+
+/* [] END OF FILE */
@@ -183,7 +183,7 @@ void assert_case_is(const char *file, int line, const char *func, int v,
 
 void dump8buf(char *buf, size_t buf_sz, uint8_t *pbytes, size_t nbytes) {
     int n = 0;
-    for (size_t byte_ix = 0; byte_ix < nbytes; ++byte_ix) {
+    for (size_t byte_ix = 0; byte_ix < nbytes;) {
         for (size_t col = 0; col < 32 && byte_ix < nbytes; ++col, ++byte_ix) {
             n += snprintf(buf + n, buf_sz - n, "%02hhx ", pbytes[byte_ix]);
             configASSERT(0 < n && n < (int)buf_sz);
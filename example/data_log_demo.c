@@ -16,6 +16,7 @@ specific language governing permissions and limitations under the License.
 //
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 //
 #include "hardware/adc.h"
@@ -27,7 +28,9 @@ specific language governing permissions and limitations under the License.
 #include "task.h"
 //
 //#include "sd_card.h"
+#include "ff_logfile.h"
 #include "ff_utils.h"
+#include "ff_writeback.h"
 
 #define DEVICENAME "sd0"
 #define MOUNTPOINT "/sd0"
@@ -35,24 +38,45 @@ specific language governing permissions and limitations under the License.
 #define TRACE_PRINTF(fmt, args...)
 //#define TRACE_PRINTF printf
 
+// An hour of records (one per second), allocated when each file is created
+#define LOG_PREALLOCATE (3600 * 32)
+
 extern bool die_now;
 
 static TaskHandle_t th;
+static char last_filename[64];
 
 static bool print_header(FF_FILE *pxFile) {
     configASSERT(pxFile);
     ff_fseek(pxFile, 0, FF_SEEK_END);
     if (0 == ff_ftell(pxFile)) {
         // Print header
-        if (ff_fprintf(pxFile, "Date,Time,Temperature (°C)\n") < 0) {
-            FAIL("ff_fprintf");
+        if (ff_log_printf(pxFile, "Date,Time,Temperature (°C)\n") < 0) {
+            FAIL("ff_log_printf");
+            return false;
+        }
+        /* Appending a record then needs no FAT updates until the file is
+        done with. */
+        if (-1 == ff_fallocate(pxFile, LOG_PREALLOCATE)) {
+            FAIL("ff_fallocate");
             return false;
         }
     }
     return true;
 }
 
-static FF_FILE *open_file() {
+// Also gives back the space preallocated for the file
+static bool close_file(FF_FILE *pxFile) {
+    if (-1 == ff_log_close(pxFile)) {
+        FF_FAIL("ff_log_close", last_filename);
+        return false;
+    }
+    return true;
+}
+
+/* Get the file for the current hour. The file is kept open from one record
+to the next, and closed when the hour changes. */
+static FF_FILE *open_file(FF_FILE *pxFile) {
     const time_t timer = FreeRTOS_time(NULL);
     struct tm tmbuf;
     localtime_r(&timer, &tmbuf);
@@ -64,20 +88,30 @@ static FF_FILE *open_file() {
                         MOUNTPOINT, tmbuf.tm_year + 1900, tmbuf.tm_mon + 1,
                         tmbuf.tm_mday);
     configASSERT(0 < n && n < (int)sizeof filename);
+    size_t nw = strftime(filename + n, sizeof filename - n, "/%H.csv", &tmbuf);
+    configASSERT(nw);
+    if (pxFile) {
+        if (!strcmp(filename, last_filename)) return pxFile;
+        if (!close_file(pxFile)) return NULL;
+    }
+    // Only once an hour: mkdirhier() looks up every directory in the path
+    filename[n] = 0;
     if (-1 == mkdirhier(filename) &&
         stdioGET_ERRNO() != pdFREERTOS_ERRNO_EEXIST) {
         FF_FAIL("mkdirhier", filename);
         return NULL;
     }
-    size_t nw = strftime(filename + n, sizeof filename - n, "/%H.csv", &tmbuf);
-    configASSERT(nw);
-    FF_FILE *pxFile = ff_fopen(filename, "a");
+    filename[n] = '/';
+    strcpy(last_filename, filename);
+    pxFile = ff_log_open(filename);
     if (!pxFile) {
-        FF_FAIL("ff_fopen", filename);
+        FF_FAIL("ff_log_open", filename);
         return NULL;
     }
-    if (!print_header(pxFile))
+    if (!print_header(pxFile)) {
+        close_file(pxFile);
         return NULL;
+    }
     return pxFile;
 }
 
@@ -98,11 +132,12 @@ static void DemoTask(void *arg) {
      vTaskDelayUntil(). */
     TickType_t xLastWakeTime = xTaskGetTickCount();
 
-    while (!die_now) {
-        /* It's very inefficient to open and close the file for every record,
-        but you're less likely to lose data that way. */
-
-        FF_FILE *pxFile = open_file();
+    FF_FILE *pxFile = NULL;
+    while (!die_now && !ff_power_failing()) {
+        /* Rather than open and close the file for every record, keep it open
+        as a log file: each record goes straight to the card, but the
+        directory entry is only updated now and then. */
+        pxFile = open_file(pxFile);
         if (!pxFile) break;
 
         // Form date-time string
@@ -129,12 +164,8 @@ static void DemoTask(void *arg) {
         int nw = snprintf(buf + n, sizeof buf - n, "%.3g\n", (double)Tc);
         configASSERT(0 < nw && nw < (int)sizeof buf);
 
-        if (ff_fprintf(pxFile, "%s", buf) < 0) {
-            FAIL("ff_fprintf");
-            break;
-        }
-        if (-1 == ff_fclose(pxFile)) {
-            FAIL("ff_fclose");
+        if (ff_log_write(buf, n + nw, pxFile) < n + nw) {
+            FAIL("ff_log_write");
             break;
         }
 
@@ -156,6 +187,8 @@ static void DemoTask(void *arg) {
         if (!xWasDelayed)
             task_printf("%s is behind schedule\n", pcTaskGetName(NULL));
     }
+    if (pxFile) close_file(pxFile);
+    last_filename[0] = 0;
 quit:
     printf("%s ending\n", pcTaskGetName(NULL));
     th = NULL;
@@ -21,7 +21,12 @@ specific language governing permissions and limitations under the License.
 #include "pico/multicore.h" // get_core_num()
 //
 #include "crash.h"
+#include "ff_headers.h"
+#include "ff_writeback.h"
 #include "stdio_cli.h"
+#if USB_MSC
+#include "msc_disk.h"
+#endif
 
 static void prvLaunchRTOS() {
 }
@@ -29,9 +34,16 @@ static void prvLaunchRTOS() {
 int main() {
 
     crash_handler_init();
+#if USB_MSC
+    msc_disk_init();
+#endif
     stdio_init_all();
     FreeRTOS_time_init();
     CLI_Start();
+    // Only needed to flush a write-back cache, or to keep the second FAT
+#if ffconfigCACHE_WRITE_THROUGH == 0 || ffconfigFAT_MIRROR
+    ff_writeback_start();
+#endif
 
     printf("Core %d: Launching FreeRTOS scheduler\n", get_core_num());
     /* Start the tasks and timer running. */
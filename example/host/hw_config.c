@@ -0,0 +1,103 @@
+/* hw_config.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+/*
+
+Hardware configuration for the host build. Each socket is on its own emulated
+SPI; main.c puts cards in them. The GPIO numbers only have to be distinct.
+
+*/
+
+#include <string.h>
+//
+#include "hw_config.h"
+
+// Hardware Configuration of SPI "objects"
+static spi_t spis[] = {  // One for each SPI.
+    {
+        .hw_inst = spi0,  // SPI component
+        .miso_gpio = 4,   // GPIO number (not pin number)
+        .mosi_gpio = 3,
+        .sck_gpio = 2,
+        .baud_rate = 12500 * 1000,  // As example/hw_config.c
+
+        // Following attributes are dynamically assigned
+        .initialized = false,  // initialized flag
+        .owner = 0,            // Owning task, assigned dynamically
+        .mutex = 0             // Guard semaphore, assigned dynamically
+    },
+    {
+        .hw_inst = spi1,  // SPI component
+        .miso_gpio = 12,  // GPIO number (not pin number)
+        .mosi_gpio = 15,
+        .sck_gpio = 14,
+        .baud_rate = 12500 * 1000,
+
+        // Following attributes are dynamically assigned
+        .initialized = false,  // initialized flag
+        .owner = 0,            // Owning task, assigned dynamically
+        .mutex = 0             // Guard semaphore, assigned dynamically
+    }};
+
+// Hardware Configuration of the SD Card "objects"
+static sd_card_t sd_cards[] = {  // One for each SD card
+    {.pcName = "sd0",            // Name used to mount device
+     .spi = &spis[0],            // Pointer to the SPI driving this card
+     .ss_gpio = 5,               // The SPI slave select GPIO for this SD card
+     .use_card_detect = false,
+     // Following attributes are dynamically assigned
+     .m_Status = STA_NOINIT,
+     .sectors = 0,
+     .card_type = 0,
+     .mutex = 0,
+     .ff_disk_count = 0,
+     .ff_disks = NULL},
+    {.pcName = "sd1",            // Name used to mount device
+     .spi = &spis[1],            // Pointer to the SPI driving this card
+     .ss_gpio = 9,               // The SPI slave select GPIO for this SD card
+     .use_card_detect = false,
+     // Following attributes are dynamically assigned
+     .m_Status = STA_NOINIT,
+     .sectors = 0,
+     .card_type = 0,
+     .mutex = 0,
+     .ff_disk_count = 0,
+     .ff_disks = NULL}
+    };
+
+/* ********************************************************************** */
+size_t sd_get_num() { return count_of(sd_cards); }
+sd_card_t *sd_get_by_num(size_t num) {
+    if (num < sd_get_num()) {
+        return &sd_cards[num];
+    } else {
+        return NULL;
+    }
+}
+sd_card_t *sd_get_by_name(const char *const name) {
+    size_t i;
+    for (i = 0; i < sd_get_num(); ++i) {
+        if (0 == strcmp(sd_cards[i].pcName, name)) return &sd_cards[i];
+    }
+    DBG_PRINTF("%s: unknown name %s\n", __func__, name);
+    return NULL;
+}
+size_t spi_get_num() { return count_of(spis); }
+spi_t *spi_get_by_num(size_t num) {
+    if (num < spi_get_num()) {
+        return &spis[num];
+    } else {
+        return NULL;
+    }
+}
+/* [] END OF FILE */
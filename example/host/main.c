@@ -0,0 +1,201 @@
+/* main.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* The example, on the host, with emulated SD cards.
+
+Usage: example_host [-m MB] [-i image]... [command]...
+
+Each -i puts a card backed by the image file in the next socket in hw_config.c;
+-m sets the size of images created after it (default 128 MB). Each command is a
+CLI command line, run in turn. With no commands, command lines are read from
+stdin. The cards' timing and faults come from the environment (see
+sd_emulator.h). For example:
+
+    example_host -i sd0.img "format sd0" "mount sd0" "big_file_test /sd0/bf 0x1000000 1"
+*/
+
+#define _GNU_SOURCE /* fopencookie() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+//
+#include "FreeRTOS.h"
+#include "task.h"
+#include "FreeRTOS_time.h"
+//
+#include "File-related-CLI-commands.h"
+#include "FreeRTOS_CLI.h"
+#include "ff_headers.h"
+#include "ff_writeback.h"
+#include "filesystem_test_suite.h"
+#include "hw_config.h"
+#include "sd_emulator.h"
+#include "stdio_cli.h"
+
+bool die_now;
+
+static char **ppcCommands;
+static int iCommands;
+
+/* The real stdout. stdout itself is replaced by prvConsoleWrite(), so that
+what a command prints goes to its sink, as at the Pico's console. */
+static FILE *pxConsole;
+
+static ssize_t prvConsoleWrite(void *pvCookie, const char *pcData,
+                               size_t xLength) {
+    (void)pvCookie;
+    if (!FreeRTOS_CLICaptureWrite(pcData, xLength))
+        fwrite(pcData, 1, xLength, pxConsole);
+    return xLength;
+}
+
+static BaseType_t prvStdoutWrite(CLI_Output_Sink_t *pxSink, const char *pcData,
+                                 size_t xLength) {
+    (void)pxSink;
+    return fwrite(pcData, 1, xLength, pxConsole) == xLength ? pdPASS : pdFAIL;
+}
+
+/* setrtc, as in CLI-commands.c, which is the Pico's: the purge tests age
+files with it. */
+static BaseType_t prvSetRTCCommand(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                   const char *pcCommandString) {
+    int day, month, year, hour, min, sec;
+    if (sscanf(pcCommandString, "setrtc %d %d %d %d %d %d", &day, &month,
+               &year, &hour, &min, &sec) != 6) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                 "Usage: setrtc <DD> <MM> <YY> <hh> <mm> <ss>\n");
+        return pdFALSE;
+    }
+    datetime_t t = {.year = year + 2000,
+                    .month = month,
+                    .day = day,
+                    .hour = hour,
+                    .min = min,
+                    .sec = sec};
+    setrtc(&t);
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xSetRTC = {
+    "setrtc", /* The command string to type. */
+    "\nsetrtc <DD> <MM> <YY> <hh> <mm> <ss>:\n Set the clock files are stamped "
+    "with\n",
+    prvSetRTCCommand, /* The function to run. */
+    6                 /* Six parameters are expected. */
+};
+
+// Returns false if the command failed, by run's rules
+static bool prvRunCommand(char *pcInput) {
+    static CLI_Output_Sink_t xStdout = {prvStdoutWrite, NULL};
+
+    printf("> %s\n", pcInput);
+    TickType_t xStart = xTaskGetTickCount();
+    BaseType_t xResult = xFileSystemCLIRunCommand(pcInput, &xStdout);
+    printf("Time: %lu ms\n",
+           (unsigned long)(xTaskGetTickCount() - xStart) * portTICK_PERIOD_MS);
+    fflush(stdout);
+    return pdPASS == xResult;
+}
+
+/* The exit status is a failure if any command failed, so that ctest sees it
+even without a PASS_REGULAR_EXPRESSION. */
+static void prvHostTask(void *arg) {
+    (void)arg;
+    unsigned uRun = 0, uFailed = 0;
+    if (iCommands) {
+        for (int i = 0; i < iCommands; ++i) {
+            ++uRun;
+            if (!prvRunCommand(ppcCommands[i])) ++uFailed;
+        }
+    } else {
+        char cInputString[cmdMAX_INPUT_SIZE];
+        while (fgets(cInputString, sizeof cInputString, stdin)) {
+            cInputString[strcspn(cInputString, "\r\n")] = 0;
+            if (!cInputString[0]) continue;
+            ++uRun;
+            if (!prvRunCommand(cInputString)) ++uFailed;
+        }
+    }
+    sd_emu_print_stats();
+    printf("Commands: %u, failed: %u\n", uRun, uFailed);
+    fflush(pxConsole);
+    exit(uFailed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[]) {
+    sd_emu_timing_t xTiming;
+    sd_emu_faults_t xFaults;
+    uint32_t ulMB = 128;
+    size_t xCards = 0;
+    int opt;
+
+    pxConsole = stdout;
+    stdout = fopencookie(NULL, "w",
+                         (cookie_io_functions_t){.write = prvConsoleWrite});
+    setvbuf(stdout, NULL, _IONBF, 0);
+    setvbuf(pxConsole, NULL, _IOLBF, 0);
+
+    sd_emu_default_timing(&xTiming);
+    sd_emu_default_faults(&xFaults);
+    sd_emu_set_faults(&xFaults);
+    while ((opt = getopt(argc, argv, "m:i:")) != -1) {
+        switch (opt) {
+            case 'm':
+                ulMB = strtoul(optarg, NULL, 0);
+                break;
+            case 'i': {
+                sd_card_t *pSD = sd_get_by_num(xCards);
+                if (!pSD) {
+                    fprintf(stderr, "Only %zu sockets\n", sd_get_num());
+                    return EXIT_FAILURE;
+                }
+                if (!sd_emu_attach(pSD->spi->hw_inst, pSD->ss_gpio, optarg,
+                                   ulMB, &xTiming)) {
+                    perror(optarg);
+                    return EXIT_FAILURE;
+                }
+                ++xCards;
+                break;
+            }
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-m MB] [-i image]... [command]...\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    ppcCommands = &argv[optind];
+    iCommands = argc - optind;
+
+    FreeRTOS_time_init();
+    register_fs_tests();
+    vRegisterFileSystemCLICommands();
+    extern const CLI_Command_Definition_t xSDStress;
+    FreeRTOS_CLIRegisterCommand(&xSDStress);
+    FreeRTOS_CLIRegisterCommand(&xSetRTC);
+#if ffconfigCACHE_WRITE_THROUGH == 0 || ffconfigFAT_MIRROR
+    ff_writeback_start();
+#endif
+
+    static StackType_t xStack[16 * configMINIMAL_STACK_SIZE];
+    static StaticTask_t xTaskBuffer;
+    xTaskCreateStatic(prvHostTask, "Host", count_of(xStack), NULL,
+                      configMAX_PRIORITIES - 3, xStack, &xTaskBuffer);
+
+    /* Start the tasks and timer running. */
+    vTaskStartScheduler();
+    /* should never reach here */
+    return EXIT_FAILURE;
+}
+/* [] END OF FILE */
@@ -0,0 +1,317 @@
+/* sd_stress.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Stress the driver's error recovery with an emulated card.
+
+A random mix of single and multiple block reads and writes, in the manner of
+test_diskio(), runs twice over the same region: once with no faults, for a
+baseline, and once with the faults that have been set (SD_EMU_FAULT_* in the
+environment), or a default mix if none have. Every read is checked against
+what was last written successfully.
+
+For each run it reports throughput, the operations that failed even after the
+driver's retries, latency, the operations that stalled (took more than four
+times the baseline's 99th percentile), and the recovery time: from the start
+of a failed operation to the end of the next one that succeeded. It ends with
+"sd_stress: PASS" or "sd_stress: FAIL", the faults injected, the operations
+that failed and were recovered from, and the blocks that were wrong when read
+back afterwards without faults. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "FreeRTOS_CLI.h"
+#include "task.h"
+//
+#include "hardware/timer.h"
+//
+#include "hw_config.h"
+#include "sd_emulator.h"
+
+#define PRINTF task_printf
+
+#define MAX_BLOCKS 64
+#define UNKNOWN UINT32_MAX  // A write to the block failed: it could be anything
+
+typedef struct {
+    uint32_t ulOps, ulFailed, ulBadData, ulStalls, ulRecoveries;
+    uint64_t ullBytes, ullUs, ullStallUs, ullRecoveryUs;
+    uint32_t ulMaxRecoveryUs;
+    uint32_t *pulLatencyUs;  // Of each operation
+} stress_run_t;
+
+static uint32_t lfsr;
+
+static uint32_t prvRandom(void) {
+    // xorshift32
+    lfsr ^= lfsr << 13;
+    lfsr ^= lfsr >> 17;
+    lfsr ^= lfsr << 5;
+    return lfsr;
+}
+
+static void prvFill(uint32_t *pulBuf, uint32_t ulBlock, uint32_t ulGen) {
+    for (size_t i = 0; i < 512 / sizeof(uint32_t); ++i)
+        pulBuf[i] = ulBlock * 0x9E3779B9 ^ ulGen << 16 ^ i;
+}
+
+static int prvCompareU32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t prvPercentile(uint32_t *pulSorted, uint32_t ulCount,
+                              unsigned uPercent) {
+    if (!ulCount) return 0;
+    return pulSorted[(uint64_t)(ulCount - 1) * uPercent / 100];
+}
+
+static void prvRun(sd_card_t *pSD, uint32_t *pulGen, uint32_t ulBlocks,
+                   uint32_t ulOps, uint32_t ulStallUs, uint32_t *pulBuf,
+                   stress_run_t *pxRun) {
+    static uint32_t ulNextGen = 1;
+    uint64_t ullFailedAt = 0;  // Start of the first failure since a success
+
+    uint64_t ullStart = time_us_64();
+    for (uint32_t op = 0; op < ulOps; ++op) {
+        uint32_t n = prvRandom() % 2 ? 1 : 2 + prvRandom() % (MAX_BLOCKS - 1);
+        uint32_t ulBlock = prvRandom() % (ulBlocks - n + 1);
+        bool bWrite = prvRandom() % 2;
+        uint32_t ulGen = ulNextGen++;
+        int status;
+
+        if (bWrite)
+            for (uint32_t i = 0; i < n; ++i)
+                prvFill(pulBuf + i * 128, ulBlock + i, ulGen);
+        uint64_t ullOpStart = time_us_64();
+        if (bWrite)
+            status = sd_write_blocks(pSD, (uint8_t *)pulBuf, ulBlock, n);
+        else
+            status = sd_read_blocks(pSD, (uint8_t *)pulBuf, ulBlock, n);
+        uint64_t ullOpEnd = time_us_64();
+        uint32_t ulUs = ullOpEnd - ullOpStart;
+
+        pxRun->pulLatencyUs[pxRun->ulOps++] = ulUs;
+        if (ulStallUs && ulUs > ulStallUs) {
+            ++pxRun->ulStalls;
+            pxRun->ullStallUs += ulUs;
+        }
+        if (SD_BLOCK_DEVICE_ERROR_NONE != status) {
+            ++pxRun->ulFailed;
+            if (!ullFailedAt) ullFailedAt = ullOpStart;
+            if (bWrite)
+                for (uint32_t i = 0; i < n; ++i) pulGen[ulBlock + i] = UNKNOWN;
+            continue;
+        }
+        if (ullFailedAt) {
+            uint32_t ulRecoveryUs = ullOpEnd - ullFailedAt;
+            ++pxRun->ulRecoveries;
+            pxRun->ullRecoveryUs += ulRecoveryUs;
+            if (ulRecoveryUs > pxRun->ulMaxRecoveryUs)
+                pxRun->ulMaxRecoveryUs = ulRecoveryUs;
+            ullFailedAt = 0;
+        }
+        pxRun->ullBytes += n * 512;
+        for (uint32_t i = 0; i < n; ++i) {
+            if (bWrite) {
+                pulGen[ulBlock + i] = ulGen;
+            } else if (UNKNOWN != pulGen[ulBlock + i]) {
+                uint32_t expect[128];
+                prvFill(expect, ulBlock + i, pulGen[ulBlock + i]);
+                if (memcmp(expect, pulBuf + i * 128, sizeof expect)) {
+                    PRINTF("Block %" PRIu32 ": data mismatch\n", ulBlock + i);
+                    ++pxRun->ulBadData;
+                }
+            }
+        }
+    }
+    pxRun->ullUs = time_us_64() - ullStart;
+}
+
+/* With no faults, read the region back: the card should answer every read,
+and hold what was last written to each block. Returns the blocks that it
+didn't. */
+static uint32_t prvVerify(sd_card_t *pSD, const uint32_t *pulGen,
+                          uint32_t ulBlocks, uint32_t *pulBuf) {
+    uint32_t ulBad = 0;
+    for (uint32_t ulBlock = 0; ulBlock < ulBlocks; ulBlock += MAX_BLOCKS) {
+        if (sd_read_blocks(pSD, (uint8_t *)pulBuf, ulBlock, MAX_BLOCKS)) {
+            PRINTF("Blocks %" PRIu32 "+%d: read failed\n", ulBlock,
+                   MAX_BLOCKS);
+            ulBad += MAX_BLOCKS;
+            continue;
+        }
+        for (uint32_t i = 0; i < MAX_BLOCKS; ++i) {
+            if (UNKNOWN == pulGen[ulBlock + i]) continue;
+            uint32_t expect[128];
+            prvFill(expect, ulBlock + i, pulGen[ulBlock + i]);
+            if (memcmp(expect, pulBuf + i * 128, sizeof expect)) ++ulBad;
+        }
+    }
+    return ulBad;
+}
+
+static uint64_t prvKiBps(const stress_run_t *pxRun) {
+    return pxRun->ullUs ? pxRun->ullBytes * 1000000 / 1024 / pxRun->ullUs : 0;
+}
+
+static void prvReport(const char *pcName, stress_run_t *pxRun) {
+    qsort(pxRun->pulLatencyUs, pxRun->ulOps, sizeof(uint32_t), prvCompareU32);
+    PRINTF("%s: %" PRIu32 " ops, %" PRIu64 " KiB/s, %" PRIu32
+           " failed, %" PRIu32 " bad data\n",
+           pcName, pxRun->ulOps, prvKiBps(pxRun), pxRun->ulFailed,
+           pxRun->ulBadData);
+    PRINTF("\tlatency us: p50 %" PRIu32 ", p99 %" PRIu32 ", max %" PRIu32 "\n",
+           prvPercentile(pxRun->pulLatencyUs, pxRun->ulOps, 50),
+           prvPercentile(pxRun->pulLatencyUs, pxRun->ulOps, 99),
+           prvPercentile(pxRun->pulLatencyUs, pxRun->ulOps, 100));
+    PRINTF("\tstalls: %" PRIu32 ", %" PRIu64 " ms in all\n", pxRun->ulStalls,
+           pxRun->ullStallUs / 1000);
+    PRINTF("\trecovery ms: %" PRIu32 " recoveries, mean %" PRIu64
+           ", max %" PRIu32 "\n",
+           pxRun->ulRecoveries,
+           pxRun->ulRecoveries
+               ? pxRun->ullRecoveryUs / pxRun->ulRecoveries / 1000
+               : 0,
+           pxRun->ulMaxRecoveryUs / 1000);
+}
+
+static void sd_stress(const char *pcName, uint32_t ulMB, uint32_t ulOps) {
+    sd_card_t *pSD = sd_get_by_name(pcName);
+    if (!pSD) return;
+    if (0 != sd_init_card(pSD)) {
+        PRINTF("%s: card not initialized\n", pcName);
+        return;
+    }
+    uint32_t ulBlocks = ulMB * 2048;
+    if (!ulOps || ulBlocks < MAX_BLOCKS || ulBlocks > pSD->sectors) {
+        PRINTF("Bad size or count\n");
+        return;
+    }
+    uint32_t *pulGen = pvPortMalloc(ulBlocks * sizeof(uint32_t));
+    uint32_t *pulBuf = pvPortMalloc(MAX_BLOCKS * 512);
+    stress_run_t xBase = {0}, xFaulty = {0};
+    sd_emu_faults_t xFaults, xNone = {0};
+    xBase.pulLatencyUs = pvPortMalloc(ulOps * sizeof(uint32_t));
+    xFaulty.pulLatencyUs = pvPortMalloc(ulOps * sizeof(uint32_t));
+    if (!pulGen || !pulBuf || !xBase.pulLatencyUs || !xFaulty.pulLatencyUs) {
+        PRINTF("%s: out of memory\n", __FUNCTION__);
+        goto out;
+    }
+    sd_emu_get_faults(&xFaults);
+    if (!xFaults.ulCmdCrcPpm && !xFaults.ulNoResponsePpm &&
+        !xFaults.ulMissedTokenPpm && !xFaults.ulReadCrcPpm &&
+        !xFaults.ulLongBusyPpm && !xFaults.ulPartialWritePpm) {
+        // None set: one operation in a hundred or so hits something
+        xFaults.ulCmdCrcPpm = xFaults.ulNoResponsePpm = 1000;
+        xFaults.ulMissedTokenPpm = xFaults.ulReadCrcPpm = 200;
+        xFaults.ulLongBusyPpm = xFaults.ulPartialWritePpm = 200;
+        if (!xFaults.ulLongBusyUs) xFaults.ulLongBusyUs = 200000;
+    }
+    PRINTF("Faults (ppm): command CRC %" PRIu32 ", no response %" PRIu32
+           ", missed token %" PRIu32 ", read CRC %" PRIu32
+           ", long busy %" PRIu32 " (%" PRIu32 " ms), partial write %" PRIu32
+           "\n",
+           xFaults.ulCmdCrcPpm, xFaults.ulNoResponsePpm,
+           xFaults.ulMissedTokenPpm, xFaults.ulReadCrcPpm,
+           xFaults.ulLongBusyPpm, xFaults.ulLongBusyUs / 1000,
+           xFaults.ulPartialWritePpm);
+
+    // Lay down known data
+    sd_emu_set_faults(&xNone);
+    for (uint32_t ulBlock = 0; ulBlock < ulBlocks; ulBlock += MAX_BLOCKS) {
+        for (uint32_t i = 0; i < MAX_BLOCKS; ++i) {
+            prvFill(pulBuf + i * 128, ulBlock + i, 0);
+            pulGen[ulBlock + i] = 0;
+        }
+        if (sd_write_blocks(pSD, (uint8_t *)pulBuf, ulBlock, MAX_BLOCKS)) {
+            PRINTF("%s: write failed with no faults\n", __FUNCTION__);
+            goto out;
+        }
+    }
+    lfsr = 1;
+    prvRun(pSD, pulGen, ulBlocks, ulOps, 0, pulBuf, &xBase);
+    prvReport("baseline", &xBase);
+
+    uint32_t ulStallUs = 4 * prvPercentile(xBase.pulLatencyUs, xBase.ulOps, 99);
+    lfsr = 1;
+    uint64_t ullInjected = sd_emu_faults_injected();
+    sd_emu_set_faults(&xFaults);
+    prvRun(pSD, pulGen, ulBlocks, ulOps, ulStallUs, pulBuf, &xFaulty);
+    sd_emu_set_faults(&xNone);
+    ullInjected = sd_emu_faults_injected() - ullInjected;
+    prvReport("faults", &xFaulty);
+    if (prvKiBps(&xBase))
+        PRINTF("Throughput with faults: %" PRIu64 "%% of baseline\n",
+               prvKiBps(&xFaulty) * 100 / prvKiBps(&xBase));
+
+    /* It passes if the baseline was clean, faults were injected but none got
+    as far as the data, and afterwards, with the faults off, the card reads
+    back what was written. */
+    uint32_t ulBadAfter = prvVerify(pSD, pulGen, ulBlocks, pulBuf);
+    bool bPass = !xBase.ulFailed && !xBase.ulBadData && ullInjected &&
+                 !xFaulty.ulBadData && !ulBadAfter;
+    PRINTF("sd_stress: %s: %" PRIu64 " faults injected, %" PRIu32
+           " operations failed, %" PRIu32 " recovered from, %" PRIu32
+           " bad blocks after\n",
+           bPass ? "PASS" : "FAIL", ullInjected, xFaulty.ulFailed,
+           xFaulty.ulRecoveries, ulBadAfter);
+
+out:
+    vPortFree(xFaulty.pulLatencyUs);
+    vPortFree(xBase.pulLatencyUs);
+    vPortFree(pulBuf);
+    vPortFree(pulGen);
+}
+
+/*-----------------------------------------------------------*/
+static BaseType_t sd_stress_cmd(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    const char *pcParameter;
+    BaseType_t xParameterStringLength;
+    char name[16];
+
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1,
+                                           &xParameterStringLength);
+    configASSERT(pcParameter);
+    snprintf(name, sizeof name, "%.*s", (int)xParameterStringLength,
+             pcParameter);
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2,
+                                           &xParameterStringLength);
+    configASSERT(pcParameter);
+    uint32_t ulMB = strtoul(pcParameter, NULL, 0);
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 3,
+                                           &xParameterStringLength);
+    configASSERT(pcParameter);
+    uint32_t ulOps = strtoul(pcParameter, NULL, 0);
+
+    sd_stress(name, ulMB, ulOps);
+
+    return pdFALSE;
+}
+const CLI_Command_Definition_t xSDStress = {
+    "sd_stress", /* The command string to type. */
+    "\nsd_stress <device name> <MB> <operations>:\n"
+    " !DESTRUCTIVE! Random I/O over the first <MB> of the card, without and\n"
+    " with the emulator's faults, comparing throughput and recovery\n"
+    "\te.g.: \"sd_stress sd0 8 2000\"\n",
+    sd_stress_cmd, /* The function to run. */
+    3              /* Three parameters are expected. */
+};
+/*-----------------------------------------------------------*/
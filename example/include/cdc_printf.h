@@ -0,0 +1,51 @@
+/* cdc_printf.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* The console on USB CDC.
+
+Output is buffered: it goes out in chunks of at least a USB packet, as soon as
+a line ends, or CDC_OUT_FLUSH_MS after the last write. Each call's output is
+kept together, even with several tasks writing. */
+
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Start the writer task, and put the buffer in place of stdio_usb as the
+stdio driver, so that printf() output takes the same path. Until then, output
+goes straight to USB. */
+void cdc_out_init();
+
+int printf_usb_cdc(const char *format, ...)
+    __attribute__((format(__printf__, 1, 2)));
+int vprintf_usb_cdc(const char *format, va_list va);
+// Raw output: len bytes, as they are
+void write_usb_cdc(const char *buf, size_t len);
+// A vfctprintf() output function; with a NULL arg, it sends c on its own
+void out_char_usb(char c, void *arg);
+
+int getchar_usb_cdc(void);
+// Up to len bytes of input, as they are: returns how many, 0 if there are none
+size_t read_usb_cdc(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,32 @@
+/* msc_disk.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* An SD card exported to the USB host as a mass storage device, beside the
+CDC console. Built with USB_MSC=1; see the "msc" command in msc_disk.c. */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Start TinyUSB, and the tasks that serve it. Call before stdio_init_all(),
+whose USB console then runs on this device. */
+void msc_disk_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
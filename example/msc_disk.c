@@ -0,0 +1,441 @@
+/* msc_disk.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* An SD card exported to the USB host as a mass storage device (TinyUSB MSC).
+
+"msc <device name>" hands the card to the host: the FreeRTOS+FAT volume is
+unmounted first, as by "eject", and mounted again afterwards, so neither side
+ever sees the other's cached view of the FAT. "msc <device name> ro" instead
+leaves the volume mounted, after writing out the cache, and both sides get the
+card read-only: the host's media is write-protected. Either way, ff_sddisk.c
+refuses FreeRTOS+FAT's writes (sd_card_t.write_protect) for the duration.
+"msc off", or the host ejecting the media, ends the export.
+
+TinyUSB passes READ(10) and WRITE(10) on a CFG_TUD_MSC_EP_BUFSIZE piece at a
+time, from usbTask. Each piece is one multi-block command to the card, and a
+second buffer lets the card work while USB does: after each read, mscTask
+reads the next piece ahead, and each write is copied and left to mscTask
+while the host sends the next. A write that fails is reported with the next
+command (or at SYNCHRONIZE CACHE, TEST UNIT READY, or the end of the export). */
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+//
+#include "tusb.h"
+//
+#include "FreeRTOS_CLI.h"
+#include "ff_headers.h"
+#include "ff_sddisk.h"
+#include "ff_utils.h"
+#include "hw_config.h"
+#include "msc_disk.h"
+#include "sd_card.h"
+
+#define MSC_BLOCK_SIZE 512
+#define MSC_PIECE_BLOCKS (CFG_TUD_MSC_EP_BUFSIZE / MSC_BLOCK_SIZE)
+
+// Not in TinyUSB's SCSI command list
+#define MSC_SCSI_SYNCHRONIZE_CACHE_10 0x35
+
+// mscTask's notification bits
+#define MSC_JOB 1u      // Do job
+#define MSC_RELEASE 2u  // The host has ejected the media: end the export
+
+typedef enum { MSC_OFF, MSC_READ_WRITE, MSC_READ_ONLY } msc_mode_t;
+typedef enum { JOB_NONE, JOB_READ, JOB_WRITE } msc_op_t;
+
+static struct {
+    SemaphoreHandle_t mutex;  // Held by the callbacks, and to change the export
+    sd_card_t *pSD;           // Exported, or NULL
+    msc_mode_t mode;
+    bool was_mounted;  // Before the export; so it is mounted again after
+    bool changed;      // Report a media change at the next TEST UNIT READY
+    bool ejected;      // By the host; mscTask is ending the export
+    uint32_t pieces, read_ahead_hits, writes;
+} msc;
+
+/* The second buffer: a piece read ahead, or being written. Whoever starts a
+job waits for it before touching the buffer or the card again. */
+static struct {
+    msc_op_t op;
+    sd_card_t *pSD;
+    uint32_t lba, count;
+    int status;
+    bool busy;
+    TaskHandle_t worker;
+    SemaphoreHandle_t done;
+    uint8_t buf[CFG_TUD_MSC_EP_BUFSIZE];
+} job;
+
+static void prvStartJob(msc_op_t op, uint32_t lba, uint32_t count) {
+    job.op = op;
+    job.pSD = msc.pSD;
+    job.lba = lba;
+    job.count = count;
+    job.busy = true;
+    xTaskNotify(job.worker, MSC_JOB, eSetBits);
+}
+
+static void prvWaitJob(void) {
+    if (!job.busy) return;
+    xSemaphoreTake(job.done, portMAX_DELAY);
+    job.busy = false;
+}
+
+/* Wait for the job, and say whether it was a write that failed (which is then
+forgotten: it is reported once). */
+static bool prvWriteFailed(void) {
+    prvWaitJob();
+    if (JOB_WRITE != job.op || SD_BLOCK_DEVICE_ERROR_NONE == job.status)
+        return false;
+    job.op = JOB_NONE;
+    return true;
+}
+
+// End the export. Call with msc.mutex held.
+static void prvUnexport(void) {
+    if (!msc.pSD) return;
+    sd_card_t *pSD = msc.pSD;
+    if (prvWriteFailed())
+        printf("%s: The host's last write failed\n", pSD->pcName);
+    job.op = JOB_NONE;
+    msc.pSD = NULL;
+    msc.ejected = false;
+    pSD->write_protect = false;
+    if (MSC_READ_WRITE == msc.mode && msc.was_mounted) {
+        char path[2 + strlen(pSD->pcName)];
+        snprintf(path, sizeof path, "/%s", pSD->pcName);
+        FF_Disk_t *pxDisk = NULL;
+        if (!mount(&pxDisk, pSD->pcName, path))
+            printf("%s: Mount failed!\n", pSD->pcName);
+    }
+    msc.mode = MSC_OFF;
+    printf("%s: Returned from the USB host\n", pSD->pcName);
+}
+
+static bool prvExport(sd_card_t *pSD, msc_mode_t mode) {
+    FF_Disk_t *pxDisk = pSD->ff_disk_count ? pSD->ff_disks[0] : NULL;
+    bool mounted = pxDisk && pxDisk->xStatus.bIsMounted;
+
+    if (MSC_READ_WRITE == mode && mounted) {
+        char path[2 + strlen(pSD->pcName)];
+        snprintf(path, sizeof path, "/%s", pSD->pcName);
+        eject(pSD->pcName, path);  // Writes out and frees the caches
+    }
+    if (0 != sd_init_card(pSD)) {
+        printf("%s: Couldn't initialize the card\n", pSD->pcName);
+        return false;
+    }
+    if (MSC_READ_WRITE == mode || !mounted) {
+        pSD->write_protect = true;  // Should it be mounted meanwhile
+    } else {
+        /* Nothing can be modified between writing out the cache, bringing
+        the FAT copies up to date (which clears the boot sector's dirty flag)
+        and this */
+        FF_PendSemaphore(pxDisk->pxIOManager->pvSemaphore);
+        FF_Error_t xError = FF_FlushCache(pxDisk->pxIOManager);
+        if (!FF_isERR(xError)) xError = FF_SDDiskMirrorFATs(pxDisk, 0);
+        pSD->write_protect = true;
+        FF_ReleaseSemaphore(pxDisk->pxIOManager->pvSemaphore);
+        if (FF_isERR(xError)) {
+            pSD->write_protect = false;
+            printf("%s: Writing out: %s\n", pSD->pcName,
+                   FF_GetErrMessage(xError));
+            return false;
+        }
+    }
+    xSemaphoreTake(msc.mutex, portMAX_DELAY);
+    msc.pSD = pSD;
+    msc.mode = mode;
+    msc.was_mounted = mounted;
+    msc.changed = true;
+    msc.pieces = msc.read_ahead_hits = msc.writes = 0;
+    job.op = JOB_NONE;
+    xSemaphoreGive(msc.mutex);
+    return true;
+}
+
+/* The card, if the host may use it now. Otherwise, sets the sense data to
+say why. */
+static sd_card_t *prvReady(uint8_t lun) {
+    if (!msc.pSD || msc.ejected) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);  // No media
+        return NULL;
+    }
+    return msc.pSD;
+}
+
+/*-----------------------------------------------------------*/
+// TinyUSB MSC callbacks. They run in usbTask.
+
+void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
+                        uint8_t product_id[16], uint8_t product_rev[4]) {
+    (void)lun;
+    memset(vendor_id, ' ', 8);
+    memset(product_id, ' ', 16);
+    memset(product_rev, ' ', 4);
+    memcpy(vendor_id, "Pico", 4);
+    memcpy(product_id, "SD card", 7);
+    memcpy(product_rev, "1.0", 3);
+}
+
+bool tud_msc_test_unit_ready_cb(uint8_t lun) {
+    xSemaphoreTake(msc.mutex, portMAX_DELAY);
+    bool ready = prvReady(lun);
+    if (ready && msc.changed) {
+        msc.changed = false;
+        tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0x00);
+        ready = false;
+    } else if (ready && prvWriteFailed()) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+        ready = false;
+    }
+    xSemaphoreGive(msc.mutex);
+    return ready;
+}
+
+void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count,
+                         uint16_t *block_size) {
+    (void)lun;
+    xSemaphoreTake(msc.mutex, portMAX_DELAY);
+    *block_count = msc.pSD ? msc.pSD->sectors : 0;
+    *block_size = MSC_BLOCK_SIZE;
+    xSemaphoreGive(msc.mutex);
+}
+
+bool tud_msc_is_writable_cb(uint8_t lun) {
+    (void)lun;
+    return MSC_READ_WRITE == msc.mode;
+}
+
+bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start,
+                           bool load_eject) {
+    (void)lun;
+    (void)power_condition;
+    if (load_eject && !start) {
+        xSemaphoreTake(msc.mutex, portMAX_DELAY);
+        if (msc.pSD && !msc.ejected) {
+            msc.ejected = true;
+            xTaskNotify(job.worker, MSC_RELEASE, eSetBits);
+        }
+        xSemaphoreGive(msc.mutex);
+    }
+    return true;
+}
+
+int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
+                          void *buffer, uint32_t bufsize) {
+    uint32_t block = lba + offset / MSC_BLOCK_SIZE;
+    uint32_t count = bufsize / MSC_BLOCK_SIZE;
+    int32_t rc = bufsize;
+
+    xSemaphoreTake(msc.mutex, portMAX_DELAY);
+    sd_card_t *pSD = prvReady(lun);
+    if (!pSD) {
+        rc = -1;
+    } else {
+        prvWaitJob();
+        ++msc.pieces;
+        if (JOB_READ == job.op && block == job.lba && count <= job.count &&
+            SD_BLOCK_DEVICE_ERROR_NONE == job.status) {
+            memcpy(buffer, job.buf, bufsize);
+            ++msc.read_ahead_hits;
+        } else if (SD_BLOCK_DEVICE_ERROR_NONE !=
+                   sd_read_blocks(pSD, buffer, block, count)) {
+            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
+            rc = -1;
+        }
+        // Read the next piece ahead, on the chance that the host wants it
+        uint32_t next = block + count;
+        if (rc > 0 && next < pSD->sectors)
+            prvStartJob(JOB_READ, next,
+                        pSD->sectors - next < MSC_PIECE_BLOCKS
+                            ? pSD->sectors - next
+                            : MSC_PIECE_BLOCKS);
+        else
+            job.op = JOB_NONE;
+    }
+    xSemaphoreGive(msc.mutex);
+    return rc;
+}
+
+int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
+                           uint8_t *buffer, uint32_t bufsize) {
+    int32_t rc = bufsize;
+
+    xSemaphoreTake(msc.mutex, portMAX_DELAY);
+    if (!prvReady(lun)) {
+        rc = -1;
+    } else if (MSC_READ_WRITE != msc.mode) {
+        tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+        rc = -1;
+    } else if (prvWriteFailed()) {
+        tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+        rc = -1;
+    } else {
+        memcpy(job.buf, buffer, bufsize);
+        prvStartJob(JOB_WRITE, lba + offset / MSC_BLOCK_SIZE,
+                    bufsize / MSC_BLOCK_SIZE);
+        ++msc.pieces;
+        ++msc.writes;
+    }
+    xSemaphoreGive(msc.mutex);
+    return rc;
+}
+
+int32_t tud_msc_scsi_cb(uint8_t lun, const uint8_t scsi_cmd[16], void *buffer,
+                        uint16_t bufsize) {
+    (void)buffer;
+    (void)bufsize;
+    int32_t rc = 0;
+
+    switch (scsi_cmd[0]) {
+        case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+            break;  // It can always be removed; the host should eject first
+        case MSC_SCSI_SYNCHRONIZE_CACHE_10:
+            xSemaphoreTake(msc.mutex, portMAX_DELAY);
+            if (prvWriteFailed()) {
+                tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);
+                rc = -1;
+            }
+            xSemaphoreGive(msc.mutex);
+            break;
+        default:
+            tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x20, 0x00);
+            rc = -1;
+    }
+    return rc;
+}
+
+/*-----------------------------------------------------------*/
+static void mscTask(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        if (bits & MSC_JOB) {
+            if (JOB_READ == job.op)
+                job.status = sd_read_blocks(job.pSD, job.buf, job.lba, job.count);
+            else
+                job.status = sd_write_blocks(job.pSD, job.buf, job.lba, job.count);
+            xSemaphoreGive(job.done);
+        }
+        if (bits & MSC_RELEASE) {
+            xSemaphoreTake(msc.mutex, portMAX_DELAY);
+            if (msc.ejected) prvUnexport();
+            xSemaphoreGive(msc.mutex);
+        }
+    }
+}
+
+static void usbTask(void *arg) {
+    (void)arg;
+    for (;;) tud_task();  // Waits for events
+}
+
+void msc_disk_init(void) {
+    static StackType_t xUsbStack[1024], xMscStack[512];
+    static StaticTask_t xUsbTaskBuffer, xMscTaskBuffer;
+
+    msc.mutex = xSemaphoreCreateMutex();
+    job.done = xSemaphoreCreateBinary();
+    configASSERT(msc.mutex && job.done);
+    tusb_init();
+    job.worker = xTaskCreateStatic(
+        mscTask, "MSC Task", count_of(xMscStack), NULL,
+        configMAX_PRIORITIES - 2, xMscStack, &xMscTaskBuffer);
+    TaskHandle_t th = xTaskCreateStatic(
+        usbTask, "USB Task", count_of(xUsbStack), NULL,
+        configMAX_PRIORITIES - 2, xUsbStack, &xUsbTaskBuffer);
+    configASSERT(job.worker && th);
+}
+
+/*-----------------------------------------------------------*/
+static BaseType_t msc_cmd(char *pcWriteBuffer, size_t xWriteBufferLen,
+                          const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    const char *pcParameter;
+    BaseType_t xParameterStringLength;
+    char name[32];
+    msc_mode_t mode = MSC_READ_WRITE;
+
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1,
+                                           &xParameterStringLength);
+    if (!pcParameter) {
+        xSemaphoreTake(msc.mutex, portMAX_DELAY);
+        if (msc.pSD)
+            printf("%s exported %s: %lu pieces, %lu read ahead, %lu written\n",
+                   msc.pSD->pcName,
+                   MSC_READ_ONLY == msc.mode ? "read-only" : "read/write",
+                   (unsigned long)msc.pieces,
+                   (unsigned long)msc.read_ahead_hits,
+                   (unsigned long)msc.writes);
+        else
+            printf("Nothing exported\n");
+        xSemaphoreGive(msc.mutex);
+        return pdFALSE;
+    }
+    snprintf(name, sizeof name, "%.*s", (int)xParameterStringLength,
+             pcParameter);
+    if (0 == strcmp(name, "off")) {
+        xSemaphoreTake(msc.mutex, portMAX_DELAY);
+        if (msc.pSD)
+            prvUnexport();
+        else
+            printf("Nothing exported\n");
+        xSemaphoreGive(msc.mutex);
+        return pdFALSE;
+    }
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2,
+                                           &xParameterStringLength);
+    if (pcParameter) {
+        if (2 != xParameterStringLength || 0 != strncmp(pcParameter, "ro", 2)) {
+            printf("Unknown mode: %.*s\n", (int)xParameterStringLength,
+                   pcParameter);
+            return pdFALSE;
+        }
+        mode = MSC_READ_ONLY;
+    }
+    sd_card_t *pSD = sd_get_by_name(name);
+    if (!pSD) {
+        printf("Unknown device name %s\n", name);
+        return pdFALSE;
+    }
+    if (msc.pSD) {
+        printf("%s is already exported\n", msc.pSD->pcName);
+        return pdFALSE;
+    }
+    if (prvExport(pSD, mode))
+        printf("%s: Exported %s\n", name,
+               MSC_READ_ONLY == mode ? "read-only" : "read/write");
+    return pdFALSE;
+}
+const CLI_Command_Definition_t xMscDisk = {
+    "msc", /* The command string to type. */
+    "\nmsc [<device name> [ro] | off]:\n"
+    " Export <device name> to the USB host as a mass storage device, unmounted\n"
+    " here until \"msc off\" or the host ejects it. With \"ro\", it stays\n"
+    " mounted, and neither side can write it. With no parameters, show the\n"
+    " export\n"
+    "\te.g.: \"msc sd0\"\n",
+    msc_cmd, /* The function to run. */
+    -1       /* Zero to two parameters. */
+};
+
+/* [] END OF FILE */
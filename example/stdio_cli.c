@@ -18,6 +18,8 @@ specific language governing permissions and limitations under the License.
 // FreeRTOS
 #include "FreeRTOS.h"
 //
+#include "semphr.h"
+#include "stream_buffer.h"
 #include "task.h"
 // Pico
 #include "pico/stdlib.h"
@@ -53,23 +55,176 @@ static void flush_dummy()
 //#define STDIO_CLI_FLUSH stdio_flush
 
 
+/* USB CDC output goes through xCdcOut: the printf_usb_cdc family formats into
+it a packet at a time, and cdcWriterTask drains it to USB in chunks. */
+#ifndef CDC_OUT_BUFFER_SIZE
+#define CDC_OUT_BUFFER_SIZE 2048
+#endif
+#define CDC_OUT_PACKET 64  // A full-speed bulk packet
+#ifndef CDC_OUT_FLUSH_MS
+#define CDC_OUT_FLUSH_MS 10
+#endif
+
+static StreamBufferHandle_t xCdcOut;
+// A stream buffer can only have one writer at a time
+static SemaphoreHandle_t xCdcOutMutex;
+
+typedef struct {
+    size_t n;
+    char buf[CDC_OUT_PACKET];
+} cdc_out_chunk_t;
+
+// Blocks while the buffer is full
+static void cdc_out_send(const char *buf, size_t len) {
+    if (!xCdcOut) {
+        stdio_usb.out_chars(buf, len);
+        return;
+    }
+    while (len) {
+        size_t n = xStreamBufferSend(xCdcOut, buf, len, portMAX_DELAY);
+        buf += n;
+        len -= n;
+    }
+}
+
+static void cdc_out_lock() {
+    if (xCdcOutMutex) xSemaphoreTake(xCdcOutMutex, portMAX_DELAY);
+}
+static void cdc_out_unlock() {
+    if (xCdcOutMutex) xSemaphoreGive(xCdcOutMutex);
+}
+
 void out_char_usb(char c, void *arg) {
-  stdio_usb.out_chars(&c, 1);
+    cdc_out_chunk_t *pxChunk = arg;
+    if (!pxChunk) {
+        cdc_out_lock();
+        cdc_out_send(&c, 1);
+        cdc_out_unlock();
+        return;
+    }
+    pxChunk->buf[pxChunk->n++] = c;
+    if (sizeof pxChunk->buf == pxChunk->n) {
+        cdc_out_send(pxChunk->buf, pxChunk->n);
+        pxChunk->n = 0;
+    }
+}
+
+int vprintf_usb_cdc(const char *format, va_list va) {
+    cdc_out_chunk_t xChunk = {0};
+    cdc_out_lock();
+    int ret = vfctprintf(out_char_usb, &xChunk, format, va);
+    cdc_out_send(xChunk.buf, xChunk.n);
+    cdc_out_unlock();
+    return ret;
 }
 
 int printf_usb_cdc(const char *format, ...) {
-  va_list va;
-  va_start(va, format);
-  int ret = vfctprintf(out_char_usb, NULL, format, va);
-  va_end(va);
-  return ret;
+    va_list va;
+    va_start(va, format);
+    int ret = vprintf_usb_cdc(format, va);
+    va_end(va);
+    return ret;
+}
+
+void write_usb_cdc(const char *buf, size_t len) {
+    cdc_out_lock();
+    cdc_out_send(buf, len);
+    cdc_out_unlock();
+}
+
+/* The console's stdio driver, in place of stdio_usb, so that printf() output
+queues up in xCdcOut behind the prompt, echo and command output written
+before it, rather than overtaking them. While a command runs, what its task
+prints goes to the command's sink instead (see FreeRTOS_CLICaptureWrite()).
+Input is still stdio_usb's. */
+static void stdio_cdc_out_chars(const char *buf, int len) {
+    if (!FreeRTOS_CLICaptureWrite(buf, len)) write_usb_cdc(buf, len);
+}
+static int stdio_cdc_in_chars(char *buf, int len) {
+    return stdio_usb.in_chars(buf, len);
+}
+#if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
+static void stdio_cdc_set_chars_available_callback(void (*fn)(void *),
+                                                   void *param) {
+    stdio_usb.set_chars_available_callback(fn, param);
+}
+#endif
+static stdio_driver_t stdio_cdc = {
+    .out_chars = stdio_cdc_out_chars,
+    .in_chars = stdio_cdc_in_chars,
+#if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
+    .set_chars_available_callback = stdio_cdc_set_chars_available_callback,
+#endif
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    .crlf_enabled = PICO_STDIO_USB_DEFAULT_CRLF
+#endif
+};
+
+static void cdcWriterTask(void *arg) {
+    (void)arg;
+    static char buf[4 * CDC_OUT_PACKET];
+    for (;;) {
+        size_t n = xStreamBufferReceive(xCdcOut, buf, sizeof buf, portMAX_DELAY);
+        bool line = memchr(buf, '\n', n);
+        // Make up a packet, unless a line has ended or it's gone quiet
+        while (n < sizeof buf) {
+            TickType_t xWait = line || n >= CDC_OUT_PACKET
+                                   ? 0
+                                   : pdMS_TO_TICKS(CDC_OUT_FLUSH_MS);
+            size_t m = xStreamBufferReceive(xCdcOut, buf + n, sizeof buf - n,
+                                            xWait);
+            if (!m) break;
+            if (memchr(buf + n, '\n', m)) line = true;
+            n += m;
+        }
+        stdio_usb.out_chars(buf, n);
+    }
+}
 
+void cdc_out_init() {
+    static uint8_t ucStorage[CDC_OUT_BUFFER_SIZE + 1];
+    static StaticStreamBuffer_t xStreamBuffer;
+    static StaticSemaphore_t xMutexBuffer;
+    static StackType_t xStack[256];
+    static StaticTask_t xTaskBuffer;
+
+    if (xCdcOut) return;
+    xCdcOutMutex = xSemaphoreCreateMutexStatic(&xMutexBuffer);
+    xCdcOut = xStreamBufferCreateStatic(CDC_OUT_BUFFER_SIZE, 1, ucStorage,
+                                        &xStreamBuffer);
+    TaskHandle_t th = xTaskCreateStatic(
+        cdcWriterTask, "CDC Writer", sizeof xStack / sizeof xStack[0], 0,
+        configMAX_PRIORITIES - 3, /* Priority at which the task is created. */
+        xStack, &xTaskBuffer);
+    configASSERT(th);
+    stdio_set_driver_enabled(&stdio_usb, false);
+    stdio_set_driver_enabled(&stdio_cdc, true);
 }
 
-int getchar_usb_cdc(void){
-char c;
-stdio_usb.in_chars(&c, 1);
-return c;
+int getchar_usb_cdc(void) {
+    char c;
+    if (stdio_usb.in_chars(&c, 1) > 0) return (unsigned char)c;
+    return PICO_ERROR_TIMEOUT;
+}
+
+size_t read_usb_cdc(char *buf, size_t len) {
+    int n = stdio_usb.in_chars(buf, len);
+    return n > 0 ? n : 0;
+}
+
+/* The SDK's stdio drivers call back, from an interrupt, when input arrives,
+and the CLI task sleeps until then. Without the callback for USB, it has to
+poll. */
+#if PICO_STDIO_USB_SUPPORT_CHARS_AVAILABLE_CALLBACK
+#define CLI_INPUT_WAIT portMAX_DELAY
+#else
+#define CLI_INPUT_WAIT pdMS_TO_TICKS(1)
+#endif
+
+static void chars_available(void *param) {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR((TaskHandle_t)param, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 
@@ -79,15 +234,72 @@ return c;
 #define STDIO_CLI_GETCHAR getchar_usb_cdc
 #define STDIO_CLI_FLUSH flush_dummy
 
+// Command output goes straight into the CDC output buffer
+static BaseType_t console_write(CLI_Output_Sink_t *pxSink, const char *pcData,
+                                size_t xLength) {
+    (void)pxSink;
+    write_usb_cdc(pcData, xLength);
+    return pdPASS;
+}
+
+/* sz and rz (see ff_xfer.h) talk over the console. They run in stdioTask, so
+they can wait for input as it does. */
+static bool xfer_send(void *context, const void *data, size_t len) {
+    (void)context;
+    write_usb_cdc(data, len);
+    return true;
+}
+static size_t xfer_receive(void *context, void *buf, size_t len,
+                           TickType_t timeout) {
+    (void)context;
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        size_t n = read_usb_cdc(buf, len);
+        if (n) return n;
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) return 0;
+        ulTaskNotifyTake(pdTRUE, timeout - elapsed < CLI_INPUT_WAIT
+                                     ? timeout - elapsed
+                                     : CLI_INPUT_WAIT);
+    }
+}
+static const FF_XferLink_t xfer_link = {xfer_send, xfer_receive, NULL};
+
+
+/* Tab completion of the command name. With a single match, the name is
+finished off; otherwise it is extended as far as the matches agree and, if
+that adds nothing, the candidates are listed. */
+static size_t complete(char *input, size_t index, size_t size) {
+    if (memchr(input, ' ', index)) return index;  // Past the command name
+    char completion[cmdMAX_INPUT_SIZE];
+    UBaseType_t matches = FreeRTOS_CLICompleteCommand(
+        input, index, completion, sizeof completion);
+    size_t len = strlen(completion);
+    if (1 == matches && len + 1 < sizeof completion)
+        completion[len++] = ' ', completion[len] = '\0';
+    if (index + len >= size) return index;
+    if (len) {
+        memcpy(input + index, completion, len + 1);
+        STDIO_CLI_PRINTF("%s", completion);
+    } else if (matches > 1) {
+        STDIO_CLI_PRINTF("\n");
+        for (UBaseType_t i = 0; i < matches; ++i)
+            STDIO_CLI_PRINTF("%s  ", FreeRTOS_CLIGetCompletion(input, index, i));
+        STDIO_CLI_PRINTF("\nFreeRTOS+CLI> %s", input);
+    } else {
+        STDIO_CLI_PRINTF("\a");
+    }
+    STDIO_CLI_FLUSH();
+    return index + len;
+}
 
 // stdioTask - the function which handles input
 static void stdioTask(void *arg) {
     (void)arg;
     vTaskDelay(1000);
     size_t cInputIndex = 0;
-    static char cOutputString[cmdMAX_OUTPUT_SIZE] = {0};
     static char cInputString[cmdMAX_INPUT_SIZE] = {0};
-    BaseType_t xMoreDataToFollow = 0;
+    static CLI_Output_Sink_t xConsole = {console_write, NULL};
     bool in_overflow = false;
 
     STDIO_CLI_PRINTF("\033[2J\033[H");  // Clear Screen
@@ -112,15 +324,22 @@ static void stdioTask(void *arg) {
     STDIO_CLI_FLUSH();
 
     for (;;) {
-        int cRxedChar = STDIO_CLI_GETCHAR();//getchar_timeout_us(0);
-        /* Get the character from terminal */
+        /* Get the character from terminal. Pasted input is all taken
+         before waiting again. */
+        int cRxedChar = STDIO_CLI_GETCHAR();
         if (PICO_ERROR_TIMEOUT == cRxedChar) {
-            vTaskDelay(pdMS_TO_TICKS(1));
+            ulTaskNotifyTake(pdTRUE, CLI_INPUT_WAIT);
             continue;
         }
         if (!isprint(cRxedChar) && !isspace(cRxedChar) && '\r' != cRxedChar &&
             '\b' != cRxedChar && cRxedChar != (char)127)
             continue;
+        if ('\t' == cRxedChar) {
+            if (!in_overflow)
+                cInputIndex = complete(cInputString, cInputIndex,
+                                       sizeof cInputString);
+            continue;
+        }
         STDIO_CLI_PRINTF("%c", cRxedChar);  // echo
         STDIO_CLI_FLUSH();
 
@@ -147,20 +366,9 @@ static void stdioTask(void *arg) {
                 strlcpy(cInputString, tmp, cmdMAX_INPUT_SIZE);
             }
             /* Process the input string received prior to the
-             newline. */
-            do {
-                /* Pass the string to FreeRTOS+CLI. */
-                cOutputString[0] = 0x00;
-                xMoreDataToFollow = FreeRTOS_CLIProcessCommand(
-                    cInputString, cOutputString, cmdMAX_OUTPUT_SIZE);
-
-                /* Send the output generated by the command's
-                 implementation. */
-                STDIO_CLI_PRINTF("%s", cOutputString);
-
-                /* Until the command does not generate any more output.
-                 */
-            } while (xMoreDataToFollow);
+             newline, with the output streamed to the console (or to a
+             file, with "> <filename>"). */
+            xFileSystemCLIProcessCommand(cInputString, &xConsole);
 
             if (xStart) {
                 STDIO_CLI_PRINTF("Time: %lu s\n",
@@ -210,13 +418,19 @@ static void stdioTask(void *arg) {
 
 /* Start UART operation. */
 void CLI_Start() {
+    cdc_out_init();
     vRegisterCLICommands();
     vRegisterMyCLICommands();
     register_fs_tests();
     vRegisterFileSystemCLICommands();
+    vRegisterFileTransferCLICommands(&xfer_link);
 
     extern const CLI_Command_Definition_t xDataLogDemo;
     FreeRTOS_CLIRegisterCommand(&xDataLogDemo);
+#if USB_MSC
+    extern const CLI_Command_Definition_t xMscDisk;
+    FreeRTOS_CLIRegisterCommand(&xMscDisk);
+#endif
 
     static StackType_t xStack[1024];
     static StaticTask_t xTaskBuffer;
@@ -225,6 +439,7 @@ void CLI_Start() {
         configMAX_PRIORITIES - 3, /* Priority at which the task is created. */
         xStack, &xTaskBuffer);
     configASSERT(th);
+    stdio_set_chars_available_callback(chars_available, th);
 }
 
 /* [] END OF FILE */
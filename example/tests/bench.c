@@ -0,0 +1,296 @@
+/* bench.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Storage benchmarks, through the ff_stdio API.
+
+In a directory on a mounted volume, bench runs:
+  seq_write, seq_read    A BENCH_FILE_SIZE file, at each of several chunk sizes
+  rand_read, rand_write  BENCH_RANDOM_OPS aligned 512 B and 4 KiB transfers
+  mixed                  4 KiB transfers, 70% reads and 30% writes
+  create, open, delete   BENCH_FILES small files (open: see ff_dir_index.h)
+  lookup, miss           ff_stat() of each of them, and of as many names that
+                         aren't there (see ff_dir_index.h and
+                         ffconfigHASH_CACHE)
+Each operation is timed with the microsecond timer into a latency histogram
+(lat_hist.h). The random sequences are seeded, so runs are comparable between
+cards and firmware versions.
+
+Results come as a table, CSV or JSON, one row per benchmark. */
+
+#include <stdio.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "FreeRTOS_CLI.h"
+#include "ff_stdio.h"
+#include "ff_utils.h"
+#include "hardware/timer.h"
+//
+#include "lat_hist.h"
+
+#ifndef BENCH_FILE_SIZE
+#define BENCH_FILE_SIZE (4 * 1024 * 1024)
+#endif
+#ifndef BENCH_RANDOM_OPS
+#define BENCH_RANDOM_OPS 500
+#endif
+#ifndef BENCH_FILES
+#define BENCH_FILES 100
+#endif
+#define BENCH_MAX_CHUNK (16 * 1024)
+
+#define errno stdioGET_ERRNO()
+
+typedef enum { BENCH_TABLE, BENCH_CSV, BENCH_JSON } bench_format_t;
+
+typedef struct {
+    bench_format_t eFormat;
+    unsigned uRows;
+    char pcPath[ffconfigMAX_FILENAME];  // The test file
+    uint8_t *pucBuf;
+    uint32_t ulLfsr;
+} bench_t;
+
+static uint32_t prvNext(bench_t *pxB) {
+    // xorshift32
+    pxB->ulLfsr ^= pxB->ulLfsr << 13;
+    pxB->ulLfsr ^= pxB->ulLfsr >> 17;
+    pxB->ulLfsr ^= pxB->ulLfsr << 5;
+    return pxB->ulLfsr;
+}
+
+static void prvReport(bench_t *pxB, const char *pcName, uint32_t ulSize,
+                      uint64_t ullBytes, uint64_t ullUs,
+                      const lat_hist_t *pxHist) {
+    uint32_t ulKiBps = ullUs ? ullBytes * 1000000 / 1024 / ullUs : 0;
+    uint32_t ulIOPS = ullUs ? (uint64_t)pxHist->ulCount * 1000000 / ullUs : 0;
+    uint32_t ulMean = lat_hist_mean(pxHist);
+    uint32_t ulP50 = lat_hist_percentile(pxHist, 500);
+    uint32_t ulP90 = lat_hist_percentile(pxHist, 900);
+    uint32_t ulP99 = lat_hist_percentile(pxHist, 990);
+
+    switch (pxB->eFormat) {
+        case BENCH_CSV:
+            if (!pxB->uRows)
+                printf("test,size,ops,bytes,us,kib_s,iops,mean_us,p50_us,"
+                       "p90_us,p99_us,max_us\n");
+            printf("%s,%lu,%lu,%llu,%llu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                   pcName, (unsigned long)ulSize,
+                   (unsigned long)pxHist->ulCount, (unsigned long long)ullBytes,
+                   (unsigned long long)ullUs, (unsigned long)ulKiBps,
+                   (unsigned long)ulIOPS, (unsigned long)ulMean,
+                   (unsigned long)ulP50, (unsigned long)ulP90,
+                   (unsigned long)ulP99, (unsigned long)pxHist->ulMaxUs);
+            break;
+        case BENCH_JSON:
+            printf("%s\n  {\"test\": \"%s\", \"size\": %lu, \"ops\": %lu, "
+                   "\"bytes\": %llu, \"us\": %llu, \"kib_s\": %lu, "
+                   "\"iops\": %lu, \"latency_us\": {\"mean\": %lu, "
+                   "\"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu}}",
+                   pxB->uRows ? "," : "{\"bench\": [", pcName,
+                   (unsigned long)ulSize, (unsigned long)pxHist->ulCount,
+                   (unsigned long long)ullBytes, (unsigned long long)ullUs,
+                   (unsigned long)ulKiBps, (unsigned long)ulIOPS,
+                   (unsigned long)ulMean, (unsigned long)ulP50,
+                   (unsigned long)ulP90, (unsigned long)ulP99,
+                   (unsigned long)pxHist->ulMaxUs);
+            break;
+        default:
+            if (!pxB->uRows)
+                printf("%-10s %6s %6s %8s %6s %8s %8s %8s %8s %8s\n", "test",
+                       "size", "ops", "KiB/s", "IOPS", "mean us", "p50 us",
+                       "p90 us", "p99 us", "max us");
+            printf("%-10s %6lu %6lu %8lu %6lu %8lu %8lu %8lu %8lu %8lu\n",
+                   pcName, (unsigned long)ulSize,
+                   (unsigned long)pxHist->ulCount, (unsigned long)ulKiBps,
+                   (unsigned long)ulIOPS, (unsigned long)ulMean,
+                   (unsigned long)ulP50, (unsigned long)ulP90,
+                   (unsigned long)ulP99, (unsigned long)pxHist->ulMaxUs);
+            break;
+    }
+    ++pxB->uRows;
+}
+
+static bool prvFail(const char *pcWhat, const char *pcPath) {
+    printf("%s(%s): %s (%d)\n", pcWhat, pcPath, strerror(errno), errno);
+    return false;
+}
+
+static bool prvSequential(bench_t *pxB, bool bWrite, size_t xChunk) {
+    lat_hist_t xHist;
+    lat_hist_reset(&xHist);
+
+    for (size_t i = 0; i < xChunk; ++i) pxB->pucBuf[i] = i;
+    uint64_t ullStart = time_us_64();
+    FF_FILE *pxFile = ff_fopen(pxB->pcPath, bWrite ? "w" : "r");
+    if (!pxFile) return prvFail("ff_fopen", pxB->pcPath);
+    for (size_t xDone = 0; xDone < BENCH_FILE_SIZE; xDone += xChunk) {
+        uint64_t ullOpStart = time_us_64();
+        size_t n = bWrite ? ff_fwrite(pxB->pucBuf, xChunk, 1, pxFile)
+                          : ff_fread(pxB->pucBuf, xChunk, 1, pxFile);
+        lat_hist_add(&xHist, time_us_64() - ullOpStart);
+        if (1 != n) {
+            prvFail(bWrite ? "ff_fwrite" : "ff_fread", pxB->pcPath);
+            ff_fclose(pxFile);
+            return false;
+        }
+    }
+    if (-1 == ff_fclose(pxFile)) return prvFail("ff_fclose", pxB->pcPath);
+    prvReport(pxB, bWrite ? "seq_write" : "seq_read", xChunk, BENCH_FILE_SIZE,
+              time_us_64() - ullStart, &xHist);
+    return true;
+}
+
+/* BENCH_RANDOM_OPS transfers of xSize at aligned offsets in the test file;
+uWritePct of them writes */
+static bool prvRandomIO(bench_t *pxB, const char *pcName, size_t xSize,
+                        unsigned uWritePct) {
+    lat_hist_t xHist;
+    lat_hist_reset(&xHist);
+    pxB->ulLfsr = 1;
+
+    uint64_t ullStart = time_us_64();
+    FF_FILE *pxFile = ff_fopen(pxB->pcPath, uWritePct ? "r+" : "r");
+    if (!pxFile) return prvFail("ff_fopen", pxB->pcPath);
+    for (unsigned i = 0; i < BENCH_RANDOM_OPS; ++i) {
+        long lOffset = prvNext(pxB) % (BENCH_FILE_SIZE / xSize) * xSize;
+        bool bWrite = prvNext(pxB) % 100 < uWritePct;
+        uint64_t ullOpStart = time_us_64();
+        size_t n = 0;
+        if (0 == ff_fseek(pxFile, lOffset, FF_SEEK_SET))
+            n = bWrite ? ff_fwrite(pxB->pucBuf, xSize, 1, pxFile)
+                       : ff_fread(pxB->pucBuf, xSize, 1, pxFile);
+        lat_hist_add(&xHist, time_us_64() - ullOpStart);
+        if (1 != n) {
+            prvFail(bWrite ? "ff_fwrite" : "ff_fread", pxB->pcPath);
+            ff_fclose(pxFile);
+            return false;
+        }
+    }
+    if (-1 == ff_fclose(pxFile)) return prvFail("ff_fclose", pxB->pcPath);
+    prvReport(pxB, pcName, xSize, (uint64_t)BENCH_RANDOM_OPS * xSize,
+              time_us_64() - ullStart, &xHist);
+    return true;
+}
+
+static bool prvMetadata(bench_t *pxB, const char *pcDir) {
+    static const char *const pcNames[] = {"create", "open", "lookup", "miss",
+                                          "delete"};
+    char pcFile[ffconfigMAX_FILENAME];
+    FF_Stat_t xStat;
+
+    for (unsigned uPhase = 0; uPhase < 5; ++uPhase) {
+        lat_hist_t xHist;
+        lat_hist_reset(&xHist);
+        uint64_t ullStart = time_us_64();
+        for (unsigned i = 0; i < BENCH_FILES; ++i) {
+            snprintf(pcFile, sizeof pcFile, "%s/%c%04u.dat", pcDir,
+                     3 == uPhase ? 'g' : 'f', i);
+            uint64_t ullOpStart = time_us_64();
+            bool bOK;
+            if (4 == uPhase) {
+                bOK = 0 == ff_remove(pcFile);
+            } else if (3 == uPhase) {
+                bOK = -1 == ff_stat(pcFile, &xStat);
+            } else if (2 == uPhase) {
+                bOK = 0 == ff_stat(pcFile, &xStat);
+            } else {
+                FF_FILE *pxFile = ff_fopen(pcFile, uPhase ? "r" : "w");
+                bOK = pxFile && 0 == ff_fclose(pxFile);
+            }
+            lat_hist_add(&xHist, time_us_64() - ullOpStart);
+            if (!bOK) return prvFail(pcNames[uPhase], pcFile);
+        }
+        prvReport(pxB, pcNames[uPhase], 0, 0, time_us_64() - ullStart, &xHist);
+    }
+    return true;
+}
+
+static void bench(const char *pcDir, bench_format_t eFormat) {
+    static const size_t xChunks[] = {512, 4096, BENCH_MAX_CHUNK};
+    static bench_t xB;  // Big, and there is only one CLI
+
+    memset(&xB, 0, sizeof xB);
+    xB.eFormat = eFormat;
+    snprintf(xB.pcPath, sizeof xB.pcPath, "%s", pcDir);
+    if (-1 == mkdirhier(xB.pcPath)) {
+        prvFail("mkdirhier", pcDir);
+        return;
+    }
+    snprintf(xB.pcPath, sizeof xB.pcPath, "%s/bench.dat", pcDir);
+    xB.pucBuf = pvPortMalloc(BENCH_MAX_CHUNK);
+    if (!xB.pucBuf) {
+        printf("%s: Couldn't allocate %d bytes\n", __FUNCTION__,
+               BENCH_MAX_CHUNK);
+        return;
+    }
+    bool bOK = true;
+    for (size_t i = 0; bOK && i < sizeof xChunks / sizeof xChunks[0]; ++i)
+        bOK = prvSequential(&xB, true, xChunks[i]) &&
+              prvSequential(&xB, false, xChunks[i]);
+    bOK = bOK && prvRandomIO(&xB, "rand_read", 512, 0) &&
+          prvRandomIO(&xB, "rand_read", 4096, 0) &&
+          prvRandomIO(&xB, "rand_write", 512, 100) &&
+          prvRandomIO(&xB, "rand_write", 4096, 100) &&
+          prvRandomIO(&xB, "mixed", 4096, 30) && prvMetadata(&xB, pcDir);
+    if (BENCH_JSON == eFormat && xB.uRows) printf("\n]}\n");
+    ff_remove(xB.pcPath);
+    vPortFree(xB.pucBuf);
+}
+
+/*-----------------------------------------------------------*/
+static BaseType_t bench_cmd(char *pcWriteBuffer, size_t xWriteBufferLen,
+                            const char *pcCommandString) {
+    const char *pcParameter;
+    BaseType_t xParameterStringLength;
+    char pcDir[ffconfigMAX_FILENAME];
+    bench_format_t eFormat = BENCH_TABLE;
+
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1,
+                                           &xParameterStringLength);
+    if (!pcParameter) {
+        snprintf(pcWriteBuffer, xWriteBufferLen,
+                 "Usage: bench <directory> [csv|json]\n");
+        return pdFALSE;
+    }
+    snprintf(pcDir, sizeof pcDir, "%.*s", (int)xParameterStringLength,
+             pcParameter);
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2,
+                                           &xParameterStringLength);
+    if (pcParameter) {
+        if (3 == xParameterStringLength &&
+            0 == strncmp(pcParameter, "csv", 3))
+            eFormat = BENCH_CSV;
+        else if (4 == xParameterStringLength &&
+                 0 == strncmp(pcParameter, "json", 4))
+            eFormat = BENCH_JSON;
+        else {
+            snprintf(pcWriteBuffer, xWriteBufferLen,
+                     "Usage: bench <directory> [csv|json]\n");
+            return pdFALSE;
+        }
+    }
+    bench(pcDir, eFormat);
+
+    return pdFALSE;
+}
+const CLI_Command_Definition_t xBench = {
+    "bench", /* The command string to type. */
+    "\nbench <directory> [csv|json]:\n"
+    " Sequential, random, mixed and metadata benchmarks in <directory>\n"
+    "\te.g.: \"bench /sd0/bench csv\"\n",
+    bench_cmd, /* The function to run. */
+    -1         /* One or two parameters. */
+};
+/*-----------------------------------------------------------*/
@@ -16,6 +16,9 @@ specific language governing permissions and limitations under the License.
 
 #include "ff_headers.h"
 #include "ff_stdio.h"
+#include "ff_direct_io.h"
+#include "ff_utils.h"
+#include "hardware/timer.h"
 
 #define FF_MAX_SS 512
 #define BUFFSZ 8 * 1024
@@ -23,8 +26,8 @@ specific language governing permissions and limitations under the License.
 #undef assert
 #define assert configASSERT
 #define fopen ff_fopen
-#define fwrite ff_fwrite
-#define fread ff_fread
+#define fwrite ff_fwrite_direct
+#define fread ff_fread_direct
 #define fclose ff_fclose
 #define errno stdioGET_ERRNO()
 #define free vPortFree
@@ -68,7 +71,7 @@ static bool create_big_file(const char *const pathname, size_t size,
     pn(seed);  // See pseudo-random number generator
 
     printf("Writing...\n");
-    TickType_t xStart = xTaskGetTickCount();
+    uint64_t ullStart = time_us_64();
 
     /* Open the file, creating the file if it does not already exist. */
     FF_Stat_t xStat;
@@ -83,16 +86,17 @@ static bool create_big_file(const char *const pathname, size_t size,
     } else {
         pxFile = ff_fopen(pathname, "w");
     }
-    //    // FF_FILE *ff_truncate( const char * pcFileName, long lTruncateSize
-    //    );
-    //    //   If the file was shorter than lTruncateSize
-    //    //   then new data added to the end of the file is set to 0.
-    //    pxFile = ff_truncate(pathname, size);
     if (!pxFile) {
         printf("ff_fopen(%s): %s (%d)\n", pathname, strerror(errno), errno);
         return false;
     }
     assert(pxFile);
+    // Allocate the whole file up front, in one contiguous run
+    if (-1 == ff_fallocate(pxFile, size)) {
+        printf("ff_fallocate(%s): %s (%d)\n", pathname, strerror(errno), errno);
+        ff_fclose(pxFile);
+        return false;
+    }
 
     size_t i;
     for (i = 0; i < size / bufsz; ++i) {
@@ -106,10 +110,13 @@ static bool create_big_file(const char *const pathname, size_t size,
     free(buff);
     /* Close the file. */
     ff_fclose(pxFile);
-    long unsigned elapsed =
-        (unsigned long)(xTaskGetTickCount() - xStart) / configTICK_RATE_HZ;
-    printf("Elapsed seconds %lu\n", elapsed);
-    printf("Transfer rate %lu KiB/s\n", size / elapsed / 1024);
+    uint64_t elapsed_us = time_us_64() - ullStart;
+    printf("Elapsed seconds %llu.%03llu\n",
+           (unsigned long long)(elapsed_us / 1000000),
+           (unsigned long long)(elapsed_us / 1000 % 1000));
+    printf("Transfer rate %llu KiB/s\n",
+           elapsed_us ? (unsigned long long)size * 1000000 / 1024 / elapsed_us
+                      : 0ULL);
     return true;
 }
 
@@ -136,7 +143,7 @@ static void check_big_file(const char *const pathname, size_t size,
     assert(pxFile);
 
     printf("Reading...\n");
-    TickType_t xStart = xTaskGetTickCount();
+    uint64_t ullStart = time_us_64();
 
     size_t i;
     for (i = 0; i < size / bufsz; ++i) {
@@ -158,10 +165,13 @@ static void check_big_file(const char *const pathname, size_t size,
     free(buff);
     /* Close the file. */
     ff_fclose(pxFile);
-    long unsigned elapsed =
-        (unsigned long)(xTaskGetTickCount() - xStart) / configTICK_RATE_HZ;
-    printf("Elapsed seconds %lu\n", elapsed);
-    printf("Transfer rate %lu KiB/s\n", size / elapsed / 1024);
+    uint64_t elapsed_us = time_us_64() - ullStart;
+    printf("Elapsed seconds %llu.%03llu\n",
+           (unsigned long long)(elapsed_us / 1000000),
+           (unsigned long long)(elapsed_us / 1000 % 1000));
+    printf("Transfer rate %llu KiB/s\n",
+           elapsed_us ? (unsigned long long)size * 1000000 / 1024 / elapsed_us
+                      : 0ULL);
 }
 
 // Create a file of size "size" bytes filled with random data seeded with "seed"
@@ -0,0 +1,130 @@
+/* dir_index_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check that names are found through a directory index (ff_dir_index.h) and
+that the index follows the directory as it changes.
+
+dir_index_test creates DIR_INDEX_TEST_FILES files with long names in <dir>,
+each holding its own name, and opens them all twice, checking what they
+hold. Then it renames one, removes another, and creates a new one (likely in
+the removed one's entry), and checks that the old names are gone and the new
+ones are found, and that a name is found whatever its case. */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "ff_dir_index.h"
+#include "ff_stdio.h"
+
+#define DIR_INDEX_TEST_FILES 200
+
+static void prvName(char *pcPath, size_t xSize, const char *pcDir,
+                    const char *pcFormat, int iFile) {
+    int iLength = snprintf(pcPath, xSize, "%s/", pcDir);
+    snprintf(pcPath + iLength, xSize - iLength, pcFormat, iFile);
+}
+
+// Create the file, holding its own name (without the directory)
+static bool prvCreate(const char *pcPath) {
+    const char *pcName = strrchr(pcPath, '/') + 1;
+    FF_FILE *pxFile = ff_fopen(pcPath, "w");
+    if (!pxFile) return false;
+    size_t xLength = strlen(pcName);
+    bool bOK = ff_fwrite(pcName, 1, xLength, pxFile) == xLength;
+    return 0 == ff_fclose(pxFile) && bOK;
+}
+
+// Open pcPath, and check that it holds pcName
+static bool prvCheck(const char *pcPath, const char *pcName) {
+    char pcBuf[ffconfigMAX_FILENAME];
+    FF_FILE *pxFile = ff_fopen(pcPath, "r");
+    if (!pxFile) return false;
+    size_t xRead = ff_fread(pcBuf, 1, sizeof pcBuf - 1, pxFile);
+    ff_fclose(pxFile);
+    pcBuf[xRead] = '\0';
+    return 0 == strcmp(pcBuf, pcName);
+}
+
+static bool prvGone(const char *pcPath) {
+    FF_FILE *pxFile = ff_fopen(pcPath, "r");
+    if (pxFile) ff_fclose(pxFile);
+    return !pxFile;
+}
+
+// Returns NULL if the check passed, or what failed
+const char *dir_index_test(const char *pcDir) {
+    static const char pcFormat[] = "a file with a long name %03d.txt";
+    char pcPath[ffconfigMAX_FILENAME], pcOther[ffconfigMAX_FILENAME];
+    const char *pcFailed = NULL;
+    uint32_t ulHits, ulScans, ulHitsBefore;
+
+    ff_mkdir(pcDir);
+    for (int i = 0; i < DIR_INDEX_TEST_FILES && !pcFailed; ++i) {
+        prvName(pcPath, sizeof pcPath, pcDir, pcFormat, i);
+        if (!prvCreate(pcPath)) pcFailed = "Creating the files";
+    }
+    ff_dir_index_counts(&ulHitsBefore, &ulScans);
+    for (int iPass = 0; iPass < 2 && !pcFailed; ++iPass)
+        for (int i = 0; i < DIR_INDEX_TEST_FILES && !pcFailed; ++i) {
+            prvName(pcPath, sizeof pcPath, pcDir, pcFormat, i);
+            if (!prvCheck(pcPath, strrchr(pcPath, '/') + 1))
+                pcFailed = "Reading the files";
+        }
+    if (pcFailed) goto out;
+
+    // Rename 7 and remove 8
+    prvName(pcPath, sizeof pcPath, pcDir, pcFormat, 7);
+    prvName(pcOther, sizeof pcOther, pcDir, "renamed %d.txt", 7);
+    if (-1 == ff_rename(pcPath, pcOther, false)) {
+        pcFailed = "Renaming 7";
+        goto out;
+    }
+    if (!prvGone(pcPath)) pcFailed = "7 found by its old name";
+    if (!pcFailed && !prvCheck(pcOther, strrchr(pcPath, '/') + 1))
+        pcFailed = "7 not found by its new name";
+    prvName(pcPath, sizeof pcPath, pcDir, pcFormat, 8);
+    if (!pcFailed && -1 == ff_remove(pcPath)) pcFailed = "Removing 8";
+    if (!pcFailed && !prvGone(pcPath)) pcFailed = "8 found after removal";
+    if (pcFailed) goto out;
+
+    prvName(pcPath, sizeof pcPath, pcDir, pcFormat, DIR_INDEX_TEST_FILES);
+    if (!prvCreate(pcPath)) pcFailed = "Creating another file";
+    if (!pcFailed && !prvCheck(pcPath, strrchr(pcPath, '/') + 1))
+        pcFailed = "Reading the new file";
+    prvName(pcPath, sizeof pcPath, pcDir, pcFormat, 9);
+    prvName(pcOther, sizeof pcOther, pcDir, "A FILE WITH A LONG NAME %03d.TXT",
+            9);
+    if (!pcFailed && !prvCheck(pcOther, strrchr(pcPath, '/') + 1))
+        pcFailed = "Finding 9 in capitals";
+    if (pcFailed) goto out;
+
+    ff_dir_index_counts(&ulHits, &ulScans);
+    printf("%lu lookups answered by an index\n",
+           (unsigned long)(ulHits - ulHitsBefore));
+#if ffconfigDIR_INDEX_DIRS > 0
+    if (ulHits == ulHitsBefore) pcFailed = "No lookups answered by an index";
+#endif
+out:
+    for (int i = 0; i <= DIR_INDEX_TEST_FILES; ++i) {
+        prvName(pcPath, sizeof pcPath, pcDir, pcFormat, i);
+        ff_remove(pcPath);
+    }
+    prvName(pcPath, sizeof pcPath, pcDir, "renamed %d.txt", 7);
+    ff_remove(pcPath);
+    ff_rmdir(pcDir);
+    return pcFailed;
+}
+
+/* [] END OF FILE */
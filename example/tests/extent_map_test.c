@@ -0,0 +1,139 @@
+/* extent_map_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check that an extent map (ff_extent_map.h) doesn't outlive its file.
+
+extent_map_test writes <dir>/a and <dir>/b a cluster at a time, in turn, so
+that a's chain is fragmented, and maps it with ff_fseek_mapped(). Then it
+deletes both and writes <dir>/c, which starts in a's first cluster but is
+contiguous, and is usually opened with the handle a had. Every cluster of c
+is then read back, through ff_fseek_mapped(), in reverse order: a stale map
+would find a's clusters instead. */
+
+#include <stdbool.h>
+#include <stdio.h>
+//
+#include "FreeRTOS.h"
+#include "ff_extent_map.h"
+#include "ff_stdio.h"
+
+#define EXTENT_MAP_TEST_CLUSTERS 8
+
+static uint32_t prvClusterBytes(FF_FILE *pxFile) {
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    return pxIOManager->xPartition.usBlkSize *
+           pxIOManager->xPartition.ulSectorsPerCluster;
+}
+
+// Fill a cluster with words naming the file and the cluster's place in it
+static void prvFill(uint32_t *pulBuf, uint32_t ulBytes, char cTag,
+                    uint32_t ulIndex) {
+    for (uint32_t i = 0; i < ulBytes / sizeof(uint32_t); ++i)
+        pulBuf[i] = (uint32_t)cTag << 24 | ulIndex << 16 | i;
+}
+
+// Read the cluster, through the extent map, and check it
+static bool prvCheck(FF_FILE *pxFile, uint32_t *pulBuf, uint32_t ulBytes,
+                     char cTag, uint32_t ulIndex) {
+    if (-1 == ff_fseek_mapped(pxFile, ulIndex * ulBytes, FF_SEEK_SET))
+        return false;
+    if (ff_fread(pulBuf, 1, ulBytes, pxFile) != ulBytes) return false;
+    for (uint32_t i = 0; i < ulBytes / sizeof(uint32_t); ++i)
+        if (pulBuf[i] != ((uint32_t)cTag << 24 | ulIndex << 16 | i))
+            return false;
+    return true;
+}
+
+// Returns NULL if the check passed, or what failed
+const char *extent_map_test(const char *pcDir) {
+    char pcA[ffconfigMAX_FILENAME], pcB[ffconfigMAX_FILENAME],
+        pcC[ffconfigMAX_FILENAME];
+    const char *pcFailed = NULL;
+    uint32_t *pulBuf = NULL;
+
+    snprintf(pcA, sizeof pcA, "%s/a", pcDir);
+    snprintf(pcB, sizeof pcB, "%s/b", pcDir);
+    snprintf(pcC, sizeof pcC, "%s/c", pcDir);
+    ff_mkdir(pcDir);
+
+    FF_FILE *pxA = ff_fopen(pcA, "w");
+    FF_FILE *pxB = ff_fopen(pcB, "w");
+    if (!pxA || !pxB) {
+        if (pxA) ff_fclose(pxA);
+        if (pxB) ff_fclose(pxB);
+        return "Creating a and b";
+    }
+    uint32_t ulBytes = prvClusterBytes(pxA);
+    pulBuf = pvPortMalloc(ulBytes);
+    if (!pulBuf) {
+        ff_fclose(pxA);
+        ff_fclose(pxB);
+        return "Allocating a cluster's buffer";
+    }
+    for (uint32_t i = 0; i < EXTENT_MAP_TEST_CLUSTERS && !pcFailed; ++i) {
+        prvFill(pulBuf, ulBytes, 'A', i);
+        if (ff_fwrite(pulBuf, 1, ulBytes, pxA) != ulBytes)
+            pcFailed = "Writing a";
+        prvFill(pulBuf, ulBytes, 'B', i);
+        if (!pcFailed && ff_fwrite(pulBuf, 1, ulBytes, pxB) != ulBytes)
+            pcFailed = "Writing b";
+    }
+    if (0 != ff_fclose(pxA) && !pcFailed) pcFailed = "Closing a";
+    if (0 != ff_fclose(pxB) && !pcFailed) pcFailed = "Closing b";
+    if (pcFailed) goto out;
+
+    // Map a
+    pxA = ff_fopen(pcA, "r");
+    if (!pxA) {
+        pcFailed = "Opening a";
+        goto out;
+    }
+    if (!prvCheck(pxA, pulBuf, ulBytes, 'A', EXTENT_MAP_TEST_CLUSTERS - 1))
+        pcFailed = "Reading a";
+    ff_fclose(pxA);
+    if (pcFailed) goto out;
+
+    if (-1 == ff_remove(pcA) || -1 == ff_remove(pcB)) {
+        pcFailed = "Removing a and b";
+        goto out;
+    }
+    FF_FILE *pxC = ff_fopen(pcC, "w");
+    if (!pxC) {
+        pcFailed = "Creating c";
+        goto out;
+    }
+    for (uint32_t i = 0; i < EXTENT_MAP_TEST_CLUSTERS && !pcFailed; ++i) {
+        prvFill(pulBuf, ulBytes, 'C', i);
+        if (ff_fwrite(pulBuf, 1, ulBytes, pxC) != ulBytes)
+            pcFailed = "Writing c";
+    }
+    if (0 != ff_fclose(pxC) && !pcFailed) pcFailed = "Closing c";
+    if (pcFailed) goto out;
+
+    pxC = ff_fopen(pcC, "r");
+    if (!pxC) {
+        pcFailed = "Opening c";
+        goto out;
+    }
+    printf("c %s the handle a had\n", pxC == pxA ? "has" : "doesn't have");
+    for (uint32_t i = EXTENT_MAP_TEST_CLUSTERS; i-- > 0 && !pcFailed;)
+        if (!prvCheck(pxC, pulBuf, ulBytes, 'C', i)) pcFailed = "Reading c";
+    ff_fclose(pxC);
+    ff_remove(pcC);
+out:
+    vPortFree(pulBuf);
+    return pcFailed;
+}
+
+/* [] END OF FILE */
@@ -0,0 +1,83 @@
+/* fallocate_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check ff_fallocate()'s accounting, by the volume's count of free clusters.
+
+fallocate_test preallocates a file, writes a little more than a cluster and
+closes it with plain ff_fclose(): all but two clusters must come back. It
+preallocates another file and closes it empty: all of them must come back.
+It asks for 4 GiB, which must fail rather than allocate nothing. Then it
+removes both files, and the count must be where it started. */
+
+#include <stdbool.h>
+#include <stdio.h>
+//
+#include "FreeRTOS.h"
+#include "ff_stdio.h"
+#include "ff_utils.h"
+
+#define FALLOCATE_TEST_CLUSTERS 16
+
+static uint32_t prvFreeClusters(FF_IOManager_t *pxIOManager) {
+    FF_Error_t xError;
+    FF_GetFreeSize(pxIOManager, &xError);  // Counts them if not yet known
+    return pxIOManager->xPartition.ulFreeClusterCount;
+}
+
+// Returns NULL if the check passed, or what failed
+const char *fallocate_test(const char *pcDir) {
+    char pcA[ffconfigMAX_FILENAME], pcB[ffconfigMAX_FILENAME];
+    const char *pcFailed = NULL;
+
+    snprintf(pcA, sizeof pcA, "%s/a", pcDir);
+    snprintf(pcB, sizeof pcB, "%s/b", pcDir);
+    ff_mkdir(pcDir);
+
+    FF_FILE *pxFile = ff_fopen(pcA, "w");
+    if (!pxFile) return "Creating a";
+    FF_IOManager_t *pxIOManager = pxFile->pxIOManager;
+    uint32_t ulClusterBytes = pxIOManager->xPartition.usBlkSize *
+                              pxIOManager->xPartition.ulSectorsPerCluster;
+    uint32_t ulFree = prvFreeClusters(pxIOManager);
+
+    if (-1 == ff_fallocate(pxFile, FALLOCATE_TEST_CLUSTERS * ulClusterBytes))
+        pcFailed = "Preallocating a";
+    else if (prvFreeClusters(pxIOManager) != ulFree - FALLOCATE_TEST_CLUSTERS)
+        pcFailed = "Counting a's clusters";
+    for (uint32_t i = 0; i < ulClusterBytes + 1 && !pcFailed; ++i)
+        if (ff_fputc('a', pxFile) != 'a') pcFailed = "Writing a";
+    if (0 != ff_fclose(pxFile) && !pcFailed) pcFailed = "Closing a";
+    if (!pcFailed && prvFreeClusters(pxIOManager) != ulFree - 2)
+        pcFailed = "Closing a gave back the wrong number of clusters";
+    if (pcFailed) return pcFailed;
+
+    pxFile = ff_fopen(pcB, "w");
+    if (!pxFile) return "Creating b";
+    if (-1 == ff_fallocate(pxFile, FALLOCATE_TEST_CLUSTERS * ulClusterBytes))
+        pcFailed = "Preallocating b";
+    // Rounded up, 4 GiB - 1 is more than the card holds
+    else if (0 == ff_fallocate(pxFile, UINT32_MAX))
+        pcFailed = "Preallocating 4 GiB didn't fail";
+    if (0 != ff_fclose(pxFile) && !pcFailed) pcFailed = "Closing b";
+    if (!pcFailed && prvFreeClusters(pxIOManager) != ulFree - 2)
+        pcFailed = "Closing b empty didn't give back its clusters";
+    if (pcFailed) return pcFailed;
+
+    if (-1 == ff_remove(pcA) || -1 == ff_remove(pcB))
+        return "Removing a and b";
+    if (prvFreeClusters(pxIOManager) != ulFree) return "Clusters leaked";
+    return NULL;
+}
+
+/* [] END OF FILE */
@@ -52,6 +52,11 @@ extern void vMultiTaskStdioWithCWDTest(const char *const pcMountPath,
                                        uint16_t usStackSizeWords);
 extern void big_file_test(const char *const pathname, size_t size,
                           uint32_t seed);
+extern bool format_plan_test();
+extern const char *purge_test(const char *pcDir);
+extern const char *extent_map_test(const char *pcDir);
+extern const char *fallocate_test(const char *pcDir);
+extern const char *dir_index_test(const char *pcDir);
 
 static void ls() {
     char pcWriteBuffer[128] = {0};
@@ -223,21 +228,43 @@ static BaseType_t runFormat(char *pcWriteBuffer, size_t xWriteBufferLen,
                             const char *pcCommandString) {
     (void)pcWriteBuffer;
     (void)xWriteBufferLen;
-    const char *pcParameter;
+    char *pcParameter;
     BaseType_t xParameterStringLength;
+    bool bQuick = false;
 
-    /* Obtain the parameter string. */
-    pcParameter = FreeRTOS_CLIGetParameter(
+    /* Obtain the optional mode. */
+    pcParameter = (char *)FreeRTOS_CLIGetParameter(
+        pcCommandString,        /* The command string itself. */
+        2,                      /* Return the second parameter. */
+        &xParameterStringLength /* Store the parameter string length. */
+    );
+    if (pcParameter) {
+        if (5 != xParameterStringLength ||
+            0 != strncmp(pcParameter, "quick", 5)) {
+            FF_PRINTF("Error: unknown format mode: %s\n", pcParameter);
+            return pdFALSE;
+        }
+        bQuick = true;
+    }
+    /* Obtain the device name. */
+    pcParameter = (char *)FreeRTOS_CLIGetParameter(
         pcCommandString,        /* The command string itself. */
         1,                      /* Return the first parameter. */
         &xParameterStringLength /* Store the parameter string length. */
     );
     /* Sanity check something was returned. */
-    configASSERT(pcParameter);
+    if (!pcParameter) {
+        FF_PRINTF("Usage: format <device name> [quick]\n");
+        return pdFALSE;
+    }
+    /* Terminate the string. */
+    pcParameter[xParameterStringLength] = 0x00;
+
     FF_Disk_t *pxDisk = NULL;
-    bool rc = format(&pxDisk, pcParameter);
+    bool rc = bQuick ? quick_format(&pxDisk, pcParameter)
+                     : format(&pxDisk, pcParameter);
     if (!rc)
-        FF_PRINTF("Format failed!\n");
+        FF_PRINTF("Failed to format %s\n", pcParameter);
     else {
         //    	/*Unmount the partition. */
         //    	FF_Error_t xError = FF_SDDiskUnmount(pxDisk);
@@ -251,10 +278,11 @@ static BaseType_t runFormat(char *pcWriteBuffer, size_t xWriteBufferLen,
 }
 static const CLI_Command_Definition_t xFormat = {
     "format", /* The command string to type. */
-    "\nformat <device name>:\n Format <device name>\n"
+    "\nformat <device name> [quick]:\n Format <device name>\n"
+    " \"quick\" erases the FAT and root directory instead of writing them\n"
     "\te.g.: \"format sd0\"\n",
     runFormat, /* The function to run. */
-    1          /* One parameter is expected. */
+    -1         /* One or two parameters are expected. */
 };
 /*-----------------------------------------------------------*/
 static BaseType_t runMount(char *pcWriteBuffer, size_t xWriteBufferLen,
@@ -277,7 +305,7 @@ static BaseType_t runMount(char *pcWriteBuffer, size_t xWriteBufferLen,
     snprintf(buf, cmdMAX_INPUT_SIZE, "/%s", pcParameter);  // Add '/' for path
     FF_Disk_t *pxDisk = NULL;
     bool rc = mount(&pxDisk, pcParameter, buf);
-    if (!rc) FF_PRINTF("Mount failed!\n");
+    if (!rc) FF_PRINTF("Failed to mount %s\n", pcParameter);
 
     return pdFALSE;
 }
@@ -639,10 +667,114 @@ static const CLI_Command_Definition_t xBFT = {
     3               /* Two parameters are expected. */
 };
 /*-----------------------------------------------------------*/
+static BaseType_t runFormatPlanTest(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                    const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    (void)pcCommandString;
+
+    format_plan_test();
+
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xFormatPlanTest = {
+    "format_plan_test", /* The command string to type. */
+    "\nformat_plan_test:\n Check the FAT layouts planned for common card "
+    "capacities\n",
+    runFormatPlanTest, /* The function to run. */
+    0                  /* No parameters are expected. */
+};
+/*-----------------------------------------------------------*/
+/* Run a check that works in the directory given as the command's parameter
+(and returns NULL if it passes, or what failed), and say how it went. */
+static void prvRunDirTest(const char *pcCommandString, const char *pcName,
+                          const char *(*pxTest)(const char *pcDir)) {
+    char pcDir[ffconfigMAX_FILENAME];
+    BaseType_t xParameterStringLength;
+
+    const char *pcParameter = FreeRTOS_CLIGetParameter(
+        pcCommandString, 1, &xParameterStringLength);
+    /* The CLI has checked that there is one. */
+    configASSERT(pcParameter);
+    snprintf(pcDir, sizeof pcDir, "%.*s", (int)xParameterStringLength,
+             pcParameter);
+    const char *pcFailed = pxTest(pcDir);
+    if (pcFailed)
+        printf("%s: %s (last error: %s)\n", pcName, pcFailed,
+               strerror(stdioGET_ERRNO()));
+    else
+        printf("%s passed\n", pcName);
+}
+static BaseType_t runPurgeTest(char *pcWriteBuffer, size_t xWriteBufferLen,
+                               const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    prvRunDirTest(pcCommandString, "Purge test", purge_test);
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xPurgeTest = {
+    "purge_test", /* The command string to type. */
+    "\npurge_test <dir>:\n"
+    " Purge a directory tree, recreate it, and check that nothing stale\n"
+    " is found\n"
+    "\te.g.: \"purge_test /sd0/pt\"\n",
+    runPurgeTest, /* The function to run. */
+    1             /* One parameter is expected. */
+};
+static BaseType_t runExtentMapTest(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                   const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    prvRunDirTest(pcCommandString, "Extent map test", extent_map_test);
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xExtentMapTest = {
+    "extent_map_test", /* The command string to type. */
+    "\nextent_map_test <dir>:\n"
+    " Map a fragmented file, replace it with a contiguous one, and check\n"
+    " that the new one isn't read through the old map\n"
+    "\te.g.: \"extent_map_test /sd0/emt\"\n",
+    runExtentMapTest, /* The function to run. */
+    1                 /* One parameter is expected. */
+};
+static BaseType_t runFallocateTest(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                   const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    prvRunDirTest(pcCommandString, "Preallocation test", fallocate_test);
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xFallocateTest = {
+    "fallocate_test", /* The command string to type. */
+    "\nfallocate_test <dir>:\n"
+    " Check that preallocated clusters come back when files are closed\n"
+    "\te.g.: \"fallocate_test /sd0/fat\"\n",
+    runFallocateTest, /* The function to run. */
+    1                 /* One parameter is expected. */
+};
+static BaseType_t runDirIndexTest(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                  const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    prvRunDirTest(pcCommandString, "Directory index test", dir_index_test);
+    return pdFALSE;
+}
+static const CLI_Command_Definition_t xDirIndexTest = {
+    "dir_index_test", /* The command string to type. */
+    "\ndir_index_test <dir>:\n"
+    " Fill a directory, rename, remove and create names in it, and check\n"
+    " that every name is found, or not, as it should be\n"
+    "\te.g.: \"dir_index_test /sd0/dit\"\n",
+    runDirIndexTest, /* The function to run. */
+    1                /* One parameter is expected. */
+};
+/*-----------------------------------------------------------*/
 
 void register_fs_tests() {
     /* Register all the command line commands defined immediately above. */
     extern const CLI_Command_Definition_t xMTLowLevIOTests;
+    extern const CLI_Command_Definition_t xBench;
+    extern const CLI_Command_Definition_t xXferTest;
 
     FreeRTOS_CLIRegisterCommand(&xFormat);
     FreeRTOS_CLIRegisterCommand(&xMount);
@@ -656,6 +788,13 @@ void register_fs_tests() {
     FreeRTOS_CLIRegisterCommand(&xMultiTaskStdioWithCWDTest);
     FreeRTOS_CLIRegisterCommand(&xMultiTaskStdioWithCWDTest2);
     FreeRTOS_CLIRegisterCommand(&xBFT);
+    FreeRTOS_CLIRegisterCommand(&xFormatPlanTest);
+    FreeRTOS_CLIRegisterCommand(&xBench);
+    FreeRTOS_CLIRegisterCommand(&xXferTest);
+    FreeRTOS_CLIRegisterCommand(&xPurgeTest);
+    FreeRTOS_CLIRegisterCommand(&xExtentMapTest);
+    FreeRTOS_CLIRegisterCommand(&xFallocateTest);
+    FreeRTOS_CLIRegisterCommand(&xDirIndexTest);
 }
 
 /* [] END OF FILE */
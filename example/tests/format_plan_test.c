@@ -0,0 +1,112 @@
+/* format_plan_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Exercise the format planner over the capacities we see in the field.
+Runs on the target ("format_plan_test" command) and on a host:
+    cc -I../../FreeRTOS+FAT+CLI/include -DFORMAT_PLAN_TEST_MAIN \
+        format_plan_test.c ../../FreeRTOS+FAT+CLI/src/ff_format_plan.c
+*/
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "ff_format_plan.h"
+
+typedef struct {
+    const char *pcName;
+    uint64_t ullSectors;
+    uint32_t ulAUSectors;  // 0: AU unknown
+    // Expected:
+    uint8_t ucFATBits;
+    uint32_t ulSectorsPerCluster;
+    uint32_t ulBoundarySectors;
+} format_plan_case_t;
+
+static const format_plan_case_t xCases[] = {
+    {"16MB SDSC", 31360, 0, 16, 4, 16},
+    {"64MB SDSC", 125440, 64, 16, 16, 64},
+    {"128MB SDSC", 250880, 0, 16, 32, 32},
+    {"256MB SDSC", 495616, 256, 16, 32, 256},
+    {"512MB SDSC", 1014784, 0, 16, 32, 64},
+    {"1GB SDSC", 1984000, 2048, 16, 32, 2048},
+    {"2GB SDSC", 3970048, 0, 16, 64, 128},
+    {"2GB SDSC, 4MB AU", 3970048, 8192, 16, 64, 8192},
+    {"4GB SDHC", 7744512, 8192, 32, 64, 8192},
+    {"8GB SDHC", 15519744, 8192, 32, 64, 8192},
+    {"8GB SDHC, AU unknown", 15519744, 0, 32, 64, 8192},
+    {"16GB SDHC", 31205376, 8192, 32, 64, 8192},
+    {"32GB SDHC", 62325760, 8192, 32, 64, 8192},
+    {"64GB SDXC", 124702720, 32768, 32, 128, 32768},
+    {"128GB SDXC", 249733120, 65536, 32, 128, 65536},
+    {"128GB SDXC, 12MB AU", 249733120, 24576, 32, 128, 24576},
+    {"256GB SDXC", 499744768, 65536, 32, 128, 65536},
+    {"1TB SDXC", 1953525168, 131072, 32, 128, 131072},
+};
+
+bool format_plan_test() {
+    size_t nFailed = 0;
+
+    printf("%-22s %10s %4s %4s %8s %6s %8s %10s %10s %s\n", "Card", "Sectors",
+           "FAT", "SPC", "Hidden", "RSC", "SPF", "Data LBA", "Clusters",
+           "Result");
+    for (size_t i = 0; i < sizeof xCases / sizeof xCases[0]; ++i) {
+        const format_plan_case_t *c = &xCases[i];
+        FF_FormatPlan_t xPlan;
+        const char *pcFail = NULL;
+
+        if (!ff_format_plan(c->ullSectors, c->ulAUSectors, &xPlan))
+            pcFail = ff_format_plan_check(c->ullSectors, &xPlan);
+        if (!pcFail && xPlan.ucFATBits != c->ucFATBits) pcFail = "FAT type";
+        if (!pcFail && xPlan.ulSectorsPerCluster != c->ulSectorsPerCluster)
+            pcFail = "cluster size";
+        if (!pcFail && xPlan.ulBoundarySectors % c->ulBoundarySectors)
+            pcFail = "boundary unit";
+        // Every cluster must start on a cluster-sized boundary of the card
+        if (!pcFail && xPlan.ulDataBeginLBA % xPlan.ulSectorsPerCluster)
+            pcFail = "cluster alignment";
+        if (!pcFail && c->ulAUSectors &&
+            xPlan.ulDataBeginLBA % c->ulAUSectors &&
+            xPlan.ulBoundarySectors >= c->ulAUSectors)
+            pcFail = "AU alignment";
+        if (!pcFail && (c->ulAUSectors > xPlan.ulSectorsPerCluster
+                            ? c->ulAUSectors % xPlan.ulSectorsPerCluster
+                            : false))
+            pcFail = "cluster straddles AU";
+
+        printf("%-22s %10" PRIu64 " %4u %4" PRIu32 " %8" PRIu32 " %6" PRIu32
+               " %8" PRIu32 " %10" PRIu32 " %10" PRIu32 " %s\n",
+               c->pcName, c->ullSectors, xPlan.ucFATBits,
+               xPlan.ulSectorsPerCluster, xPlan.ulHiddenSectors,
+               xPlan.ulReservedSectors, xPlan.ulSectorsPerFAT,
+               xPlan.ulDataBeginLBA, xPlan.ulClusterCount,
+               pcFail ? pcFail : "OK");
+        if (pcFail) ++nFailed;
+    }
+    // Too large for 32 bit LBAs
+    FF_FormatPlan_t xPlan;
+    if (ff_format_plan(0x100000000ULL, 0, &xPlan)) {
+        printf("2TB+: expected failure\n");
+        ++nFailed;
+    }
+    printf("format_plan_test: %s (%zu failed)\n", nFailed ? "FAIL" : "PASS",
+           nFailed);
+    return 0 == nFailed;
+}
+
+#ifdef FORMAT_PLAN_TEST_MAIN
+int main() { return format_plan_test() ? 0 : 1; }
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,96 @@
+/* purge_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Check that ff_purge() leaves nothing stale behind in FreeRTOS+FAT's path and
+hash caches.
+
+purge_test makes <dir>/old/sub/a.txt, looks it up (so that the caches know
+the directories), and purges <dir>. Then it writes <dir>/filler, to take up
+the clusters freed, recreates <dir>/old/sub with b.txt in it, and checks that
+b.txt, a.txt and filler are what they should be: a stale cache would put b.txt
+in the old directory's cluster, now part of filler. */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "ff_purge.h"
+#include "ff_stdio.h"
+#include "ff_utils.h"
+
+#define PURGE_TEST_FILLER 32768
+
+static bool prvWrite(const char *pcPath, const char *pcText, size_t xSize) {
+    FF_FILE *pxFile = ff_fopen(pcPath, "w");
+    if (!pxFile) return false;
+    size_t xLength = strlen(pcText);
+    for (size_t xDone = 0; xDone < xSize; xDone += xLength) {
+        if (ff_fwrite(pcText, 1, xLength, pxFile) != xLength) {
+            ff_fclose(pxFile);
+            return false;
+        }
+    }
+    return 0 == ff_fclose(pxFile);
+}
+
+// Does the file hold pcText, xSize bytes' worth of it?
+static bool prvHolds(const char *pcPath, const char *pcText, size_t xSize) {
+    char cBuf[32];
+    size_t xLength = strlen(pcText), xDone = 0, xRead;
+    FF_FILE *pxFile = ff_fopen(pcPath, "r");
+    if (!pxFile) return false;
+    bool bSame = true;
+    while (bSame && (xRead = ff_fread(cBuf, 1, xLength, pxFile)) > 0) {
+        bSame = xRead == xLength && 0 == memcmp(cBuf, pcText, xLength);
+        xDone += xRead;
+    }
+    ff_fclose(pxFile);
+    return bSame && xDone == xSize;
+}
+
+// Returns NULL if the check passed, or what failed
+const char *purge_test(const char *pcDir) {
+    char pcPath[ffconfigMAX_FILENAME], pcFile[ffconfigMAX_FILENAME];
+    FF_PurgeStats_t xStats;
+    FF_Stat_t xStat;
+
+    snprintf(pcPath, sizeof pcPath, "%s/old/sub", pcDir);
+    if (-1 == mkdirhier(pcPath)) return "mkdirhier";
+    snprintf(pcFile, sizeof pcFile, "%s/a.txt", pcPath);
+    if (!prvWrite(pcFile, "before\n", 7)) return "Writing a.txt";
+    if (-1 == ff_stat(pcFile, &xStat)) return "Finding a.txt";
+
+    if (-1 == ff_purge(pcDir, FreeRTOS_time(NULL) + 60, 0, &xStats))
+        return "ff_purge";
+    if (1 != xStats.ulFiles || 2 != xStats.ulDirectories)
+        return "Purged the wrong things";
+
+    snprintf(pcFile, sizeof pcFile, "%s/filler", pcDir);
+    if (!prvWrite(pcFile, "filler\n", PURGE_TEST_FILLER))
+        return "Writing filler";
+    if (-1 == mkdirhier(pcPath)) return "Recreating the directories";
+    snprintf(pcFile, sizeof pcFile, "%s/b.txt", pcPath);
+    if (!prvWrite(pcFile, "after\n", 6)) return "Writing b.txt";
+
+    if (!prvHolds(pcFile, "after\n", 6)) return "b.txt is wrong";
+    snprintf(pcFile, sizeof pcFile, "%s/a.txt", pcPath);
+    if (0 == ff_stat(pcFile, &xStat)) return "a.txt came back";
+    snprintf(pcFile, sizeof pcFile, "%s/filler", pcDir);
+    if (!prvHolds(pcFile, "filler\n", PURGE_TEST_FILLER))
+        return "filler is wrong";
+    return NULL;
+}
+
+/* [] END OF FILE */
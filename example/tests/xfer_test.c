@@ -0,0 +1,223 @@
+/* xfer_test.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Loopback test of the file transfer protocol (ff_xfer.h).
+
+xfer_test writes a file of pseudo-random data, sends it with ff_xfer_send() to
+a task receiving it with ff_xfer_receive() into "<file>.rx", and compares the
+two. The two ends talk through a pair of stream buffers that lose or corrupt
+about one write in XFER_TEST_FAULT_RATE, in both directions, so the resending
+is exercised too. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//
+#include "FreeRTOS.h"
+#include "FreeRTOS_CLI.h"
+#include "ff_stdio.h"
+#include "ff_xfer.h"
+#include "stream_buffer.h"
+#include "task.h"
+
+#ifndef XFER_TEST_FAULT_RATE
+#define XFER_TEST_FAULT_RATE 64
+#endif
+#define XFER_TEST_BUFFER 4096
+#define XFER_TEST_CHUNK 4096
+
+#define errno stdioGET_ERRNO()
+
+typedef struct {
+    StreamBufferHandle_t xIn, xOut;
+    uint32_t ulLfsr;
+    unsigned uDropped, uCorrupted;
+    uint8_t ucCopy[ffconfigXFER_BLOCK_SIZE];
+} xfer_test_end_t;
+
+typedef struct {
+    const char *pcPath;
+    const FF_XferLink_t *pxLink;
+    FF_XferStats_t xStats;
+    int iResult, iErrno;
+    TaskHandle_t xParent;
+} xfer_test_rx_t;
+
+static uint32_t prvRandom(uint32_t *pulLfsr) {
+    *pulLfsr = *pulLfsr >> 1 ^ (-(*pulLfsr & 1u) & 0xD0000001u);
+    return *pulLfsr;
+}
+
+static bool prvSend(void *pvContext, const void *pvData, size_t xLength) {
+    xfer_test_end_t *pxEnd = pvContext;
+    uint8_t *ucCopy = pxEnd->ucCopy;
+
+    uint32_t ulDice = prvRandom(&pxEnd->ulLfsr) % XFER_TEST_FAULT_RATE;
+    if (0 == ulDice) {
+        ++pxEnd->uDropped;
+        return true;
+    }
+    memcpy(ucCopy, pvData, xLength);
+    if (1 == ulDice) {
+        ucCopy[prvRandom(&pxEnd->ulLfsr) % xLength] ^= 0x10;
+        ++pxEnd->uCorrupted;
+    }
+    for (size_t xSent = 0; xSent < xLength;)
+        xSent += xStreamBufferSend(pxEnd->xOut, ucCopy + xSent,
+                                   xLength - xSent, portMAX_DELAY);
+    return true;
+}
+
+static size_t prvReceive(void *pvContext, void *pvBuffer, size_t xLength,
+                         TickType_t xTimeout) {
+    xfer_test_end_t *pxEnd = pvContext;
+    return xStreamBufferReceive(pxEnd->xIn, pvBuffer, xLength, xTimeout);
+}
+
+static void prvReceiverTask(void *pvParameters) {
+    xfer_test_rx_t *pxRx = pvParameters;
+    pxRx->iResult = ff_xfer_receive(pxRx->pcPath, pxRx->pxLink, &pxRx->xStats);
+    pxRx->iErrno = errno;
+    xTaskNotifyGive(pxRx->xParent);
+    vTaskDelete(NULL);
+}
+
+static bool prvWriteFile(const char *pcPath, uint32_t ulSize, uint8_t *pucBuf) {
+    uint32_t ulLfsr = ulSize | 1;
+    FF_FILE *pxFile = ff_fopen(pcPath, "w");
+    if (!pxFile) return false;
+    for (uint32_t ulDone = 0; ulDone < ulSize;) {
+        size_t xChunk = ulSize - ulDone < XFER_TEST_CHUNK ? ulSize - ulDone
+                                                         : XFER_TEST_CHUNK;
+        for (size_t i = 0; i < xChunk; ++i)
+            pucBuf[i] = prvRandom(&ulLfsr);
+        if (ff_fwrite(pucBuf, 1, xChunk, pxFile) != xChunk) {
+            ff_fclose(pxFile);
+            return false;
+        }
+        ulDone += xChunk;
+    }
+    return 0 == ff_fclose(pxFile);
+}
+
+static bool prvSameFiles(const char *pcA, const char *pcB, uint8_t *pucBuf) {
+    bool bSame = false;
+    FF_FILE *pxA = ff_fopen(pcA, "r");
+    FF_FILE *pxB = ff_fopen(pcB, "r");
+    if (pxA && pxB && pxA->ulFileSize == pxB->ulFileSize) {
+        size_t xA, xB;
+        do {
+            xA = ff_fread(pucBuf, 1, XFER_TEST_CHUNK, pxA);
+            xB = ff_fread(pucBuf + XFER_TEST_CHUNK, 1, XFER_TEST_CHUNK, pxB);
+        } while (xA == xB && xA &&
+                 0 == memcmp(pucBuf, pucBuf + XFER_TEST_CHUNK, xA));
+        bSame = xA == xB && !xA;
+    }
+    if (pxA) ff_fclose(pxA);
+    if (pxB) ff_fclose(pxB);
+    return bSame;
+}
+
+static void xfer_test(const char *pcPath, uint32_t ulSize) {
+    static xfer_test_end_t xTx, xRx;  // Big, and there is only one CLI
+    char pcRxPath[ffconfigMAX_FILENAME];
+    FF_XferLink_t xTxLink = {prvSend, prvReceive, &xTx};
+    FF_XferLink_t xRxLink = {prvSend, prvReceive, &xRx};
+    xfer_test_rx_t xReceiver = {.pcPath = pcRxPath, .pxLink = &xRxLink};
+    FF_XferStats_t xStats = {0};
+
+    memset(&xTx, 0, sizeof xTx);
+    memset(&xRx, 0, sizeof xRx);
+    xTx.ulLfsr = 0x1234567;
+    xRx.ulLfsr = 0x7654321;
+    snprintf(pcRxPath, sizeof pcRxPath, "%s.rx", pcPath);
+    uint8_t *pucBuf = pvPortMalloc(2 * XFER_TEST_CHUNK);
+    xTx.xOut = xRx.xIn = xStreamBufferCreate(XFER_TEST_BUFFER, 1);
+    xRx.xOut = xTx.xIn = xStreamBufferCreate(XFER_TEST_BUFFER, 1);
+    if (!pucBuf || !xTx.xOut || !xTx.xIn) {
+        printf("%s: Out of memory\n", __FUNCTION__);
+        goto out;
+    }
+    if (!prvWriteFile(pcPath, ulSize, pucBuf)) {
+        printf("%s: Couldn't write %s: %s\n", __FUNCTION__, pcPath,
+               strerror(errno));
+        goto out;
+    }
+
+    xReceiver.xParent = xTaskGetCurrentTaskHandle();
+    if (pdPASS != xTaskCreate(prvReceiverTask, "xfer_test Rx", 1024,
+                              &xReceiver, uxTaskPriorityGet(NULL), NULL)) {
+        printf("%s: Couldn't create the receiver\n", __FUNCTION__);
+        goto out;
+    }
+    TickType_t xStart = xTaskGetTickCount();
+    int iResult = ff_xfer_send(pcPath, &xTxLink, &xStats);
+    int iErrno = errno;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // For the receiver
+    TickType_t xTicks = xTaskGetTickCount() - xStart;
+
+    printf("Sent %lu bytes in %lu ms: %lu frames, %lu resent\n",
+           (unsigned long)xStats.ulBytes,
+           (unsigned long)xTicks * portTICK_PERIOD_MS,
+           (unsigned long)xStats.ulFrames, (unsigned long)xStats.ulResent);
+    printf("Dropped %u and corrupted %u writes\n", xTx.uDropped + xRx.uDropped,
+           xTx.uCorrupted + xRx.uCorrupted);
+    if (-1 == iResult)
+        printf("%s: Sending failed: %s\n", __FUNCTION__, strerror(iErrno));
+    else if (-1 == xReceiver.iResult)
+        printf("%s: Receiving failed: %s\n", __FUNCTION__,
+               strerror(xReceiver.iErrno));
+    else if (!prvSameFiles(pcPath, pcRxPath, pucBuf))
+        printf("%s: %s differs from %s\n", __FUNCTION__, pcRxPath, pcPath);
+    else
+        printf("Received intact\n");
+out:
+    if (xTx.xOut) vStreamBufferDelete(xTx.xOut);
+    if (xTx.xIn) vStreamBufferDelete(xTx.xIn);
+    vPortFree(pucBuf);
+}
+
+/*-----------------------------------------------------------*/
+static BaseType_t xfer_test_cmd(char *pcWriteBuffer, size_t xWriteBufferLen,
+                                const char *pcCommandString) {
+    (void)pcWriteBuffer;
+    (void)xWriteBufferLen;
+    const char *pcParameter;
+    BaseType_t xParameterStringLength;
+    char pcPath[ffconfigMAX_FILENAME];
+    uint32_t ulSize = 256 * 1024;
+
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 1,
+                                           &xParameterStringLength);
+    configASSERT(pcParameter);
+    snprintf(pcPath, sizeof pcPath, "%.*s", (int)xParameterStringLength,
+             pcParameter);
+    pcParameter = FreeRTOS_CLIGetParameter(pcCommandString, 2,
+                                           &xParameterStringLength);
+    if (pcParameter) ulSize = strtoul(pcParameter, NULL, 0);
+    xfer_test(pcPath, ulSize);
+
+    return pdFALSE;
+}
+const CLI_Command_Definition_t xXferTest = {
+    "xfer_test", /* The command string to type. */
+    "\nxfer_test <file> [<bytes>]:\n"
+    " Send a file of <bytes> over a lossy loopback, to <file>.rx\n"
+    " (<file> is a full path)\n"
+    "\te.g.: \"xfer_test /sd0/xfer 262144\"\n",
+    xfer_test_cmd, /* The function to run. */
+    -1             /* One or two parameters. */
+};
+
+/* [] END OF FILE */
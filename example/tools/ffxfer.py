@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+# ffxfer.py
+# Copyright 2021 Carl John Kugler III
+#
+# Licensed under the Apache License, Version 2.0 (the License); you may not use
+# this file except in compliance with the License. You may obtain a copy of the
+# License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an AS IS BASIS, WITHOUT
+# WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+# License for the specific language governing permissions and limitations under
+# the License.
+
+"""Copy files to and from the example's SD cards over its USB console.
+
+    ffxfer.py /dev/ttyACM0 get /sd0/log.txt [local file]
+    ffxfer.py /dev/ttyACM0 put <local file> /sd0/log.txt
+
+This types "sz" or "rz" at the CLI prompt, then speaks the protocol described
+in FreeRTOS+FAT+CLI/include/ff_xfer.h. BLOCK_SIZE must match
+ffconfigXFER_BLOCK_SIZE in FreeRTOSFATConfig.h; the other settings below are
+this end's own.
+"""
+
+import argparse
+import binascii
+import os
+import select
+import struct
+import sys
+import time
+import tty
+
+BLOCK_SIZE = 1024
+WINDOW = 16
+TIMEOUT = 1.0
+RETRIES = 10
+
+SOH = 0x01
+HEADER = struct.Struct('<BBIH')  # SOH, type, sequence, length
+FILE, DATA, END, ACK, NAK, CANCEL = (ord(c) for c in 'FDEANC')
+PROMPT = b'\n> '
+
+
+class XferError(Exception):
+    pass
+
+
+class Link:
+    """Frames over a pair of file descriptors."""
+
+    def __init__(self, fd_in, fd_out):
+        self.fd_in = fd_in
+        self.fd_out = fd_out
+        self.rx = bytearray()
+
+    def send(self, kind, sequence, payload=b''):
+        body = HEADER.pack(SOH, kind, sequence, len(payload))[1:] + payload
+        data = bytes([SOH]) + body + struct.pack('>H', binascii.crc_hqx(body, 0))
+        while data:
+            data = data[os.write(self.fd_out, data):]
+
+    def _fill(self, deadline):
+        left = deadline - time.monotonic()
+        if left <= 0 or not select.select([self.fd_in], [], [], left)[0]:
+            return False
+        data = os.read(self.fd_in, 65536)
+        if not data:
+            raise XferError('the link closed')
+        self.rx += data
+        return True
+
+    def receive(self, timeout=TIMEOUT):
+        """The next intact frame, as (type, sequence, payload), or None."""
+        deadline = time.monotonic() + timeout
+        while True:
+            start = self.rx.find(SOH)
+            del self.rx[:start if start >= 0 else len(self.rx)]
+            if len(self.rx) >= HEADER.size:
+                _, kind, sequence, length = HEADER.unpack_from(self.rx)
+                end = HEADER.size + length + 2
+                if length > BLOCK_SIZE:
+                    del self.rx[0]
+                    continue
+                if len(self.rx) >= end:
+                    body = bytes(self.rx[1:end - 2])
+                    if binascii.crc_hqx(body, 0) == int.from_bytes(
+                            self.rx[end - 2:end], 'big'):
+                        del self.rx[:end]
+                        return kind, sequence, body[HEADER.size - 1:]
+                    del self.rx[0]
+                    continue
+            if not self._fill(deadline):
+                return None
+
+    def text_until_prompt(self, timeout=2 * TIMEOUT):
+        """What the console prints after the transfer, up to the prompt."""
+        deadline = time.monotonic() + timeout
+        while PROMPT not in self.rx and self._fill(deadline):
+            pass
+        text, _, self.rx = self.rx.partition(PROMPT)
+        return text.decode(errors='replace').strip()
+
+
+def send_file(link, f, name):
+    """Send the open file f, as name. Returns the number of bytes sent."""
+    size = os.fstat(f.fileno()).st_size
+    blocks = (size + BLOCK_SIZE - 1) // BLOCK_SIZE
+    end = blocks + 1  # Frame 0 is the file, 1 to blocks the data
+
+    def frame(sequence):
+        if sequence == 0:
+            link.send(FILE, 0, struct.pack('<I', size) + name.encode())
+        elif sequence == end:
+            link.send(END, sequence)
+        else:
+            f.seek((sequence - 1) * BLOCK_SIZE)
+            link.send(DATA, sequence, f.read(BLOCK_SIZE))
+
+    base = next_ = timeouts = 0
+    while base <= end:
+        while next_ <= end and next_ - base < WINDOW:
+            frame(next_)
+            next_ += 1
+        reply = link.receive()
+        if reply is None:
+            timeouts += 1
+            if timeouts > RETRIES:
+                link.send(CANCEL, 0)
+                raise XferError('timed out')
+            next_ = base  # Go back
+            continue
+        kind, sequence, _ = reply
+        if kind == CANCEL:
+            raise XferError('cancelled by the device')
+        if kind in (ACK, NAK) and base <= sequence <= next_:
+            if sequence > base:
+                base = sequence
+                timeouts = 0
+            if kind == NAK:
+                next_ = base
+    link.send(ACK, base)
+    return size
+
+
+def receive_file(link, f):
+    """Receive into the open file f. Returns (name, bytes received)."""
+    expected = size = received = timeouts = 0
+    ahead = 0  # The furthest frame seen beyond a gap since it was reported
+    name = None
+    done = False
+    while True:
+        # Once done, stay until a sender that missed the last ACK would resend
+        reply = link.receive(2 * TIMEOUT if done else TIMEOUT)
+        if reply is None:
+            if done:
+                return name, received
+            timeouts += 1
+            if timeouts > RETRIES:
+                link.send(CANCEL, 0)
+                raise XferError('timed out')
+            link.send(NAK, expected)
+            continue
+        kind, sequence, payload = reply
+        if kind == CANCEL:
+            raise XferError('cancelled by the device')
+        if kind in (ACK, NAK):
+            if done:
+                return name, received
+            continue
+        if sequence != expected:
+            if sequence < expected:
+                link.send(ACK, expected)
+            else:
+                if not ahead or sequence <= ahead:
+                    link.send(NAK, expected)
+                ahead = sequence
+            continue
+        timeouts = 0
+        ahead = 0
+        if (kind == FILE) != (expected == 0):
+            link.send(CANCEL, 0)
+            raise XferError('frame %c out of order' % kind)
+        if kind == FILE:
+            size, = struct.unpack_from('<I', payload)
+            name = payload[4:].decode(errors='replace')
+        elif kind == DATA:
+            if received + len(payload) > size:
+                link.send(CANCEL, 0)
+                raise XferError('more data than the file holds')
+            f.write(payload)
+            received += len(payload)
+        elif kind == END:
+            if received != size:
+                link.send(CANCEL, 0)
+                raise XferError('got %d bytes of %d' % (received, size))
+            done = True
+        expected += 1
+        link.send(ACK, expected)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('device', help='the USB console, e.g. /dev/ttyACM0')
+    sub = parser.add_subparsers(dest='command', required=True)
+    get = sub.add_parser('get', help='copy a file from the card')
+    get.add_argument('remote')
+    get.add_argument('local', nargs='?')
+    put = sub.add_parser('put', help='copy a file to the card')
+    put.add_argument('local')
+    put.add_argument('remote')
+    args = parser.parse_args()
+
+    fd = os.open(args.device, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    link = Link(fd, fd)
+    start = time.monotonic()
+    try:
+        if args.command == 'get':
+            local = args.local or os.path.basename(args.remote)
+            with open(local, 'wb') as f:
+                os.write(fd, b'sz %s\r' % args.remote.encode())
+                try:
+                    _, size = receive_file(link, f)
+                except XferError:
+                    f.close()
+                    os.remove(local)
+                    raise
+        else:
+            with open(args.local, 'rb') as f:
+                os.write(fd, b'rz %s\r' % args.remote.encode())
+                size = send_file(link, f, os.path.basename(args.local))
+    except XferError as e:
+        print('ffxfer: %s' % e, file=sys.stderr)
+        print(link.text_until_prompt(), file=sys.stderr)
+        return 1
+    seconds = time.monotonic() - start
+    print(link.text_until_prompt(), file=sys.stderr)
+    print('%d bytes in %.1f s (%.0f kB/s)' %
+          (size, seconds, size / seconds / 1000), file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,48 @@
+/* tusb_config.h
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* TinyUSB configuration for USB_MSC=1 builds: the CDC console (as the SDK's
+own configuration has it) and one mass storage LUN. This directory is only on
+the include path in those builds; otherwise the SDK's configuration is used. */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
+// tud_task() runs in a task of its own (see msc_disk.c), waiting on a queue
+#define CFG_TUSB_OS (OPT_OS_FREERTOS)
+
+#define CFG_TUD_ENDPOINT0_SIZE (64)
+
+#define CFG_TUD_CDC (1)
+#define CFG_TUD_CDC_RX_BUFSIZE (256)
+#define CFG_TUD_CDC_TX_BUFSIZE (256)
+
+#define CFG_TUD_MSC (1)
+/* READ(10) and WRITE(10) are passed to msc_disk.c this much at a time, and
+each piece goes to the card as one multi-block command. */
+#define CFG_TUD_MSC_EP_BUFSIZE (4096)
+
+#define CFG_TUD_HID (0)
+#define CFG_TUD_MIDI (0)
+#define CFG_TUD_VENDOR (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+/* [] END OF FILE */
@@ -0,0 +1,104 @@
+/* usb_descriptors.c
+Copyright 2021 Carl John Kugler III
+
+Licensed under the Apache License, Version 2.0 (the License); you may not use
+this file except in compliance with the License. You may obtain a copy of the
+License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software distributed
+under the License is distributed on an AS IS BASIS, WITHOUT WARRANTIES OR
+CONDITIONS OF ANY KIND, either express or implied. See the License for the
+specific language governing permissions and limitations under the License.
+*/
+
+/* Descriptors for USB_MSC=1 builds: a composite device with the CDC console
+and a mass storage interface. (The SDK supplies its own, CDC only, unless the
+application links tinyusb_device.) */
+
+#include <string.h>
+//
+#include "pico/unique_id.h"
+#include "tusb.h"
+
+/* The IDs are TinyUSB's, for development: a product ID per combination of
+classes, so that hosts don't apply what they remember of another one. */
+#define USB_VID 0xCafe
+#define USB_PID (0x4000 | (CFG_TUD_CDC << 0) | (CFG_TUD_MSC << 1))
+
+static const tusb_desc_device_t desc_device = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0200,
+    // For the CDC's interface association
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USB_VID,
+    .idProduct = USB_PID,
+    .bcdDevice = 0x0100,
+    .iManufacturer = 1,
+    .iProduct = 2,
+    .iSerialNumber = 3,
+    .bNumConfigurations = 1};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&desc_device;
+}
+
+enum { ITF_NUM_CDC, ITF_NUM_CDC_DATA, ITF_NUM_MSC, ITF_NUM_TOTAL };
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_OUT 0x02
+#define EPNUM_CDC_IN 0x82
+#define EPNUM_MSC_OUT 0x03
+#define EPNUM_MSC_IN 0x83
+
+#define CONFIG_TOTAL_LEN \
+    (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_MSC_DESC_LEN)
+
+static const uint8_t desc_configuration[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 250),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT,
+                       EPNUM_CDC_IN, 64),
+    TUD_MSC_DESCRIPTOR(ITF_NUM_MSC, 5, EPNUM_MSC_OUT, EPNUM_MSC_IN, 64)};
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
+    (void)index;
+    return desc_configuration;
+}
+
+static const char *const strings[] = {
+    NULL,             // 0: Languages, below
+    "Raspberry Pi",   // 1: Manufacturer
+    "Pico SD card",   // 2: Product
+    NULL,             // 3: Serial number, the flash's unique ID
+    "Pico Console",   // 4: CDC interface
+    "Pico SD card"};  // 5: MSC interface
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    (void)langid;
+    static uint16_t desc[1 + 32];
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    size_t len;
+
+    if (0 == index) {
+        desc[1] = 0x0409;  // English (US)
+        len = 1;
+    } else {
+        if (index >= count_of(strings)) return NULL;
+        const char *str = strings[index];
+        if (3 == index) {
+            pico_get_unique_board_id_string(serial, sizeof serial);
+            str = serial;
+        }
+        len = strlen(str);
+        if (len > count_of(desc) - 1) len = count_of(desc) - 1;
+        for (size_t i = 0; i < len; ++i) desc[1 + i] = (uint8_t)str[i];
+    }
+    desc[0] = (uint16_t)(TUSB_DESC_STRING << 8 | (2 * len + 2));
+    return desc;
+}
+
+/* [] END OF FILE */